@@ -0,0 +1,36 @@
+# Link time check of the static allocation profile. Fails if an object of the SDK in ARCHIVE references a function
+# that allocates from the heap or creates a FreeRTOS object dynamically. cJSON and iotc-c-lib objects are not checked.
+#
+#   cmake -DNM=<nm> -DARCHIVE=<library> -DSOURCES=<source names without .c, separated by commas> -P iotc_check_no_heap.cmake
+
+set(forbidden
+    malloc calloc realloc free strdup strndup
+    pvPortMalloc vPortFree
+    xTaskCreate xQueueGenericCreate xQueueCreateMutex xQueueCreateCountingSemaphore xTimerCreate xEventGroupCreate)
+
+string(REPLACE "," ";" sources "${SOURCES}")
+
+execute_process(COMMAND ${NM} -A -u ${ARCHIVE} OUTPUT_VARIABLE nm_output RESULT_VARIABLE nm_result)
+if(NOT nm_result EQUAL 0)
+    message(FATAL_ERROR "Unable to list the symbols of ${ARCHIVE}")
+endif()
+
+string(REGEX MATCHALL "[^\n]+" lines "${nm_output}")
+set(errors "")
+foreach(line ${lines})
+    # "library.a:object.c.o:         U symbol", or ".obj" objects
+    if(line MATCHES "([^:/\\\\]+)\\.c\\.o(bj)?: *U +_?([A-Za-z0-9_]+)$")
+        set(source ${CMAKE_MATCH_1})
+        set(symbol ${CMAKE_MATCH_3})
+        list(FIND sources ${source} is_sdk)
+        list(FIND forbidden ${symbol} is_forbidden)
+        if(is_sdk GREATER -1 AND is_forbidden GREATER -1)
+            set(errors "${errors}\n  ${source}.c references ${symbol}")
+        endif()
+    endif()
+endforeach()
+
+if(errors)
+    message(FATAL_ERROR "The static allocation profile must not use the heap:${errors}")
+endif()
+message(STATUS "No heap use in ${ARCHIVE}")
@@ -0,0 +1,73 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_TLS_STATS_H
+#define IOTC_TLS_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Connections for which TLS handshakes are counted and timed
+typedef enum {
+    IOTC_TLS_MQTT,  // MQTT broker. Timing includes the MQTT CONNECT exchange.
+    IOTC_TLS_HTTPS, // discovery, sync and other HTTPS hosts
+    IOTC_TLS_TARGET_COUNT
+} IotcTlsTarget;
+
+typedef struct {
+    unsigned long handshakes; // successful connections, each with a handshake
+    unsigned long resumed; // handshakes that resumed an earlier TLS session. Included in handshakes.
+    unsigned long failures; // connection attempts that failed
+    unsigned long reused; // requests sent over an already established connection, without a handshake
+    uint32_t last_ms; // duration of the last successful connection setup (DNS, TCP and TLS)
+    uint32_t max_ms;
+    uint32_t total_ms; // over all successful connections. Divide by handshakes for the average.
+    // CPU time of the connecting task for the last successful connection setup, mostly spent in the handshake.
+    // 0 if the platform cannot tell. See iotc_platform_cpu_us().
+    uint32_t last_cpu_us;
+    uint64_t total_cpu_us;
+} IotcTlsStats;
+
+// Cost of parsing the trust anchors of iotconnect_trust.h. Ports that parse them on each connection instead,
+// such as Secure Sockets, do not record this, and the parsing is part of the handshake CPU time.
+typedef struct {
+    unsigned long anchors; // certificates parsed
+    uint32_t parse_cpu_us;
+    size_t parse_heap; // heap held by the parsed certificates, in bytes. 0 if the platform cannot tell.
+} IotcTrustStoreStats;
+
+// Start of a connection attempt
+typedef struct {
+    uint32_t ms;
+    uint32_t cpu_us;
+} IotcTlsTimer;
+
+void iotc_tls_stats_start(IotcTlsTimer *timer);
+
+// Records a connection attempt that started with iotc_tls_stats_start()
+void iotc_tls_stats_record(IotcTlsTarget target, bool success, const IotcTlsTimer *start);
+
+void iotc_tls_stats_record_reuse(IotcTlsTarget target);
+
+// Call after a successful iotc_tls_stats_record() if the handshake resumed a session.
+// Ports whose TLS stack cannot resume sessions never call this.
+void iotc_tls_stats_record_resumed(IotcTlsTarget target);
+
+uint32_t iotc_tls_stats_now_ms(void);
+
+void iotc_tls_stats_get(IotcTlsTarget target, IotcTlsStats *stats);
+
+void iotc_tls_stats_record_trust_store(unsigned long anchors, uint32_t parse_cpu_us, size_t parse_heap);
+
+void iotc_tls_stats_get_trust_store(IotcTrustStoreStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTC_TLS_STATS_H
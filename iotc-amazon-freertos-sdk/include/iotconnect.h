@@ -6,16 +6,31 @@
 #ifndef IOTCONNECT_H
 #define IOTCONNECT_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include "iotconnect_event.h"
 #include "iotconnect_telemetry.h"
 #include "iotconnect_lib.h"
+#include "iotconnect_spool.h"
+#include "iotconnect_event_view.h"
+#include "iotconnect_telemetry_stream.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Maximum number of clients, each with its own device identity and MQTT connection, that can exist at the same time.
+// All client state, including the MQTT buffers and the QoS 1 window, is allocated statically per client,
+// so memory use grows linearly with this value. The iotconnect_sdk_* API uses one client.
+#ifndef IOTCONNECT_MAX_CLIENTS
+#define IOTCONNECT_MAX_CLIENTS 1
+#endif
+
+// A device session. See iotconnect_client_create().
+typedef struct IotConnectClient IotConnectClient;
+
 typedef enum {
     // Authentication based on your CPID. Sync HTTP endpoint returns a long lived SAS token
     // This auth type is only intended as a simple way to connect your test and development devices
@@ -41,6 +56,92 @@ typedef enum {
 
 typedef void (*IotConnectStatusCallback)(IotConnectConnectionStatus data);
 
+typedef void (*IotConnectClientStatusCallback)(IotConnectClient *client, IotConnectConnectionStatus status);
+
+// Receives an inbound event parsed in place, without copies or heap allocations. See iotconnect_event_view.h.
+typedef void (*IotConnectEventViewCallback)(IotConnectClient *client, const IotcEventView *event);
+
+// Reports the outcome of a message sent in async mode. status is 0 if the message was published successfully.
+typedef void (*IotConnectPublishCallback)(uint32_t message_id, int status);
+
+// Same as IotConnectPublishCallback, for messages sent without async mode. Also receives the client.
+typedef void (*IotConnectClientPublishCallback)(IotConnectClient *client, uint32_t message_id, int status);
+
+typedef struct {
+    // If enabled, iotconnect_sdk_send_packet*() only queue the message and return immediately.
+    // An SDK-owned I/O task sends queued messages and runs the MQTT process loop, so inbound message
+    // callbacks are invoked from that task and iotconnect_sdk_loop() only needs to be called for reconnect.
+    bool enabled;
+    IotConnectPublishCallback publish_cb; // optional. Called from the I/O task once a queued message is acknowledged (QoS 1) or sent (QoS 0), or has failed.
+} IotConnectAsyncConfig;
+
+typedef struct {
+    size_t depth; // messages currently queued
+    size_t capacity; // maximum number of queued messages
+    size_t high_water; // maximum depth seen
+    unsigned long enqueued;
+    unsigned long sent;
+    unsigned long failed; // dequeued, but could not be published
+    unsigned long dropped; // rejected because the queue was full or the message was too large
+} IotConnectAsyncStats;
+
+typedef struct {
+    // If enabled, iotconnect_sdk_loop() restores a lost connection. Attempts are spaced with exponential backoff and
+    // full jitter, and use the broker credentials from the last sync. Discovery and sync run again only after
+    // IOTCONNECT_RECONNECT_RESYNC_ATTEMPTS failed attempts, or when the server requested a sync.
+    // The loop does not block between attempts. In async mode, iotconnect_sdk_loop() still needs to be called for this.
+    // A disconnect by the application, or requested by the server, is not followed by a reconnect.
+    bool enabled;
+    unsigned int base_ms; // upper limit of the first delay. 0 means IOTCONNECT_RECONNECT_BASE_MS.
+    unsigned int max_ms; // upper limit of any delay. 0 means IOTCONNECT_RECONNECT_MAX_MS.
+    // Ask the broker to keep the MQTT session, so that reconnects need no new subscription,
+    // and messages awaiting PUBACK are completed within the same session.
+    bool persistent_session;
+} IotConnectReconnectConfig;
+
+typedef struct {
+    size_t max_bytes; // Flush when the next data point would not fit. 0 means IOTCONNECT_BATCH_MAX_BYTES.
+    // Flush when the oldest data point is this old, once connected. 0 means no age limit.
+    unsigned int max_age_ms;
+} IotConnectBatchConfig;
+
+typedef enum {
+    IOTC_FT_NUMBER,
+    IOTC_FT_STRING,
+    IOTC_FT_BOOL,
+    IOTC_FT_NULL
+} IotConnectFieldType;
+
+// A single name/value pair of a telemetry data point
+typedef struct {
+    const char *name;
+    IotConnectFieldType type;
+    union {
+        double number;
+        const char *string;
+        bool boolean;
+    } value;
+} IotConnectTelemetryField;
+
+typedef struct {
+    unsigned long packets; // number of packets flushed
+    unsigned long points; // number of data points sent in those packets
+    unsigned long last_points_per_packet;
+    unsigned long max_points_per_packet;
+    unsigned long size_flushes; // flushed because the byte budget was hit
+    unsigned long age_flushes; // flushed because max_age_ms was hit
+    unsigned long explicit_flushes; // flushed by iotconnect_sdk_batch_flush()
+    unsigned long failed_packets; // packets that could not be sent
+    unsigned long rejected_points; // points that would never fit into max_bytes
+} IotConnectBatchStats;
+
+typedef struct {
+    bool sync_from_cache; // discovery and sync were skipped because cached values were used
+    unsigned long sync_ms; // from the start of iotconnect_sdk_init() until the discovery and sync response was available
+    unsigned long connect_ms; // from the start of iotconnect_sdk_init() until the MQTT connection was established
+    unsigned long first_publish_ms; // from the start of iotconnect_sdk_init() until the first message was sent. 0 if none yet.
+} IotConnectStartupStats;
+
 typedef struct {
     IotConnectAuthType type;
     char* trust_store; // Path to a file containing the trust certificates for the remote MQTT host
@@ -55,15 +156,48 @@ typedef struct {
 } IotConnectAuthInfo;
 
 typedef struct {
+    // These strings are not copied, and must remain valid while the client is in use
     char *env;    // Settings -> Key Vault -> CPID.
     char *cpid;   // Settings -> Key Vault -> Evnironment.
     char *duid;   // Name of the device.
-    int qos; // QOS for outbound messages. Default 1.
+    int qos; // QOS for outbound messages (0 or 1). Default 1. With QoS 1, several messages can await PUBACK at once.
     IotConnectAuthInfo auth_info;
+    // ota_cb, cmd_cb and msg_cb go through the IoTConnect library, which has a single global configuration.
+    // They are only supported with the iotconnect_sdk_* API. Clients from iotconnect_client_create() use the view callbacks.
+    // The library copies and parses each event on the heap, so they are rejected with IOTC_STATIC_ALLOCATION.
     IotclOtaCallback ota_cb; // callback for OTA events.
     IotclCommandCallback cmd_cb; // callback for command events.
     IotclMessageCallback msg_cb; // callback for ALL messages, including the specific ones like cmd or ota callback.
     IotConnectStatusCallback status_cb; // callback for connection status
+    IotConnectClientStatusCallback client_status_cb; // same as status_cb, but also receives the client
+    // Optional. Called once a message sent with a message_id by iotconnect_client_send_packet_async() is acknowledged (QoS 1)
+    // or sent (QoS 0), from the send call or from iotconnect_client_loop(). Not used in async mode, which reports to async.publish_cb.
+    IotConnectClientPublishCallback client_publish_cb;
+    // Zero-copy alternatives to cmd_cb and ota_cb. If set, they are used instead of cmd_cb and ota_cb.
+    // Unless msg_cb (or cmd_cb/ota_cb without their view counterpart) is set, inbound events are
+    // never copied or parsed into a cJSON tree by the IoTConnect library.
+    IotConnectEventViewCallback cmd_view_cb;
+    IotConnectEventViewCallback ota_view_cb;
+    IotConnectBatchConfig batch; // limits for iotconnect_sdk_batch_add()
+    IotConnectAsyncConfig async; // asynchronous sending
+    IotConnectReconnectConfig reconnect; // enabled by iotconnect_sdk_init_and_get_config()
+    // Optional. If set, outbound messages that cannot be sent while disconnected are stored here
+    // and replayed oldest-first once connected. See iotconnect_spool.h.
+    const IotcStorage *spool_storage;
+    // Optional. If set, the discovery and sync response is kept here, and later startups connect with it right away
+    // instead of making two HTTPS requests. Discovery and sync run again if the broker refuses the cached values,
+    // when the cached values expire, or when the server requests a new sync. See iotconnect_sync.h.
+    const IotcStorage *sync_cache_storage;
+    // If not 0, iotconnect_client_loop() sends a snapshot of the SDK metrics as telemetry this often, while connected.
+    // The message is written into the TX buffer. See iotconnect_metrics.h.
+    unsigned int metrics_interval_ms;
+    // Wire format of the batch packets, and of the streams started with iotconnect_client_telemetry_begin().
+    // With IOTC_TELEMETRY_CBOR, the sync also requests the attributes of the device template, and attribute names
+    // are sent as their index in it. Metrics and acks are always sent as JSON.
+    IotcTelemetryFormat telemetry_format;
+    // Only one client at a time can enable async mode, as there is a single I/O task.
+    // Each client needs its own spool_storage and sync_cache_storage, if used.
+    void *user_data; // for the application. See iotconnect_client_get_user_data().
 } IotConnectClientConfig;
 
 
@@ -80,14 +214,115 @@ IotclConfig *iotconnect_sdk_get_lib_config();
 // Run the MQTT loop. 
 // This should be done periodically so that inbound events can be detect and pings processed.
 // The function will block up to timeout_ms and issue callbacks for connection events or inbound messages if there are any.
+// In async mode, the I/O task runs the MQTT loop, and this function only services batching and waits for timeout_ms.
 void iotconnect_sdk_loop(unsigned int timeout_ms);
 
 // blocks until sent and returns 0 if successful.
 // data is a null-terminated string
+// In async mode, the message is queued and 0 is returned if it was queued successfully.
 int iotconnect_sdk_send_packet(const char *data);
 
+// Queues the message for the I/O task when config.async.enabled is set and returns immediately.
+// message_id (optional) receives the ID passed to config.async.publish_cb.
+// Returns 0 if the message was queued, or -1 if the queue is full or the message is too large.
+// If async mode is not enabled, this sends the message synchronously, and message_id receives the ID passed to config.client_publish_cb.
+int iotconnect_sdk_send_packet_async(const char *data, size_t len, uint32_t *message_id);
+
+void iotconnect_sdk_get_async_stats(IotConnectAsyncStats *stats);
+
+// Returns the number of messages waiting in the offline spool, and fills stats if not NULL
+size_t iotconnect_sdk_get_spool_stats(IotcSpoolStats *stats);
+
+// Same as iotconnect_sdk_send_packet, but with a known length. data does not need to be null-terminated.
+int iotconnect_sdk_send_packet_len(const char *data, size_t len);
+
+// Sends the acknowledgement for an event received by cmd_view_cb or ota_view_cb. To be called from the callback.
+// The ack is written into a separate SDK buffer, so the TX buffer contents are not affected.
+// message is copied into the ack before anything is sent, so it may point into the event.
+// Returns 0 on success, or -1 if the event has no ack ID or the ack could not be sent.
+int iotconnect_sdk_send_ack(const IotcEventView *event, bool success, const char *message);
+
+// Returns the SDK-owned buffer that outbound messages can be serialized into (see iotconnect_telemetry_stream.h)
+// and its size in *size. The MQTT client sends the payload directly from this buffer, so passing
+// the serialized data to iotconnect_sdk_send_packet_len() involves no further copies or heap allocations.
+// The buffer contents are only valid until the next call that uses it.
+char *iotconnect_sdk_get_tx_buffer(size_t *size);
+
+// Appends a data point to the current batch. Data points are accumulated into a single telemetry packet
+// which is sent when the next point would exceed config.batch.max_bytes, when the oldest point is older than
+// config.batch.max_age_ms (checked here and in iotconnect_sdk_loop()) or when iotconnect_sdk_batch_flush() is called.
+// If iso_time is NULL, the current time is used. Field names and string values are copied, so they need not persist.
+// Returns 0 on success.
+int iotconnect_sdk_batch_add(const char *iso_time, const IotConnectTelemetryField *fields, size_t count);
+
+// Sends any accumulated data points right away. Returns 0 if successful or if there was nothing to send.
+int iotconnect_sdk_batch_flush(void);
+
+void iotconnect_sdk_get_batch_stats(IotConnectBatchStats *stats);
+
+// Starts a telemetry message in buf, in config.telemetry_format, with the attribute dictionary of the sync response.
+// Returns false if the SDK is not connected, or buf is too small.
+bool iotconnect_sdk_telemetry_begin(IotcTelemetryStream *s, char *buf, size_t size);
+
+// Reports how long the last iotconnect_sdk_init() took to connect and send the first message
+void iotconnect_sdk_get_startup_stats(IotConnectStartupStats *stats);
+
 void iotconnect_sdk_disconnect();
 
+// Returns the client used by the iotconnect_sdk_* functions, or NULL before the first iotconnect_sdk_init()
+IotConnectClient *iotconnect_sdk_get_client(void);
+
+// Multiple client API, so that one process (a gateway, for example) can drive several device identities.
+// Each client runs its own discovery and sync, and has its own MQTT connection, buffers, batch and spool.
+// The functions below behave like their iotconnect_sdk_* counterparts, for the given client.
+// A client can be used from several tasks, but clients should be created and destroyed from one task at a time.
+// Only the HTTPS buffer used by discovery and sync is shared. Requests are serialized, as they only run while connecting.
+
+// Takes a client from the pool of IOTCONNECT_MAX_CLIENTS and copies config. Does not connect.
+// Returns NULL if the configuration is invalid or no client is free.
+IotConnectClient *iotconnect_client_create(const IotConnectClientConfig *config);
+
+// Disconnects if needed and returns the client to the pool
+void iotconnect_client_destroy(IotConnectClient *client);
+
+// Runs discovery and sync (or uses the cached response) and connects
+int iotconnect_client_connect(IotConnectClient *client);
+
+void iotconnect_client_disconnect(IotConnectClient *client);
+
+bool iotconnect_client_is_connected(IotConnectClient *client);
+
+void iotconnect_client_loop(IotConnectClient *client, unsigned int timeout_ms);
+
+int iotconnect_client_send_packet(IotConnectClient *client, const char *data);
+
+int iotconnect_client_send_packet_len(IotConnectClient *client, const char *data, size_t len);
+
+int iotconnect_client_send_packet_async(IotConnectClient *client, const char *data, size_t len, uint32_t *message_id);
+
+int iotconnect_client_send_ack(IotConnectClient *client, const IotcEventView *event, bool success, const char *message);
+
+char *iotconnect_client_get_tx_buffer(IotConnectClient *client, size_t *size);
+
+// The device identity and dtg of the client, for iotconnect_telemetry_stream.h and iotconnect_event_view.h.
+// Valid once connected. Unlike iotconnect_sdk_get_lib_config(), this cannot be used with the cJSON based telemetry
+// functions of the IoTConnect library.
+IotclConfig *iotconnect_client_get_lib_config(IotConnectClient *client);
+
+int iotconnect_client_batch_add(IotConnectClient *client, const char *iso_time, const IotConnectTelemetryField *fields, size_t count);
+
+int iotconnect_client_batch_flush(IotConnectClient *client);
+
+void iotconnect_client_get_batch_stats(IotConnectClient *client, IotConnectBatchStats *stats);
+
+bool iotconnect_client_telemetry_begin(IotConnectClient *client, IotcTelemetryStream *s, char *buf, size_t size);
+
+size_t iotconnect_client_get_spool_stats(IotConnectClient *client, IotcSpoolStats *stats);
+
+void iotconnect_client_get_startup_stats(IotConnectClient *client, IotConnectStartupStats *stats);
+
+void *iotconnect_client_get_user_data(IotConnectClient *client);
+
 #ifdef __cplusplus
 }
 #endif
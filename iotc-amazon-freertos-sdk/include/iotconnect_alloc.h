@@ -0,0 +1,96 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_ALLOC_H
+#define IOTCONNECT_ALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// The allocator behind the heap use of the SDK. By default, this is the heap of the OS: pvPortMalloc() on FreeRTOS,
+// and cJSON keeps using malloc() and free().
+//
+// With IOTC_POOL_ALLOCATOR set to 1, the default is a set of fixed-size block pools instead, one per size class of
+// IOTC_POOL_CLASSES, which allocate and free in constant time and cannot fragment. Requests that do not fit a class,
+// or whose class is exhausted, go to the heap of the OS, unless IOTC_STATIC_ALLOCATION is set.
+// With the pools, in the static allocation profile, or once an allocator is set with iotc_alloc_set_allocator(),
+// the SDK also points cJSON to iotc_malloc() and iotc_free() with cJSON_InitHooks(). The cJSON trees of the IoTConnect
+// library, like telemetry messages, parsed events and serialized strings, are then allocated here, and strings
+// serialized by the library must be released with iotcl_destroy_serialized() rather than free().
+// Strings that the library duplicates without cJSON, like the results of iotcl_clone_command(), always come from
+// malloc() and are released with free().
+
+#ifndef IOTC_POOL_ALLOCATOR
+#define IOTC_POOL_ALLOCATOR 0
+#endif
+
+// X(block_size, block_count) for each class, smallest first. Block sizes must be multiples of 8.
+// The defaults fit telemetry messages of a few dozen values made with the cJSON based IoTConnect library:
+// 32 - member names and short string values
+// 64 - cJSON items (36 bytes on 32-bit targets, 64 on 64-bit hosts), ISO timestamps and the dtg
+// 128 - longer strings, like command texts and download URLs
+// 256, 512, 1024 - serialized messages, which cJSON prints into a 256 byte buffer, doubled as needed
+#ifndef IOTC_POOL_CLASSES
+#define IOTC_POOL_CLASSES(X) \
+    X(32, 48) \
+    X(64, 48) \
+    X(128, 8) \
+    X(256, 4) \
+    X(512, 4) \
+    X(1024, 2)
+#endif
+
+#define IOTC_POOL_COUNT_CLASS(block_size, block_count) +1
+#define IOTC_POOL_CLASS_COUNT (0 IOTC_POOL_CLASSES(IOTC_POOL_COUNT_CLASS))
+
+typedef struct {
+    void *(*malloc_fn)(size_t size);
+    void (*free_fn)(void *ptr); // must accept NULL
+} IotcAllocator;
+
+typedef struct {
+    size_t block_size;
+    size_t blocks;
+    size_t in_use;
+    size_t peak; // most blocks in use at once
+    unsigned long exhausted; // requests of this size that found no free block
+} IotcPoolClassStats;
+
+typedef struct {
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long failures; // allocations that returned NULL
+    unsigned long live; // blocks allocated and not yet freed
+    unsigned long peak_live;
+    unsigned long heap_fallbacks; // pool allocations that were passed on to the heap of the OS
+    IotcPoolClassStats classes[IOTC_POOL_CLASS_COUNT]; // all zero unless the pools are in use
+} IotcAllocStats;
+
+// Replaces the allocator, and installs the cJSON hooks. NULL restores the default, and the cJSON defaults unless
+// the pools are in use. Must be called before the SDK, cJSON or the IoTConnect library allocate anything,
+// as blocks are always returned to the current allocator.
+void iotc_alloc_set_allocator(const IotcAllocator *allocator);
+
+// The pool allocator, to pass to iotc_alloc_set_allocator(). NULL unless IOTC_POOL_ALLOCATOR is set.
+const IotcAllocator *iotc_alloc_pool_allocator(void);
+
+// Installs the cJSON hooks if they are needed (see above). Called by the SDK when a client is created.
+// Applications that use cJSON before that should call it first.
+void iotc_alloc_init(void);
+
+void *iotc_malloc(size_t size);
+
+void iotc_free(void *ptr);
+
+void iotc_alloc_get_stats(IotcAllocStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_ALLOC_H
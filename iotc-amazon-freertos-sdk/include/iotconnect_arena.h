@@ -0,0 +1,79 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_ARENA_H
+#define IOTCONNECT_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// A single static work area that lends the network buffers: to the HTTPS client for discovery and sync at boot,
+// and to the MQTT clients once connected. MQTT buffers are only needed while connected, and the HTTPS buffer only
+// while a request and its response are in use, so the same memory serves both phases.
+// An MQTT buffer gets up to IOTC_DEVICE_CLIENT_BUFFER_MAX_SIZE bytes if that leaves IOTC_ARENA_RESERVE bytes free
+// for HTTPS requests made while connected, such as OTA downloads, and at least IOTC_DEVICE_CLIENT_BUFFER_SIZE.
+
+// The default is what the 4 KB HTTPS buffer, with its NUL byte, and the 1 KB MQTT buffer of each client took
+// before they shared the arena
+#ifndef IOTC_ARENA_SIZE
+#define IOTC_ARENA_SIZE (4096 + 8 + IOTCONNECT_MAX_CLIENTS * 1024)
+#endif
+
+// Bytes that MQTT buffers leave free when they take more than their minimum size. The default leaves room for
+// a 2 KB HTTPS buffer and the 1 KB minimum of each other client.
+#ifndef IOTC_ARENA_RESERVE
+#define IOTC_ARENA_RESERVE (2048 + (IOTCONNECT_MAX_CLIENTS - 1) * 1024)
+#endif
+
+// The HTTPS buffer and one MQTT buffer for each client
+#ifndef IOTC_ARENA_MAX_LEASES
+#define IOTC_ARENA_MAX_LEASES (IOTCONNECT_MAX_CLIENTS + 1)
+#endif
+
+typedef enum {
+    IOTC_ARENA_HTTPS,
+    IOTC_ARENA_MQTT,
+    IOTC_ARENA_USER_COUNT
+} IotcArenaUser;
+
+typedef enum {
+    IOTC_ARENA_PROVISIONING, // no MQTT client is connected: discovery and sync
+    IOTC_ARENA_CONNECTED, // at least one MQTT client holds a buffer
+    IOTC_ARENA_PHASE_COUNT
+} IotcArenaPhase;
+
+typedef struct {
+    size_t size; // IOTC_ARENA_SIZE
+    size_t in_use; // bytes lent now
+    IotcArenaPhase phase;
+    size_t peak[IOTC_ARENA_PHASE_COUNT]; // most bytes lent at once in each phase
+    size_t user_peak[IOTC_ARENA_PHASE_COUNT][IOTC_ARENA_USER_COUNT]; // most bytes lent at once to each user
+    uint32_t failures; // requests that did not get their minimum size
+} IotcArenaStats;
+
+// Lends a block of at least min_size and up to max_size bytes to owner, which is any address that identifies
+// the borrower, until iotc_arena_release(owner). size receives the size of the block.
+// If owner already holds a block, that block is returned. Returns NULL if there is not enough free space.
+void *iotc_arena_acquire(IotcArenaUser user, const void *owner, size_t min_size, size_t max_size, size_t *size);
+
+// Does nothing if owner holds no block
+void iotc_arena_release(const void *owner);
+
+void iotc_arena_get_stats(IotcArenaStats *stats);
+
+// Forgets the peaks, for example to measure the connected phase of a long running device separately
+void iotc_arena_reset_peaks(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_ARENA_H
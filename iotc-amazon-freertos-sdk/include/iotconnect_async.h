@@ -0,0 +1,83 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_ASYNC_H
+#define IOTCONNECT_ASYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iotconnect.h"
+#include "iotc_device_client.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Outbound queue used by the SDK when IotConnectClientConfig.async.enabled is set.
+// Messages are copied into one of IOTCONNECT_ASYNC_QUEUE_DEPTH preallocated slots and sent by a single I/O task
+// which exclusively owns the MQTT connection and also runs the MQTT process loop.
+// There is a single queue and I/O task, so only one client at a time can use async mode.
+// These functions are called by iotconnect.c. Applications should use the iotconnect_sdk_* API.
+
+struct IotcDeviceClient;
+
+// Maximum number of queued outbound messages
+#ifndef IOTCONNECT_ASYNC_QUEUE_DEPTH
+#define IOTCONNECT_ASYNC_QUEUE_DEPTH 8
+#endif
+
+// Maximum size of a single queued message
+#ifndef IOTCONNECT_ASYNC_MAX_MESSAGE_SIZE
+#define IOTCONNECT_ASYNC_MAX_MESSAGE_SIZE 768
+#endif
+
+// In bytes
+#ifndef IOTCONNECT_ASYNC_TASK_STACK_SIZE
+#define IOTCONNECT_ASYNC_TASK_STACK_SIZE 4096
+#endif
+
+// Relative to the idle priority
+#ifndef IOTCONNECT_ASYNC_TASK_PRIORITY
+#define IOTCONNECT_ASYNC_TASK_PRIORITY 2
+#endif
+
+// While the device client is disconnected, how long the I/O task sleeps before checking the connection again.
+// Queued messages are kept until it reconnects. While connected, the task blocks in iotc_device_client_loop()
+// and enqueuing wakes it up.
+#ifndef IOTCONNECT_ASYNC_POLL_MS
+#define IOTCONNECT_ASYNC_POLL_MS 100
+#endif
+
+// Starts the I/O task for the device client. The MQTT connection must be established already.
+// complete_cb receives the messages that failed to publish. It should also be the publish_complete_cb
+// of the device client, which reports the others.
+// Returns -1 if the task is already running for a different client.
+int iotc_async_start(struct IotcDeviceClient *client, IotConnectPublishCompleteCallback complete_cb, void *cb_ctx);
+
+// Stops the I/O task and waits for it to exit. The task sends already queued messages before exiting if still connected.
+// Otherwise, messages are kept in the queue for the next iotc_async_start().
+// Can be called from the I/O task itself (from an inbound message callback), in which case it does not wait.
+void iotc_async_stop(void);
+
+bool iotc_async_is_running(void);
+
+// Returns true if the I/O task is running for the device client
+bool iotc_async_is_running_for(const struct IotcDeviceClient *client);
+
+// Returns true if the calling task is the I/O task
+bool iotc_async_is_io_task(void);
+
+// Copies the message into a free slot. Returns 0 on success or -1 if the queue is full or the message is too large.
+// If message_id is not NULL, it receives the ID that will be passed to the publish complete callback.
+// It is set before the message can be sent.
+int iotc_async_enqueue(const char *data, size_t len, uint32_t *message_id);
+
+void iotc_async_get_stats(IotConnectAsyncStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_ASYNC_H
@@ -0,0 +1,91 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_CBOR_H
+#define IOTCONNECT_CBOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_telemetry_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The part of CBOR (RFC 8949) that the binary telemetry format uses: integers, floats, text and byte strings,
+// true, false, null, and maps and arrays of indefinite length, so that they can be streamed.
+// The writer appends to an IotcJsonWriter, used as a plain byte buffer, with the same overflow handling.
+
+#define IOTC_CBOR_BREAK 0xFF
+
+void iotc_cbor_write_uint(IotcJsonWriter *w, uint64_t value);
+
+void iotc_cbor_write_int(IotcJsonWriter *w, int64_t value);
+
+// Integral values up to 2^53 are written as integers, others as 32-bit floats if that is exact, and as 64-bit floats
+// otherwise. NaN and infinity are written as null, as JSON has no such numbers.
+void iotc_cbor_write_number(IotcJsonWriter *w, double value);
+
+void iotc_cbor_write_text(IotcJsonWriter *w, const char *s, size_t len);
+
+void iotc_cbor_write_bytes(IotcJsonWriter *w, const uint8_t *data, size_t len);
+
+void iotc_cbor_write_bool(IotcJsonWriter *w, bool value);
+
+void iotc_cbor_write_null(IotcJsonWriter *w);
+
+// Starts a map or an array of indefinite length, which iotc_cbor_write_break() ends
+void iotc_cbor_begin_map(IotcJsonWriter *w);
+
+void iotc_cbor_begin_array(IotcJsonWriter *w);
+
+void iotc_cbor_write_break(IotcJsonWriter *w);
+
+
+// Reader for the same subset, for the ingest side and the tools. Strings point into the input.
+typedef enum {
+    IOTC_CBOR_INVALID, // malformed, or not in the subset
+    IOTC_CBOR_UINT,
+    IOTC_CBOR_NEGATIVE, // the value is -1 - value
+    IOTC_CBOR_BYTES,
+    IOTC_CBOR_TEXT,
+    IOTC_CBOR_ARRAY,
+    IOTC_CBOR_MAP,
+    IOTC_CBOR_FLOAT,
+    IOTC_CBOR_FALSE,
+    IOTC_CBOR_TRUE,
+    IOTC_CBOR_NULL,
+    IOTC_CBOR_END // the break that ends an indefinite map or array
+} IotcCborType;
+
+typedef struct {
+    IotcCborType type;
+    uint64_t value; // integers, the length of strings, and the number of entries of definite maps and arrays
+    bool indefinite; // maps and arrays
+    double number; // floats
+    const uint8_t *ptr; // strings
+} IotcCborItem;
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+} IotcCborReader;
+
+void iotc_cbor_reader_init(IotcCborReader *r, const uint8_t *data, size_t len);
+
+// Reads the next item. Maps and arrays are not skipped: their entries are the items that follow.
+// Returns false at the end of the input, or if the item is malformed.
+bool iotc_cbor_read(IotcCborReader *r, IotcCborItem *item);
+
+// Converts an integer or float item. Returns false for other items.
+bool iotc_cbor_to_double(const IotcCborItem *item, double *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_CBOR_H
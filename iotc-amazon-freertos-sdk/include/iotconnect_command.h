@@ -0,0 +1,100 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_COMMAND_H
+#define IOTCONNECT_COMMAND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iotconnect.h"
+#include "iotconnect_event_view.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Command registry. Handlers are registered by command name, which is the first word of the command string,
+// and run on a pool of worker tasks, so that slow commands do not hold up the MQTT loop.
+// Received commands are copied into one of IOTCONNECT_COMMAND_QUEUE_DEPTH slots. If all slots are taken,
+// the command is rejected right away with a failure ack.
+// Commands that are not registered go to cmd_view_cb or cmd_cb as before.
+// The registry is shared by all clients. Handlers receive the client that the command was sent to.
+
+#ifndef IOTCONNECT_COMMAND_MAX_COMMANDS
+#define IOTCONNECT_COMMAND_MAX_COMMANDS 8
+#endif
+
+// Number of hash table buckets. Must be a power of 2, and larger than IOTCONNECT_COMMAND_MAX_COMMANDS.
+#ifndef IOTCONNECT_COMMAND_TABLE_SIZE
+#define IOTCONNECT_COMMAND_TABLE_SIZE 16
+#endif
+
+#ifndef IOTCONNECT_COMMAND_WORKERS
+#define IOTCONNECT_COMMAND_WORKERS 1
+#endif
+
+// Maximum number of commands waiting for, or being executed by, a worker
+#ifndef IOTCONNECT_COMMAND_QUEUE_DEPTH
+#define IOTCONNECT_COMMAND_QUEUE_DEPTH 4
+#endif
+
+// Maximum length of a command string. Longer commands are rejected.
+#ifndef IOTCONNECT_COMMAND_MAX_LEN
+#define IOTCONNECT_COMMAND_MAX_LEN 128
+#endif
+
+#ifndef IOTCONNECT_COMMAND_ACK_ID_MAX_LEN
+#define IOTCONNECT_COMMAND_ACK_ID_MAX_LEN 64
+#endif
+
+#ifndef IOTCONNECT_COMMAND_ACK_BUFFER_SIZE
+#define IOTCONNECT_COMMAND_ACK_BUFFER_SIZE 384
+#endif
+
+// In bytes
+#ifndef IOTCONNECT_COMMAND_TASK_STACK_SIZE
+#define IOTCONNECT_COMMAND_TASK_STACK_SIZE 3072
+#endif
+
+// Relative to the idle priority
+#ifndef IOTCONNECT_COMMAND_TASK_PRIORITY
+#define IOTCONNECT_COMMAND_TASK_PRIORITY 1
+#endif
+
+// Runs on a worker task. args is the rest of the command string after the name (NUL-terminated, possibly empty).
+// Returns true on success. The handler can set *message to a string that stays valid after it returns,
+// which is sent in the ack.
+typedef bool (*IotConnectCommandHandler)(IotConnectClient *client, const char *args, void *ctx, const char **message);
+
+typedef struct {
+    const char *name;
+    unsigned long executed;
+    unsigned long failed; // the handler returned false
+    unsigned long rejected; // not executed because the queue was full or the command was too long
+    uint32_t last_ms; // from receiving the command until the handler returned
+    uint32_t max_ms;
+    uint32_t total_ms; // over all executions. Divide by executed for the average.
+    uint32_t max_queue_ms; // longest wait for a worker
+} IotConnectCommandStats;
+
+// Registers a handler. name must stay valid. Workers are started on the first registration.
+// Returns 0 on success, or -1 if the name is already registered or the registry is full.
+int iotconnect_command_register(const char *name, IotConnectCommandHandler handler, void *ctx);
+
+// Fills stats for the named command. Returns false if the command is not registered.
+bool iotconnect_command_get_stats(const char *name, IotConnectCommandStats *stats);
+
+// Called by iotconnect.c. Returns true if the command of the event is registered.
+bool iotc_command_is_registered(const IotcEventView *ev);
+
+// Called by iotconnect.c for received commands. Returns true if the command is registered,
+// in which case it has been queued for a worker or rejected.
+bool iotc_command_dispatch(IotConnectClient *client, const IotcEventView *ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_COMMAND_H
@@ -0,0 +1,87 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_DELTA_H
+#define IOTCONNECT_DELTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_sha256.h"
+#include "iotconnect_storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary patches that turn the running firmware image (the source) into a new one (the target).
+// Patches are made with the iotc-delta tool and applied as they are downloaded, in a single pass and with a fixed
+// amount of RAM, so the patch never needs to be stored. The target is written into a different storage than the
+// source, such as the inactive slot of an A/B layout.
+//
+// Format, with all numbers little endian:
+//   header: "IOTCDLT1", source size (u32), source SHA-256 (32 bytes), target size (u32), target SHA-256 (32 bytes)
+//   operations, until END:
+//     COPY:   0x01, source offset (u32), length (u32) - copies bytes of the source to the target
+//     INSERT: 0x02, length (u32), then the bytes   - appends new bytes to the target
+//     END:    0x00
+// The source is checked against its hash before anything is written, so a patch made for another version
+// fails without touching the target. The target is checked against its hash at the end.
+
+#define IOTC_DELTA_MAGIC "IOTCDLT1"
+#define IOTC_DELTA_MAGIC_LEN 8
+#define IOTC_DELTA_HEADER_SIZE (IOTC_DELTA_MAGIC_LEN + 4 + IOTC_SHA256_SIZE + 4 + IOTC_SHA256_SIZE)
+
+#define IOTC_DELTA_OP_END 0x00
+#define IOTC_DELTA_OP_COPY 0x01
+#define IOTC_DELTA_OP_INSERT 0x02
+
+// Size of the stack buffer used to copy from the source and to hash it
+#ifndef IOTC_DELTA_COPY_BUFFER_SIZE
+#define IOTC_DELTA_COPY_BUFFER_SIZE 256
+#endif
+
+typedef enum {
+    IOTC_DELTA_OK,
+    IOTC_DELTA_ERR_FORMAT, // not a valid patch
+    IOTC_DELTA_ERR_SOURCE, // the patch was made for a different source image
+    IOTC_DELTA_ERR_STORAGE, // reading the source or writing the target failed, or the target does not fit
+    IOTC_DELTA_ERR_VERIFY // the target does not match its hash
+} IotcDeltaResult;
+
+typedef struct {
+    const IotcStorage *source;
+    const IotcStorage *target;
+    uint8_t header[IOTC_DELTA_HEADER_SIZE];
+    uint8_t op_header[9];
+    size_t header_len; // bytes of header received
+    size_t op_header_len; // bytes of the current operation header received
+    uint8_t op;
+    uint32_t op_source; // next source offset of a COPY
+    uint32_t op_remaining; // bytes left in the current operation
+    uint32_t source_size;
+    uint32_t target_size;
+    uint32_t written; // target bytes written
+    IotcSha256 sha; // of the target
+    bool done; // END was received
+    IotcDeltaResult error;
+} IotcDeltaPatcher;
+
+// True if data, the start of a download, is a patch
+bool iotc_delta_is_patch(const void *data, size_t len);
+
+void iotc_delta_init(IotcDeltaPatcher *p, const IotcStorage *source, const IotcStorage *target);
+
+// Applies the next part of the patch. The target is written from offset 0, erasing each sector before writing into it.
+IotcDeltaResult iotc_delta_feed(IotcDeltaPatcher *p, const void *data, size_t len);
+
+// Checks that the patch was complete and the target matches its hash. The digest of the target goes into digest.
+IotcDeltaResult iotc_delta_finish(IotcDeltaPatcher *p, uint8_t digest[IOTC_SHA256_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_DELTA_H
@@ -0,0 +1,59 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_EVENT_VIEW_H
+#define IOTCONNECT_EVENT_VIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "iotconnect_event.h"
+#include "iotconnect_lib.h"
+#include "iotconnect_json_view.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A parsed inbound (cloud to device) event that references the received payload in place.
+// Only the event type, the ack ID and the ack flag are located when parsing. Everything else is looked up
+// on request with the iotc_event_view_get_* functions or with iotconnect_json_view.h on the data object.
+//
+// The view is only valid while the payload buffer is. Inside an event callback, that is until the callback
+// returns, or until a message is sent, as sending reuses the MQTT client's buffer which holds the payload.
+// Copy out what is needed (iotc_json_view_copy_string) before sending anything.
+typedef struct {
+    IotConnectEventType type;
+    IotcJsonToken data; // the "data" object of the event
+    IotcJsonToken ack_id; // IOTC_JSON_NONE if the event has no ack ID
+    bool needs_ack; // the event requests an acknowledgement
+} IotcEventView;
+
+// Returns 0 on success, or -1 if the payload is not a valid event
+int iotc_event_view_parse(IotcEventView *ev, const char *payload, size_t len);
+
+// The command string of a device command, or the command line of an OTA event
+bool iotc_event_view_get_command(const IotcEventView *ev, IotcJsonToken *command);
+
+// The download URL at index of an OTA event
+bool iotc_event_view_get_url(const IotcEventView *ev, size_t index, IotcJsonToken *url);
+
+// The software version of an OTA event
+bool iotc_event_view_get_sw_version(const IotcEventView *ev, IotcJsonToken *version);
+
+// Writes an acknowledgement for the event into buf, in the same format as iotcl_create_ack_string_and_destroy_event().
+// Returns the NUL-terminated ack and its length in out_len (if not NULL), or NULL if the event
+// has no ack ID or the ack does not fit.
+const char *iotc_event_view_write_ack(const IotcEventView *ev, const IotclConfig *config, bool success,
+                                      const char *message, char *buf, size_t size, size_t *out_len);
+
+// Same as iotc_event_view_write_ack(), for an ack ID that was copied out of the event.
+// ack_id is the raw (still escaped) ack ID as it appears in the event.
+const char *iotc_write_ack(IotConnectEventType type, const char *ack_id, size_t ack_id_len, const IotclConfig *config,
+                           bool success, const char *message, char *buf, size_t size, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_EVENT_VIEW_H
@@ -0,0 +1,63 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_JSON_VIEW_H
+#define IOTCONNECT_JSON_VIEW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Length-bounded, non-allocating JSON lookups over a buffer that does not need to be NUL-terminated.
+// Nothing is parsed up front. Each lookup scans the enclosing object or array and returns a token that
+// points into the original buffer, so tokens are only valid as long as the buffer is.
+// Malformed input makes lookups fail rather than read past the end of the buffer.
+
+typedef enum {
+    IOTC_JSON_NONE, // not found, or malformed
+    IOTC_JSON_OBJECT,
+    IOTC_JSON_ARRAY,
+    IOTC_JSON_STRING,
+    IOTC_JSON_NUMBER,
+    IOTC_JSON_TRUE,
+    IOTC_JSON_FALSE,
+    IOTC_JSON_NULL
+} IotcJsonType;
+
+typedef struct {
+    IotcJsonType type;
+    const char *ptr; // for strings, the raw (still escaped) characters between the quotes. Otherwise, the whole value.
+    size_t len;
+} IotcJsonToken;
+
+// Returns a token for the top level value in json. Fails if there is anything but whitespace after it.
+bool iotc_json_view_init(IotcJsonToken *root, const char *json, size_t len);
+
+// Looks up a member of an object. Keys are compared as raw bytes, without unescaping.
+bool iotc_json_view_get(const IotcJsonToken *object, const char *key, IotcJsonToken *out);
+
+// Looks up an array element by index
+bool iotc_json_view_get_index(const IotcJsonToken *array, size_t index, IotcJsonToken *out);
+
+// Returns true if the token is a string equal to str. The string is compared as raw bytes, without unescaping.
+bool iotc_json_view_equals(const IotcJsonToken *token, const char *str);
+
+// Returns true if the token is the true literal
+bool iotc_json_view_is_true(const IotcJsonToken *token);
+
+// Converts a number token that is an integer. Fails for fractions, exponents and values that do not fit.
+bool iotc_json_view_to_long(const IotcJsonToken *token, long *value);
+
+// Copies the unescaped string into buf and NUL-terminates it.
+// Returns the length of the copied string, or -1 if the token is not a string or does not fit.
+int iotc_json_view_copy_string(const IotcJsonToken *token, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_JSON_VIEW_H
@@ -0,0 +1,110 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_METRICS_H
+#define IOTCONNECT_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_lib.h"
+#include "iotc_platform.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Process-wide counters and duration histograms of the SDK hot paths. Updates are atomic adds on fixed-size
+// storage, so they can be made from any task without locks or heap allocations.
+// Values from all clients are added together. Counters wrap around at 2^32.
+
+// Power-of-two millisecond buckets: bucket 0 counts durations under 1 ms, bucket i from 2^(i-1) to 2^i - 1 ms.
+// The last bucket also counts everything longer.
+#ifndef IOTC_METRICS_HISTOGRAM_BUCKETS
+#define IOTC_METRICS_HISTOGRAM_BUCKETS 16
+#endif
+
+// Maximum number of tasks whose stack usage is reported
+#ifndef IOTC_METRICS_MAX_TASKS
+#define IOTC_METRICS_MAX_TASKS 8
+#endif
+
+typedef enum {
+    IOTC_METRIC_PUBLISH_ATTEMPTS,
+    IOTC_METRIC_PUBLISH_SUCCEEDED, // PUBACK received (QoS 1), or written to the network (QoS 0)
+    IOTC_METRIC_PUBLISH_FAILED,
+    IOTC_METRIC_BYTES_OUT, // payload bytes of successful publishes
+    IOTC_METRIC_BYTES_IN, // payload bytes of inbound messages
+    IOTC_METRIC_MESSAGES_IN,
+    IOTC_METRIC_CONNECTION_LOSSES, // connections that failed, as opposed to being closed by the application
+    IOTC_METRIC_RECONNECTS, // connections established again after a loss
+    IOTC_METRIC_COUNTER_COUNT
+} IotcMetricsCounter;
+
+typedef enum {
+    IOTC_METRIC_PUBLISH_LATENCY, // from the publish call until the message succeeded
+    IOTC_METRIC_PROCESS_LOOP, // duration of MQTT_ProcessLoop() calls
+    IOTC_METRIC_RECONNECT_TIME, // from a connection loss until connected again
+    IOTC_METRIC_DISCOVERY_TIME, // discovery HTTP requests
+    IOTC_METRIC_SYNC_TIME, // sync HTTP requests
+    IOTC_METRIC_HISTOGRAM_COUNT
+} IotcMetricsHistogramId;
+
+typedef struct {
+    uint32_t count;
+    uint32_t sum_ms;
+    uint32_t max_ms;
+    uint32_t buckets[IOTC_METRICS_HISTOGRAM_BUCKETS];
+} IotcMetricsHistogram;
+
+typedef struct {
+    char name[16];
+    size_t stack_free; // smallest amount of unused stack, in bytes, since the task started. 0 if unknown.
+} IotcMetricsTaskStack;
+
+typedef struct {
+    uint32_t counters[IOTC_METRIC_COUNTER_COUNT];
+    IotcMetricsHistogram histograms[IOTC_METRIC_HISTOGRAM_COUNT];
+    size_t heap_high_water; // most heap in use so far, in bytes. 0 if unknown. See iotc_platform_heap_high_water().
+    size_t task_count;
+    IotcMetricsTaskStack tasks[IOTC_METRICS_MAX_TASKS];
+} IotcMetricsSnapshot;
+
+void iotc_metrics_add(IotcMetricsCounter counter, uint32_t value);
+
+void iotc_metrics_record_ms(IotcMetricsHistogramId histogram, uint32_t duration_ms);
+
+// Records the time since start_ms, as returned by iotc_platform_now_ms()
+void iotc_metrics_record_since(IotcMetricsHistogramId histogram, uint32_t start_ms);
+
+// Adds a task to the stack usage report. The name is copied. The SDK registers its own tasks.
+// Returns -1 if IOTC_METRICS_MAX_TASKS tasks are registered.
+int iotc_metrics_register_task(const char *name, const IotcTask *task);
+
+// Must be called before the task ends
+void iotc_metrics_unregister_task(const IotcTask *task);
+
+// Copies all values. Values that change while the copy is made may be off by the last update.
+void iotc_metrics_snapshot(IotcMetricsSnapshot *snapshot);
+
+void iotc_metrics_reset(void);
+
+// The duration below which the given fraction (0..1) of the recorded durations fall, rounded up to the bucket limit
+uint32_t iotc_metrics_histogram_percentile(const IotcMetricsHistogram *histogram, double fraction);
+
+const char *iotc_metrics_counter_name(IotcMetricsCounter counter);
+
+const char *iotc_metrics_histogram_name(IotcMetricsHistogramId histogram);
+
+// Writes the snapshot as an IoTConnect telemetry message: all counters, the count, p99 and max of each histogram,
+// the heap high-water mark and the free stack of each task. Returns the message, or NULL if it does not fit.
+const char *iotc_metrics_write_telemetry(const IotcMetricsSnapshot *snapshot, const IotclConfig *config,
+                                         char *buf, size_t size, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_METRICS_H
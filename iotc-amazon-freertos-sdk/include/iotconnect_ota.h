@@ -0,0 +1,113 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_OTA_H
+#define IOTCONNECT_OTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_delta.h"
+#include "iotconnect_sha256.h"
+#include "iotconnect_storage.h"
+#include "iotc_http_request.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Downloads a firmware image with HTTP Range requests straight into an image partition, hashing it as it arrives.
+//
+// The image is written from offset 0 of the image storage, erasing each sector before writing into it.
+// At sector boundaries, at most every IOTC_OTA_CHECKPOINT_BYTES, the offset and the SHA-256 state are saved
+// to the progress storage. A download that is interrupted, by a network error or a reset, continues from the last
+// checkpoint when iotc_ota_download() is called again for the same job, instead of starting over.
+// No heap is used. Only the Range request buffer of the HTTPS client is needed on top of the IotcOta struct.
+//
+// If the download is a patch made by the iotc-delta tool (see iotconnect_delta.h) and a source is configured,
+// the patch is applied on the fly: the new image is built in the image storage from the running image in the source
+// storage and the patch. Patches are small, so they are not checkpointed and start over when interrupted.
+// A patch for another version than the running one fails with IOTC_OTA_ERR_SOURCE before anything is written,
+// and the full image can then be downloaded instead.
+//
+// The SDK does not activate the image. Once iotc_ota_download() succeeds, the application marks the image for boot
+// with the vendor boot loader API and sends the OTA ack.
+
+// The download is saved at the first sector boundary after this many bytes since the last checkpoint
+#ifndef IOTC_OTA_CHECKPOINT_BYTES
+#define IOTC_OTA_CHECKPOINT_BYTES 16384
+#endif
+
+#ifndef IOTC_OTA_MAX_HOST_LEN
+#define IOTC_OTA_MAX_HOST_LEN 128
+#endif
+
+// Including the query string, which carries the access token of blob storage URLs
+#ifndef IOTC_OTA_MAX_RESOURCE_LEN
+#define IOTC_OTA_MAX_RESOURCE_LEN 512
+#endif
+
+// Called at each checkpoint, when a download resumes, and once the image is complete.
+// total is 0 until the server reports the size of the image.
+typedef void (*IotcOtaProgressCallback)(void *ctx, size_t received, size_t total);
+
+typedef struct {
+    const IotcStorage *image; // receives the image. Must be at least as large as the image.
+    const IotcStorage *source; // the running image, for patches. NULL accepts full images only.
+    // Holds the checkpoints. A single sector is enough. NULL disables resuming.
+    // Must not be shared with other users, as it is erased when needed.
+    const IotcStorage *progress;
+    const IotcTrustAnchor *trust_anchor; // trust anchor of the download host, from iotconnect_trust.h
+    const char *tls_cert; // PEM root CA of the download host, if it has no trust anchor. Ignored if trust_anchor is set.
+    // IOTC_SHA256_SIZE bytes, if known. Otherwise the digest is only computed. For a patch, the hash of the new image.
+    const uint8_t *expected_sha256;
+    // Identifies the image across resets, so that a checkpoint of a different image is never resumed.
+    // Download URLs usually carry a fresh access token each time, so the URL is only used if this is NULL.
+    // The firmware version of the OTA event is a good choice. It is combined with the path of the URL.
+    const char *job_id;
+    IotcOtaProgressCallback progress_cb;
+    void *cb_ctx;
+} IotcOtaConfig;
+
+typedef enum {
+    IOTC_OTA_OK,
+    IOTC_OTA_ERR_INVALID, // invalid URL or configuration
+    IOTC_OTA_ERR_DOWNLOAD, // the download failed. Calling iotc_ota_download() again resumes it.
+    IOTC_OTA_ERR_STORAGE, // the image does not fit, or writing it failed
+    IOTC_OTA_ERR_VERIFY, // the image does not match expected_sha256, or the patched image does not match the patch
+    IOTC_OTA_ERR_SOURCE // the download is a patch for a different image than the source, or there is no source
+} IotcOtaResult;
+
+typedef struct {
+    IotcOtaConfig config;
+    uint32_t job_key;
+    IotcSha256 sha;
+    size_t received; // bytes downloaded
+    size_t total; // size of the download. 0 until the server reports it.
+    size_t checkpoint; // offset of the last checkpoint
+    uint32_t record_offset; // where the next checkpoint record goes in the progress storage
+    IotConnectHttpStream stream;
+    IotcOtaResult error; // set by the chunk callback to stop the download
+    bool restart; // the image on the server differs from the checkpoint
+    bool is_delta; // the download is a patch
+    IotcDeltaPatcher patcher;
+    char host[IOTC_OTA_MAX_HOST_LEN + 1];
+    char resource[IOTC_OTA_MAX_RESOURCE_LEN + 1];
+    uint8_t sha256[IOTC_SHA256_SIZE]; // digest of the image, once downloaded or patched
+} IotcOta;
+
+// Downloads the image at url ("https://host/path?query") and verifies it. Blocks until the download is complete
+// or fails. The HTTPS client is locked meanwhile, so this should not run in an event callback or on the task that
+// runs the MQTT loop. Copy the URL out of the OTA event and download from the application task instead.
+IotcOtaResult iotc_ota_download(IotcOta *ota, const IotcOtaConfig *config, const char *url);
+
+// Forgets the saved progress, so that the next download starts from the beginning
+void iotc_ota_clear_progress(const IotcStorage *progress);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_OTA_H
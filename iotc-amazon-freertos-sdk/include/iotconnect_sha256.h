@@ -0,0 +1,36 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_SHA256_H
+#define IOTCONNECT_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IOTC_SHA256_SIZE 32
+#define IOTC_SHA256_BLOCK_SIZE 64
+
+// Incremental SHA-256. The state is plain data, so that a hash over a partly received image can be saved
+// and continued after a reset: at a multiple of IOTC_SHA256_BLOCK_SIZE, state and length are all there is.
+typedef struct {
+    uint32_t state[8];
+    uint64_t length; // bytes hashed so far
+    uint8_t block[IOTC_SHA256_BLOCK_SIZE]; // the incomplete block
+} IotcSha256;
+
+void iotc_sha256_init(IotcSha256 *ctx);
+
+void iotc_sha256_update(IotcSha256 *ctx, const void *data, size_t len);
+
+void iotc_sha256_finish(IotcSha256 *ctx, uint8_t digest[IOTC_SHA256_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_SHA256_H
@@ -0,0 +1,62 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_SPOOL_H
+#define IOTCONNECT_SPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iotconnect_storage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Append-only ring log of outbound messages, used to keep telemetry while the device is offline.
+//
+// Records are written sequentially into storage sectors and never span a sector. Each record has a header
+// with a sequence number and a CRC32 over the header and the payload, and is committed by clearing bits of its
+// state byte after the payload is written, so a record torn by a reset is never replayed.
+// Replayed records are marked as consumed the same way. When the log is full, the sector holding the oldest
+// records is erased and those records are dropped.
+// Only the read/write positions are held in RAM. The log is rebuilt by scanning the storage in iotc_spool_init().
+
+typedef struct {
+    unsigned long appended;
+    unsigned long replayed;
+    unsigned long dropped; // lost because the log was full
+    unsigned long corrupted; // skipped because of a CRC error or an incomplete write
+} IotcSpoolStats;
+
+typedef struct {
+    const IotcStorage *storage;
+    uint32_t head; // where the next record will be written
+    uint32_t tail; // oldest pending record. Equals head when there is none.
+    uint32_t next_seq;
+    uint32_t count; // number of pending records
+    IotcSpoolStats stats;
+} IotcSpool;
+
+// Scans the storage and restores the log. Returns 0 on success.
+int iotc_spool_init(IotcSpool *s, const IotcStorage *storage);
+
+// Appends a record. Returns 0 on success.
+int iotc_spool_append(IotcSpool *s, const void *data, size_t len);
+
+// Copies the oldest pending record into buf. Returns 0 on success, 1 if there is nothing to replay, or -1 on error.
+int iotc_spool_peek(IotcSpool *s, void *buf, size_t buf_size, size_t *len);
+
+// Marks the oldest pending record as consumed. Returns 0 on success.
+int iotc_spool_pop(IotcSpool *s);
+
+static inline bool iotc_spool_is_empty(const IotcSpool *s) {
+    return 0 == s->count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_SPOOL_H
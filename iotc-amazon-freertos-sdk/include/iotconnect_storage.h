@@ -0,0 +1,49 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_STORAGE_H
+#define IOTCONNECT_STORAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pluggable non-volatile storage used by the SDK for data that needs to survive a reboot.
+// The semantics follow NOR flash: erase() sets a whole sector to 0xFF, and write() is only ever called
+// on erased areas or to clear additional bits in a byte that was already written.
+// A flash partition on the target can be used by implementing these functions with the vendor flash driver.
+// All functions return 0 on success.
+typedef struct IotcStorage {
+    int (*read)(void *ctx, uint32_t offset, void *buf, size_t len);
+    int (*write)(void *ctx, uint32_t offset, const void *buf, size_t len);
+    int (*erase)(void *ctx, uint32_t offset); // erases the sector at offset (offset is sector aligned)
+    uint32_t size; // total size. Must be a multiple of sector_size.
+    uint32_t sector_size;
+    void *ctx;
+} IotcStorage;
+
+// Computes CRC-32 (IEEE 802.3). Start with crc = 0 and pass the previous result to continue over more data.
+uint32_t iotc_crc32(uint32_t crc, const void *data, size_t len);
+
+// File backed storage for host builds, or for targets with a file system
+typedef struct {
+    FILE *file;
+    uint32_t sector_size;
+} IotcFileStorage;
+
+// Opens (or creates) the file at path and sets up storage to use it. A new file is filled with 0xFF.
+int iotc_storage_file_open(IotcStorage *storage, IotcFileStorage *file_storage, const char *path,
+                           uint32_t size, uint32_t sector_size);
+
+void iotc_storage_file_close(IotcStorage *storage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_STORAGE_H
@@ -7,9 +7,68 @@
 #ifndef IOTCONNECT_SYNC_H
 #define IOTCONNECT_SYNC_H
 
+#include <stdbool.h>
+#include "iotconnect_storage.h"
+#include "iotconnect_telemetry_stream.h"
+
 #ifdef __cplusplus
 extern   "C" {
 #endif
+
+// Size of the buffer in each context that holds the cpid, env and duid, and the values parsed from the sync response.
+// The cache (see iotc_sync_set_cache_storage) saves and loads this buffer. The sync fails if the values do not fit.
+#ifndef IOTCONNECT_SYNC_CACHE_MAX_SIZE
+#define IOTCONNECT_SYNC_CACHE_MAX_SIZE 768
+#endif
+
+// Cached values older than this are not used. 0 means no age limit.
+// The age is only checked if the clock was set when the values were saved and is set at startup.
+#ifndef IOTCONNECT_SYNC_CACHE_MAX_AGE_S
+#define IOTCONNECT_SYNC_CACHE_MAX_AGE_S (7L * 24 * 60 * 60)
+#endif
+
+// Discovery and sync state of one device identity: the values obtained from the responses, and the cache.
+// The responses are parsed in place, without allocating.
+// Contexts come from a static pool of IOTCONNECT_MAX_CLIENTS entries (see iotconnect.h).
+typedef struct IotcSyncContext IotcSyncContext;
+
+// cpid, env and duid are not copied, and must remain valid until the context is destroyed.
+// Returns NULL if all contexts are in use.
+IotcSyncContext* iotc_sync_create(const char* cpid, const char* env, const char* duid);
+
+// Returns the context to the pool
+void iotc_sync_destroy(IotcSyncContext* ctx);
+
+// Sets the context used by the functions below that take no context argument
+void iotc_sync_set_default(IotcSyncContext* ctx);
+IotcSyncContext* iotc_sync_get_default(void);
+
+const char* iotc_sync_ctx_get_iothub_host(IotcSyncContext* ctx);
+const char* iotc_sync_ctx_get_username(IotcSyncContext* ctx);
+const char* iotc_sync_ctx_get_client_id(IotcSyncContext* ctx);
+const char* iotc_sync_ctx_get_pub_topic(IotcSyncContext* ctx);
+const char* iotc_sync_ctx_get_sub_topic(IotcSyncContext* ctx);
+const char* iotc_sync_ctx_get_dtg(IotcSyncContext* ctx);
+
+// Also requests the attributes of the device template with the next sync, for the attribute dictionary
+// of the binary telemetry format (see iotconnect_telemetry_stream.h). Off by default.
+void iotc_sync_ctx_set_attributes(IotcSyncContext* ctx, bool attributes);
+
+// Obtains the attribute dictionary of the response. It is empty if the attributes were not requested, or did not
+// fit into IOTCONNECT_SYNC_CACHE_MAX_SIZE, and it remains valid until the response is freed.
+// Returns false if there is no response.
+bool iotc_sync_ctx_get_attributes(IotcSyncContext* ctx, IotcAttributeDictionary* dict);
+int iotc_sync_ctx_obtain_response(IotcSyncContext* ctx);
+int iotc_sync_ctx_obtain_cached_response(IotcSyncContext* ctx, bool* from_cache);
+void iotc_sync_ctx_free_response(IotcSyncContext* ctx);
+void iotc_sync_ctx_set_cache_storage(IotcSyncContext* ctx, const IotcStorage* storage);
+void iotc_sync_ctx_invalidate_cache(IotcSyncContext* ctx);
+
+// The getters return NULL until a response is obtained with iotc_sync_ctx_obtain_response() or
+// iotc_sync_ctx_obtain_cached_response(), and after it is freed. They never make HTTPS requests.
+
+// The functions below operate on the default context. They fail, or return NULL, if none is set.
+
 const char* iotc_sync_get_iothub_host();
 const char* iotc_sync_get_username(void);
 const char* iotc_sync_get_client_id(void);
@@ -17,9 +76,25 @@ const char* iotc_sync_get_pub_topic(void);
 const char* iotc_sync_get_sub_topic(void);
 const char* iotc_sync_get_dtg(void);
 
+// Runs discovery and sync over HTTPS, and saves the result into the cache if one is set.
+// If that fails, the previous response, if any, remains in use.
 int iotc_sync_obtain_response(void);
+
+// Uses the cached values if they are valid for this device and not expired. Otherwise, same as iotc_sync_obtain_response().
+// from_cache (optional) is set to true if the cached values were used.
+int iotc_sync_obtain_cached_response(bool *from_cache);
+
+// Forgets the response. The getters return NULL until iotc_sync_obtain_response() or
+// iotc_sync_obtain_cached_response() obtains it again.
 void iotc_sync_free_response(void);
 
+// Sets the storage where the host, client ID, username, topics and dtg are kept across reboots, so that
+// startup can skip the discovery and sync HTTPS requests. Only the first sector of the storage is used.
+void iotc_sync_set_cache_storage(const IotcStorage *storage);
+
+// Marks the cached values as invalid. Should be called when they have been rejected, or the server requested a new sync.
+void iotc_sync_invalidate_cache(void);
+
 
 #ifdef __cplusplus
 }
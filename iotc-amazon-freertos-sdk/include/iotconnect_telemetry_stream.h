@@ -0,0 +1,170 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_TELEMETRY_STREAM_H
+#define IOTCONNECT_TELEMETRY_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "iotconnect_lib.h"
+#include "iotconnect_json_view.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A minimal append-only JSON writer over a caller-provided buffer.
+// It never allocates. Once the buffer overflows, all further writes are ignored
+// and the overflow flag stays set, so callers only need to check it once at the end.
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+} IotcJsonWriter;
+
+void iotc_json_writer_init(IotcJsonWriter *w, char *buf, size_t size);
+
+void iotc_json_write_raw(IotcJsonWriter *w, const char *s, size_t len);
+
+// writes a quoted string, escaped the same way cJSON does it
+void iotc_json_write_string(IotcJsonWriter *w, const char *s);
+
+void iotc_json_write_string_len(IotcJsonWriter *w, const char *s, size_t len);
+
+// writes a number formatted the same way cJSON does it
+void iotc_json_write_number(IotcJsonWriter *w, double value);
+
+// writes "name": (with the leading comma if not first)
+void iotc_json_write_key(IotcJsonWriter *w, const char *name, bool first);
+
+// writes the SDK identification object: {"l":"M_C","v":"2.0","e":env}
+void iotc_json_write_sdk_info(IotcJsonWriter *w, const char *env);
+
+// NUL-terminates the buffer and returns it, or NULL if the output did not fit
+const char *iotc_json_writer_finish(IotcJsonWriter *w, size_t *out_len);
+
+
+// Attribute names of a device template, in the order of the sync response. The CBOR format sends the index
+// of a name that is in the dictionary instead of the name, and the hash of the dictionary in the message header.
+typedef struct {
+    const char *names; // count NUL terminated names, one after the other
+    size_t count;
+    uint32_t hash; // see iotc_attribute_dictionary_hash()
+} IotcAttributeDictionary;
+
+// Collects the names in the "att" array of the "d" object of a sync response into buf, and points dict to them.
+// Attributes of an object type attribute are sent within its object, so only the name of the object is taken.
+// Also sets the hash. Returns the number of bytes used in buf, or -1 if the names do not fit.
+int iotc_attribute_dictionary_parse(IotcAttributeDictionary *dict, const IotcJsonToken *d, char *buf, size_t size);
+
+// Returns the index of name, or -1 if it is not in the dictionary
+int iotc_attribute_dictionary_find(const IotcAttributeDictionary *dict, const char *name);
+
+// Returns NULL if index is out of range
+const char *iotc_attribute_dictionary_get(const IotcAttributeDictionary *dict, size_t index);
+
+// Returns the CRC32 of the names, in order and with their NUL terminators, which changes with the device template.
+// 0 for an empty dictionary.
+uint32_t iotc_attribute_dictionary_hash(const IotcAttributeDictionary *dict);
+
+
+typedef enum {
+    IOTC_TELEMETRY_JSON,
+    IOTC_TELEMETRY_CBOR
+} IotcTelemetryFormat;
+
+// Streaming telemetry serializer.
+// Produces the same bytes as iotcl_telemetry_create() + iotcl_create_serialized_string(msg, false),
+// but writes directly into the supplied buffer and tracks the length as it goes.
+//
+// Usage mirrors the iotcl_telemetry_* calls:
+//   iotc_telemetry_stream_begin(&s, iotconnect_sdk_get_lib_config(), buf, sizeof(buf));
+//   iotc_telemetry_stream_add_point(&s, NULL); // optional, NULL means "now"
+//   iotc_telemetry_stream_set_number(&s, "cpu", 3.123);
+//   const char *str = iotc_telemetry_stream_finish(&s, &len);
+//
+// IOTC_TELEMETRY_CBOR writes the same message as CBOR (see iotconnect_cbor.h), with integer keys:
+//   {0: 2 (format version), 1: env, 2: cpId, 3: dtg, 4: id, 5: dictionary hash,
+//    6: [{0: dt, 1: {attribute: value, ...}}, ...]}
+// The dtg is written as 16 bytes if it is a lowercase GUID, and dt as milliseconds since 1970 if it has the
+// "2022-07-01T12:00:00.000Z" form of IoTConnect timestamps. Otherwise they are written as text.
+// Each attribute is written as its index in the dictionary, or as its name if it is not there. The dictionary hash
+// is that of the dictionary used, or 0 without one. A decoder must not resolve the indexes with a dictionary
+// of another hash, as the device may still use a cached sync response from before a change of the template.
+// The message starts with 0xBF, a map of indefinite length, which tells it apart from JSON, which starts with '{'.
+// The iotc-cbor tool turns it back into the JSON message, byte for byte.
+#define IOTC_CBOR_FORMAT_VERSION 2
+
+// Keys of the CBOR message
+typedef enum {
+    IOTC_CBOR_KEY_VERSION,
+    IOTC_CBOR_KEY_ENV,
+    IOTC_CBOR_KEY_CPID,
+    IOTC_CBOR_KEY_DTG,
+    IOTC_CBOR_KEY_ID,
+    IOTC_CBOR_KEY_DICTIONARY,
+    IOTC_CBOR_KEY_POINTS
+} IotcCborMessageKey;
+
+// Keys of each data point of the CBOR message
+typedef enum {
+    IOTC_CBOR_KEY_TIME,
+    IOTC_CBOR_KEY_DATA
+} IotcCborPointKey;
+
+typedef struct {
+    IotcJsonWriter w;
+    const IotclConfig *config;
+    int points; // number of data points started so far
+    int fields; // number of fields in the current data point
+    IotcTelemetryFormat format;
+    const IotcAttributeDictionary *dict; // CBOR only. Optional.
+} IotcTelemetryStream;
+
+bool iotc_telemetry_stream_begin(IotcTelemetryStream *s, const IotclConfig *config, char *buf, size_t size);
+
+// Same as iotc_telemetry_stream_begin(), in the given format. dict is only used by IOTC_TELEMETRY_CBOR, can be NULL,
+// and must remain valid until the message is finished.
+bool iotc_telemetry_stream_begin_format(IotcTelemetryStream *s, const IotclConfig *config, IotcTelemetryFormat format,
+                                        const IotcAttributeDictionary *dict, char *buf, size_t size);
+
+// Starts a new data point with the given ISO timestamp. If iso_time is NULL, the current time is used.
+// Calling this is optional if sending a single data point. The first set_* call will add one.
+bool iotc_telemetry_stream_add_point(IotcTelemetryStream *s, const char *iso_time);
+
+bool iotc_telemetry_stream_set_number(IotcTelemetryStream *s, const char *name, double value);
+
+bool iotc_telemetry_stream_set_string(IotcTelemetryStream *s, const char *name, const char *value);
+
+bool iotc_telemetry_stream_set_bool(IotcTelemetryStream *s, const char *name, bool value);
+
+bool iotc_telemetry_stream_set_null(IotcTelemetryStream *s, const char *name);
+
+// A saved position in the stream. Rewinding to it discards everything written after the mark,
+// including a write that overflowed, so callers can try to append a data point and back it out if it does not fit.
+typedef struct {
+    size_t len;
+    int points;
+    int fields;
+} IotcTelemetryStreamMark;
+
+void iotc_telemetry_stream_mark(const IotcTelemetryStream *s, IotcTelemetryStreamMark *mark);
+
+void iotc_telemetry_stream_rewind(IotcTelemetryStream *s, const IotcTelemetryStreamMark *mark);
+
+// Number of bytes that iotc_telemetry_stream_finish() still needs to write, including the NUL terminator
+size_t iotc_telemetry_stream_finish_len(const IotcTelemetryStream *s);
+
+// Closes the JSON document and returns the NUL-terminated string (pointing into the buffer)
+// and its length in out_len (if not NULL). Returns NULL if the buffer was too small.
+// A CBOR message is binary, so its length must be taken from out_len.
+const char *iotc_telemetry_stream_finish(IotcTelemetryStream *s, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_TELEMETRY_STREAM_H
@@ -0,0 +1,40 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTCONNECT_TRUST_H
+#define IOTCONNECT_TRUST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// Certificates that the SDK trusts, compiled in as DER, so that nothing needs to decode PEM at run time.
+// The POSIX layer parses each anchor once into a trust store that is shared by all HTTPS and MQTT connections.
+// Secure Sockets takes the DER as is. mbedTLS parses DER directly, without the base64 and PEM decoding.
+// The PEM strings in iotconnect_certs.h are kept for applications that use them.
+
+typedef enum {
+    IOTC_TRUST_GODADDY_SECURE_G2, // Go Daddy Secure Certificate Authority - G2. IoTConnect discovery and sync.
+    IOTC_TRUST_BALTIMORE_ROOT, // Baltimore CyberTrust Root. Azure IoT Hub MQTT and blob storage.
+    IOTC_TRUST_ANCHOR_COUNT
+} IotcTrustAnchorId;
+
+typedef struct {
+    IotcTrustAnchorId id;
+    const char *name;
+    const uint8_t *der;
+    size_t der_len;
+} IotcTrustAnchor;
+
+// Returns NULL for an unknown id
+const IotcTrustAnchor *iotc_trust_anchor(IotcTrustAnchorId id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTCONNECT_TRUST_H
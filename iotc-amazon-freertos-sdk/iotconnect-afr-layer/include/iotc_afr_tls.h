@@ -0,0 +1,67 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_AFR_TLS_H
+#define IOTC_AFR_TLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iot_secure_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#include "iotconnect_trust.h"
+#include "transport_interface.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// TLS transport for coreHTTP on mbedTLS over a plain Secure Sockets TCP socket.
+// The TLS of Secure Sockets keeps its mbedTLS context private to the port, so its sessions cannot be resumed.
+// This transport owns the context instead, and keeps the session for the next connection to the same host.
+// It has no client credentials, which Secure Sockets takes from PKCS #11, so the MQTT client stays on Secure Sockets.
+
+struct NetworkContext {
+    Socket_t socket; // SOCKETS_INVALID_SOCKET when closed
+    mbedtls_ssl_context ssl;
+};
+
+// The root CA of a host and the last session obtained from it. The session is offered on the next connection,
+// so that reconnecting to the same host can skip the full handshake. Not thread safe.
+typedef struct {
+    bool is_initialized;
+    mbedtls_ssl_config config;
+    mbedtls_x509_crt root_ca;
+    bool has_session;
+    mbedtls_ssl_session session;
+} IotcTlsClient;
+
+// root_anchor is used instead of root_ca, which is a PEM string, if set. Returns 0 on success.
+int iotc_tls_client_init(IotcTlsClient *client, const IotcTrustAnchor *root_anchor, const char *root_ca);
+
+void iotc_tls_client_free(IotcTlsClient *client);
+
+// Forgets the session, so that the next connection does a full handshake
+void iotc_tls_client_forget_session(IotcTlsClient *client);
+
+// Connects and completes the handshake within timeout_ms, which is then the send and receive timeout as well.
+// Returns 0 on success. *resumed is set if the handshake resumed the stored session.
+int iotc_tls_connect(IotcTlsClient *client, NetworkContext_t *net, const char *host, uint16_t port,
+                     uint32_t timeout_ms, bool *resumed);
+
+void iotc_tls_disconnect(NetworkContext_t *net);
+
+// TransportSend_t and TransportRecv_t. Return the number of bytes, 0 on timeout, or -1 on error.
+int32_t iotc_tls_send(NetworkContext_t *net, const void *buffer, size_t bytes);
+
+int32_t iotc_tls_recv(NetworkContext_t *net, void *buffer, size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTC_AFR_TLS_H
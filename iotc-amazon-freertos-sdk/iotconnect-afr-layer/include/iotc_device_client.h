@@ -8,28 +8,163 @@
 
 #include "iotconnect_discovery.h"
 #include "iotconnect.h"
+#include "iotconnect_trust.h"
 
 #ifdef __cplusplus
 extern   "C" {
 #endif
 
+// Smallest size of the coreMQTT network buffer. Outbound packets (topic + payload + header) should fit into it.
+// The buffer is borrowed from the work arena (see iotconnect_arena.h) when connecting, and returned when disconnected.
+#ifndef IOTC_DEVICE_CLIENT_BUFFER_SIZE
+#define IOTC_DEVICE_CLIENT_BUFFER_SIZE 1024
+#endif
+
+// Size of the network buffer when the arena has room to spare. Larger inbound messages then fit.
+#ifndef IOTC_DEVICE_CLIENT_BUFFER_MAX_SIZE
+#define IOTC_DEVICE_CLIENT_BUFFER_MAX_SIZE 2048
+#endif
+
+// Maximum number of QoS 1 messages that can be waiting for PUBACK at the same time
+#ifndef IOTC_DEVICE_CLIENT_QOS1_WINDOW
+#define IOTC_DEVICE_CLIENT_QOS1_WINDOW 4
+#endif
+
+// QoS 1 messages are copied so that they can be retransmitted after a reconnect. This is the maximum message size.
+#ifndef IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE
+#define IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE 768
+#endif
+
+// How long a QoS 1 publish waits for a free window slot before failing
+#ifndef IOTC_DEVICE_CLIENT_QOS1_WINDOW_WAIT_MS
+#define IOTC_DEVICE_CLIENT_QOS1_WINDOW_WAIT_MS 5000
+#endif
+
+// Where the socket cannot wake the loop up when data arrives, iotc_device_client_loop() polls with MQTT_ProcessLoop()
+// slices of this length. It releases the client lock in between, so that other tasks can send.
+#ifndef IOTC_DEVICE_CLIENT_LOOP_SLICE_MS
+#define IOTC_DEVICE_CLIENT_LOOP_SLICE_MS 50
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_MQTT_PORT
+#define IOTC_DEVICE_CLIENT_MQTT_PORT 8883
+#endif
+
+// Trust anchor of the MQTT host, from iotconnect_trust.h. Defining IOTC_DEVICE_CLIENT_ROOT_CA as a PEM string literal
+// instead is still supported.
+#ifndef IOTC_DEVICE_CLIENT_TRUST_ANCHOR
+#define IOTC_DEVICE_CLIENT_TRUST_ANCHOR IOTC_TRUST_BALTIMORE_ROOT
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_KEEP_ALIVE_S
+#define IOTC_DEVICE_CLIENT_KEEP_ALIVE_S 60
+#endif
+
+#ifndef IOTC_DEVICE_CLIENT_CONNACK_TIMEOUT_MS
+#define IOTC_DEVICE_CLIENT_CONNACK_TIMEOUT_MS 5000
+#endif
 
-typedef void (*IotConnectC2dCallback)(unsigned char* message, size_t message_len);
+#ifndef IOTC_DEVICE_CLIENT_SUBACK_TIMEOUT_MS
+#define IOTC_DEVICE_CLIENT_SUBACK_TIMEOUT_MS 10000
+#endif
+
+// Send and receive timeout of the TLS socket
+#ifndef IOTC_DEVICE_CLIENT_TRANSPORT_TIMEOUT_MS
+#define IOTC_DEVICE_CLIENT_TRANSPORT_TIMEOUT_MS 500
+#endif
+
+// An MQTT session with its own connection, buffers and QoS 1 window.
+// Clients come from a static pool of IOTCONNECT_MAX_CLIENTS entries.
+typedef struct IotcDeviceClient IotcDeviceClient;
+
+// ctx is IotConnectDeviceClientConfig.cb_ctx in all callbacks
+typedef void (*IotConnectC2dCallback)(void *ctx, unsigned char* message, size_t message_len);
+
+typedef void (*IotConnectDeviceClientStatusCallback)(void *ctx, IotConnectConnectionStatus status);
+
+// Called when a message sent with iotc_device_client_publish() is complete:
+// when PUBACK is received for QoS 1, or once the message is written to the network for QoS 0.
+typedef void (*IotConnectPublishCompleteCallback)(void *ctx, uint32_t tag, int status);
 
 typedef struct {
+    // Values obtained by discovery and sync. They are not copied, and must remain valid while the client is in use.
+    const char *host;
+    const char *client_id;
+    const char *username;
+    const char *pub_topic;
+    const char *sub_topic;
+    int qos; // QoS for outbound messages. 0 or 1.
+    // Trust store and X.509 device certificate files. Used by the POSIX layer.
+    // The FreeRTOS layer uses the credentials provisioned with PKCS #11 and ignores this.
+    const IotConnectAuthInfo *auth;
+    // Connect without a clean session. If the broker still has the session, the subscription is not sent again,
+    // and unacknowledged messages are retransmitted as duplicates with their original packet IDs.
+    bool persistent_session;
     IotConnectC2dCallback c2d_msg_cb; // callback for inbound messages
-    IotConnectStatusCallback status_cb; // callback for connection status
+    // Receives IOTC_CS_MQTT_CONNECTED once init succeeds, and IOTC_CS_MQTT_DISCONNECTED when the connection is lost or closed
+    IotConnectDeviceClientStatusCallback status_cb;
+    IotConnectPublishCompleteCallback publish_complete_cb; // optional
+    void *cb_ctx;
 } IotConnectDeviceClientConfig;
 
-int iotc_device_client_init(IotConnectDeviceClientConfig *c);
+// The destination of outbound messages. iotc_device_client_init() validates config.pub_topic once and binds it here,
+// so that a publish only wraps the payload in the MQTT header, and never looks up the topic or makes a network request
+// other than the publish itself.
+typedef struct {
+    const char *topic; // NULL until bound
+    uint16_t topic_len;
+} IotcPublishChannel;
+
+// Returns NULL if all clients are in use
+IotcDeviceClient *iotc_device_client_create(void);
+
+// Disconnects if needed and returns the client to the pool
+void iotc_device_client_destroy(IotcDeviceClient *c);
+
+// Returned by iotc_device_client_init() when the broker refused the connection in its CONNACK, which means that
+// the client ID or the credentials are not valid for the host. Other failures, like network errors, return EXIT_FAILURE.
+#define IOTC_DEVICE_CLIENT_REFUSED 2
+
+// Connects, or reconnects with a new configuration. Returns EXIT_SUCCESS, EXIT_FAILURE or IOTC_DEVICE_CLIENT_REFUSED.
+int iotc_device_client_init(IotcDeviceClient *c, const IotConnectDeviceClientConfig *config);
+
+int iotc_device_client_disconnect(IotcDeviceClient *c);
+
+bool iotc_device_client_is_connected(IotcDeviceClient *c);
+
+int iotc_device_client_send_message(IotcDeviceClient *c, const char *message);
+
+// Same as iotc_device_client_send_message, but the message length is known,
+// so the message does not need to be NUL-terminated and strlen() is avoided.
+int iotc_device_client_send_message_len(IotcDeviceClient *c, const char *message, size_t message_len);
+
+// Sends the message with the configured QoS. The tag is passed to publish_complete_cb.
+// With QoS 1, up to IOTC_DEVICE_CLIENT_QOS1_WINDOW messages can be in flight. If the window is full,
+// this runs the MQTT loop until a PUBACK frees a slot or IOTC_DEVICE_CLIENT_QOS1_WINDOW_WAIT_MS expires.
+// Messages that are not acknowledged when the connection is lost are retransmitted after the next iotc_device_client_init().
+int iotc_device_client_publish(IotcDeviceClient *c, const char *message, size_t message_len, uint32_t tag);
+
+// The channel bound by the last successful iotc_device_client_init(), or NULL
+const IotcPublishChannel *iotc_device_client_get_publish_channel(IotcDeviceClient *c);
+
+// Number of QoS 1 messages waiting for PUBACK
+size_t iotc_device_client_get_inflight_count(IotcDeviceClient *c);
 
-int iotc_device_client_disconnect();
+// Processes inbound packets and keep-alive pings for up to timeout_ms, which can be IOTC_WAIT_FOREVER.
+// Between packets, the caller blocks until data arrives or a keep-alive ping is due: on epoll with the POSIX layer,
+// and with the Secure Sockets wake-up callback on FreeRTOS, if the port supports it. Otherwise the socket is polled.
+// Returns early when the connection is lost or iotc_device_client_wake() is called.
+void iotc_device_client_loop(IotcDeviceClient *c, unsigned int timeout_ms);
 
-bool iotc_device_client_is_connected();
+// Makes iotc_device_client_loop() return early, for example to send from the task that runs the loop.
+// Can be called from any task.
+void iotc_device_client_wake(IotcDeviceClient *c);
 
-int iotc_device_client_send_message(const char *message);
+// All functions above, except create and destroy, take the client's recursive lock, so they can be called from several tasks.
+// Callers can take the lock themselves to make a sequence of calls, or their own state, atomic with respect to the client.
+void iotc_device_client_lock(IotcDeviceClient *c);
 
-void iotc_device_client_loop(unsigned int timeout_ms);
+void iotc_device_client_unlock(IotcDeviceClient *c);
 
 #ifdef __cplusplus
 }
@@ -9,20 +9,53 @@
 extern   "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "iotconnect_trust.h"
+
 typedef struct IotConnectHttpRequest {
     char* host_name;
     char* resource; // path of the resource to GET/PUT
     char* payload; // if payload is not null, a POST will be issued, rather than GET.
     char* response; // We will will provide a default buffer with default size. Response will be a null terminated string.
     char* tls_cert; // provide an SSL certificate for your host (default ones provided in iotconnect_certs.h)
+    const IotcTrustAnchor* trust_anchor; // the trust anchor of the host, from iotconnect_trust.h. Used instead of tls_cert.
 } IotConnectHttpRequest;
 
 // supports get and post
 // if post_data is NULL, a get is executed
 int iotconnect_https_request(IotConnectHttpRequest* request);
 
+// Receives the body of a streamed response in order. offset is the position of data within the resource.
+// Return false to stop the download, which then fails.
+typedef bool (*IotConnectHttpChunkCallback)(void* ctx, size_t offset, const uint8_t* data, size_t len);
+
+typedef struct IotConnectHttpStream {
+    size_t offset; // first byte of the resource to get, for example to resume a download
+    size_t length; // number of bytes to get. 0 gets everything up to the end of the resource.
+    // Size of each Range request. 0, or anything larger than the client buffer allows, uses the largest size that fits.
+    size_t chunk_size;
+    IotConnectHttpChunkCallback chunk_cb;
+    void* cb_ctx;
+    size_t total_size; // receives the size of the whole resource, from Content-Range. 0 if the server does not say.
+} IotConnectHttpStream;
+
+// GETs request->resource in parts with Range requests, so that the body can be larger than the client buffer.
+// Each part is passed to stream->chunk_cb. A request that fails half way, for example because the server closed
+// a kept connection, is resumed from where it stopped. Chunked transfer encoding is decoded by the client, so parts
+// can be chunked too. A server that ignores the Range header can only send bodies that fit into the buffer.
+// request->payload must be NULL and request->response is not set.
+int iotconnect_https_stream(IotConnectHttpRequest* request, IotConnectHttpStream* stream);
+
+// The response points into a buffer that is shared by all requests, and that is borrowed from the work arena
+// (see iotconnect_arena.h) until the lock is released. Callers hold this lock from the request until they are done
+// with the response. The lock is recursive.
+void iotconnect_https_lock(void);
+
+void iotconnect_https_unlock(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,102 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_PLATFORM_H
+#define IOTC_PLATFORM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// OS services used by the SDK core, so that the same code runs on FreeRTOS and on POSIX systems.
+// Each port layer defines the IotcMutex, IotcQueue and IotcTask types and implements the functions below.
+// All objects are allocated by the caller, so no port needs a heap for them.
+#ifdef IOTC_PLATFORM_POSIX
+#include "iotc_platform_posix.h"
+#else
+#include "iotc_platform_afr.h"
+#endif
+
+// Set to 1 for the static allocation profile, in which the SDK never uses a heap once it runs.
+// The FreeRTOS port turns it on when configSUPPORT_DYNAMIC_ALLOCATION is 0. See README.md.
+#ifndef IOTC_STATIC_ALLOCATION
+#define IOTC_STATIC_ALLOCATION 0
+#endif
+
+// Declares the stacks of count tasks of stack_size bytes each, to pass to iotc_task_create() as name[i].
+// Ports that allocate stacks themselves declare NULL pointers.
+#ifndef IOTC_TASK_STACKS
+#define IOTC_TASK_STACKS(name, count, stack_size) static void *const name[count]
+#endif
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+#define IOTC_WAIT_FOREVER UINT32_MAX
+
+// Milliseconds since an arbitrary point. Wraps around, so only differences are meaningful.
+uint32_t iotc_platform_now_ms(void);
+
+void iotc_platform_sleep_ms(uint32_t ms);
+
+// For retry jitter. Should differ between devices, so that a fleet does not retry in step.
+uint32_t iotc_platform_random(void);
+
+// For short sections, like updating counters, which must not block or call into other SDK functions
+void iotc_platform_enter_critical(void);
+
+void iotc_platform_exit_critical(void);
+
+// Recursive mutex
+void iotc_mutex_init(IotcMutex *m);
+
+void iotc_mutex_destroy(IotcMutex *m);
+
+void iotc_mutex_lock(IotcMutex *m);
+
+void iotc_mutex_unlock(IotcMutex *m);
+
+// Queue of byte values, used to hand slot indexes between tasks. items must hold capacity entries.
+void iotc_queue_init(IotcQueue *q, uint8_t *items, size_t capacity);
+
+// Never blocks. Returns false if the queue is full.
+bool iotc_queue_send(IotcQueue *q, uint8_t value);
+
+// Returns false if nothing was received within timeout_ms
+bool iotc_queue_receive(IotcQueue *q, uint8_t *value, uint32_t timeout_ms);
+
+size_t iotc_queue_count(IotcQueue *q);
+
+// Runs fn(arg) on a new task, which ends when fn returns. stack_size is in bytes.
+// stack is declared with IOTC_TASK_STACKS() and must not be used by another task while this one runs.
+// priority is relative to the lowest (idle) priority, and is ignored where threads have no priorities.
+int iotc_task_create(IotcTask *t, const char *name, void (*fn)(void *arg), void *arg, void *stack, size_t stack_size,
+                     unsigned int priority);
+
+// Returns true if called from the task t
+bool iotc_task_is_current(const IotcTask *t);
+
+// Smallest amount of stack, in bytes, that has remained unused since the task started. 0 if unknown or the task has ended.
+size_t iotc_task_get_stack_free(const IotcTask *t);
+
+// The heap of the OS, behind iotc_malloc() (see iotconnect_alloc.h). Not available with IOTC_STATIC_ALLOCATION.
+void *iotc_platform_malloc(size_t size);
+
+void iotc_platform_free(void *ptr);
+
+// Most heap in use so far, in bytes. 0 if unknown.
+size_t iotc_platform_heap_high_water(void);
+
+// Heap in use now, in bytes. 0 if unknown.
+size_t iotc_platform_heap_in_use(void);
+
+// CPU time used by the calling task, in microseconds. Wraps around, so only differences are meaningful. 0 if unknown.
+uint32_t iotc_platform_cpu_us(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTC_PLATFORM_H
@@ -0,0 +1,50 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_PLATFORM_AFR_H
+#define IOTC_PLATFORM_AFR_H
+
+/* Kernel includes. */
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+// FreeRTOS types behind iotc_platform.h. Everything is created with the static allocation API.
+// Tasks too, in the static allocation profile, which is the default when the kernel has no heap.
+
+#ifndef IOTC_STATIC_ALLOCATION
+#if (configSUPPORT_DYNAMIC_ALLOCATION == 0)
+#define IOTC_STATIC_ALLOCATION 1
+#else
+#define IOTC_STATIC_ALLOCATION 0
+#endif
+#endif
+
+#if IOTC_STATIC_ALLOCATION
+#define IOTC_TASK_STACKS(name, count, stack_size) \
+    static StackType_t name[count][((stack_size) + sizeof(StackType_t) - 1) / sizeof(StackType_t)]
+#endif
+
+typedef struct {
+    StaticSemaphore_t storage;
+    SemaphoreHandle_t handle;
+} IotcMutex;
+
+typedef struct {
+    StaticQueue_t storage;
+    QueueHandle_t handle;
+} IotcQueue;
+
+typedef struct {
+    TaskHandle_t handle;
+#if IOTC_STATIC_ALLOCATION
+    StaticTask_t tcb;
+    TaskHandle_t parked; // a task that has ended and waits to be deleted before its TCB and stack are reused
+#endif
+    void (*fn)(void *arg);
+    void *arg;
+} IotcTask;
+
+#endif // IOTC_PLATFORM_AFR_H
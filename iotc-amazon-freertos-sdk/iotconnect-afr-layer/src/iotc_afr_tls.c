@@ -0,0 +1,207 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotc_platform.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/net_sockets.h"
+#include "pkcs11_helpers.h"
+
+#include "iotc_afr_tls.h"
+
+// Random numbers for the handshakes. Seeded once from PKCS #11, which gives access to the TRNG
+// if the platform has one, as opening a PKCS #11 session for each handshake would be slow.
+// Only the HTTPS client connects with this transport, under its lock.
+static mbedtls_ctr_drbg_context drbg;
+static bool is_drbg_seeded = false;
+
+static int pkcs11_entropy(void *ctx, unsigned char *output, size_t len) {
+    (void) ctx;
+    return (pdPASS == xPkcs11GenerateRandomNumber(output, len)) ? 0 : MBEDTLS_ERR_CTR_DRBG_ENTROPY_SOURCE_FAILED;
+}
+
+static int bio_send(void *ctx, const unsigned char *buf, size_t len) {
+    int32_t ret = SOCKETS_Send(((NetworkContext_t *) ctx)->socket, buf, len, 0);
+    if (ret > 0) {
+        return (int) ret;
+    }
+    return (0 == ret || SOCKETS_EWOULDBLOCK == ret) ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+// Secure Sockets ports return 0 or SOCKETS_EWOULDBLOCK when the receive timeout expires
+static int bio_recv(void *ctx, unsigned char *buf, size_t len) {
+    int32_t ret = SOCKETS_Recv(((NetworkContext_t *) ctx)->socket, buf, len, 0);
+    if (ret > 0) {
+        return (int) ret;
+    }
+    return (0 == ret || SOCKETS_EWOULDBLOCK == ret) ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+static void close_socket(NetworkContext_t *net) {
+    (void) SOCKETS_Shutdown(net->socket, SOCKETS_SHUT_RDWR);
+    (void) SOCKETS_Close(net->socket);
+    net->socket = SOCKETS_INVALID_SOCKET;
+}
+
+int iotc_tls_client_init(IotcTlsClient *client, const IotcTrustAnchor *root_anchor, const char *root_ca) {
+    int ret;
+
+    memset(client, 0, sizeof(*client));
+    if (!is_drbg_seeded) {
+        mbedtls_ctr_drbg_init(&drbg);
+        if (0 != (ret = mbedtls_ctr_drbg_seed(&drbg, pkcs11_entropy, NULL, NULL, 0))) {
+            printf("TLS: Unable to seed the random number generator: -0x%04x\n", (unsigned int) -ret);
+            mbedtls_ctr_drbg_free(&drbg);
+            return -1;
+        }
+        is_drbg_seeded = true;
+    }
+
+    mbedtls_ssl_config_init(&client->config);
+    mbedtls_x509_crt_init(&client->root_ca);
+    mbedtls_ssl_session_init(&client->session);
+    client->is_initialized = true;
+
+    if (root_anchor) {
+        ret = mbedtls_x509_crt_parse_der(&client->root_ca, root_anchor->der, root_anchor->der_len);
+    } else {
+        ret = mbedtls_x509_crt_parse(&client->root_ca, (const unsigned char *) root_ca, strlen(root_ca) + 1);
+    }
+    if (0 != ret) {
+        printf("TLS: Unable to parse the root CA: -0x%04x\n", (unsigned int) -ret);
+        iotc_tls_client_free(client);
+        return -1;
+    }
+    ret = mbedtls_ssl_config_defaults(&client->config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+        MBEDTLS_SSL_PRESET_DEFAULT);
+    if (0 != ret) {
+        printf("TLS: Unable to set up the configuration: -0x%04x\n", (unsigned int) -ret);
+        iotc_tls_client_free(client);
+        return -1;
+    }
+    mbedtls_ssl_conf_authmode(&client->config, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&client->config, &client->root_ca, NULL);
+    mbedtls_ssl_conf_rng(&client->config, mbedtls_ctr_drbg_random, &drbg);
+    return 0;
+}
+
+void iotc_tls_client_free(IotcTlsClient *client) {
+    if (client->is_initialized) {
+        mbedtls_ssl_session_free(&client->session);
+        mbedtls_x509_crt_free(&client->root_ca);
+        mbedtls_ssl_config_free(&client->config);
+        client->is_initialized = false;
+        client->has_session = false;
+    }
+}
+
+void iotc_tls_client_forget_session(IotcTlsClient *client) {
+    if (client->has_session) {
+        mbedtls_ssl_session_free(&client->session);
+        mbedtls_ssl_session_init(&client->session);
+        client->has_session = false;
+    }
+}
+
+// Keeps the session of the connection for the next one. Returns true if it is the stored session, resumed.
+static bool store_session(IotcTlsClient *client, NetworkContext_t *net) {
+    mbedtls_ssl_session session;
+    bool resumed = false;
+
+    mbedtls_ssl_session_init(&session);
+    if (0 != mbedtls_ssl_get_session(&net->ssl, &session)) {
+        mbedtls_ssl_session_free(&session);
+        iotc_tls_client_forget_session(client);
+        return false;
+    }
+    // A resumed session keeps the master secret of the original handshake, while a full handshake derives a new one.
+    // The session ID cannot tell, as the client sends a random one with a ticket.
+    if (client->has_session) {
+        resumed = (0 == memcmp(session.master, client->session.master, sizeof(session.master)));
+    }
+    mbedtls_ssl_session_free(&client->session);
+    client->session = session;
+    client->has_session = true;
+    return resumed;
+}
+
+int iotc_tls_connect(IotcTlsClient *client, NetworkContext_t *net, const char *host, uint16_t port,
+                     uint32_t timeout_ms, bool *resumed) {
+    SocketsSockaddr_t address = { 0 };
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+    uint32_t start_ms = iotc_platform_now_ms();
+    int ret;
+
+    *resumed = false;
+    mbedtls_ssl_init(&net->ssl);
+    net->socket = SOCKETS_Socket(SOCKETS_AF_INET, SOCKETS_SOCK_STREAM, SOCKETS_IPPROTO_TCP);
+    if (SOCKETS_INVALID_SOCKET == net->socket) {
+        printf("TLS: Unable to create a socket\n");
+        return -1;
+    }
+    address.ucLength = sizeof(address);
+    address.ucSocketDomain = SOCKETS_AF_INET;
+    address.usPort = SOCKETS_htons(port);
+    address.ulAddress = SOCKETS_GetHostByName(host);
+    if (0 == address.ulAddress
+        || SOCKETS_ERROR_NONE != SOCKETS_SetSockOpt(net->socket, 0, SOCKETS_SO_SNDTIMEO, &timeout, sizeof(timeout))
+        || SOCKETS_ERROR_NONE != SOCKETS_SetSockOpt(net->socket, 0, SOCKETS_SO_RCVTIMEO, &timeout, sizeof(timeout))
+        || SOCKETS_ERROR_NONE != SOCKETS_Connect(net->socket, &address, sizeof(address))) {
+        printf("TLS: Unable to connect to %s:%u\n", host, (unsigned int) port);
+        close_socket(net);
+        return -1;
+    }
+
+    if (0 != (ret = mbedtls_ssl_setup(&net->ssl, &client->config))
+        || 0 != (ret = mbedtls_ssl_set_hostname(&net->ssl, host))) {
+        printf("TLS: Unable to set up the connection: -0x%04x\n", (unsigned int) -ret);
+        iotc_tls_disconnect(net);
+        return -1;
+    }
+    mbedtls_ssl_set_bio(&net->ssl, net, bio_send, bio_recv, NULL);
+    if (client->has_session && 0 != mbedtls_ssl_set_session(&net->ssl, &client->session)) {
+        iotc_tls_client_forget_session(client);
+    }
+
+    do {
+        ret = mbedtls_ssl_handshake(&net->ssl);
+    } while ((MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret)
+        && iotc_platform_now_ms() - start_ms < timeout_ms);
+    if (0 != ret) {
+        printf("TLS: Handshake with %s failed: -0x%04x\n", host, (unsigned int) -ret);
+        // the session may be the reason, for example if the server was reconfigured
+        iotc_tls_client_forget_session(client);
+        iotc_tls_disconnect(net);
+        return -1;
+    }
+    *resumed = store_session(client, net);
+    return 0;
+}
+
+void iotc_tls_disconnect(NetworkContext_t *net) {
+    if (SOCKETS_INVALID_SOCKET != net->socket) {
+        (void) mbedtls_ssl_close_notify(&net->ssl); // only sent once the handshake is over
+        close_socket(net);
+    }
+    mbedtls_ssl_free(&net->ssl);
+}
+
+int32_t iotc_tls_send(NetworkContext_t *net, const void *buffer, size_t bytes) {
+    int ret = mbedtls_ssl_write(&net->ssl, (const unsigned char *) buffer, bytes);
+    if (ret >= 0) {
+        return (int32_t) ret;
+    }
+    return (MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret) ? 0 : -1;
+}
+
+int32_t iotc_tls_recv(NetworkContext_t *net, void *buffer, size_t bytes) {
+    int ret = mbedtls_ssl_read(&net->ssl, (unsigned char *) buffer, bytes);
+    if (ret > 0) {
+        return (int32_t) ret;
+    }
+    // 0 and MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY are the peer closing the connection
+    return (MBEDTLS_ERR_SSL_WANT_READ == ret || MBEDTLS_ERR_SSL_WANT_WRITE == ret) ? 0 : -1;
+}
@@ -25,6 +25,7 @@
 //
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,17 +35,25 @@
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
 
-/* shadow demo helpers header. */
-#include <mqtt_demo_helpers.h>
+#include "core_mqtt.h"
 
 /* Transport interface implementation include header for TLS. */
 #include "transport_secure_sockets.h"
+#include "iot_secure_sockets.h"
 
 #include <transport_interface.h>
 
-#include "iotconnect_sync.h"
+#include "iotconnect_certs.h"
 #include "iotc_device_client.h"
+#include "iotc_tls_stats.h"
+#include "iotconnect_arena.h"
+#include "iotconnect_metrics.h"
+
+#ifndef MQTT_PINGRESP_TIMEOUT_MS
+#define MQTT_PINGRESP_TIMEOUT_MS 500U
+#endif
 
 /*-----------------------------------------------------------*/
 struct NetworkContext
@@ -52,32 +61,138 @@ struct NetworkContext
     SecureSocketsTransportParams_t* pParams;
 };
 
-static bool is_connected = false;
-static NetworkContext_t xNetworkContext = {0};
-static uint8_t ucSharedBuffer[1024];
-static MQTTContext_t xMqttContext = { 0 };
-static MQTTFixedBuffer_t xBuffer =
-{
-    .pBuffer = ucSharedBuffer,
-    .size = 1024
+// QoS 1 messages waiting for PUBACK. A packet_id of 0 marks a free slot.
+typedef struct {
+    uint16_t packet_id;
+    uint32_t tag;
+    uint32_t sent_ms; // for the publish latency
+    size_t len;
+    char payload[IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE];
+} InflightPublish;
+
+struct IotcDeviceClient {
+    MQTTContext_t xMqttContext;
+    bool in_use;
+    bool is_connected;
+    bool suback_received;
+    bool packet_received; // during the last MQTT_ProcessLoop()
+    // The socket gives xWake when data arrives, so the loop can block instead of polling
+    bool wakeup_enabled;
+    volatile bool wake_requested; // by iotc_device_client_wake()
+    bool session_present; // the broker kept the session of the previous connection
+    bool connection_lost; // since the last successful init
+    uint32_t lost_ms;
+    SecureSocketsTransportParams_t xTransportParams;
+    NetworkContext_t xNetworkContext;
+    // Borrowed from the work arena while connected
+    MQTTFixedBuffer_t xBuffer;
+    // MQTT_ProcessLoop() calls in progress. A session closed by a callback keeps the buffer until they return.
+    UBaseType_t uxProcessDepth;
+    IotConnectDeviceClientConfig config;
+    IotcPublishChannel channel;
+    MQTTQoS_t publish_qos;
+    InflightPublish inflight[IOTC_DEVICE_CLIENT_QOS1_WINDOW];
+    size_t inflight_count;
+    uint16_t last_packet_id; // so that new IDs do not collide with those kept in a persistent session
+
+    // Serializes access to the MQTT context between the application task, command workers and the I/O task.
+    // Recursive, so that messages can be sent from inbound message callbacks, which run with the lock held.
+    StaticSemaphore_t xLockStorage;
+    SemaphoreHandle_t xLock;
+
+    StaticSemaphore_t xWakeStorage;
+    SemaphoreHandle_t xWake;
 };
-static IotConnectC2dCallback c2d_msg_cb = NULL; // callback for inbound messages
-static IotConnectStatusCallback status_cb = NULL; // callback for connection connection_status
+
+static IotcDeviceClient clients[IOTCONNECT_MAX_CLIENTS];
+
+/*-----------------------------------------------------------*/
+static uint32_t prvGetTimeMs(void)
+{
+    return (uint32_t) (xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+// coreMQTT passes only the MQTT context to the event callback. It is embedded in the client.
+static IotcDeviceClient* prvClientFromContext(MQTTContext_t* pxMqttContext)
+{
+    return (IotcDeviceClient*) ((char*) pxMqttContext - offsetof(IotcDeviceClient, xMqttContext));
+}
+
+IotcDeviceClient* iotc_device_client_create(void)
+{
+    for (size_t i = 0; i < IOTCONNECT_MAX_CLIENTS; i++) {
+        IotcDeviceClient* c = &clients[i];
+        if (!c->in_use) {
+            memset(c, 0, sizeof(*c));
+            c->in_use = true;
+            c->publish_qos = MQTTQoS1;
+            c->xTransportParams.tcpSocket = NULL;
+            c->xNetworkContext.pParams = &c->xTransportParams;
+            c->xLock = xSemaphoreCreateRecursiveMutexStatic(&c->xLockStorage);
+            c->xWake = xSemaphoreCreateBinaryStatic(&c->xWakeStorage);
+            return c;
+        }
+    }
+    LogError(("No free device client. Increase IOTCONNECT_MAX_CLIENTS."));
+    return NULL;
+}
+
+void iotc_device_client_destroy(IotcDeviceClient* c)
+{
+    if (!c) {
+        return;
+    }
+    if (c->is_connected) {
+        (void) iotc_device_client_disconnect(c);
+    }
+    iotc_arena_release(c); // held if the last connection was lost rather than closed
+    vSemaphoreDelete(c->xLock);
+    vSemaphoreDelete(c->xWake);
+    c->in_use = false;
+}
+
+void iotc_device_client_lock(IotcDeviceClient* c)
+{
+    (void) xSemaphoreTakeRecursive(c->xLock, portMAX_DELAY);
+}
+
+void iotc_device_client_unlock(IotcDeviceClient* c)
+{
+    (void) xSemaphoreGiveRecursive(c->xLock);
+}
 
 /*-----------------------------------------------------------*/
+static void prvCompletePublish(IotcDeviceClient* c, uint16_t usPacketIdentifier)
+{
+    for (size_t i = 0; i < IOTC_DEVICE_CLIENT_QOS1_WINDOW; i++) {
+        if (c->inflight[i].packet_id == usPacketIdentifier) {
+            c->inflight[i].packet_id = 0;
+            c->inflight_count--;
+            iotc_metrics_add(IOTC_METRIC_PUBLISH_SUCCEEDED, 1);
+            iotc_metrics_add(IOTC_METRIC_BYTES_OUT, (uint32_t) c->inflight[i].len);
+            iotc_metrics_record_since(IOTC_METRIC_PUBLISH_LATENCY, c->inflight[i].sent_ms);
+            if (c->config.publish_complete_cb) {
+                c->config.publish_complete_cb(c->config.cb_ctx, c->inflight[i].tag, EXIT_SUCCESS);
+            }
+            return;
+        }
+    }
+    LogWarn(("Received PUBACK for unknown packet ID %u.", usPacketIdentifier));
+}
+
 static void prvEventCallback(MQTTContext_t* pxMqttContext,
     MQTTPacketInfo_t* pxPacketInfo,
     MQTTDeserializedInfo_t* pxDeserializedInfo)
 { 
     uint16_t usPacketIdentifier;
 
-    (void)pxMqttContext;
-
     assert(pxDeserializedInfo != NULL);
     assert(pxMqttContext != NULL);
     assert(pxPacketInfo != NULL);
 
+    IotcDeviceClient* c = prvClientFromContext(pxMqttContext);
     usPacketIdentifier = pxDeserializedInfo->packetIdentifier;
+    c->packet_received = true;
 
     /* Handle incoming publish. The lower 4 bits of the publish packet
      * type is used for the dup, QoS, and retain flags. Hence masking
@@ -85,113 +200,550 @@ static void prvEventCallback(MQTTContext_t* pxMqttContext,
     if ((pxPacketInfo->type & 0xF0U) == MQTT_PACKET_TYPE_PUBLISH)
     {
         assert(pxDeserializedInfo->pPublishInfo != NULL);
-        if(c2d_msg_cb) {
-            c2d_msg_cb((unsigned char*) pxDeserializedInfo->pPublishInfo->pPayload,  pxDeserializedInfo->pPublishInfo->payloadLength);
+        iotc_metrics_add(IOTC_METRIC_MESSAGES_IN, 1);
+        iotc_metrics_add(IOTC_METRIC_BYTES_IN, (uint32_t) pxDeserializedInfo->pPublishInfo->payloadLength);
+        if (c->config.c2d_msg_cb) {
+            c->config.c2d_msg_cb(c->config.cb_ctx, (unsigned char*) pxDeserializedInfo->pPublishInfo->pPayload,  pxDeserializedInfo->pPublishInfo->payloadLength);
         }
     }
-    else
+    else if (pxPacketInfo->type == MQTT_PACKET_TYPE_PUBACK)
+    {
+        prvCompletePublish(c, usPacketIdentifier);
+    }
+    else if (pxPacketInfo->type == MQTT_PACKET_TYPE_SUBACK)
+    {
+        c->suback_received = true;
+    }
+    else if (pxPacketInfo->type != MQTT_PACKET_TYPE_PINGRESP)
     {
-        vHandleOtherIncomingPacket(pxPacketInfo, usPacketIdentifier);
+        LogWarn(("Unexpected packet type %02X received.", (unsigned) pxPacketInfo->type));
+    }
+}
+
+static MQTTStatus_t prvPublish(IotcDeviceClient* c, const char* payload, size_t payload_len, uint16_t* pusPacketId)
+{
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+
+    xPublishInfo.qos = c->publish_qos;
+    xPublishInfo.retain = false;
+    xPublishInfo.pTopicName = c->channel.topic;
+    xPublishInfo.topicNameLength = c->channel.topic_len;
+    xPublishInfo.pPayload = payload;
+    xPublishInfo.payloadLength = payload_len;
+
+    *pusPacketId = (MQTTQoS0 == c->publish_qos) ? 0 : MQTT_GetPacketId(&c->xMqttContext);
+    if (0 != *pusPacketId) {
+        c->last_packet_id = *pusPacketId;
     }
+    return MQTT_Publish(&c->xMqttContext, &xPublishInfo, *pusPacketId);
+}
+
+// Sends a message again within a resumed session, where the broker knows it by its original packet ID
+static MQTTStatus_t prvPublishDuplicate(IotcDeviceClient* c, const InflightPublish* p)
+{
+    MQTTPublishInfo_t xPublishInfo = { 0 };
+
+    xPublishInfo.qos = MQTTQoS1;
+    xPublishInfo.retain = false;
+    xPublishInfo.dup = true;
+    xPublishInfo.pTopicName = c->channel.topic;
+    xPublishInfo.topicNameLength = c->channel.topic_len;
+    xPublishInfo.pPayload = p->payload;
+    xPublishInfo.payloadLength = p->len;
+    return MQTT_Publish(&c->xMqttContext, &xPublishInfo, p->packet_id);
 }
 
-int iotc_device_client_disconnect() {
-    BaseType_t ret = DisconnectMqttSession(&xMqttContext, &xNetworkContext);
-    if (ret == pdFAIL) {
-        LogError(("Encountered a failure while trying to disconnect the MQTT session."));
+// Called by the TCP/IP task when data arrives. It receives the socket of the TCP/IP stack rather than
+// the Secure Sockets handle, so all clients that wait for data wake up and check their own socket.
+static void prvSocketWakeup(void* pvSocket)
+{
+    (void) pvSocket;
+    for (size_t i = 0; i < IOTCONNECT_MAX_CLIENTS; i++) {
+        if (clients[i].wakeup_enabled) {
+            (void) xSemaphoreGive(clients[i].xWake);
+        }
     }
-    is_connected = false;
-    return (ret == pdPASS ? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
-bool iotc_device_client_is_connected() {
-    return (xMqttContext.connectStatus == MQTTConnected);
+static uint32_t prvMinMs(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
 }
 
-int iotc_device_client_send_message(const char* message) {
-    BaseType_t ret = PublishToTopic(
-        &xMqttContext,
-        iotc_sync_get_pub_topic(),
-        strlen(iotc_sync_get_pub_topic()),
-        message,
-        strlen(message)
-        );
+// Milliseconds until coreMQTT needs to run for the keep-alive: to send PINGREQ, or to give up on PINGRESP
+static uint32_t prvMsUntilKeepAlive(IotcDeviceClient* c)
+{
+    uint32_t now = prvGetTimeMs();
+    uint32_t due;
+    if (c->xMqttContext.waitingForPingResp) {
+        due = c->xMqttContext.pingReqSendTimeMs + MQTT_PINGRESP_TIMEOUT_MS;
+    } else if (c->xMqttContext.keepAliveIntervalSec > 0) {
+        due = c->xMqttContext.lastPacketTime + (uint32_t) c->xMqttContext.keepAliveIntervalSec * 1000U + 1U; // coreMQTT waits for "more than"
+    } else {
+        return UINT32_MAX;
+    }
+    int32_t remaining = (int32_t) (due - now);
+    return remaining > 0 ? (uint32_t) remaining : 0;
+}
 
-    bool connected = xMqttContext.connectStatus == MQTTConnected;
-    if (pdPASS != ret) {
-        LogError(("Failed to send message %s. Connection status: %s", message, connected ? "CONNECTED" : "DISCONNECTED"));
+// Borrows the network buffer from the work arena for the next connection. It can be larger than
+// IOTC_DEVICE_CLIENT_BUFFER_SIZE, if the arena has room to spare.
+static BaseType_t prvAcquireBuffer(IotcDeviceClient* c)
+{
+    size_t xSize;
+    c->xBuffer.pBuffer = iotc_arena_acquire(IOTC_ARENA_MQTT, c, IOTC_DEVICE_CLIENT_BUFFER_SIZE,
+        IOTC_DEVICE_CLIENT_BUFFER_MAX_SIZE, &xSize);
+    c->xBuffer.size = xSize;
+    if (NULL == c->xBuffer.pBuffer) {
+        LogError(("No room for the MQTT buffer in the work arena."));
+        return pdFAIL;
     }
-    return (ret == pdPASS ? EXIT_SUCCESS : EXIT_FAILURE);
+    return pdPASS;
+}
+
+// Returns the network buffer once coreMQTT is done with it. The context keeps no pointer to it.
+static void prvReleaseBuffer(IotcDeviceClient* c)
+{
+    iotc_arena_release(c);
+    c->xBuffer.pBuffer = NULL;
+    c->xBuffer.size = 0;
+    c->xMqttContext.networkBuffer = c->xBuffer;
 }
 
-void iotc_device_client_loop(unsigned int timeout_ms) {
-    BaseType_t ret = ProcessLoop(& xMqttContext, (uint32_t) timeout_ms);
-    bool connected = xMqttContext.connectStatus == MQTTConnected;
-    if (pdPASS != ret) {
-        LogError(("Received an error from ProcessLoop! Connection status: %s", connected ? "CONNECTED" : "DISCONNECTED"));      
+// Blocks until data arrives, iotc_device_client_wake() is called, or the timeout passes
+static void prvWaitForSocket(IotcDeviceClient* c, uint32_t ulTimeoutMs)
+{
+    (void) xSemaphoreTake(c->xWake, (UINT32_MAX == ulTimeoutMs) ? portMAX_DELAY : pdMS_TO_TICKS(ulTimeoutMs));
+}
+
+// With the wake-up callback, runs MQTT_ProcessLoop until a pass receives nothing, as one wake-up can stand
+// for several packets. Otherwise runs it once, for up to ulSliceMs.
+static MQTTStatus_t prvProcess(IotcDeviceClient* c, uint32_t ulSliceMs)
+{
+    MQTTStatus_t status;
+    c->uxProcessDepth++;
+    do {
+        uint32_t ulStartMs = prvGetTimeMs();
+        c->packet_received = false;
+        status = MQTT_ProcessLoop(&c->xMqttContext, c->wakeup_enabled ? 0U : ulSliceMs);
+        iotc_metrics_record_since(IOTC_METRIC_PROCESS_LOOP, ulStartMs);
+    } while (MQTTSuccess == status && c->wakeup_enabled && c->packet_received);
+    if (0 == --c->uxProcessDepth && NULL == c->xTransportParams.tcpSocket) {
+        prvReleaseBuffer(c); // the session was closed by a callback
     }
-    if (is_connected && !connected) {
-        if (status_cb) {
-            status_cb(IOTC_CS_MQTT_CONNECTED);
+    return status;
+}
+
+// Returns a free window slot, running the MQTT loop to receive PUBACKs while the window is full
+static InflightPublish* prvAcquireInflightSlot(IotcDeviceClient* c)
+{
+    TickType_t xStart = xTaskGetTickCount();
+    for (;;) {
+        for (size_t i = 0; i < IOTC_DEVICE_CLIENT_QOS1_WINDOW; i++) {
+            if (0 == c->inflight[i].packet_id) {
+                return &c->inflight[i];
+            }
+        }
+        if (c->xMqttContext.connectStatus != MQTTConnected
+            || (xTaskGetTickCount() - xStart) >= pdMS_TO_TICKS(IOTC_DEVICE_CLIENT_QOS1_WINDOW_WAIT_MS)) {
+            return NULL;
+        }
+        if (c->wakeup_enabled) {
+            // Not for long, as a loop on another task may take the wake-up first
+            prvWaitForSocket(c, IOTC_DEVICE_CLIENT_LOOP_SLICE_MS);
+        }
+        if (MQTTSuccess != prvProcess(c, 0)) {
+            return NULL;
         }
-        is_connected = false;
     }
 }
 
-int iotc_device_client_init(IotConnectDeviceClientConfig* c) {
-    BaseType_t ret;
-
-    c2d_msg_cb = NULL;
-    status_cb = NULL;
+// Sends again all messages that were not acknowledged before the connection was lost
+static void prvRetransmitInflight(IotcDeviceClient* c)
+{
+    if (0 == c->inflight_count) {
+        return;
+    }
+    LogInfo(("Retransmitting %u unacknowledged messages.", (unsigned)c->inflight_count));
+    for (size_t i = 0; i < IOTC_DEVICE_CLIENT_QOS1_WINDOW; i++) {
+        InflightPublish* p = &c->inflight[i];
+        if (0 == p->packet_id) {
+            continue;
+        }
+        MQTTStatus_t status;
+        if (c->session_present && MQTTQoS1 == c->publish_qos) {
+            status = prvPublishDuplicate(c, p);
+        } else {
+            // This is a new session, so the packet gets a new ID
+            status = prvPublish(c, p->payload, p->len, &p->packet_id);
+        }
+        if (MQTTSuccess != status) {
+            LogError(("Failed to retransmit a message: %s", MQTT_Status_strerror(status)));
+            p->packet_id = 0;
+        }
+        if (0 == p->packet_id) {
+            // failed, or sent with QoS 0 if the QoS was changed since
+            c->inflight_count--;
+            if (MQTTSuccess == status) {
+                iotc_metrics_add(IOTC_METRIC_PUBLISH_SUCCEEDED, 1);
+                iotc_metrics_add(IOTC_METRIC_BYTES_OUT, (uint32_t) p->len);
+                iotc_metrics_record_since(IOTC_METRIC_PUBLISH_LATENCY, p->sent_ms);
+            } else {
+                iotc_metrics_add(IOTC_METRIC_PUBLISH_FAILED, 1);
+            }
+            if (c->config.publish_complete_cb) {
+                c->config.publish_complete_cb(c->config.cb_ctx, p->tag, (MQTTSuccess == status) ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+        }
+    }
+}
 
-    if (is_connected) {
-        ret = DisconnectMqttSession(&xMqttContext, &xNetworkContext);
-        if (ret == pdFAIL) {
-            LogError(("Failed to disconnect a stale MQTT session."));
+static void prvCloseSession(IotcDeviceClient* c)
+{
+    c->wakeup_enabled = false;
+    if (c->xMqttContext.connectStatus == MQTTConnected) {
+        MQTTStatus_t status = MQTT_Disconnect(&c->xMqttContext);
+        if (MQTTSuccess != status) {
+            LogError(("Failed to send DISCONNECT: %s", MQTT_Status_strerror(status)));
         }
     }
-    is_connected = false;
-    /* Remove compiler warnings about unused parameters. */
+    if (c->xTransportParams.tcpSocket) {
+        (void) SecureSocketsTransport_Disconnect(&c->xNetworkContext);
+        c->xTransportParams.tcpSocket = NULL;
+    }
+    c->is_connected = false;
+    if (0 == c->uxProcessDepth) {
+        prvReleaseBuffer(c);
+    }
+}
 
-    ret = EstablishMqttSession(&xMqttContext,
-        &xNetworkContext,
-        &xBuffer,
-        prvEventCallback);
+int iotc_device_client_disconnect(IotcDeviceClient* c) {
+    iotc_device_client_lock(c);
+    bool was_connected = c->is_connected;
+    prvCloseSession(c);
+    if (was_connected && c->config.status_cb) {
+        c->config.status_cb(c->config.cb_ctx, IOTC_CS_MQTT_DISCONNECTED);
+    }
+    iotc_device_client_unlock(c);
+    iotc_device_client_wake(c); // for a loop that is waiting on another task
+    return EXIT_SUCCESS;
+}
 
-    if (ret == pdFAIL) {
-        /* Log error to indicate connection failure. */
-        LogError(("Failed to connect to MQTT broker."));
+void iotc_device_client_wake(IotcDeviceClient* c) {
+    c->wake_requested = true;
+    (void) xSemaphoreGive(c->xWake);
+}
+
+bool iotc_device_client_is_connected(IotcDeviceClient* c) {
+    return (c->xMqttContext.connectStatus == MQTTConnected);
+}
+
+int iotc_device_client_send_message(IotcDeviceClient* c, const char* message) {
+    return iotc_device_client_send_message_len(c, message, strlen(message));
+}
+
+int iotc_device_client_send_message_len(IotcDeviceClient* c, const char* message, size_t message_len) {
+    return iotc_device_client_publish(c, message, message_len, 0);
+}
+
+static int prvPublishMessage(IotcDeviceClient* c, const char* message, size_t message_len, uint32_t tag) {
+    MQTTStatus_t status;
+    uint16_t usPacketId;
+    uint32_t start_ms = prvGetTimeMs();
+    if (!c->channel.topic) {
+        LogError(("Unable to send message. Publish topic is not available."));
+        return EXIT_FAILURE;
+    }
+
+    if (MQTTQoS0 == c->publish_qos) {
+        status = prvPublish(c, message, message_len, &usPacketId);
+        if (MQTTSuccess == status) {
+            iotc_metrics_add(IOTC_METRIC_PUBLISH_SUCCEEDED, 1);
+            iotc_metrics_add(IOTC_METRIC_BYTES_OUT, (uint32_t) message_len);
+            iotc_metrics_record_since(IOTC_METRIC_PUBLISH_LATENCY, start_ms);
+        }
+        if (MQTTSuccess == status && c->config.publish_complete_cb) {
+            c->config.publish_complete_cb(c->config.cb_ctx, tag, EXIT_SUCCESS);
+        }
+    } else {
+        if (message_len > IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE) {
+            LogError(("Message of %u bytes exceeds IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE.", (unsigned)message_len));
+            return EXIT_FAILURE;
+        }
+        InflightPublish* p = prvAcquireInflightSlot(c);
+        if (!p) {
+            LogError(("Unable to send message. No PUBACK received for %u in-flight messages.", (unsigned)c->inflight_count));
+            return EXIT_FAILURE;
+        }
+        // The payload must stay valid until PUBACK in case it needs to be retransmitted
+        memcpy(p->payload, message, message_len);
+        p->len = message_len;
+        p->tag = tag;
+        p->sent_ms = start_ms;
+        status = prvPublish(c, p->payload, p->len, &usPacketId);
+        if (MQTTSuccess == status) {
+            p->packet_id = usPacketId;
+            c->inflight_count++;
+        }
+    }
+
+    if (MQTTSuccess != status) {
+        bool connected = c->xMqttContext.connectStatus == MQTTConnected;
+        LogError(("Failed to send message %.*s: %s. Connection status: %s", (int)message_len, message,
+            MQTT_Status_strerror(status), connected ? "CONNECTED" : "DISCONNECTED"));
         return EXIT_FAILURE;
     }
-    LogInfo(("Connected to MQTT with EstablishMqttSession."));
+    return EXIT_SUCCESS;
+}
+
+int iotc_device_client_publish(IotcDeviceClient* c, const char* message, size_t message_len, uint32_t tag) {
+    iotc_metrics_add(IOTC_METRIC_PUBLISH_ATTEMPTS, 1);
+    iotc_device_client_lock(c);
+    int ret = prvPublishMessage(c, message, message_len, tag);
+    iotc_device_client_unlock(c);
+    if (EXIT_SUCCESS != ret) {
+        iotc_metrics_add(IOTC_METRIC_PUBLISH_FAILED, 1);
+    }
+    return ret;
+}
 
-    ret = SubscribeToTopic(&xMqttContext,
-       iotc_sync_get_sub_topic(),
-       (uint16_t)strlen(iotc_sync_get_sub_topic())
-    );
-    if (pdPASS != ret) {
-        LogError(("Failed to subscribe to topic %s", iotc_sync_get_sub_topic()));
+const IotcPublishChannel* iotc_device_client_get_publish_channel(IotcDeviceClient* c) {
+    return c->channel.topic ? &c->channel : NULL;
+}
+
+size_t iotc_device_client_get_inflight_count(IotcDeviceClient* c) {
+    return c->inflight_count;
+}
+
+void iotc_device_client_loop(IotcDeviceClient* c, unsigned int timeout_ms) {
+    uint32_t ulStartMs = prvGetTimeMs();
+    uint32_t ulElapsedMs = 0;
+    bool connected;
+    if (!iotc_device_client_is_connected(c)) {
+        return;
     }
-    bool connected = false;
-    int tries = 0;
+    // The lock is not held while waiting, so that other tasks can send in the meantime.
+    // Without the wake-up callback, the loop polls in slices instead.
     do {
-        connected = (xMqttContext.connectStatus == MQTTConnected);
-        ret = ProcessLoop(&xMqttContext, 100);
-        if (ret)
-        tries++;
-        if (tries >= 100) {
-            // 10 seconds
-            LogError(("Failed to connect"));
-            return EXIT_FAILURE;
+        uint32_t ulRemainingMs = (uint32_t) timeout_ms - ulElapsedMs;
+        uint32_t ulSliceMs = prvMinMs(ulRemainingMs, IOTC_DEVICE_CLIENT_LOOP_SLICE_MS);
+        if (c->wakeup_enabled) {
+            prvWaitForSocket(c, prvMinMs(ulRemainingMs, prvMsUntilKeepAlive(c)));
+        }
+
+        iotc_device_client_lock(c);
+        bool was_connected = c->is_connected;
+        MQTTStatus_t status = prvProcess(c, ulSliceMs);
+        if (MQTTSuccess != status && c->xMqttContext.connectStatus == MQTTConnected) {
+            LogError(("MQTT_ProcessLoop returned %s. Closing the connection.", MQTT_Status_strerror(status)));
+            // coreMQTT leaves the status alone on transport errors. There is no point in sending DISCONNECT.
+            c->xMqttContext.connectStatus = MQTTNotConnected;
+            prvCloseSession(c);
+        }
+        connected = c->xMqttContext.connectStatus == MQTTConnected;
+        if (was_connected && !connected) {
+            if (c->config.status_cb) {
+                c->config.status_cb(c->config.cb_ctx, IOTC_CS_MQTT_DISCONNECTED);
+            }
+            c->is_connected = false;
+            c->connection_lost = true;
+            c->lost_ms = prvGetTimeMs();
+            iotc_metrics_add(IOTC_METRIC_CONNECTION_LOSSES, 1);
         }
-    } while (!connected);
+        bool woken = c->wake_requested;
+        c->wake_requested = false;
+        iotc_device_client_unlock(c);
+        if (woken) {
+            break;
+        }
+        if (!c->wakeup_enabled) {
+            taskYIELD();
+        }
+        ulElapsedMs = prvGetTimeMs() - ulStartMs;
+    } while (connected && ulElapsedMs < timeout_ms);
+}
+
+// Opens the TLS connection and the MQTT session with the host and credentials obtained by sync.
+// Returns EXIT_SUCCESS, EXIT_FAILURE, or IOTC_DEVICE_CLIENT_REFUSED if the broker rejected the CONNECT.
+static int prvConnect(IotcDeviceClient* c)
+{
+    ServerInfo_t xServerInfo = { 0 };
+    SocketsConfig_t xSocketsConfig = { 0 };
+    TransportInterface_t xTransport = { 0 };
+    MQTTConnectInfo_t xConnectInfo = { 0 };
+    bool xSessionPresent = false;
+
+    xServerInfo.pHostName = c->config.host;
+    xServerInfo.hostNameLength = strlen(c->config.host);
+    xServerInfo.port = IOTC_DEVICE_CLIENT_MQTT_PORT;
 
-    is_connected = true;
+    xSocketsConfig.enableTls = true;
+#ifdef IOTC_DEVICE_CLIENT_ROOT_CA
+    xSocketsConfig.pRootCa = IOTC_DEVICE_CLIENT_ROOT_CA;
+    xSocketsConfig.rootCaSize = sizeof(IOTC_DEVICE_CLIENT_ROOT_CA);
+#else
+    const IotcTrustAnchor *pxAnchor = iotc_trust_anchor(IOTC_DEVICE_CLIENT_TRUST_ANCHOR);
+    xSocketsConfig.pRootCa = (const char *) pxAnchor->der;
+    xSocketsConfig.rootCaSize = pxAnchor->der_len;
+#endif
+    xSocketsConfig.sendTimeoutMs = IOTC_DEVICE_CLIENT_TRANSPORT_TIMEOUT_MS;
+    xSocketsConfig.recvTimeoutMs = IOTC_DEVICE_CLIENT_TRANSPORT_TIMEOUT_MS;
+
+    if (pdPASS != prvAcquireBuffer(c)) {
+        return EXIT_FAILURE;
+    }
+    TransportSocketStatus_t xNetworkStatus = SecureSocketsTransport_Connect(&c->xNetworkContext, &xServerInfo, &xSocketsConfig);
+    if (TRANSPORT_SOCKET_STATUS_SUCCESS != xNetworkStatus) {
+        LogError(("Failed to connect to %s. Error %d.", c->config.host, (int) xNetworkStatus));
+        c->xTransportParams.tcpSocket = NULL;
+        prvReleaseBuffer(c);
+        return EXIT_FAILURE;
+    }
 
-    c2d_msg_cb = c->c2d_msg_cb;
-    status_cb = c->status_cb;
+    xTransport.pNetworkContext = &c->xNetworkContext;
+    xTransport.send = SecureSocketsTransport_Send;
+    xTransport.recv = SecureSocketsTransport_Recv;
 
+    MQTTStatus_t xStatus = MQTT_Init(&c->xMqttContext, &xTransport, prvGetTimeMs, prvEventCallback, &c->xBuffer);
+    if (MQTTSuccess == xStatus) {
+        xConnectInfo.cleanSession = !c->config.persistent_session;
+        xConnectInfo.keepAliveIntervalSec = IOTC_DEVICE_CLIENT_KEEP_ALIVE_S;
+        xConnectInfo.pClientIdentifier = c->config.client_id;
+        xConnectInfo.clientIdentifierLength = (uint16_t) strlen(c->config.client_id);
+        xConnectInfo.pUserName = c->config.username;
+        xConnectInfo.userNameLength = (uint16_t) strlen(c->config.username);
+        xStatus = MQTT_Connect(&c->xMqttContext, &xConnectInfo, NULL, IOTC_DEVICE_CLIENT_CONNACK_TIMEOUT_MS, &xSessionPresent);
+    }
+    if (MQTTSuccess != xStatus) {
+        LogError(("MQTT connection to %s failed: %s", c->config.host, MQTT_Status_strerror(xStatus)));
+        (void) SecureSocketsTransport_Disconnect(&c->xNetworkContext);
+        c->xTransportParams.tcpSocket = NULL;
+        prvReleaseBuffer(c);
+        return (MQTTServerRefused == xStatus) ? IOTC_DEVICE_CLIENT_REFUSED : EXIT_FAILURE;
+    }
+
+    // With the wake-up callback, the receive timeout only needs to cover reading what has arrived already
+    uint32_t ulRecvTimeoutMs = portTICK_PERIOD_MS; // 0 would mean no timeout
+    (void) xSemaphoreTake(c->xWake, 0);
+    c->wakeup_enabled = SOCKETS_ERROR_NONE == SOCKETS_SetSockOpt(c->xTransportParams.tcpSocket, 0,
+            SOCKETS_SO_WAKEUP_CALLBACK, (void*) prvSocketWakeup, sizeof(void*))
+        && SOCKETS_ERROR_NONE == SOCKETS_SetSockOpt(c->xTransportParams.tcpSocket, 0,
+            SOCKETS_SO_RCVTIMEO, &ulRecvTimeoutMs, sizeof(ulRecvTimeoutMs));
+    if (!c->wakeup_enabled) {
+        LogInfo(("Socket wake-up callback is not available. Polling every %u ms.", (unsigned) IOTC_DEVICE_CLIENT_LOOP_SLICE_MS));
+    }
+
+    c->session_present = c->config.persistent_session && xSessionPresent;
+    if (c->session_present) {
+        // MQTT_Init() restarted the IDs at 1. Continue after the last one, which the broker may still hold.
+        c->xMqttContext.nextPacketId = (uint16_t) (c->last_packet_id + 1U);
+        if (0 == c->xMqttContext.nextPacketId) {
+            c->xMqttContext.nextPacketId = 1;
+        }
+    }
     return EXIT_SUCCESS;
 }
 
+static BaseType_t prvSubscribe(IotcDeviceClient* c)
+{
+    MQTTSubscribeInfo_t xSubscription = { 0 };
+    uint32_t ulStartMs = prvGetTimeMs();
+    uint32_t ulElapsedMs = 0;
+
+    xSubscription.qos = MQTTQoS1;
+    xSubscription.pTopicFilter = c->config.sub_topic;
+    xSubscription.topicFilterLength = (uint16_t) strlen(c->config.sub_topic);
+
+    c->suback_received = false;
+    MQTTStatus_t xStatus = MQTT_Subscribe(&c->xMqttContext, &xSubscription, 1, MQTT_GetPacketId(&c->xMqttContext));
+    while (MQTTSuccess == xStatus && !c->suback_received && ulElapsedMs < IOTC_DEVICE_CLIENT_SUBACK_TIMEOUT_MS) {
+        if (c->wakeup_enabled) {
+            prvWaitForSocket(c, IOTC_DEVICE_CLIENT_SUBACK_TIMEOUT_MS - ulElapsedMs);
+        }
+        xStatus = prvProcess(c, 100);
+        ulElapsedMs = prvGetTimeMs() - ulStartMs;
+    }
+    if (MQTTSuccess != xStatus || !c->suback_received) {
+        LogError(("Failed to subscribe to topic %s", c->config.sub_topic));
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+// The PUBLISH header must fit into the smallest MQTT buffer: packet type, up to 4 bytes of remaining length,
+// the topic with its 2 byte length, and the packet ID
+#define MQTT_PUBLISH_HEADER_OVERHEAD 9U
+
+static BaseType_t prvBindChannel(IotcDeviceClient* c, const char* topic)
+{
+    size_t xLen = strlen(topic);
+    if (0 == xLen || xLen + MQTT_PUBLISH_HEADER_OVERHEAD > IOTC_DEVICE_CLIENT_BUFFER_SIZE || strpbrk(topic, "+#")) {
+        LogError(("Device client: Invalid publish topic %s", topic));
+        return pdFAIL;
+    }
+    c->channel.topic = topic;
+    c->channel.topic_len = (uint16_t) xLen;
+    return pdPASS;
+}
+
+static int prvInit(IotcDeviceClient* c, const IotConnectDeviceClientConfig* config) {
+    if (!config->host || !config->client_id || !config->username || !config->pub_topic || !config->sub_topic) {
+        LogError(("Device client: Connection parameters are missing."));
+        return EXIT_FAILURE;
+    }
 
+    if (c->is_connected) {
+        prvCloseSession(c);
+    }
+    c->channel.topic = NULL;
+    if (pdPASS != prvBindChannel(c, config->pub_topic)) {
+        return EXIT_FAILURE;
+    }
+    c->config = *config;
+    // Inbound messages and status changes are reported only once connected
+    c->config.c2d_msg_cb = NULL;
+    c->config.status_cb = NULL;
+    c->publish_qos = (config->qos > 0) ? MQTTQoS1 : MQTTQoS0; // QoS 2 is not supported by the broker
+
+    IotcTlsTimer start;
+    iotc_tls_stats_start(&start);
+    int ret = prvConnect(c);
+    iotc_tls_stats_record(IOTC_TLS_MQTT, EXIT_SUCCESS == ret, &start);
+
+    if (ret) {
+        /* Log error to indicate connection failure. */
+        LogError(("Failed to connect to MQTT broker."));
+        return ret;
+    }
+    LogInfo(("Connected to MQTT host %s as %s.", c->config.host, c->config.client_id));
+
+    // A resumed session still has the subscription
+    if (!c->session_present && pdPASS != prvSubscribe(c)) {
+        prvCloseSession(c);
+        return EXIT_FAILURE;
+    }
+
+    c->is_connected = true;
+    if (c->connection_lost) {
+        c->connection_lost = false;
+        iotc_metrics_add(IOTC_METRIC_RECONNECTS, 1);
+        iotc_metrics_record_since(IOTC_METRIC_RECONNECT_TIME, c->lost_ms);
+    }
+
+    prvRetransmitInflight(c);
+
+    c->config.c2d_msg_cb = config->c2d_msg_cb;
+    c->config.status_cb = config->status_cb;
+    if (c->config.status_cb) {
+        c->config.status_cb(c->config.cb_ctx, IOTC_CS_MQTT_CONNECTED);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int iotc_device_client_init(IotcDeviceClient* c, const IotConnectDeviceClientConfig* config) {
+    iotc_device_client_lock(c);
+    int ret = prvInit(c, config);
+    iotc_device_client_unlock(c);
+    return ret;
+}
@@ -48,14 +48,18 @@
 /* Kernel includes. */
 #include "FreeRTOS.h"
 #include "task.h"
+#include "semphr.h"
 
-#include "transport_secure_sockets.h"
 #include "backoff_algorithm.h"
 #include "core_http_client.h"
 #include "iotconnect_certs.h"
 #include "pkcs11_helpers.h"
 
+#include "iotc_afr_tls.h"
 #include "iotc_http_request.h"
+#include "iotc_platform.h"
+#include "iotc_tls_stats.h"
+#include "iotconnect_arena.h"
 
 /*------------- Demo configurations -------------------------*/
 
@@ -71,6 +75,31 @@
 #define IOTC_HTTP_CLIENT_USER_BUFFER_SIZE    ( 4096 )
 #endif
 
+// The buffer comes from the work arena (see iotconnect_arena.h). While MQTT clients hold their buffers, it can be
+// smaller than IOTC_HTTP_CLIENT_USER_BUFFER_SIZE, down to this size. Streamed downloads then use smaller parts.
+#ifndef IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE
+#define IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE    ( 2048 )
+#endif
+
+#ifndef IOTC_HTTP_CLIENT_MAX_HOST_LEN
+#define IOTC_HTTP_CLIENT_MAX_HOST_LEN    ( 128U )
+#endif
+
+// Number of hosts for which a TLS session is kept, so that new connections to them can resume it.
+// Discovery and sync are two hosts. Each one holds its parsed root CA and a session with the server certificate.
+#ifndef IOTC_HTTP_CLIENT_SESSION_HOSTS
+#define IOTC_HTTP_CLIENT_SESSION_HOSTS    ( 2 )
+#endif
+
+// Room left in the buffer for the response headers when iotconnect_https_stream() sizes its Range requests
+#ifndef IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM
+#define IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM    ( 1024U )
+#endif
+
+#if IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE <= IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM
+#error "IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE must leave room for a body after IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM"
+#endif
+
 #define CONNECTION_RETRY_MAX_ATTEMPTS            ( 5U )
 #define CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS    ( 5000U )
 #define CONNECTION_RETRY_BACKOFF_BASE_MS         ( 500U )
@@ -87,28 +116,13 @@
 /*-----------------------------------------------------------*/
 
 /**
-* @brief Each compilation unit that consumes the NetworkContext must define it.
-* It should contain a single pointer to the type of your desired transport.
-* When using multiple transports in the same compilation unit, define this pointer as void *.
-*
-* @note Transport stacks are defined in amazon-freertos/libraries/abstractions/transport/secure_sockets/transport_secure_sockets.h.
-*/
-struct NetworkContext
-{
-    SecureSocketsTransportParams_t* pParams;
-};
-
-/*-----------------------------------------------------------*/
-
-/**
- * @brief A buffer used in the demo for storing HTTP request headers, and HTTP
- * response headers and body.
- *
- * @note This demo shows how the same buffer can be re-used for storing the HTTP
- * response after the HTTP request is sent out. However, the user can decide how
- * to use buffers to store HTTP requests and responses.
+ * @brief The buffer for the HTTP request headers, and the response headers and body, borrowed from the work arena
+ * by the first request while the lock is held, and returned when the lock is released.
+ * xBufferLen leaves one extra byte for the NUL after the response body.
  */
-static uint8_t httpClientBuffer[IOTC_HTTP_CLIENT_USER_BUFFER_SIZE];
+static uint8_t* pucBuffer = NULL;
+static size_t xBufferLen = 0;
+static UBaseType_t uxLockDepth = 0;
 
 /**
  * @brief Represents header data that will be sent in an HTTP request.
@@ -126,6 +140,29 @@ static HTTPRequestInfo_t requestInfo;
  */
 static HTTPResponse_t response;
 
+/**
+ * @brief Root CAs and TLS sessions by host (see iotc_afr_tls.h). The root CA can differ between hosts.
+ */
+static struct {
+    char host[IOTC_HTTP_CLIENT_MAX_HOST_LEN + 1];
+    const char* tls_cert;
+    const IotcTrustAnchor* trust_anchor;
+    uint32_t last_used;
+    IotcTlsClient tls;
+} hosts[IOTC_HTTP_CLIENT_SESSION_HOSTS];
+
+/**
+ * @brief Serializes requests, which share the buffers above, between clients connecting from different tasks.
+ */
+static StaticSemaphore_t xLockStorage;
+static SemaphoreHandle_t xLock = NULL;
+
+typedef enum {
+    PART_OK,
+    PART_RETRY, // the request failed, but can be sent again
+    PART_FAILED
+} PartResult_t;
+
 typedef BaseType_t(*TransportConnect_t)(NetworkContext_t* pxNetworkContext, IotConnectHttpRequest* request);
 
 static BaseType_t prvBackoffForRetry(BackoffAlgorithmContext_t* pxRetryParams)
@@ -219,45 +256,69 @@ static BaseType_t connectToServerWithBackoffRetriesV2(TransportConnect_t connect
 }
 
 /*-----------------------------------------------------------*/
-static BaseType_t prvConnectToServer(NetworkContext_t* pxNetworkContext, IotConnectHttpRequest* r)
+// Returns the TLS client for the host, evicting the least recently used one if needed
+static IotcTlsClient* prvGetTlsClient(const IotConnectHttpRequest* r)
 {
-    ServerInfo_t serverInfo = { 0 };
-    SocketsConfig_t socketsConfig = { 0 };
-    BaseType_t status = pdPASS;
-    TransportSocketStatus_t networkStatus;
+    size_t xLru = 0;
+    size_t i;
+
+    for (i = 0; i < IOTC_HTTP_CLIENT_SESSION_HOSTS; i++) {
+        if (hosts[i].tls.is_initialized && 0 == strcmp(hosts[i].host, r->host_name)
+            && hosts[i].tls_cert == r->tls_cert && hosts[i].trust_anchor == r->trust_anchor) {
+            hosts[i].last_used = iotc_platform_now_ms();
+            return &hosts[i].tls;
+        }
+        if (!hosts[i].tls.is_initialized) {
+            xLru = i;
+        } else if (hosts[xLru].tls.is_initialized && (int32_t)(hosts[i].last_used - hosts[xLru].last_used) < 0) {
+            xLru = i;
+        }
+    }
 
-    serverInfo.pHostName = r->host_name;
-    serverInfo.hostNameLength = strlen(r->host_name);
-    serverInfo.port = 443;
+    iotc_tls_client_free(&hosts[xLru].tls);
+    if (iotc_tls_client_init(&hosts[xLru].tls, r->trust_anchor, r->tls_cert) != 0) {
+        return NULL;
+    }
+    (void)snprintf(hosts[xLru].host, sizeof(hosts[xLru].host), "%s", r->host_name);
+    hosts[xLru].tls_cert = r->tls_cert;
+    hosts[xLru].trust_anchor = r->trust_anchor;
+    hosts[xLru].last_used = iotc_platform_now_ms();
+    return &hosts[xLru].tls;
+}
 
-    socketsConfig.enableTls = true;
-    socketsConfig.pAlpnProtos = NULL;
-    socketsConfig.maxFragmentLength = 0;
-    socketsConfig.disableSni = false;
-    socketsConfig.pRootCa = r->tls_cert;
-    socketsConfig.rootCaSize = strlen(r->tls_cert) + 1;
-    socketsConfig.sendTimeoutMs = IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS;
-    socketsConfig.recvTimeoutMs = IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS;
+static BaseType_t prvConnectToServer(NetworkContext_t* pxNetworkContext, IotConnectHttpRequest* r)
+{
+    bool xResumed = false;
+    IotcTlsClient* pxTls = prvGetTlsClient(r);
 
-    LogInfo(("Establishing a TLS session with %s.", r->host_name));
+    if (NULL == pxTls) {
+        return pdFAIL;
+    }
 
-    networkStatus = SecureSocketsTransport_Connect(pxNetworkContext,
-        &serverInfo,
-        &socketsConfig);
+    LogInfo(("Establishing a TLS session with %s.", r->host_name));
 
-    if (networkStatus != TRANSPORT_SOCKET_STATUS_SUCCESS) {
-        status = pdFAIL;
+    IotcTlsTimer start;
+    iotc_tls_stats_start(&start);
+    int ret = iotc_tls_connect(pxTls, pxNetworkContext, r->host_name, 443, IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS,
+        &xResumed);
+    iotc_tls_stats_record(IOTC_TLS_HTTPS, 0 == ret, &start);
+    if (ret != 0) {
+        return pdFAIL;
     }
-    return status;
+    if (xResumed) {
+        iotc_tls_stats_record_resumed(IOTC_TLS_HTTPS);
+    }
+    return pdPASS;
 }
 
 
-static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterface, IotConnectHttpRequest* r)
+// Sends the request and receives the response into the buffer. With lRangeStart < 0, no Range header is sent.
+// pxKeepOpen receives whether the server allows the connection to stay open after the response.
+static BaseType_t prvSendRequest(const TransportInterface_t* ptransportInterface, IotConnectHttpRequest* r,
+    bool xKeepAlive, int32_t lRangeStart, int32_t lRangeEnd, bool* pxKeepOpen)
 {
-    BaseType_t status = pdFAIL;
     HTTPStatus_t httpStatus;
 
-
     configASSERT(r->resource != NULL);
 
     (void)memset(&requestHeaders, 0, sizeof(requestHeaders));
@@ -270,12 +331,13 @@ static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterfa
     requestInfo.methodLen = strlen(requestInfo.pMethod);
     requestInfo.pPath = r->resource;
     requestInfo.pathLen = strlen(r->resource);
+    requestInfo.reqFlags = xKeepAlive ? HTTP_REQUEST_KEEP_ALIVE_FLAG : 0U;
 
-    requestHeaders.pBuffer = httpClientBuffer;
-    requestHeaders.bufferLen = IOTC_HTTP_CLIENT_USER_BUFFER_SIZE;
+    requestHeaders.pBuffer = pucBuffer;
+    requestHeaders.bufferLen = xBufferLen;
 
-    response.pBuffer = httpClientBuffer;
-    response.bufferLen = IOTC_HTTP_CLIENT_USER_BUFFER_SIZE;
+    response.pBuffer = pucBuffer;
+    response.bufferLen = xBufferLen;
 
     httpStatus = HTTPClient_InitializeRequestHeaders(&requestHeaders, &requestInfo);
 
@@ -288,6 +350,13 @@ static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterfa
         "Content-Type", strlen("Content-Type"),
         "application/json", strlen("application/json")
     );
+    if (httpStatus == HTTPSuccess && lRangeStart >= 0) {
+        httpStatus = HTTPClient_AddRangeHeader(&requestHeaders, lRangeStart, lRangeEnd);
+    }
+    if (httpStatus != HTTPSuccess) {
+        LogError(("Failed to add HTTP request headers: Error=%s.", HTTPClient_strerror(httpStatus)));
+        return pdFAIL;
+    }
 
     httpStatus = HTTPClient_Send(ptransportInterface,
         &requestHeaders,
@@ -303,34 +372,98 @@ static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterfa
         return pdFAIL;
     }
 
-    LogDebug(("Received HTTP response from %s%s...", host, path));
+    *pxKeepOpen = xKeepAlive && (0U == (response.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG));
+    return pdPASS;
+}
+
+static BaseType_t prvClientRequest(const TransportInterface_t* ptransportInterface, IotConnectHttpRequest* r)
+{
+    BaseType_t status = pdFAIL;
+    bool xKeepOpen = false;
+
+    if (prvSendRequest(ptransportInterface, r, false, -1, 0, &xKeepOpen) != pdPASS) {
+        return pdFAIL;
+    }
+
+    LogDebug(("Received HTTP response from %s%s...", r->host_name, r->resource));
     LogDebug(("Response Headers:\n%.*s", (int32_t)response.headersLen, response.pHeaders));
     LogInfo(("Response Body (%lu):\n%.*s\n",
         response.bodyLen,
         (int32_t)response.bodyLen,
         response.pBody));
     r->response = (char *) response.pBody;
-    r->response[response.bodyLen] = 0; // null terminate
+    r->response[response.bodyLen] = 0; // the buffer has room for it
     status = (response.statusCode == 200) ? pdPASS : pdFAIL;
 
     if (status != pdPASS) {
         LogError(("Received an invalid response from the server Result: %u.", response.statusCode));
     }
 
-    return((status == pdPASS) && (httpStatus == HTTPSuccess));
+    return status;
 }
 
-int iotconnect_https_request(IotConnectHttpRequest* request)
+void iotconnect_https_lock(void)
+{
+    if (NULL == xLock) {
+        taskENTER_CRITICAL();
+        if (NULL == xLock) {
+            xLock = xSemaphoreCreateRecursiveMutexStatic(&xLockStorage);
+        }
+        taskEXIT_CRITICAL();
+    }
+    (void) xSemaphoreTakeRecursive(xLock, portMAX_DELAY);
+    uxLockDepth++;
+}
+
+void iotconnect_https_unlock(void)
+{
+    if (0 == --uxLockDepth && NULL != pucBuffer) {
+        // Nothing refers to the response anymore
+        iotc_arena_release(&pucBuffer);
+        pucBuffer = NULL;
+        xBufferLen = 0;
+    }
+    (void) xSemaphoreGiveRecursive(xLock);
+}
+
+// Borrows the buffer for the requests made while the lock is held
+static BaseType_t prvAcquireBuffer(void)
+{
+    size_t xSize;
+    if (NULL == pucBuffer) {
+        pucBuffer = iotc_arena_acquire(IOTC_ARENA_HTTPS, &pucBuffer, IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE + 1,
+            IOTC_HTTP_CLIENT_USER_BUFFER_SIZE + 1, &xSize);
+        if (NULL == pucBuffer) {
+            LogError(("No room for the HTTP buffer in the work arena."));
+            return pdFAIL;
+        }
+        xBufferLen = xSize - 1;
+    }
+    return pdPASS;
+}
+
+static BaseType_t prvRequestOverConnection(NetworkContext_t* pxNetworkContext, IotConnectHttpRequest* request)
 {
     TransportInterface_t transportInterface;
-    NetworkContext_t networkContext = { 0 };
-    TransportSocketStatus_t networkStatus;
 
-    SecureSocketsTransportParams_t secureSocketsTransportParams = { 0 };
+    transportInterface.pNetworkContext = pxNetworkContext;
+    transportInterface.send = iotc_tls_send;
+    transportInterface.recv = iotc_tls_recv;
+
+    BaseType_t status = prvClientRequest(&transportInterface, request);
+    iotc_tls_disconnect(pxNetworkContext);
+    return status;
+}
+
+static int prvHttpsRequest(IotConnectHttpRequest* request)
+{
+    NetworkContext_t networkContext;
     BaseType_t status = pdPASS;
 
-    networkContext.pParams = &secureSocketsTransportParams;
     request->response = NULL;
+    if (prvAcquireBuffer() != pdPASS) {
+        return EXIT_FAILURE;
+    }
 
     BaseType_t tries = 0;
     do {
@@ -343,21 +476,7 @@ int iotconnect_https_request(IotConnectHttpRequest* request)
         }
 
         if (status == pdPASS) {
-            transportInterface.pNetworkContext = &networkContext;
-            transportInterface.send = SecureSocketsTransport_Send;
-            transportInterface.recv = SecureSocketsTransport_Recv;
-
-            status = prvClientRequest(&transportInterface, request);
-
-            // cleanup/disconnect
-            networkStatus = SecureSocketsTransport_Disconnect(&networkContext);
-
-            if (networkStatus != TRANSPORT_SOCKET_STATUS_SUCCESS) {
-                status = pdFAIL;
-                LogError(("SecureSocketsTransport_Disconnect() failed to close the network connection. Result: %d.", 
-                    (int)networkStatus)
-                );
-            }
+            status = prvRequestOverConnection(&networkContext, request);
             break;
         }
 
@@ -381,3 +500,148 @@ int iotconnect_https_request(IotConnectHttpRequest* request)
     }
     return EXIT_FAILURE;
 }
+
+int iotconnect_https_request(IotConnectHttpRequest* request)
+{
+    iotconnect_https_lock();
+    int ret = prvHttpsRequest(request);
+    iotconnect_https_unlock();
+    return ret;
+}
+
+// Parses the Content-Range header: "bytes <first>-<last>/<total>". pxTotal is 0 if the server sent "*".
+static bool prvParseContentRange(size_t* pxFirst, size_t* pxTotal)
+{
+    const char* pcValue;
+    size_t xValueLen;
+    char cBuf[64];
+    char* p;
+
+    if (HTTPClient_ReadHeader(&response, "Content-Range", strlen("Content-Range"), &pcValue, &xValueLen) != HTTPSuccess
+        || xValueLen >= sizeof(cBuf) || xValueLen < 6 || strncmp(pcValue, "bytes ", 6) != 0) {
+        return false;
+    }
+    memcpy(cBuf, pcValue, xValueLen);
+    cBuf[xValueLen] = 0;
+    *pxFirst = strtoul(cBuf + 6, &p, 10);
+    if (*p != '-' || (p = strchr(p, '/')) == NULL) {
+        return false;
+    }
+    *pxTotal = (p[1] == '*') ? 0 : strtoul(p + 1, NULL, 10);
+    return true;
+}
+
+// Gets the part of the stream that starts at *pxPos and passes it to the callback. pxDone is set at the end of the stream.
+static PartResult_t prvStreamPart(NetworkContext_t* pxNetworkContext, IotConnectHttpRequest* r, IotConnectHttpStream* s,
+    size_t xPartSize, size_t* pxPos, bool* pxDone, bool* pxKeepOpen)
+{
+    TransportInterface_t transportInterface;
+    size_t xLast = *pxPos + xPartSize - 1;
+    if (s->length && xLast > s->offset + s->length - 1) {
+        xLast = s->offset + s->length - 1;
+    }
+
+    transportInterface.pNetworkContext = pxNetworkContext;
+    transportInterface.send = iotc_tls_send;
+    transportInterface.recv = iotc_tls_recv;
+    if (prvSendRequest(&transportInterface, r, true, (int32_t) *pxPos, (int32_t) xLast, pxKeepOpen) != pdPASS) {
+        return PART_RETRY;
+    }
+
+    const uint8_t* pucData = response.pBody;
+    size_t xLen = response.bodyLen;
+    size_t xFirst = 0;
+    size_t xTotal = 0;
+    if (response.statusCode == 206) {
+        if (!prvParseContentRange(&xFirst, &xTotal) || xFirst != *pxPos || xLen > xLast - *pxPos + 1) {
+            LogError(("Invalid Content-Range in the response from %s%s.", r->host_name, r->resource));
+            return PART_FAILED;
+        }
+    } else if (response.statusCode == 200) {
+        // The server ignored the Range header and sent the whole resource, which happened to fit into the buffer
+        xTotal = xLen;
+        if (*pxPos > xLen) {
+            return PART_FAILED;
+        }
+        pucData += *pxPos;
+        xLen = ((xLast + 1 < xTotal) ? xLast + 1 : xTotal) - *pxPos;
+        *pxDone = true;
+    } else {
+        LogError(("Received an invalid response from the server Result: %u.", response.statusCode));
+        return (response.statusCode >= 500) ? PART_RETRY : PART_FAILED;
+    }
+    s->total_size = xTotal;
+
+    if (xLen > 0 && !s->chunk_cb(s->cb_ctx, *pxPos, pucData, xLen)) {
+        LogError(("Download of %s%s stopped at %lu.", r->host_name, r->resource, (unsigned long) *pxPos));
+        return PART_FAILED;
+    }
+    *pxPos += xLen;
+    // Without a total size, a short part marks the end
+    if (xLen < xLast - xFirst + 1 || (xTotal && *pxPos >= xTotal) || (s->length && *pxPos >= s->offset + s->length)) {
+        *pxDone = true;
+    }
+    return PART_OK;
+}
+
+static int prvHttpsStream(IotConnectHttpRequest* r, IotConnectHttpStream* s)
+{
+    size_t xPos = s->offset;
+    bool xDone = false;
+    int tries = 0;
+
+    if (r->payload || !s->chunk_cb || s->offset > INT32_MAX || s->length > (size_t) INT32_MAX - s->offset) {
+        LogError(("Invalid stream request for %s%s.", r->host_name, r->resource));
+        return EXIT_FAILURE;
+    }
+    if (prvAcquireBuffer() != pdPASS) {
+        return EXIT_FAILURE;
+    }
+    size_t xPartSize = xBufferLen - IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM;
+    if (s->chunk_size > 0 && s->chunk_size < xPartSize) {
+        xPartSize = s->chunk_size;
+    }
+    r->response = NULL;
+    s->total_size = 0;
+
+    NetworkContext_t networkContext;
+    bool xIsOpen = false;
+    while (!xDone) {
+        bool xKeepOpen = false;
+
+        if (xIsOpen) {
+            iotc_tls_stats_record_reuse(IOTC_TLS_HTTPS);
+        } else if (connectToServerWithBackoffRetriesV2(prvConnectToServer, &networkContext, r) != pdPASS) {
+            LogError(("Failed to connect to HTTP server %s.", r->host_name));
+            return EXIT_FAILURE;
+        }
+        PartResult_t result = prvStreamPart(&networkContext, r, s, xPartSize, &xPos, &xDone, &xKeepOpen);
+        // The parts go over one connection where the server allows it
+        xIsOpen = result == PART_OK && xKeepOpen && !xDone;
+        if (!xIsOpen) {
+            iotc_tls_disconnect(&networkContext);
+        }
+        if (result == PART_FAILED) {
+            return EXIT_FAILURE;
+        }
+        if (result == PART_RETRY) {
+            if (++tries > MAX_HTTP_REQUEST_TRIES) {
+                LogError(("All %d HTTP request iterations failed.", MAX_HTTP_REQUEST_TRIES));
+                return EXIT_FAILURE;
+            }
+            LogWarn(("Resuming %s%s at %lu.", r->host_name, r->resource, (unsigned long) xPos));
+            vTaskDelay(HTTP_REQUEST_BACKOFF_MS);
+        } else {
+            tries = 0;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int iotconnect_https_stream(IotConnectHttpRequest* request, IotConnectHttpStream* stream)
+{
+    iotconnect_https_lock();
+    int ret = prvHttpsStream(request, stream);
+    iotconnect_https_unlock();
+    return ret;
+}
@@ -0,0 +1,180 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <string.h>
+
+#include "iotc_platform.h"
+#include "pkcs11_helpers.h"
+
+uint32_t iotc_platform_now_ms(void) {
+    return (uint32_t) (xTaskGetTickCount() * portTICK_PERIOD_MS);
+}
+
+void iotc_platform_sleep_ms(uint32_t ms) {
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+uint32_t iotc_platform_random(void) {
+    uint32_t value = 0;
+    // PKCS #11 gives access to the TRNG, if the platform has one
+    if (pdPASS != xPkcs11GenerateRandomNumber((uint8_t *) &value, sizeof(value))) {
+        value = (uint32_t) xTaskGetTickCount();
+    }
+    return value;
+}
+
+void iotc_platform_enter_critical(void) {
+    taskENTER_CRITICAL();
+}
+
+void iotc_platform_exit_critical(void) {
+    taskEXIT_CRITICAL();
+}
+
+void iotc_mutex_init(IotcMutex *m) {
+    m->handle = xSemaphoreCreateRecursiveMutexStatic(&m->storage);
+}
+
+void iotc_mutex_destroy(IotcMutex *m) {
+    vSemaphoreDelete(m->handle);
+    m->handle = NULL;
+}
+
+void iotc_mutex_lock(IotcMutex *m) {
+    (void) xSemaphoreTakeRecursive(m->handle, portMAX_DELAY);
+}
+
+void iotc_mutex_unlock(IotcMutex *m) {
+    (void) xSemaphoreGiveRecursive(m->handle);
+}
+
+void iotc_queue_init(IotcQueue *q, uint8_t *items, size_t capacity) {
+    q->handle = xQueueCreateStatic((UBaseType_t) capacity, sizeof(uint8_t), items, &q->storage);
+}
+
+bool iotc_queue_send(IotcQueue *q, uint8_t value) {
+    return pdTRUE == xQueueSend(q->handle, &value, 0);
+}
+
+bool iotc_queue_receive(IotcQueue *q, uint8_t *value, uint32_t timeout_ms) {
+    TickType_t ticks = (IOTC_WAIT_FOREVER == timeout_ms) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    return pdTRUE == xQueueReceive(q->handle, value, ticks);
+}
+
+size_t iotc_queue_count(IotcQueue *q) {
+    return (size_t) uxQueueMessagesWaiting(q->handle);
+}
+
+#if IOTC_STATIC_ALLOCATION
+// A task that deletes itself is only cleaned up later by the idle task, so its TCB could not be reused right away.
+// Instead, it suspends itself, and the next iotc_task_create() on the same IotcTask deletes it.
+// Needs INCLUDE_vTaskSuspend and INCLUDE_eTaskGetState.
+static void task_entry(void *arg) {
+    IotcTask *t = (IotcTask *) arg;
+    t->fn(t->arg);
+    t->parked = t->handle;
+    t->handle = NULL; // see iotc_task_get_stack_free()
+    vTaskSuspend(NULL);
+}
+
+int iotc_task_create(IotcTask *t, const char *name, void (*fn)(void *arg), void *arg, void *stack, size_t stack_size,
+                     unsigned int priority) {
+    if (NULL != t->parked) {
+        while (eSuspended != eTaskGetState(t->parked)) {
+            vTaskDelay(1); // it is about to suspend itself
+        }
+        vTaskDelete(t->parked);
+        t->parked = NULL;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    t->handle = xTaskCreateStatic(task_entry, name, (uint32_t) (stack_size / sizeof(StackType_t)), t,
+        tskIDLE_PRIORITY + priority, (StackType_t *) stack, &t->tcb);
+    return (NULL == t->handle) ? -1 : 0;
+}
+#else
+static void task_entry(void *arg) {
+    IotcTask *t = (IotcTask *) arg;
+    t->fn(t->arg);
+    t->handle = NULL; // see iotc_task_get_stack_free()
+    vTaskDelete(NULL);
+}
+
+int iotc_task_create(IotcTask *t, const char *name, void (*fn)(void *arg), void *arg, void *stack, size_t stack_size,
+                     unsigned int priority) {
+    (void) stack;
+    t->fn = fn;
+    t->arg = arg;
+    if (pdPASS != xTaskCreate(task_entry, name, (configSTACK_DEPTH_TYPE) (stack_size / sizeof(StackType_t)), t,
+        tskIDLE_PRIORITY + priority, &t->handle)) {
+        t->handle = NULL;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+bool iotc_task_is_current(const IotcTask *t) {
+    return NULL != t->handle && xTaskGetCurrentTaskHandle() == t->handle;
+}
+
+size_t iotc_task_get_stack_free(const IotcTask *t) {
+#if (INCLUDE_uxTaskGetStackHighWaterMark == 1)
+    size_t free_bytes = 0;
+    // With the scheduler suspended, the task cannot end and the idle task cannot free its stack while it is checked
+    vTaskSuspendAll();
+    if (NULL != t->handle) {
+        free_bytes = (size_t) uxTaskGetStackHighWaterMark(t->handle) * sizeof(StackType_t);
+    }
+    (void) xTaskResumeAll();
+    return free_bytes;
+#else
+    (void) t;
+    return 0;
+#endif
+}
+
+#if !IOTC_STATIC_ALLOCATION
+void *iotc_platform_malloc(size_t size) {
+    return pvPortMalloc(size);
+}
+
+void iotc_platform_free(void *ptr) {
+    vPortFree(ptr);
+}
+#endif
+
+// heap_2, heap_4 and heap_5 track the minimum free heap. The total is only known with configTOTAL_HEAP_SIZE.
+// Define IOTC_PLATFORM_HEAP_STATS to 0 with heap implementations that have no xPortGetMinimumEverFreeHeapSize().
+#ifndef IOTC_PLATFORM_HEAP_STATS
+#define IOTC_PLATFORM_HEAP_STATS 1
+#endif
+
+size_t iotc_platform_heap_high_water(void) {
+#if (IOTC_PLATFORM_HEAP_STATS == 1) && defined(configTOTAL_HEAP_SIZE)
+    return (size_t) configTOTAL_HEAP_SIZE - xPortGetMinimumEverFreeHeapSize();
+#else
+    return 0;
+#endif
+}
+
+size_t iotc_platform_heap_in_use(void) {
+#if (IOTC_PLATFORM_HEAP_STATS == 1) && defined(configTOTAL_HEAP_SIZE)
+    return (size_t) configTOTAL_HEAP_SIZE - xPortGetFreeHeapSize();
+#else
+    return 0;
+#endif
+}
+
+// The run time counter of the task only exists with run time stats. Its frequency is set up by the port with
+// portCONFIGURE_TIMER_FOR_RUN_TIME_STATS(), so define IOTC_PLATFORM_RUN_TIME_COUNTER_HZ to match it.
+uint32_t iotc_platform_cpu_us(void) {
+#if defined(IOTC_PLATFORM_RUN_TIME_COUNTER_HZ) && (configGENERATE_RUN_TIME_STATS == 1) && (configUSE_TRACE_FACILITY == 1)
+    TaskStatus_t status;
+    vTaskGetInfo(NULL, &status, pdFALSE, eRunning);
+    return (uint32_t) ((uint64_t) status.ulRunTimeCounter * 1000000U / IOTC_PLATFORM_RUN_TIME_COUNTER_HZ);
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,35 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_PLATFORM_POSIX_H
+#define IOTC_PLATFORM_POSIX_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// pthread types behind iotc_platform.h
+
+typedef struct {
+    pthread_mutex_t mutex;
+} IotcMutex;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t *items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+} IotcQueue;
+
+typedef struct {
+    pthread_t thread;
+    bool started;
+    void (*fn)(void *arg);
+    void *arg;
+} IotcTask;
+
+#endif // IOTC_PLATFORM_POSIX_H
@@ -0,0 +1,87 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef IOTC_POSIX_TLS_H
+#define IOTC_POSIX_TLS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/ssl.h>
+
+#include "iotconnect_trust.h"
+#include "transport_interface.h"
+
+#ifdef __cplusplus
+extern   "C" {
+#endif
+
+// TLS transport for coreMQTT and coreHTTP on POSIX sockets and OpenSSL
+
+struct NetworkContext {
+    int fd; // -1 when closed
+    SSL *ssl;
+    // With a timeout of 0, send and receive return 0 right away if the socket is not ready,
+    // so that the caller can wait for the socket in its own event loop
+    uint32_t send_timeout_ms;
+    uint32_t recv_timeout_ms;
+};
+
+typedef struct {
+    // Parsed once into a trust store that is shared by all clients, instead of into each SSL context.
+    // Used instead of root_ca. Ignored if trust_store is set.
+    const IotcTrustAnchor *root_anchor;
+    const char *root_ca; // PEM string. Ignored if root_anchor or trust_store is set.
+    const char *trust_store; // path to a PEM file with trusted certificates
+    const char *device_cert; // path to the client certificate (chain) in PEM format. Optional.
+    const char *device_key; // path to the client private key in PEM format. Optional.
+} IotcTlsCredentials;
+
+// An SSL context with loaded credentials, and the last session obtained with it.
+// The session is offered on the next connection, so that reconnecting to the same host
+// can skip the full handshake. Not thread safe. Each connection owner needs its own.
+typedef struct {
+    SSL_CTX *ctx;
+    SSL_SESSION *session;
+} IotcTlsClient;
+
+int iotc_tls_client_init(IotcTlsClient *client, const IotcTlsCredentials *credentials);
+
+void iotc_tls_client_free(IotcTlsClient *client);
+
+// Forgets the session, so that the next connection does a full handshake
+void iotc_tls_client_forget_session(IotcTlsClient *client);
+
+// Connects and completes the handshake within timeout_ms. Returns 0 on success.
+// *resumed is set if the handshake resumed the stored session.
+int iotc_tls_connect(IotcTlsClient *client, NetworkContext_t *net, const char *host, uint16_t port,
+                     uint32_t timeout_ms, bool *resumed);
+
+void iotc_tls_disconnect(NetworkContext_t *net);
+
+// TransportSend_t and TransportRecv_t. Return the number of bytes, 0 on timeout, or -1 on error.
+int32_t iotc_tls_send(NetworkContext_t *net, const void *buffer, size_t bytes);
+
+int32_t iotc_tls_recv(NetworkContext_t *net, void *buffer, size_t bytes);
+
+// Returns true if OpenSSL has buffered decrypted data, which will not show up as readable on the socket
+bool iotc_tls_has_pending(NetworkContext_t *net);
+
+// Maximum number of iotc_tls_add_connect_to() entries
+#ifndef IOTC_TLS_CONNECT_TO_MAX
+#define IOTC_TLS_CONNECT_TO_MAX 4
+#endif
+
+// Sends connections for host:port to address:to_port instead, like curl's --connect-to. This is for testing
+// against local servers. The server name and the certificate are still checked against host.
+// If ca_file is set, the server certificate is verified with the certificates in it instead of the client's credentials.
+// Call before any connections are made. Returns 0 on success.
+int iotc_tls_add_connect_to(const char *host, uint16_t port, const char *address, uint16_t to_port, const char *ca_file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IOTC_POSIX_TLS_H
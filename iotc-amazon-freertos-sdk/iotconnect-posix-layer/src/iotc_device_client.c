@@ -0,0 +1,676 @@
+//
+// Copyright: Avnet 2022
+//
+
+// iotc_device_client.h implementation for Linux, on coreMQTT, POSIX sockets and OpenSSL.
+// The loop waits in epoll on the socket, so a connected client costs no CPU while idle,
+// and wakes up only for inbound data or when a keep-alive ping is due.
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "core_mqtt.h"
+
+#include "iotc_platform.h"
+#include "iotc_posix_tls.h"
+#include "iotconnect_certs.h"
+#include "iotc_device_client.h"
+#include "iotc_tls_stats.h"
+#include "iotconnect_arena.h"
+#include "iotconnect_metrics.h"
+
+#ifndef MQTT_PINGRESP_TIMEOUT_MS
+#define MQTT_PINGRESP_TIMEOUT_MS 500U
+#endif
+
+// The PUBLISH header must fit into the smallest MQTT buffer: packet type, up to 4 bytes of remaining length,
+// the topic with its 2 byte length, and the packet ID
+#define MQTT_PUBLISH_HEADER_OVERHEAD 9U
+
+// QoS 1 messages waiting for PUBACK. A packet_id of 0 marks a free slot.
+typedef struct {
+    uint16_t packet_id;
+    uint32_t tag;
+    uint32_t sent_ms; // for the publish latency
+    size_t len;
+    char payload[IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE];
+} InflightPublish;
+
+struct IotcDeviceClient {
+    MQTTContext_t mqtt;
+    bool in_use;
+    bool is_connected;
+    bool suback_received;
+    bool session_present; // the broker kept the session of the previous connection
+    bool connection_lost; // since the last successful init
+    uint32_t lost_ms;
+    NetworkContext_t net;
+    IotcTlsClient tls;
+    char tls_host[128]; // host that the stored TLS session belongs to
+    // epoll set with the socket, while connected, and wake_fd
+    int epoll_fd;
+    // Written by iotc_device_client_wake() to end a loop that is waiting on another thread
+    int wake_fd;
+    volatile bool wake_requested;
+    // Borrowed from the work arena while connected
+    MQTTFixedBuffer_t buffer;
+    // MQTT_ProcessLoop() calls in progress. A session closed by a callback keeps the buffer until they return.
+    unsigned int process_depth;
+    IotConnectDeviceClientConfig config;
+    IotcPublishChannel channel;
+    MQTTQoS_t publish_qos;
+    InflightPublish inflight[IOTC_DEVICE_CLIENT_QOS1_WINDOW];
+    size_t inflight_count;
+    uint16_t last_packet_id; // so that new IDs do not collide with those kept in a persistent session
+
+    // Serializes access to the MQTT context between the application thread, command workers and the I/O thread.
+    // Recursive, so that messages can be sent from inbound message callbacks, which run with the lock held.
+    IotcMutex lock;
+};
+
+static IotcDeviceClient clients[IOTCONNECT_MAX_CLIENTS];
+
+// coreMQTT passes only the MQTT context to the event callback. It is embedded in the client.
+static IotcDeviceClient *client_from_context(MQTTContext_t *mqtt) {
+    return (IotcDeviceClient *) ((char *) mqtt - offsetof(IotcDeviceClient, mqtt));
+}
+
+IotcDeviceClient *iotc_device_client_create(void) {
+    for (size_t i = 0; i < IOTCONNECT_MAX_CLIENTS; i++) {
+        IotcDeviceClient *c = &clients[i];
+        if (c->in_use) {
+            continue;
+        }
+        memset(c, 0, sizeof(*c));
+        c->net.fd = -1;
+        c->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        c->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = c->wake_fd };
+        if (c->epoll_fd < 0 || c->wake_fd < 0 || 0 != epoll_ctl(c->epoll_fd, EPOLL_CTL_ADD, c->wake_fd, &ev)) {
+            fprintf(stderr, "Device client: Failed to set up epoll: %s\n", strerror(errno));
+            if (c->epoll_fd >= 0) {
+                close(c->epoll_fd);
+            }
+            if (c->wake_fd >= 0) {
+                close(c->wake_fd);
+            }
+            return NULL;
+        }
+        c->in_use = true;
+        c->publish_qos = MQTTQoS1;
+        iotc_mutex_init(&c->lock);
+        return c;
+    }
+    fprintf(stderr, "No free device client. Increase IOTCONNECT_MAX_CLIENTS.\n");
+    return NULL;
+}
+
+void iotc_device_client_destroy(IotcDeviceClient *c) {
+    if (!c) {
+        return;
+    }
+    if (c->is_connected) {
+        (void) iotc_device_client_disconnect(c);
+    }
+    iotc_arena_release(c); // held if the last connection was lost rather than closed
+    iotc_tls_client_free(&c->tls);
+    close(c->epoll_fd);
+    close(c->wake_fd);
+    iotc_mutex_destroy(&c->lock);
+    c->in_use = false;
+}
+
+void iotc_device_client_lock(IotcDeviceClient *c) {
+    iotc_mutex_lock(&c->lock);
+}
+
+void iotc_device_client_unlock(IotcDeviceClient *c) {
+    iotc_mutex_unlock(&c->lock);
+}
+
+static void complete_publish(IotcDeviceClient *c, uint16_t packet_id) {
+    for (size_t i = 0; i < IOTC_DEVICE_CLIENT_QOS1_WINDOW; i++) {
+        if (c->inflight[i].packet_id == packet_id) {
+            c->inflight[i].packet_id = 0;
+            c->inflight_count--;
+            iotc_metrics_add(IOTC_METRIC_PUBLISH_SUCCEEDED, 1);
+            iotc_metrics_add(IOTC_METRIC_BYTES_OUT, (uint32_t) c->inflight[i].len);
+            iotc_metrics_record_since(IOTC_METRIC_PUBLISH_LATENCY, c->inflight[i].sent_ms);
+            if (c->config.publish_complete_cb) {
+                c->config.publish_complete_cb(c->config.cb_ctx, c->inflight[i].tag, EXIT_SUCCESS);
+            }
+            return;
+        }
+    }
+    fprintf(stderr, "Received PUBACK for unknown packet ID %u.\n", packet_id);
+}
+
+static void on_mqtt_event(MQTTContext_t *mqtt, MQTTPacketInfo_t *packet_info, MQTTDeserializedInfo_t *info) {
+    IotcDeviceClient *c = client_from_context(mqtt);
+
+    // The lower 4 bits of the publish packet type are the dup, QoS, and retain flags
+    if ((packet_info->type & 0xF0U) == MQTT_PACKET_TYPE_PUBLISH) {
+        iotc_metrics_add(IOTC_METRIC_MESSAGES_IN, 1);
+        iotc_metrics_add(IOTC_METRIC_BYTES_IN, (uint32_t) info->pPublishInfo->payloadLength);
+        if (c->config.c2d_msg_cb) {
+            c->config.c2d_msg_cb(c->config.cb_ctx, (unsigned char *) info->pPublishInfo->pPayload,
+                info->pPublishInfo->payloadLength);
+        }
+    } else if (packet_info->type == MQTT_PACKET_TYPE_PUBACK) {
+        complete_publish(c, info->packetIdentifier);
+    } else if (packet_info->type == MQTT_PACKET_TYPE_SUBACK) {
+        c->suback_received = true;
+    } else if (packet_info->type != MQTT_PACKET_TYPE_PINGRESP) {
+        fprintf(stderr, "Unexpected packet type %02X received.\n", (unsigned) packet_info->type);
+    }
+}
+
+static MQTTStatus_t publish(IotcDeviceClient *c, const char *payload, size_t payload_len, uint16_t *packet_id) {
+    MQTTPublishInfo_t publish_info = { 0 };
+
+    publish_info.qos = c->publish_qos;
+    publish_info.retain = false;
+    publish_info.pTopicName = c->channel.topic;
+    publish_info.topicNameLength = c->channel.topic_len;
+    publish_info.pPayload = payload;
+    publish_info.payloadLength = payload_len;
+
+    *packet_id = (MQTTQoS0 == c->publish_qos) ? 0 : MQTT_GetPacketId(&c->mqtt);
+    if (0 != *packet_id) {
+        c->last_packet_id = *packet_id;
+    }
+    return MQTT_Publish(&c->mqtt, &publish_info, *packet_id);
+}
+
+// Sends a message again within a resumed session, where the broker knows it by its original packet ID
+static MQTTStatus_t publish_duplicate(IotcDeviceClient *c, const InflightPublish *p) {
+    MQTTPublishInfo_t publish_info = { 0 };
+
+    publish_info.qos = MQTTQoS1;
+    publish_info.retain = false;
+    publish_info.dup = true;
+    publish_info.pTopicName = c->channel.topic;
+    publish_info.topicNameLength = c->channel.topic_len;
+    publish_info.pPayload = p->payload;
+    publish_info.payloadLength = p->len;
+    return MQTT_Publish(&c->mqtt, &publish_info, p->packet_id);
+}
+
+static uint32_t min_u32(uint32_t a, uint32_t b) {
+    return a < b ? a : b;
+}
+
+// Milliseconds until coreMQTT needs to run for the keep-alive: to send PINGREQ, or to give up on PINGRESP
+static uint32_t ms_until_keep_alive(IotcDeviceClient *c) {
+    uint32_t now = iotc_platform_now_ms();
+    uint32_t due;
+    if (c->mqtt.waitingForPingResp) {
+        due = c->mqtt.pingReqSendTimeMs + MQTT_PINGRESP_TIMEOUT_MS;
+    } else if (c->mqtt.keepAliveIntervalSec > 0) {
+        due = c->mqtt.lastPacketTime + (uint32_t) c->mqtt.keepAliveIntervalSec * 1000U + 1U; // coreMQTT waits for "more than"
+    } else {
+        return UINT32_MAX;
+    }
+    int32_t remaining = (int32_t) (due - now);
+    return remaining > 0 ? (uint32_t) remaining : 0;
+}
+
+// Waits until the socket is readable, the wake event is signalled, or timeout_ms passes
+static void wait_for_socket(IotcDeviceClient *c, uint32_t timeout_ms) {
+    struct epoll_event events[2];
+    int n = epoll_wait(c->epoll_fd, events, 2, (timeout_ms > INT32_MAX) ? -1 : (int) timeout_ms);
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.fd == c->wake_fd) {
+            uint64_t value;
+            (void) read(c->wake_fd, &value, sizeof(value));
+        }
+    }
+}
+
+// Borrows the network buffer from the work arena for the next connection. It can be larger than
+// IOTC_DEVICE_CLIENT_BUFFER_SIZE, if the arena has room to spare.
+static int acquire_buffer(IotcDeviceClient *c) {
+    size_t size;
+    c->buffer.pBuffer = iotc_arena_acquire(IOTC_ARENA_MQTT, c, IOTC_DEVICE_CLIENT_BUFFER_SIZE,
+                                           IOTC_DEVICE_CLIENT_BUFFER_MAX_SIZE, &size);
+    c->buffer.size = size;
+    return c->buffer.pBuffer ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Returns the network buffer once coreMQTT is done with it. The context keeps no pointer to it.
+static void release_buffer(IotcDeviceClient *c) {
+    iotc_arena_release(c);
+    c->buffer.pBuffer = NULL;
+    c->buffer.size = 0;
+    c->mqtt.networkBuffer = c->buffer;
+}
+
+static void close_session(IotcDeviceClient *c) {
+    if (c->mqtt.connectStatus == MQTTConnected) {
+        MQTTStatus_t status = MQTT_Disconnect(&c->mqtt);
+        if (MQTTSuccess != status) {
+            fprintf(stderr, "Failed to send DISCONNECT: %s\n", MQTT_Status_strerror(status));
+        }
+        c->mqtt.connectStatus = MQTTNotConnected;
+    }
+    if (c->net.fd >= 0) {
+        (void) epoll_ctl(c->epoll_fd, EPOLL_CTL_DEL, c->net.fd, NULL);
+        iotc_tls_disconnect(&c->net);
+    }
+    c->is_connected = false;
+    if (0 == c->process_depth) {
+        release_buffer(c);
+    }
+}
+
+static MQTTStatus_t process_loop(IotcDeviceClient *c) {
+    c->process_depth++;
+    MQTTStatus_t status = MQTT_ProcessLoop(&c->mqtt, 0);
+    if (0 == --c->process_depth && c->net.fd < 0) {
+        release_buffer(c); // the session was closed by a callback
+    }
+    return status;
+}
+
+// Runs the MQTT loop once, with the lock held. Returns false if the connection is gone.
+static bool process(IotcDeviceClient *c) {
+    iotc_device_client_lock(c);
+    bool was_connected = c->is_connected;
+    if (c->mqtt.connectStatus == MQTTConnected) {
+        uint32_t start_ms = iotc_platform_now_ms();
+        MQTTStatus_t status = process_loop(c);
+        iotc_metrics_record_since(IOTC_METRIC_PROCESS_LOOP, start_ms);
+        if (MQTTSuccess != status) {
+            fprintf(stderr, "MQTT_ProcessLoop returned %s. Closing the connection.\n", MQTT_Status_strerror(status));
+            // coreMQTT leaves the status alone on transport errors. There is no point in sending DISCONNECT.
+            c->mqtt.connectStatus = MQTTNotConnected;
+            close_session(c);
+        }
+    }
+    bool connected = c->mqtt.connectStatus == MQTTConnected;
+    if (was_connected && !connected) {
+        if (c->config.status_cb) {
+            c->config.status_cb(c->config.cb_ctx, IOTC_CS_MQTT_DISCONNECTED);
+        }
+        c->is_connected = false;
+        c->connection_lost = true;
+        c->lost_ms = iotc_platform_now_ms();
+        iotc_metrics_add(IOTC_METRIC_CONNECTION_LOSSES, 1);
+    }
+    iotc_device_client_unlock(c);
+    return connected;
+}
+
+// Returns a free window slot, running the MQTT loop to receive PUBACKs while the window is full
+static InflightPublish *acquire_inflight_slot(IotcDeviceClient *c) {
+    uint32_t start_ms = iotc_platform_now_ms();
+    for (;;) {
+        for (size_t i = 0; i < IOTC_DEVICE_CLIENT_QOS1_WINDOW; i++) {
+            if (0 == c->inflight[i].packet_id) {
+                return &c->inflight[i];
+            }
+        }
+        uint32_t elapsed_ms = iotc_platform_now_ms() - start_ms;
+        if (c->mqtt.connectStatus != MQTTConnected || elapsed_ms >= IOTC_DEVICE_CLIENT_QOS1_WINDOW_WAIT_MS) {
+            return NULL;
+        }
+        if (!iotc_tls_has_pending(&c->net)) {
+            wait_for_socket(c, min_u32(IOTC_DEVICE_CLIENT_QOS1_WINDOW_WAIT_MS - elapsed_ms, ms_until_keep_alive(c)));
+        }
+        if (MQTTSuccess != process_loop(c)) {
+            return NULL;
+        }
+    }
+}
+
+// Sends again all messages that were not acknowledged before the connection was lost
+static void retransmit_inflight(IotcDeviceClient *c) {
+    if (0 == c->inflight_count) {
+        return;
+    }
+    printf("Retransmitting %u unacknowledged messages.\n", (unsigned) c->inflight_count);
+    for (size_t i = 0; i < IOTC_DEVICE_CLIENT_QOS1_WINDOW; i++) {
+        InflightPublish *p = &c->inflight[i];
+        if (0 == p->packet_id) {
+            continue;
+        }
+        MQTTStatus_t status;
+        if (c->session_present && MQTTQoS1 == c->publish_qos) {
+            status = publish_duplicate(c, p);
+        } else {
+            // This is a new session, so the packet gets a new ID
+            status = publish(c, p->payload, p->len, &p->packet_id);
+        }
+        if (MQTTSuccess != status) {
+            fprintf(stderr, "Failed to retransmit a message: %s\n", MQTT_Status_strerror(status));
+            p->packet_id = 0;
+        }
+        if (0 == p->packet_id) {
+            // failed, or sent with QoS 0 if the QoS was changed since
+            c->inflight_count--;
+            if (MQTTSuccess == status) {
+                iotc_metrics_add(IOTC_METRIC_PUBLISH_SUCCEEDED, 1);
+                iotc_metrics_add(IOTC_METRIC_BYTES_OUT, (uint32_t) p->len);
+                iotc_metrics_record_since(IOTC_METRIC_PUBLISH_LATENCY, p->sent_ms);
+            } else {
+                iotc_metrics_add(IOTC_METRIC_PUBLISH_FAILED, 1);
+            }
+            if (c->config.publish_complete_cb) {
+                c->config.publish_complete_cb(c->config.cb_ctx, p->tag, (MQTTSuccess == status) ? EXIT_SUCCESS : EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+int iotc_device_client_disconnect(IotcDeviceClient *c) {
+    iotc_device_client_lock(c);
+    bool was_connected = c->is_connected;
+    close_session(c);
+    if (was_connected && c->config.status_cb) {
+        c->config.status_cb(c->config.cb_ctx, IOTC_CS_MQTT_DISCONNECTED);
+    }
+    iotc_device_client_unlock(c);
+    iotc_device_client_wake(c);
+    return EXIT_SUCCESS;
+}
+
+void iotc_device_client_wake(IotcDeviceClient *c) {
+    uint64_t one = 1;
+    c->wake_requested = true;
+    (void) write(c->wake_fd, &one, sizeof(one));
+}
+
+bool iotc_device_client_is_connected(IotcDeviceClient *c) {
+    return (c->mqtt.connectStatus == MQTTConnected);
+}
+
+int iotc_device_client_send_message(IotcDeviceClient *c, const char *message) {
+    return iotc_device_client_send_message_len(c, message, strlen(message));
+}
+
+int iotc_device_client_send_message_len(IotcDeviceClient *c, const char *message, size_t message_len) {
+    return iotc_device_client_publish(c, message, message_len, 0);
+}
+
+static int publish_message(IotcDeviceClient *c, const char *message, size_t message_len, uint32_t tag) {
+    MQTTStatus_t status;
+    uint16_t packet_id;
+    uint32_t start_ms = iotc_platform_now_ms();
+    if (!c->channel.topic) {
+        fprintf(stderr, "Unable to send message. Publish topic is not available.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (MQTTQoS0 == c->publish_qos) {
+        status = publish(c, message, message_len, &packet_id);
+        if (MQTTSuccess == status) {
+            iotc_metrics_add(IOTC_METRIC_PUBLISH_SUCCEEDED, 1);
+            iotc_metrics_add(IOTC_METRIC_BYTES_OUT, (uint32_t) message_len);
+            iotc_metrics_record_since(IOTC_METRIC_PUBLISH_LATENCY, start_ms);
+        }
+        if (MQTTSuccess == status && c->config.publish_complete_cb) {
+            c->config.publish_complete_cb(c->config.cb_ctx, tag, EXIT_SUCCESS);
+        }
+    } else {
+        if (message_len > IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE) {
+            fprintf(stderr, "Message of %u bytes exceeds IOTC_DEVICE_CLIENT_QOS1_MESSAGE_SIZE.\n", (unsigned) message_len);
+            return EXIT_FAILURE;
+        }
+        InflightPublish *p = acquire_inflight_slot(c);
+        if (!p) {
+            fprintf(stderr, "Unable to send message. No PUBACK received for %u in-flight messages.\n",
+                (unsigned) c->inflight_count);
+            return EXIT_FAILURE;
+        }
+        // The payload must stay valid until PUBACK in case it needs to be retransmitted
+        memcpy(p->payload, message, message_len);
+        p->len = message_len;
+        p->tag = tag;
+        p->sent_ms = start_ms;
+        status = publish(c, p->payload, p->len, &packet_id);
+        if (MQTTSuccess == status) {
+            p->packet_id = packet_id;
+            c->inflight_count++;
+        }
+    }
+
+    if (MQTTSuccess != status) {
+        bool connected = c->mqtt.connectStatus == MQTTConnected;
+        fprintf(stderr, "Failed to send message %.*s: %s. Connection status: %s\n", (int) message_len, message,
+            MQTT_Status_strerror(status), connected ? "CONNECTED" : "DISCONNECTED");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int iotc_device_client_publish(IotcDeviceClient *c, const char *message, size_t message_len, uint32_t tag) {
+    iotc_metrics_add(IOTC_METRIC_PUBLISH_ATTEMPTS, 1);
+    iotc_device_client_lock(c);
+    int ret = publish_message(c, message, message_len, tag);
+    iotc_device_client_unlock(c);
+    if (EXIT_SUCCESS != ret) {
+        iotc_metrics_add(IOTC_METRIC_PUBLISH_FAILED, 1);
+    }
+    return ret;
+}
+
+const IotcPublishChannel *iotc_device_client_get_publish_channel(IotcDeviceClient *c) {
+    return c->channel.topic ? &c->channel : NULL;
+}
+
+size_t iotc_device_client_get_inflight_count(IotcDeviceClient *c) {
+    return c->inflight_count;
+}
+
+void iotc_device_client_loop(IotcDeviceClient *c, unsigned int timeout_ms) {
+    uint32_t start_ms = iotc_platform_now_ms();
+    uint32_t elapsed_ms = 0;
+    if (!iotc_device_client_is_connected(c)) {
+        return;
+    }
+    // The lock is not held while waiting, so other threads can send in the meantime
+    do {
+        if (!iotc_tls_has_pending(&c->net)) {
+            wait_for_socket(c, min_u32(timeout_ms - elapsed_ms, ms_until_keep_alive(c)));
+        }
+        if (!process(c)) {
+            break;
+        }
+        if (c->wake_requested) {
+            c->wake_requested = false;
+            break;
+        }
+        elapsed_ms = iotc_platform_now_ms() - start_ms;
+    } while (elapsed_ms < timeout_ms);
+}
+
+// Opens the TLS connection and the MQTT session with the host and credentials obtained by sync.
+// Returns IOTC_DEVICE_CLIENT_REFUSED if the broker rejected the CONNECT.
+static int connect_session(IotcDeviceClient *c) {
+    TransportInterface_t transport = { 0 };
+    MQTTConnectInfo_t connect_info = { 0 };
+    bool session_present = false;
+    bool resumed = false;
+
+    if (acquire_buffer(c)) {
+        fprintf(stderr, "No room for the MQTT buffer in the work arena\n");
+        return EXIT_FAILURE;
+    }
+    IotcTlsTimer start;
+    iotc_tls_stats_start(&start);
+    if (iotc_tls_connect(&c->tls, &c->net, c->config.host, IOTC_DEVICE_CLIENT_MQTT_PORT,
+        IOTC_DEVICE_CLIENT_CONNACK_TIMEOUT_MS, &resumed)) {
+        iotc_tls_stats_record(IOTC_TLS_MQTT, false, &start);
+        release_buffer(c);
+        return EXIT_FAILURE;
+    }
+    // coreMQTT calls recv once per loop iteration and treats 0 as "no data", so the socket is polled only in the loop
+    c->net.recv_timeout_ms = 0;
+    c->net.send_timeout_ms = IOTC_DEVICE_CLIENT_TRANSPORT_TIMEOUT_MS;
+
+    transport.pNetworkContext = &c->net;
+    transport.send = iotc_tls_send;
+    transport.recv = iotc_tls_recv;
+
+    MQTTStatus_t status = MQTT_Init(&c->mqtt, &transport, iotc_platform_now_ms, on_mqtt_event, &c->buffer);
+    if (MQTTSuccess == status) {
+        connect_info.cleanSession = !c->config.persistent_session;
+        connect_info.keepAliveIntervalSec = IOTC_DEVICE_CLIENT_KEEP_ALIVE_S;
+        connect_info.pClientIdentifier = c->config.client_id;
+        connect_info.clientIdentifierLength = (uint16_t) strlen(c->config.client_id);
+        connect_info.pUserName = c->config.username;
+        connect_info.userNameLength = (uint16_t) strlen(c->config.username);
+        status = MQTT_Connect(&c->mqtt, &connect_info, NULL, IOTC_DEVICE_CLIENT_CONNACK_TIMEOUT_MS, &session_present);
+    }
+    iotc_tls_stats_record(IOTC_TLS_MQTT, MQTTSuccess == status, &start);
+    if (MQTTSuccess != status) {
+        fprintf(stderr, "MQTT connection to %s failed: %s\n", c->config.host, MQTT_Status_strerror(status));
+        iotc_tls_disconnect(&c->net);
+        release_buffer(c);
+        return (MQTTServerRefused == status) ? IOTC_DEVICE_CLIENT_REFUSED : EXIT_FAILURE;
+    }
+    if (resumed) {
+        iotc_tls_stats_record_resumed(IOTC_TLS_MQTT);
+    }
+    c->session_present = c->config.persistent_session && session_present;
+    if (c->session_present) {
+        // MQTT_Init() restarted the IDs at 1. Continue after the last one, which the broker may still hold.
+        c->mqtt.nextPacketId = (uint16_t) (c->last_packet_id + 1U);
+        if (0 == c->mqtt.nextPacketId) {
+            c->mqtt.nextPacketId = 1;
+        }
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = c->net.fd };
+    if (0 != epoll_ctl(c->epoll_fd, EPOLL_CTL_ADD, c->net.fd, &ev)) {
+        fprintf(stderr, "Device client: Failed to add the socket to epoll: %s\n", strerror(errno));
+        close_session(c);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int subscribe(IotcDeviceClient *c) {
+    MQTTSubscribeInfo_t subscription = { 0 };
+    uint32_t start_ms = iotc_platform_now_ms();
+
+    subscription.qos = MQTTQoS1;
+    subscription.pTopicFilter = c->config.sub_topic;
+    subscription.topicFilterLength = (uint16_t) strlen(c->config.sub_topic);
+
+    c->suback_received = false;
+    MQTTStatus_t status = MQTT_Subscribe(&c->mqtt, &subscription, 1, MQTT_GetPacketId(&c->mqtt));
+    uint32_t elapsed_ms = 0;
+    while (MQTTSuccess == status && !c->suback_received && elapsed_ms < IOTC_DEVICE_CLIENT_SUBACK_TIMEOUT_MS) {
+        if (!iotc_tls_has_pending(&c->net)) {
+            wait_for_socket(c, IOTC_DEVICE_CLIENT_SUBACK_TIMEOUT_MS - elapsed_ms);
+        }
+        status = process_loop(c);
+        elapsed_ms = iotc_platform_now_ms() - start_ms;
+    }
+    if (MQTTSuccess != status || !c->suback_received) {
+        fprintf(stderr, "Failed to subscribe to topic %s\n", c->config.sub_topic);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Sets up the SSL context on first use. The credentials do not change for the lifetime of a client.
+static int init_tls(IotcDeviceClient *c, const IotConnectDeviceClientConfig *config) {
+    IotcTlsCredentials credentials = { 0 };
+    if (c->tls.ctx) {
+        return EXIT_SUCCESS;
+    }
+#ifdef IOTC_DEVICE_CLIENT_ROOT_CA
+    credentials.root_ca = IOTC_DEVICE_CLIENT_ROOT_CA;
+#else
+    credentials.root_anchor = iotc_trust_anchor(IOTC_DEVICE_CLIENT_TRUST_ANCHOR);
+#endif
+    if (config->auth) {
+        credentials.trust_store = config->auth->trust_store;
+        if (IOTC_AT_X509 == config->auth->type) {
+            credentials.device_cert = config->auth->data.cert_info.device_cert;
+            credentials.device_key = config->auth->data.cert_info.device_key;
+        }
+    }
+    return iotc_tls_client_init(&c->tls, &credentials) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int bind_channel(IotcDeviceClient *c, const char *topic) {
+    size_t len = strlen(topic);
+    if (0 == len || len + MQTT_PUBLISH_HEADER_OVERHEAD > IOTC_DEVICE_CLIENT_BUFFER_SIZE || strpbrk(topic, "+#")) {
+        fprintf(stderr, "Device client: Invalid publish topic %s\n", topic);
+        return EXIT_FAILURE;
+    }
+    c->channel.topic = topic;
+    c->channel.topic_len = (uint16_t) len;
+    return EXIT_SUCCESS;
+}
+
+static int init(IotcDeviceClient *c, const IotConnectDeviceClientConfig *config) {
+    if (!config->host || !config->client_id || !config->username || !config->pub_topic || !config->sub_topic) {
+        fprintf(stderr, "Device client: Connection parameters are missing.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (c->is_connected) {
+        close_session(c);
+    }
+    if (0 != strcmp(c->tls_host, config->host)) {
+        iotc_tls_client_forget_session(&c->tls); // sessions are only valid with the host that issued them
+        snprintf(c->tls_host, sizeof(c->tls_host), "%s", config->host);
+    }
+    c->channel.topic = NULL;
+    if (bind_channel(c, config->pub_topic)) {
+        return EXIT_FAILURE;
+    }
+    c->config = *config;
+    // Inbound messages and status changes are reported only once connected
+    c->config.c2d_msg_cb = NULL;
+    c->config.status_cb = NULL;
+    c->publish_qos = (config->qos > 0) ? MQTTQoS1 : MQTTQoS0; // QoS 2 is not supported by the broker
+
+    int ret = init_tls(c, config) ? EXIT_FAILURE : connect_session(c);
+    if (ret) {
+        fprintf(stderr, "Failed to connect to MQTT broker.\n");
+        return ret;
+    }
+    printf("Connected to MQTT host %s as %s.\n", c->config.host, c->config.client_id);
+
+    // A resumed session still has the subscription
+    if (!c->session_present && subscribe(c)) {
+        close_session(c);
+        return EXIT_FAILURE;
+    }
+
+    c->is_connected = true;
+    if (c->connection_lost) {
+        c->connection_lost = false;
+        iotc_metrics_add(IOTC_METRIC_RECONNECTS, 1);
+        iotc_metrics_record_since(IOTC_METRIC_RECONNECT_TIME, c->lost_ms);
+    }
+
+    retransmit_inflight(c);
+
+    c->config.c2d_msg_cb = config->c2d_msg_cb;
+    c->config.status_cb = config->status_cb;
+    if (c->config.status_cb) {
+        c->config.status_cb(c->config.cb_ctx, IOTC_CS_MQTT_CONNECTED);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int iotc_device_client_init(IotcDeviceClient *c, const IotConnectDeviceClientConfig *config) {
+    iotc_device_client_lock(c);
+    int ret = init(c, config);
+    iotc_device_client_unlock(c);
+    return ret;
+}
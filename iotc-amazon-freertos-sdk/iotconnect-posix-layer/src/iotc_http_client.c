@@ -0,0 +1,421 @@
+//
+// Copyright: Avnet 2022
+//
+
+// iotc_http_request.h implementation for Linux, on coreHTTP, POSIX sockets and OpenSSL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core_http_client.h"
+
+#include "iotc_platform.h"
+#include "iotc_posix_tls.h"
+#include "iotc_http_request.h"
+#include "iotc_tls_stats.h"
+#include "iotconnect_arena.h"
+
+#ifndef IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS
+#define IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS 5000U
+#endif
+
+#ifndef IOTC_HTTP_CLIENT_USER_BUFFER_SIZE
+#define IOTC_HTTP_CLIENT_USER_BUFFER_SIZE 4096
+#endif
+
+// The buffer comes from the work arena (see iotconnect_arena.h). While MQTT clients hold their buffers, it can be
+// smaller than IOTC_HTTP_CLIENT_USER_BUFFER_SIZE, down to this size. Streamed downloads then use smaller parts.
+#ifndef IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE
+#define IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE 2048
+#endif
+
+#ifndef IOTC_HTTP_CLIENT_MAX_HOST_LEN
+#define IOTC_HTTP_CLIENT_MAX_HOST_LEN 128U
+#endif
+
+// Number of hosts for which a TLS session is kept, so that new connections to them can resume it
+#ifndef IOTC_HTTP_CLIENT_SESSION_HOSTS
+#define IOTC_HTTP_CLIENT_SESSION_HOSTS 4
+#endif
+
+// Room left in the buffer for the response headers when iotconnect_https_stream() sizes its Range requests
+#ifndef IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM
+#define IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM 1024U
+#endif
+
+#if IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE <= IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM
+#error "IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE must leave room for a body after IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM"
+#endif
+
+#define CONNECTION_RETRY_MAX_ATTEMPTS 5U
+#define CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS 5000U
+#define CONNECTION_RETRY_BACKOFF_BASE_MS 500U
+
+// The number of times to try the whole HTTP request
+#ifndef MAX_HTTP_REQUEST_TRIES
+#define MAX_HTTP_REQUEST_TRIES 3
+#endif
+
+#define HTTP_REQUEST_BACKOFF_MS 2000U
+
+// Shared by the request headers and the response. Borrowed from the work arena by the first request while the lock
+// is held, and returned when the lock is released. buffer_len leaves one extra byte for the NUL after the response body.
+static uint8_t *http_buffer = NULL;
+static size_t buffer_len = 0;
+static unsigned int lock_depth = 0;
+
+// SSL contexts and sessions by host. The root CA can differ between hosts, so each host gets its own context.
+static struct {
+    char host[IOTC_HTTP_CLIENT_MAX_HOST_LEN + 1];
+    const char *tls_cert;
+    const IotcTrustAnchor *trust_anchor;
+    uint32_t last_used;
+    IotcTlsClient tls;
+} hosts[IOTC_HTTP_CLIENT_SESSION_HOSTS];
+
+// Serializes requests, which share the buffers above, between clients connecting from different threads
+static IotcMutex lock;
+static pthread_once_t lock_once = PTHREAD_ONCE_INIT;
+
+static void init_lock(void) {
+    iotc_mutex_init(&lock);
+}
+
+void iotconnect_https_lock(void) {
+    pthread_once(&lock_once, init_lock);
+    iotc_mutex_lock(&lock);
+    lock_depth++;
+}
+
+void iotconnect_https_unlock(void) {
+    if (0 == --lock_depth && http_buffer) {
+        // nothing refers to the response anymore
+        iotc_arena_release(&http_buffer);
+        http_buffer = NULL;
+        buffer_len = 0;
+    }
+    iotc_mutex_unlock(&lock);
+}
+
+// Borrows the buffer for the requests made while the lock is held
+static int acquire_buffer(void) {
+    size_t size;
+    if (!http_buffer) {
+        http_buffer = iotc_arena_acquire(IOTC_ARENA_HTTPS, &http_buffer, IOTC_HTTP_CLIENT_MIN_BUFFER_SIZE + 1,
+                                         IOTC_HTTP_CLIENT_USER_BUFFER_SIZE + 1, &size);
+        if (!http_buffer) {
+            fprintf(stderr, "No room for the HTTP buffer in the work arena\n");
+            return EXIT_FAILURE;
+        }
+        buffer_len = size - 1;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Returns the TLS client for the host, evicting the least recently used one if needed
+static IotcTlsClient *get_tls_client(const IotConnectHttpRequest *r) {
+    size_t lru = 0;
+    for (size_t i = 0; i < IOTC_HTTP_CLIENT_SESSION_HOSTS; i++) {
+        if (hosts[i].tls.ctx && 0 == strcmp(hosts[i].host, r->host_name) && hosts[i].tls_cert == r->tls_cert
+            && hosts[i].trust_anchor == r->trust_anchor) {
+            hosts[i].last_used = iotc_platform_now_ms();
+            return &hosts[i].tls;
+        }
+        if (!hosts[i].tls.ctx) {
+            lru = i;
+        } else if (hosts[lru].tls.ctx && (int32_t) (hosts[i].last_used - hosts[lru].last_used) < 0) {
+            lru = i;
+        }
+    }
+
+    IotcTlsCredentials credentials = { .root_ca = r->tls_cert, .root_anchor = r->trust_anchor };
+    iotc_tls_client_free(&hosts[lru].tls);
+    if (iotc_tls_client_init(&hosts[lru].tls, &credentials)) {
+        return NULL;
+    }
+    snprintf(hosts[lru].host, sizeof(hosts[lru].host), "%s", r->host_name);
+    hosts[lru].tls_cert = r->tls_cert;
+    hosts[lru].trust_anchor = r->trust_anchor;
+    hosts[lru].last_used = iotc_platform_now_ms();
+    return &hosts[lru].tls;
+}
+
+static int connect_to_server(NetworkContext_t *net, IotConnectHttpRequest *r) {
+    bool resumed = false;
+    IotcTlsClient *tls = get_tls_client(r);
+    if (!tls) {
+        return EXIT_FAILURE;
+    }
+
+    printf("Establishing a TLS session with %s.\n", r->host_name);
+    IotcTlsTimer start;
+    iotc_tls_stats_start(&start);
+    int ret = iotc_tls_connect(tls, net, r->host_name, 443, IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS, &resumed);
+    iotc_tls_stats_record(IOTC_TLS_HTTPS, 0 == ret, &start);
+    if (ret) {
+        return EXIT_FAILURE;
+    }
+    if (resumed) {
+        iotc_tls_stats_record_resumed(IOTC_TLS_HTTPS);
+    }
+    net->send_timeout_ms = IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS;
+    net->recv_timeout_ms = IOTC_HTTP_CLIENT_SEND_RECV_TIMEOUT_MS;
+    return EXIT_SUCCESS;
+}
+
+// Retries with exponential backoff and jitter
+static int connect_with_backoff(NetworkContext_t *net, IotConnectHttpRequest *r) {
+    uint32_t backoff_ms = CONNECTION_RETRY_BACKOFF_BASE_MS;
+    for (unsigned int attempt = 1; ; attempt++) {
+        if (EXIT_SUCCESS == connect_to_server(net, r)) {
+            return EXIT_SUCCESS;
+        }
+        if (attempt >= CONNECTION_RETRY_MAX_ATTEMPTS) {
+            fprintf(stderr, "All retry attempts have exhausted. Operation will not be retried\n");
+            return EXIT_FAILURE;
+        }
+        uint32_t delay_ms = (uint32_t) rand() % (backoff_ms + 1);
+        fprintf(stderr, "Connection to the HTTP server failed. Retry attempt %u out of %u in %lu ms.\n",
+            attempt, CONNECTION_RETRY_MAX_ATTEMPTS - 1, (unsigned long) delay_ms);
+        iotc_platform_sleep_ms(delay_ms);
+        backoff_ms = (backoff_ms * 2 > CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS) ? CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS : backoff_ms * 2;
+    }
+}
+
+typedef enum {
+    PART_OK,
+    PART_RETRY, // the request failed, but can be sent again
+    PART_FAILED
+} PartResult;
+
+// Sends the request and receives the response into http_buffer. With range_start < 0, no Range header is sent.
+// keep_open receives whether the server allows the connection to stay open after the response.
+static int send_request(NetworkContext_t *net, IotConnectHttpRequest *r, bool keep_alive, int32_t range_start,
+                        int32_t range_end, HTTPResponse_t *response, bool *keep_open) {
+    TransportInterface_t transport = { 0 };
+    HTTPRequestHeaders_t request_headers = { 0 };
+    HTTPRequestInfo_t request_info = { 0 };
+
+    transport.pNetworkContext = net;
+    transport.send = iotc_tls_send;
+    transport.recv = iotc_tls_recv;
+
+    request_info.pHost = r->host_name;
+    request_info.hostLen = strlen(r->host_name);
+    request_info.pMethod = r->payload ? HTTP_METHOD_POST : HTTP_METHOD_GET;
+    request_info.methodLen = strlen(request_info.pMethod);
+    request_info.pPath = r->resource;
+    request_info.pathLen = strlen(r->resource);
+    request_info.reqFlags = keep_alive ? HTTP_REQUEST_KEEP_ALIVE_FLAG : 0U;
+
+    request_headers.pBuffer = http_buffer;
+    request_headers.bufferLen = buffer_len;
+
+    memset(response, 0, sizeof(*response));
+    response->pBuffer = http_buffer;
+    response->bufferLen = buffer_len;
+    response->getTime = iotc_platform_now_ms;
+
+    HTTPStatus_t status = HTTPClient_InitializeRequestHeaders(&request_headers, &request_info);
+    if (HTTPSuccess == status) {
+        status = HTTPClient_AddHeader(&request_headers, "Content-Type", strlen("Content-Type"),
+            "application/json", strlen("application/json"));
+    }
+    if (HTTPSuccess == status && range_start >= 0) {
+        status = HTTPClient_AddRangeHeader(&request_headers, range_start, range_end);
+    }
+    if (HTTPSuccess != status) {
+        fprintf(stderr, "Failed to initialize HTTP request headers: Error=%s.\n", HTTPClient_strerror(status));
+        return EXIT_FAILURE;
+    }
+
+    status = HTTPClient_Send(&transport, &request_headers, (const uint8_t *) r->payload,
+        r->payload ? strlen(r->payload) : 0, response, 0);
+    if (HTTPSuccess != status) {
+        fprintf(stderr, "Failed to send HTTP request to %s%s: Error=%s.\n", r->host_name, r->resource,
+            HTTPClient_strerror(status));
+        return EXIT_FAILURE;
+    }
+
+    *keep_open = keep_alive && (0U == (response->respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG));
+    return EXIT_SUCCESS;
+}
+
+static int client_request(NetworkContext_t *net, IotConnectHttpRequest *r) {
+    HTTPResponse_t response;
+    bool keep_open = false;
+
+    if (send_request(net, r, false, -1, 0, &response, &keep_open)) {
+        return EXIT_FAILURE;
+    }
+    r->response = (char *) response.pBody;
+    r->response[response.bodyLen] = 0; // the buffer has room for it
+    if (200 != response.statusCode) {
+        fprintf(stderr, "Received an invalid response from the server Result: %u.\n", (unsigned) response.statusCode);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int request_over_connection(NetworkContext_t *net, IotConnectHttpRequest *r) {
+    int ret = client_request(net, r);
+    iotc_tls_disconnect(net);
+    return ret;
+}
+
+static int https_request(IotConnectHttpRequest *r) {
+    NetworkContext_t net = { .fd = -1 };
+    r->response = NULL;
+    if (acquire_buffer()) {
+        return EXIT_FAILURE;
+    }
+
+    for (int tries = 0; ; tries++) {
+        if (EXIT_SUCCESS == connect_with_backoff(&net, r)) {
+            return request_over_connection(&net, r);
+        }
+        fprintf(stderr, "Failed to connect to HTTP server %s. Tries so far %d...\n", r->host_name, tries);
+        if (tries >= MAX_HTTP_REQUEST_TRIES) {
+            fprintf(stderr, "All %d HTTP request iterations failed.\n", MAX_HTTP_REQUEST_TRIES);
+            return EXIT_FAILURE;
+        }
+        iotc_platform_sleep_ms(HTTP_REQUEST_BACKOFF_MS);
+    }
+}
+
+int iotconnect_https_request(IotConnectHttpRequest *request) {
+    iotconnect_https_lock();
+    int ret = https_request(request);
+    iotconnect_https_unlock();
+    return ret;
+}
+
+// Parses the Content-Range header: "bytes <first>-<last>/<total>". total is 0 if the server sent "*".
+static bool parse_content_range(const HTTPResponse_t *response, size_t *first, size_t *total) {
+    const char *value;
+    size_t value_len;
+    char buf[64];
+    char *p;
+
+    if (HTTPSuccess != HTTPClient_ReadHeader(response, "Content-Range", strlen("Content-Range"), &value, &value_len)
+        || value_len >= sizeof(buf) || value_len < 6 || 0 != strncmp(value, "bytes ", 6)) {
+        return false;
+    }
+    memcpy(buf, value, value_len);
+    buf[value_len] = 0;
+    *first = strtoul(buf + 6, &p, 10);
+    if ('-' != *p || NULL == (p = strchr(p, '/'))) {
+        return false;
+    }
+    *total = ('*' == p[1]) ? 0 : strtoul(p + 1, NULL, 10);
+    return true;
+}
+
+// Gets the part of the stream that starts at *pos and passes it to the callback. done is set at the end of the stream.
+static PartResult stream_part(NetworkContext_t *net, IotConnectHttpRequest *r, IotConnectHttpStream *s,
+                              size_t part_size, size_t *pos, bool *done, bool *keep_open) {
+    HTTPResponse_t response;
+    size_t last = *pos + part_size - 1;
+    if (s->length && last > s->offset + s->length - 1) {
+        last = s->offset + s->length - 1;
+    }
+
+    if (send_request(net, r, true, (int32_t) *pos, (int32_t) last, &response, keep_open)) {
+        return PART_RETRY;
+    }
+
+    const uint8_t *data = response.pBody;
+    size_t len = response.bodyLen;
+    size_t first = 0;
+    size_t total = 0;
+    if (206 == response.statusCode) {
+        if (!parse_content_range(&response, &first, &total) || first != *pos || len > last - *pos + 1) {
+            fprintf(stderr, "Invalid Content-Range in the response from %s%s.\n", r->host_name, r->resource);
+            return PART_FAILED;
+        }
+    } else if (200 == response.statusCode) {
+        // The server ignored the Range header and sent the whole resource, which happened to fit into the buffer
+        total = len;
+        if (*pos > len) {
+            return PART_FAILED;
+        }
+        data += *pos;
+        len = ((last + 1 < total) ? last + 1 : total) - *pos;
+        *done = true;
+    } else {
+        fprintf(stderr, "Received an invalid response from the server Result: %u.\n", (unsigned) response.statusCode);
+        return (response.statusCode >= 500) ? PART_RETRY : PART_FAILED;
+    }
+    s->total_size = total;
+
+    if (len > 0 && !s->chunk_cb(s->cb_ctx, *pos, data, len)) {
+        fprintf(stderr, "Download of %s%s stopped at %lu.\n", r->host_name, r->resource, (unsigned long) *pos);
+        return PART_FAILED;
+    }
+    *pos += len;
+    // Without a total size, a short part marks the end
+    if (len < last - first + 1 || (total && *pos >= total) || (s->length && *pos >= s->offset + s->length)) {
+        *done = true;
+    }
+    return PART_OK;
+}
+
+static int https_stream(IotConnectHttpRequest *r, IotConnectHttpStream *s) {
+    size_t pos = s->offset;
+    bool done = false;
+    int tries = 0;
+
+    if (r->payload || !s->chunk_cb || s->offset > INT32_MAX || s->length > (size_t) INT32_MAX - s->offset) {
+        fprintf(stderr, "Invalid stream request for %s%s.\n", r->host_name, r->resource);
+        return EXIT_FAILURE;
+    }
+    if (acquire_buffer()) {
+        return EXIT_FAILURE;
+    }
+    size_t part_size = buffer_len - IOTC_HTTP_CLIENT_STREAM_HEADER_ROOM;
+    if (s->chunk_size > 0 && s->chunk_size < part_size) {
+        part_size = s->chunk_size;
+    }
+    r->response = NULL;
+    s->total_size = 0;
+
+    NetworkContext_t net = { .fd = -1 };
+    bool is_open = false;
+    while (!done) {
+        bool keep_open = false;
+
+        if (is_open) {
+            iotc_tls_stats_record_reuse(IOTC_TLS_HTTPS);
+        } else if (connect_with_backoff(&net, r)) {
+            return EXIT_FAILURE;
+        }
+        PartResult result = stream_part(&net, r, s, part_size, &pos, &done, &keep_open);
+        // The parts go over one connection where the server allows it
+        is_open = PART_OK == result && keep_open && !done;
+        if (!is_open) {
+            iotc_tls_disconnect(&net);
+        }
+        if (PART_FAILED == result) {
+            return EXIT_FAILURE;
+        }
+        if (PART_RETRY == result) {
+            if (++tries > MAX_HTTP_REQUEST_TRIES) {
+                fprintf(stderr, "All %d HTTP request iterations failed.\n", MAX_HTTP_REQUEST_TRIES);
+                return EXIT_FAILURE;
+            }
+            fprintf(stderr, "Resuming %s%s at %lu.\n", r->host_name, r->resource, (unsigned long) pos);
+            iotc_platform_sleep_ms(HTTP_REQUEST_BACKOFF_MS);
+        } else {
+            tries = 0;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int iotconnect_https_stream(IotConnectHttpRequest *request, IotConnectHttpStream *stream) {
+    iotconnect_https_lock();
+    int ret = https_stream(request, stream);
+    iotconnect_https_unlock();
+    return ret;
+}
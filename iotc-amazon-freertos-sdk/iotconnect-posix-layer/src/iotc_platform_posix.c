@@ -0,0 +1,212 @@
+//
+// Copyright: Avnet 2022
+//
+
+#define _GNU_SOURCE // for pthread_setname_np()
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+
+#include "iotc_platform.h"
+
+// Critical sections only guard a few counters, so a single mutex for the whole process is enough
+static pthread_mutex_t critical_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000U + (uint64_t) ts.tv_nsec / 1000000U;
+}
+
+uint32_t iotc_platform_now_ms(void) {
+    return (uint32_t) monotonic_ms();
+}
+
+void iotc_platform_sleep_ms(uint32_t ms) {
+    struct timespec ts = { .tv_sec = ms / 1000U, .tv_nsec = (long) (ms % 1000U) * 1000000L };
+    while (0 != nanosleep(&ts, &ts) && EINTR == errno) {
+    }
+}
+
+uint32_t iotc_platform_random(void) {
+    uint32_t value;
+    if ((ssize_t) sizeof(value) != getrandom(&value, sizeof(value), GRND_NONBLOCK)) {
+        value = (uint32_t) rand();
+    }
+    return value;
+}
+
+void iotc_platform_enter_critical(void) {
+    pthread_mutex_lock(&critical_mutex);
+}
+
+void iotc_platform_exit_critical(void) {
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+void iotc_mutex_init(IotcMutex *m) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&m->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void iotc_mutex_destroy(IotcMutex *m) {
+    pthread_mutex_destroy(&m->mutex);
+}
+
+void iotc_mutex_lock(IotcMutex *m) {
+    pthread_mutex_lock(&m->mutex);
+}
+
+void iotc_mutex_unlock(IotcMutex *m) {
+    pthread_mutex_unlock(&m->mutex);
+}
+
+void iotc_queue_init(IotcQueue *q, uint8_t *items, size_t capacity) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // timeouts are not affected by wall clock changes
+    pthread_cond_init(&q->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&q->mutex, NULL);
+    q->items = items;
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+}
+
+bool iotc_queue_send(IotcQueue *q, uint8_t value) {
+    bool ret = false;
+    pthread_mutex_lock(&q->mutex);
+    if (q->count < q->capacity) {
+        q->items[(q->head + q->count) % q->capacity] = value;
+        q->count++;
+        ret = true;
+        pthread_cond_signal(&q->cond);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return ret;
+}
+
+bool iotc_queue_receive(IotcQueue *q, uint8_t *value, uint32_t timeout_ms) {
+    struct timespec deadline;
+    if (IOTC_WAIT_FOREVER != timeout_ms) {
+        uint64_t ms = monotonic_ms() + timeout_ms;
+        deadline.tv_sec = (time_t) (ms / 1000U);
+        deadline.tv_nsec = (long) (ms % 1000U) * 1000000L;
+    }
+
+    pthread_mutex_lock(&q->mutex);
+    while (0 == q->count && 0 != timeout_ms) {
+        if (IOTC_WAIT_FOREVER == timeout_ms) {
+            pthread_cond_wait(&q->cond, &q->mutex);
+        } else if (ETIMEDOUT == pthread_cond_timedwait(&q->cond, &q->mutex, &deadline)) {
+            break;
+        }
+    }
+    bool ret = q->count > 0;
+    if (ret) {
+        *value = q->items[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return ret;
+}
+
+size_t iotc_queue_count(IotcQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    size_t count = q->count;
+    pthread_mutex_unlock(&q->mutex);
+    return count;
+}
+
+static void *task_entry(void *arg) {
+    IotcTask *t = (IotcTask *) arg;
+    t->fn(t->arg);
+    return NULL;
+}
+
+// Stacks are sized for FreeRTOS, which is too small for glibc and OpenSSL, so threads get the default stack instead.
+// Threads are not given priorities, as that needs privileges on most systems.
+int iotc_task_create(IotcTask *t, const char *name, void (*fn)(void *arg), void *arg, void *stack, size_t stack_size,
+                     unsigned int priority) {
+    pthread_attr_t attr;
+    (void) stack;
+    (void) stack_size;
+    (void) priority;
+
+    t->fn = fn;
+    t->arg = arg;
+    t->started = true; // before the thread runs, so that it sees itself as current
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int ret = pthread_create(&t->thread, &attr, task_entry, t);
+    pthread_attr_destroy(&attr);
+    if (0 != ret) {
+        fprintf(stderr, "Failed to create thread %s: %s\n", name, strerror(ret));
+        t->started = false;
+        return -1;
+    }
+#ifdef __linux__
+    char short_name[16]; // the kernel limit, including the NUL
+    snprintf(short_name, sizeof(short_name), "%s", name);
+    (void) pthread_setname_np(t->thread, short_name);
+#endif
+    return 0;
+}
+
+bool iotc_task_is_current(const IotcTask *t) {
+    return t->started && pthread_equal(pthread_self(), t->thread);
+}
+
+// glibc has no call for the free stack of a thread, and the stacks are not sized by the SDK anyway
+size_t iotc_task_get_stack_free(const IotcTask *t) {
+    (void) t;
+    return 0;
+}
+
+void *iotc_platform_malloc(size_t size) {
+    return malloc(size);
+}
+
+void iotc_platform_free(void *ptr) {
+    free(ptr);
+}
+
+size_t iotc_platform_heap_in_use(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// The allocator does not track its peak, so this is the most seen by the calls so far
+size_t iotc_platform_heap_high_water(void) {
+    static size_t high_water = 0;
+    size_t in_use = iotc_platform_heap_in_use();
+    pthread_mutex_lock(&critical_mutex);
+    if (in_use > high_water) {
+        high_water = in_use;
+    }
+    size_t ret = high_water;
+    pthread_mutex_unlock(&critical_mutex);
+    return ret;
+}
+
+uint32_t iotc_platform_cpu_us(void) {
+    struct timespec ts;
+    if (0 != clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+        return 0;
+    }
+    return (uint32_t) ((uint64_t) ts.tv_sec * 1000000U + (uint64_t) ts.tv_nsec / 1000U);
+}
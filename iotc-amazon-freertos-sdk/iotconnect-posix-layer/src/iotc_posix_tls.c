@@ -0,0 +1,390 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include "iotc_platform.h"
+#include "iotc_posix_tls.h"
+#include "iotc_tls_stats.h"
+
+typedef struct {
+    char host[128];
+    uint16_t port;
+    char address[64];
+    uint16_t to_port;
+    X509_STORE *store; // NULL to verify with the client's credentials
+} ConnectTo;
+
+static ConnectTo connect_to[IOTC_TLS_CONNECT_TO_MAX];
+static size_t connect_to_count = 0;
+
+// A store for each trust anchor, shared by the SSL contexts of all clients that trust it
+static X509_STORE *anchor_stores[IOTC_TRUST_ANCHOR_COUNT];
+static pthread_once_t anchor_stores_once = PTHREAD_ONCE_INIT;
+
+static void print_ssl_error(const char *what) {
+    unsigned long err = ERR_get_error();
+    char buf[256];
+    ERR_error_string_n(err, buf, sizeof(buf));
+    fprintf(stderr, "TLS: %s: %s\n", what, err ? buf : "unknown error");
+    ERR_clear_error();
+}
+
+// Writing to a socket that the peer has closed raises SIGPIPE, which terminates the process by default.
+// Errors are handled where they are returned, so the signal is ignored unless the application handles it.
+static void ignore_sigpipe(void) {
+    struct sigaction sa;
+    if (0 == sigaction(SIGPIPE, NULL, &sa) && SIG_DFL == sa.sa_handler) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+}
+
+// OpenSSL passes new sessions here. With TLS 1.3, tickets arrive after the handshake, so this is the
+// only reliable way to get a resumable session.
+static int on_new_session(SSL *ssl, SSL_SESSION *session) {
+    IotcTlsClient *client = (IotcTlsClient *) SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    if (client->session) {
+        SSL_SESSION_free(client->session);
+    }
+    client->session = session;
+    return 1; // we keep the reference
+}
+
+static int load_root_ca(SSL_CTX *ctx, const char *pem) {
+    X509_STORE *store = SSL_CTX_get_cert_store(ctx);
+    BIO *bio = BIO_new_mem_buf(pem, -1);
+    X509 *cert;
+    int count = 0;
+    if (!bio) {
+        return -1;
+    }
+    while (NULL != (cert = PEM_read_bio_X509(bio, NULL, NULL, NULL))) {
+        if (X509_STORE_add_cert(store, cert)) {
+            count++;
+        }
+        X509_free(cert);
+    }
+    ERR_clear_error(); // end of data is reported as an error
+    BIO_free(bio);
+    return count > 0 ? 0 : -1;
+}
+
+// Parses all anchors, which are few and small, so that the parse is measured once and never repeated
+static void parse_anchors(void) {
+    unsigned long count = 0;
+    size_t heap_start = iotc_platform_heap_in_use();
+    uint32_t cpu_start = iotc_platform_cpu_us();
+
+    for (int i = 0; i < IOTC_TRUST_ANCHOR_COUNT; i++) {
+        const IotcTrustAnchor *anchor = iotc_trust_anchor((IotcTrustAnchorId) i);
+        const unsigned char *der = anchor->der;
+        X509 *cert = d2i_X509(NULL, &der, (long) anchor->der_len);
+        X509_STORE *store = X509_STORE_new();
+        if (!cert || !store || 1 != X509_STORE_add_cert(store, cert)) {
+            print_ssl_error(anchor->name);
+            X509_STORE_free(store);
+        } else {
+            // Some anchors are intermediates, which mbedTLS on the devices trusts as they are
+            X509_STORE_set_flags(store, X509_V_FLAG_PARTIAL_CHAIN);
+            anchor_stores[i] = store;
+            count++;
+        }
+        X509_free(cert);
+    }
+
+    size_t heap_end = iotc_platform_heap_in_use();
+    iotc_tls_stats_record_trust_store(count, iotc_platform_cpu_us() - cpu_start,
+                                      heap_end > heap_start ? heap_end - heap_start : 0);
+}
+
+static int use_anchor(SSL_CTX *ctx, const IotcTrustAnchor *anchor) {
+    pthread_once(&anchor_stores_once, parse_anchors);
+    if ((unsigned) anchor->id >= IOTC_TRUST_ANCHOR_COUNT || !anchor_stores[anchor->id]) {
+        return -1;
+    }
+    // The context takes a reference, so the store outlives all of them
+    SSL_CTX_set1_cert_store(ctx, anchor_stores[anchor->id]);
+    return 0;
+}
+
+int iotc_tls_client_init(IotcTlsClient *client, const IotcTlsCredentials *credentials) {
+    memset(client, 0, sizeof(*client));
+    ignore_sigpipe();
+
+    client->ctx = SSL_CTX_new(TLS_client_method());
+    if (!client->ctx) {
+        print_ssl_error("Failed to create the context");
+        return -1;
+    }
+    SSL_CTX_set_min_proto_version(client->ctx, TLS1_2_VERSION);
+    SSL_CTX_set_verify(client->ctx, SSL_VERIFY_PEER, NULL);
+    SSL_CTX_set_app_data(client->ctx, client);
+    SSL_CTX_set_session_cache_mode(client->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(client->ctx, on_new_session);
+
+    if (credentials->trust_store) {
+        if (1 != SSL_CTX_load_verify_locations(client->ctx, credentials->trust_store, NULL)) {
+            print_ssl_error("Failed to load the trust store");
+            goto fail;
+        }
+    } else if (credentials->root_anchor) {
+        if (use_anchor(client->ctx, credentials->root_anchor)) {
+            fprintf(stderr, "TLS: Trust anchor %s is not available\n", credentials->root_anchor->name);
+            goto fail;
+        }
+    } else if (!credentials->root_ca || load_root_ca(client->ctx, credentials->root_ca)) {
+        print_ssl_error("Failed to load the root CA");
+        goto fail;
+    }
+
+    if (credentials->device_cert
+        && 1 != SSL_CTX_use_certificate_chain_file(client->ctx, credentials->device_cert)) {
+        print_ssl_error("Failed to load the device certificate");
+        goto fail;
+    }
+    if (credentials->device_key
+        && 1 != SSL_CTX_use_PrivateKey_file(client->ctx, credentials->device_key, SSL_FILETYPE_PEM)) {
+        print_ssl_error("Failed to load the device key");
+        goto fail;
+    }
+    return 0;
+
+    fail:
+    iotc_tls_client_free(client);
+    return -1;
+}
+
+void iotc_tls_client_free(IotcTlsClient *client) {
+    iotc_tls_client_forget_session(client);
+    if (client->ctx) {
+        SSL_CTX_free(client->ctx);
+        client->ctx = NULL;
+    }
+}
+
+void iotc_tls_client_forget_session(IotcTlsClient *client) {
+    if (client->session) {
+        SSL_SESSION_free(client->session);
+        client->session = NULL;
+    }
+}
+
+// Returns 1 if the socket is ready, 0 on timeout, -1 on error
+static int wait_socket(int fd, short events, uint32_t timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = events };
+    uint32_t start_ms = iotc_platform_now_ms();
+    for (;;) {
+        uint32_t elapsed_ms = iotc_platform_now_ms() - start_ms;
+        int wait_ms = (elapsed_ms >= timeout_ms) ? 0 : (int) (timeout_ms - elapsed_ms);
+        int ret = poll(&pfd, 1, wait_ms);
+        if (ret >= 0) {
+            return ret > 0 ? 1 : 0;
+        }
+        if (EINTR != errno) {
+            return -1;
+        }
+    }
+}
+
+static int connect_socket(const char *host, uint16_t port, uint32_t timeout_ms) {
+    struct addrinfo hints = { 0 };
+    struct addrinfo *results;
+    char port_str[6];
+    int fd = -1;
+
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, sizeof(port_str), "%u", (unsigned) port);
+    int ret = getaddrinfo(host, port_str, &hints, &results);
+    if (0 != ret) {
+        fprintf(stderr, "TLS: Failed to resolve %s: %s\n", host, gai_strerror(ret));
+        return -1;
+    }
+
+    for (struct addrinfo *ai = results; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        if (0 == connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+            break;
+        }
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (EINPROGRESS == errno && 1 == wait_socket(fd, POLLOUT, timeout_ms)
+            && 0 == getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) && 0 == err) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(results);
+    if (fd < 0) {
+        fprintf(stderr, "TLS: Failed to connect to %s:%u\n", host, (unsigned) port);
+    }
+    return fd;
+}
+
+int iotc_tls_add_connect_to(const char *host, uint16_t port, const char *address, uint16_t to_port, const char *ca_file) {
+    if (connect_to_count >= IOTC_TLS_CONNECT_TO_MAX) {
+        fprintf(stderr, "TLS: Too many connect-to entries. Increase IOTC_TLS_CONNECT_TO_MAX.\n");
+        return -1;
+    }
+    ConnectTo *entry = &connect_to[connect_to_count];
+    memset(entry, 0, sizeof(*entry));
+    if (strlen(host) >= sizeof(entry->host) || strlen(address) >= sizeof(entry->address)) {
+        fprintf(stderr, "TLS: Connect-to host or address is too long\n");
+        return -1;
+    }
+    strcpy(entry->host, host);
+    strcpy(entry->address, address);
+    entry->port = port;
+    entry->to_port = to_port;
+    if (ca_file) {
+        entry->store = X509_STORE_new();
+        if (!entry->store || 1 != X509_STORE_load_locations(entry->store, ca_file, NULL)) {
+            print_ssl_error("Failed to load the connect-to CA file");
+            X509_STORE_free(entry->store);
+            entry->store = NULL;
+            return -1;
+        }
+    }
+    connect_to_count++;
+    return 0;
+}
+
+static const ConnectTo *find_connect_to(const char *host, uint16_t port) {
+    for (size_t i = 0; i < connect_to_count; i++) {
+        if (port == connect_to[i].port && 0 == strcmp(host, connect_to[i].host)) {
+            return &connect_to[i];
+        }
+    }
+    return NULL;
+}
+
+int iotc_tls_connect(IotcTlsClient *client, NetworkContext_t *net, const char *host, uint16_t port,
+                     uint32_t timeout_ms, bool *resumed) {
+    uint32_t start_ms = iotc_platform_now_ms();
+    const ConnectTo *redirect = find_connect_to(host, port);
+    *resumed = false;
+    net->ssl = NULL;
+    if (redirect) {
+        net->fd = connect_socket(redirect->address, redirect->to_port, timeout_ms);
+    } else {
+        net->fd = connect_socket(host, port, timeout_ms);
+    }
+    if (net->fd < 0) {
+        return -1;
+    }
+
+    net->ssl = SSL_new(client->ctx);
+    if (!net->ssl || 1 != SSL_set_fd(net->ssl, net->fd)
+        || 1 != SSL_set_tlsext_host_name(net->ssl, host)
+        || 1 != SSL_set1_host(net->ssl, host)
+        || (redirect && redirect->store && 1 != SSL_set1_verify_cert_store(net->ssl, redirect->store))) {
+        print_ssl_error("Failed to set up the connection");
+        iotc_tls_disconnect(net);
+        return -1;
+    }
+    if (client->session) {
+        (void) SSL_set_session(net->ssl, client->session);
+    }
+
+    for (;;) {
+        int ret = SSL_connect(net->ssl);
+        if (1 == ret) {
+            break;
+        }
+        int err = SSL_get_error(net->ssl, ret);
+        uint32_t elapsed_ms = iotc_platform_now_ms() - start_ms;
+        if ((SSL_ERROR_WANT_READ != err && SSL_ERROR_WANT_WRITE != err) || elapsed_ms >= timeout_ms
+            || 1 != wait_socket(net->fd, (SSL_ERROR_WANT_READ == err) ? POLLIN : POLLOUT, timeout_ms - elapsed_ms)) {
+            long verify = SSL_get_verify_result(net->ssl);
+            if (X509_V_OK != verify) {
+                fprintf(stderr, "TLS: Certificate verification for %s failed: %s\n", host,
+                    X509_verify_cert_error_string(verify));
+            } else {
+                print_ssl_error("Handshake failed");
+            }
+            // the session may be the reason, for example if the server was reconfigured
+            iotc_tls_client_forget_session(client);
+            iotc_tls_disconnect(net);
+            return -1;
+        }
+    }
+    *resumed = (1 == SSL_session_reused(net->ssl));
+    return 0;
+}
+
+void iotc_tls_disconnect(NetworkContext_t *net) {
+    if (net->ssl) {
+        (void) SSL_shutdown(net->ssl); // best effort. The socket is non-blocking, so this does not wait for the peer.
+        SSL_free(net->ssl);
+        net->ssl = NULL;
+    }
+    if (net->fd >= 0) {
+        close(net->fd);
+        net->fd = -1;
+    }
+}
+
+// Waits for the socket according to the SSL error. Returns 1 to retry, 0 on timeout, -1 on error.
+static int wait_for_retry(NetworkContext_t *net, int ret, uint32_t timeout_ms) {
+    switch (SSL_get_error(net->ssl, ret)) {
+        case SSL_ERROR_WANT_READ:
+            return (0 == timeout_ms) ? 0 : wait_socket(net->fd, POLLIN, timeout_ms);
+        case SSL_ERROR_WANT_WRITE:
+            return (0 == timeout_ms) ? 0 : wait_socket(net->fd, POLLOUT, timeout_ms);
+        default:
+            ERR_clear_error();
+            return -1; // includes the peer closing the connection
+    }
+}
+
+int32_t iotc_tls_send(NetworkContext_t *net, const void *buffer, size_t bytes) {
+    int len = (bytes > INT_MAX) ? INT_MAX : (int) bytes;
+    for (;;) {
+        int ret = SSL_write(net->ssl, buffer, len);
+        if (ret > 0) {
+            return ret;
+        }
+        ret = wait_for_retry(net, ret, net->send_timeout_ms);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+}
+
+int32_t iotc_tls_recv(NetworkContext_t *net, void *buffer, size_t bytes) {
+    int len = (bytes > INT_MAX) ? INT_MAX : (int) bytes;
+    for (;;) {
+        int ret = SSL_read(net->ssl, buffer, len);
+        if (ret > 0) {
+            return ret;
+        }
+        ret = wait_for_retry(net, ret, net->recv_timeout_ms);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+}
+
+bool iotc_tls_has_pending(NetworkContext_t *net) {
+    return net->ssl && SSL_pending(net->ssl) > 0;
+}
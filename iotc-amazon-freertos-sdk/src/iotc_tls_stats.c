@@ -0,0 +1,84 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+
+#include "iotc_platform.h"
+#include "iotc_tls_stats.h"
+
+static const char *target_names[IOTC_TLS_TARGET_COUNT] = { "MQTT", "HTTPS" };
+
+static IotcTlsStats stats[IOTC_TLS_TARGET_COUNT];
+
+static IotcTrustStoreStats trust_store_stats;
+
+uint32_t iotc_tls_stats_now_ms(void) {
+    return iotc_platform_now_ms();
+}
+
+void iotc_tls_stats_start(IotcTlsTimer *timer) {
+    timer->ms = iotc_tls_stats_now_ms();
+    timer->cpu_us = iotc_platform_cpu_us();
+}
+
+void iotc_tls_stats_record(IotcTlsTarget target, bool success, const IotcTlsTimer *start) {
+    uint32_t elapsed_ms = iotc_tls_stats_now_ms() - start->ms;
+    uint32_t cpu_us = iotc_platform_cpu_us() - start->cpu_us;
+    IotcTlsStats *s = &stats[target];
+
+    iotc_platform_enter_critical();
+    if (success) {
+        s->handshakes++;
+        s->last_ms = elapsed_ms;
+        s->total_ms += elapsed_ms;
+        s->last_cpu_us = cpu_us;
+        s->total_cpu_us += cpu_us;
+        if (elapsed_ms > s->max_ms) {
+            s->max_ms = elapsed_ms;
+        }
+    } else {
+        s->failures++;
+    }
+    iotc_platform_exit_critical();
+
+    if (success) {
+        printf("%s TLS connection established in %lu ms, %lu us CPU (handshakes: %lu, reused: %lu).\n",
+            target_names[target], (unsigned long) elapsed_ms, (unsigned long) cpu_us, s->handshakes, s->reused);
+    }
+}
+
+void iotc_tls_stats_record_reuse(IotcTlsTarget target) {
+    iotc_platform_enter_critical();
+    stats[target].reused++;
+    iotc_platform_exit_critical();
+}
+
+void iotc_tls_stats_record_resumed(IotcTlsTarget target) {
+    iotc_platform_enter_critical();
+    stats[target].resumed++;
+    iotc_platform_exit_critical();
+}
+
+void iotc_tls_stats_get(IotcTlsTarget target, IotcTlsStats *out) {
+    iotc_platform_enter_critical();
+    *out = stats[target];
+    iotc_platform_exit_critical();
+}
+
+void iotc_tls_stats_record_trust_store(unsigned long anchors, uint32_t parse_cpu_us, size_t parse_heap) {
+    iotc_platform_enter_critical();
+    trust_store_stats.anchors = anchors;
+    trust_store_stats.parse_cpu_us = parse_cpu_us;
+    trust_store_stats.parse_heap = parse_heap;
+    iotc_platform_exit_critical();
+
+    printf("Trust store: %lu certificates parsed in %lu us CPU, %lu bytes of heap.\n",
+        anchors, (unsigned long) parse_cpu_us, (unsigned long) parse_heap);
+}
+
+void iotc_tls_stats_get_trust_store(IotcTrustStoreStats *out) {
+    iotc_platform_enter_critical();
+    *out = trust_store_stats;
+    iotc_platform_exit_critical();
+}
@@ -29,31 +29,129 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "aws_demo.h"
-
-/* Kernel includes. */
-#include "FreeRTOS.h"
-#include "task.h"
-
-/* shadow demo helpers header. */
-#include "mqtt_demo_helpers.h"
-
-/* Transport interface implementation include header for TLS. */
-#include "transport_secure_sockets.h"
-
-#include "transport_interface.h"
-
 //
 // Copyright: Avnet, Softweb Inc. 2021
 // Modified by Nik Markovic <nikola.markovic@avnet.com> on 6/24/21.
 //
 
+#include "iotc_platform.h"
 #include "iotc_device_client.h"
+#include "iotconnect_alloc.h"
 #include "iotconnect_sync.h"
+#include "iotconnect_telemetry_stream.h"
+#include "iotconnect_async.h"
+#include "iotconnect_command.h"
+#include "iotconnect_metrics.h"
 #include "iotconnect.h"
 
-static IotclConfig lib_config = { 0 };
-static IotConnectClientConfig config = { 0 };
+#ifndef IOTCONNECT_SDK_TX_BUFFER_SIZE
+#define IOTCONNECT_SDK_TX_BUFFER_SIZE 768
+#endif
+
+// Upper limit for the batch packet size. The packet, the topic and the MQTT header must fit into the MQTT buffer.
+#ifndef IOTCONNECT_BATCH_MAX_BYTES
+#define IOTCONNECT_BATCH_MAX_BYTES 768
+#endif
+
+#if IOTCONNECT_BATCH_MAX_BYTES > IOTC_DEVICE_CLIENT_BUFFER_SIZE
+#error "IOTCONNECT_BATCH_MAX_BYTES must not exceed IOTC_DEVICE_CLIENT_BUFFER_SIZE"
+#endif
+
+// Maximum size of a message that can be stored in the offline spool
+#ifndef IOTCONNECT_SPOOL_MAX_MESSAGE_SIZE
+#define IOTCONNECT_SPOOL_MAX_MESSAGE_SIZE 768
+#endif
+
+// Replay is rate-limited to at most IOTCONNECT_SPOOL_REPLAY_BURST messages every IOTCONNECT_SPOOL_REPLAY_INTERVAL_MS
+#ifndef IOTCONNECT_SPOOL_REPLAY_INTERVAL_MS
+#define IOTCONNECT_SPOOL_REPLAY_INTERVAL_MS 1000
+#endif
+
+#ifndef IOTCONNECT_SPOOL_REPLAY_BURST
+#define IOTCONNECT_SPOOL_REPLAY_BURST 2
+#endif
+
+// Size of the buffer that acks for view callbacks are written into
+#ifndef IOTCONNECT_SDK_ACK_BUFFER_SIZE
+#define IOTCONNECT_SDK_ACK_BUFFER_SIZE 384
+#endif
+
+// Defaults for IotConnectReconnectConfig. The delay before each attempt is random, up to a limit that starts
+// at the base and doubles with every attempt, up to the maximum.
+#ifndef IOTCONNECT_RECONNECT_BASE_MS
+#define IOTCONNECT_RECONNECT_BASE_MS 1000
+#endif
+
+#ifndef IOTCONNECT_RECONNECT_MAX_MS
+#define IOTCONNECT_RECONNECT_MAX_MS 120000
+#endif
+
+// Failed reconnect attempts with the broker credentials from the last sync before discovery and sync run again
+#ifndef IOTCONNECT_RECONNECT_RESYNC_ATTEMPTS
+#define IOTCONNECT_RECONNECT_RESYNC_ATTEMPTS 5
+#endif
+
+// Set to 1 to log the full payload of every inbound event, rather than just its type and size
+#ifndef IOTCONNECT_SDK_LOG_EVENT_PAYLOAD
+#define IOTCONNECT_SDK_LOG_EVENT_PAYLOAD 0
+#endif
+
+struct IotConnectClient {
+    bool in_use;
+    // Set for the client behind the iotconnect_sdk_* API, which is the only one that drives the IoTConnect library
+    bool uses_lib;
+    IotConnectClientConfig config;
+    IotclConfig lib_config;
+    IotcAttributeDictionary dict; // points into the sync response, like the dtg of lib_config
+    IotcSyncContext* sync;
+    IotcDeviceClient* device;
+    char tx_buffer[IOTCONNECT_SDK_TX_BUFFER_SIZE];
+    // Only used from inbound event callbacks, which run on one task at a time
+    char ack_buffer[IOTCONNECT_SDK_ACK_BUFFER_SIZE];
+    // Set while the IoTConnect library processes a command that was already passed to the command registry
+    bool command_in_registry;
+    uint32_t last_message_id; // for messages sent with an ID without async mode
+    uint32_t last_metrics_ms;
+
+    struct {
+        char buffer[IOTCONNECT_BATCH_MAX_BYTES];
+        IotcTelemetryStream stream;
+        bool started;
+        uint32_t first_point_ms;
+        IotConnectBatchStats stats;
+    } batch;
+
+    struct {
+        IotcSpool log;
+        uint32_t last_replay_ms;
+        // Message ID of the replayed record that waits for its publish to complete, or 0.
+        // The oldest record and the count of dropped records at the time, to check that it is still the oldest.
+        uint32_t replay_id;
+        uint32_t replay_tail;
+        unsigned long replay_dropped;
+        char buffer[IOTCONNECT_SPOOL_MAX_MESSAGE_SIZE];
+    } spool;
+
+    struct {
+        uint32_t init_ms;
+        IotConnectStartupStats stats;
+    } startup;
+
+    struct {
+        bool keep_connected; // connected by the application, and not disconnected by it or by the server since
+        bool active; // the connection is down and is being restored
+        bool needs_sync; // the server requested a new sync
+        unsigned int attempts; // failed attempts since the connection went down
+        uint32_t backoff_ms; // upper limit of the next delay
+        uint32_t next_attempt_ms;
+    } reconnect;
+};
+
+static IotConnectClient clients[IOTCONNECT_MAX_CLIENTS];
+
+// Configuration and client of the iotconnect_sdk_* API
+static IotConnectClientConfig sdk_config = { 0 };
+static IotConnectClient* sdk_client = NULL;
 
 
 #if 0 // UNUSED?
@@ -99,113 +197,918 @@ static void report_sync_error(IotclSyncResponse* response, const char* sync_resp
 }
 #endif
 
-static void on_mqtt_c2d_message(unsigned char* message, size_t message_len) {
-    char* str = malloc(message_len + 1);
+static void handle_connection_event(IotConnectClient* client, IotConnectEventType type) {
+    switch (type) {
+    case ON_FORCE_SYNC:
+        printf("Got a SYNC request request. Closing the mqtt connection.\n");
+        // disconnect first, as the connection parameters point into the response
+        iotconnect_client_disconnect(client);
+        iotc_sync_ctx_invalidate_cache(client->sync);
+        iotc_sync_ctx_free_response(client->sync);
+        // the loop connects again after a new sync
+        client->reconnect.keep_connected = client->config.reconnect.enabled;
+        client->reconnect.needs_sync = true;
+        break;
+    case ON_CLOSE:
+        printf("Got a disconnect request. Closing the mqtt connection.\n");
+        iotconnect_client_disconnect(client);
+        break;
+    default:
+        break; // not handling nay other messages
+    }
+}
+
+#if !IOTC_STATIC_ALLOCATION
+// The IoTConnect library needs a NUL-terminated copy of the event and parses it into a cJSON tree
+static char* copy_event(const unsigned char* message, size_t message_len) {
+    char* str = iotc_malloc(message_len + 1);
+    if (NULL == str) {
+        fprintf(stderr, "Unable to allocate memory for the inbound event\n");
+        return NULL;
+    }
     memcpy(str, message, message_len);
     str[message_len] = 0;
-    printf("event>>> %s\n", str);
-    if (!iotcl_process_event(str)) {
-        fprintf(stderr, "Error encountered while processing %s\n", str);
+    return str;
+}
+
+// The IoTConnect library callbacks carry no context. Only the SDK client uses the library.
+static void on_lib_command(IotclEventData data) {
+    if (sdk_client && !sdk_client->command_in_registry && NULL != sdk_client->config.cmd_cb) {
+        sdk_client->config.cmd_cb(data);
     }
-    free(str);
 }
 
-void iotconnect_sdk_disconnect() {
+static void on_message_intercept(IotclEventData data, IotConnectEventType type) {
+    if (!sdk_client) {
+        return;
+    }
+    handle_connection_event(sdk_client, type);
+
+    if (NULL != sdk_client->config.msg_cb) {
+        sdk_client->config.msg_cb(data, type);
+    }
+}
+#endif
+
+// Returns true if the event still needs to go through the IoTConnect library, for callbacks that take IotclEventData
+static bool needs_lib_processing(IotConnectClient* client, const IotcEventView* ev, bool parsed, bool registered) {
+    if (IOTC_STATIC_ALLOCATION || !client->uses_lib) {
+        return false; // in the static allocation profile, the callbacks are rejected by apply_config()
+    }
+    if (NULL != client->config.msg_cb) {
+        return true;
+    }
+    if (!parsed) {
+        return NULL != client->lib_config.event_functions.cmd_cb || NULL != client->lib_config.event_functions.ota_cb;
+    }
+    switch (ev->type) {
+    case DEVICE_COMMAND:
+        return NULL != client->lib_config.event_functions.cmd_cb && !registered;
+    case DEVICE_OTA:
+        return NULL != client->lib_config.event_functions.ota_cb;
+    default:
+        return false;
+    }
+}
+
+static void on_mqtt_c2d_message(void* ctx, unsigned char* message, size_t message_len) {
+    IotConnectClient* client = (IotConnectClient*) ctx;
+    IotcEventView ev;
+    char* str = NULL;
+    bool parsed = (0 == iotc_event_view_parse(&ev, (const char*) message, message_len));
+
+#if IOTCONNECT_SDK_LOG_EVENT_PAYLOAD
+    printf("event>>> %.*s\n", (int) message_len, (const char*) message);
+#else
+    printf("event>>> type 0x%02x, %lu bytes\n", parsed ? (unsigned int) ev.type : 0U, (unsigned long) message_len);
+#endif
+    if (!parsed) {
+        fprintf(stderr, "Unable to parse the inbound event\n");
+    }
+
+    bool registered = parsed && iotc_command_is_registered(&ev);
+    bool use_lib = needs_lib_processing(client, &ev, parsed, registered);
+#if !IOTC_STATIC_ALLOCATION
+    if (use_lib) {
+        // copy before the view callbacks, which may send messages and overwrite the MQTT buffer
+        str = copy_event(message, message_len);
+    }
+#endif
+
+    if (parsed) {
+        switch (ev.type) {
+        case DEVICE_COMMAND:
+            if (registered) {
+                (void) iotc_command_dispatch(client, &ev); // queued for a worker, or rejected
+            } else if (client->config.cmd_view_cb) {
+                client->config.cmd_view_cb(client, &ev);
+            }
+            break;
+        case DEVICE_OTA:
+            if (client->config.ota_view_cb) {
+                client->config.ota_view_cb(client, &ev);
+            }
+            break;
+        case ON_FORCE_SYNC:
+        case ON_CLOSE:
+            if (!use_lib) {
+                handle_connection_event(client, ev.type); // otherwise intercepted in on_message_intercept()
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+#if !IOTC_STATIC_ALLOCATION
+    if (str) {
+        client->command_in_registry = registered;
+        if (!iotcl_process_event(str)) {
+            fprintf(stderr, "Error encountered while processing %s\n", str);
+        }
+        client->command_in_registry = false;
+        iotc_free(str);
+    }
+#else
+    (void) str;
+#endif
+}
+
+static void on_device_status(void* ctx, IotConnectConnectionStatus status) {
+    IotConnectClient* client = (IotConnectClient*) ctx;
+    if (client->config.status_cb) {
+        client->config.status_cb(status);
+    }
+    if (client->config.client_status_cb) {
+        client->config.client_status_cb(client, status);
+    }
+}
+
+// A replayed record is only removed from the spool once it has been published, or acknowledged with QoS 1.
+// If the publish failed, the record is replayed again.
+static void spool_on_replay_complete(IotConnectClient* client, int status) {
+    IotcSpool* log = &client->spool.log;
+    iotc_device_client_lock(client->device); // the spool is also used by other tasks
+    if (0 == status && log->tail == client->spool.replay_tail && log->stats.dropped == client->spool.replay_dropped) {
+        (void) iotc_spool_pop(log);
+    }
+    client->spool.replay_id = 0;
+    iotc_device_client_unlock(client->device);
+}
+
+// Called from the send call or the MQTT loop, or from the I/O task in async mode
+static void on_device_publish_complete(void* ctx, uint32_t tag, int status) {
+    IotConnectClient* client = (IotConnectClient*) ctx;
+    // acks and other messages sent without an ID have tag 0
+    if (0 == tag) {
+        return;
+    }
+    if (tag == client->spool.replay_id) {
+        spool_on_replay_complete(client, status);
+    } else if (client->config.async.enabled) {
+        if (client->config.async.publish_cb) {
+            client->config.async.publish_cb(tag, status);
+        }
+    } else if (client->config.client_publish_cb) {
+        client->config.client_publish_cb(client, tag, status);
+    }
+}
+
+static bool is_same_string(const char* a, const char* b) {
+    return a == b || (a && b && 0 == strcmp(a, b));
+}
+
+// Copies the configuration, and moves to a new sync context if the device identity changed
+static int apply_config(IotConnectClient* client, const IotConnectClientConfig* c) {
+    if (!c->env || !c->cpid || !c->duid) {
+        printf("Error: Device configuration is invalid. Configuration values for env, cpid and duid are required.\n");
+        return -1;
+    }
+#if IOTC_STATIC_ALLOCATION
+    if (c->cmd_cb || c->ota_cb || c->msg_cb) {
+        fprintf(stderr, "Error: cmd_cb, ota_cb and msg_cb are not supported with IOTC_STATIC_ALLOCATION. Use cmd_view_cb and ota_view_cb.\n");
+        return -1;
+    }
+#endif
+    if (!client->uses_lib && (c->cmd_cb || c->ota_cb || c->msg_cb)) {
+        fprintf(stderr, "Warning: cmd_cb, ota_cb and msg_cb are only supported by the iotconnect_sdk_* API. Use cmd_view_cb and ota_view_cb.\n");
+    }
+    if (client->sync && !(is_same_string(c->cpid, client->config.cpid) && is_same_string(c->env, client->config.env)
+        && is_same_string(c->duid, client->config.duid))) {
+        iotc_sync_destroy(client->sync);
+        client->sync = NULL;
+    }
+    client->config = *c;
+    if (!client->sync) {
+        client->sync = iotc_sync_create(client->config.cpid, client->config.env, client->config.duid);
+        if (!client->sync) {
+            return -1;
+        }
+        if (client->uses_lib) {
+            iotc_sync_set_default(client->sync);
+        }
+    }
+    iotc_sync_ctx_set_attributes(client->sync, IOTC_TELEMETRY_CBOR == c->telemetry_format);
+    return 0;
+}
+
+static void release_client(IotConnectClient* client) {
+    iotc_sync_destroy(client->sync);
+    iotc_device_client_destroy(client->device);
+    client->sync = NULL;
+    client->device = NULL;
+    client->in_use = false;
+}
+
+// Clients should be created and destroyed from one task at a time
+static IotConnectClient* alloc_client(const IotConnectClientConfig* c, bool uses_lib) {
+    for (int i = 0; i < IOTCONNECT_MAX_CLIENTS; i++) {
+        IotConnectClient* client = &clients[i];
+        if (client->in_use) {
+            continue;
+        }
+        memset(client, 0, sizeof(*client));
+        iotc_alloc_init(); // before the IoTConnect library creates any cJSON items
+        client->in_use = true;
+        client->uses_lib = uses_lib;
+        client->device = iotc_device_client_create();
+        if (!client->device || apply_config(client, c)) {
+            release_client(client);
+            return NULL;
+        }
+        return client;
+    }
+    fprintf(stderr, "Error: No free client. Increase IOTCONNECT_MAX_CLIENTS.\n");
+    return NULL;
+}
+
+IotConnectClient* iotconnect_client_create(const IotConnectClientConfig* config) {
+    return alloc_client(config, false);
+}
+
+void iotconnect_client_destroy(IotConnectClient* client) {
+    if (!client) {
+        return;
+    }
+    iotconnect_client_disconnect(client);
+    if (client == sdk_client) {
+        sdk_client = NULL;
+    }
+    release_client(client);
+}
+
+void* iotconnect_client_get_user_data(IotConnectClient* client) {
+    return client->config.user_data;
+}
+
+IotConnectClient* iotconnect_sdk_get_client(void) {
+    return sdk_client;
+}
+
+void iotconnect_client_disconnect(IotConnectClient* client) {
+    client->reconnect.keep_connected = false;
+    if (iotc_device_client_is_connected(client->device)) {
+        iotconnect_client_batch_flush(client);
+    }
+    // The I/O task owns the connection while it runs. Stop it before disconnecting.
+    if (iotc_async_is_running_for(client->device)) {
+        iotc_async_stop();
+    }
     printf("Disconnecting...\n");
-    if (0 == iotc_device_client_disconnect()) {
+    if (0 == iotc_device_client_disconnect(client->device)) {
         printf("Disconnected.\n");
     }
 }
 
-bool iotconnect_sdk_is_connected() {
-    return iotc_device_client_is_connected();
+bool iotconnect_client_is_connected(IotConnectClient* client) {
+    return iotc_device_client_is_connected(client->device);
 }
 
-IotConnectClientConfig* iotconnect_sdk_init_and_get_config() {
-    memset(&config, 0, sizeof(config));
-    return &config;
+IotclConfig* iotconnect_client_get_lib_config(IotConnectClient* client) {
+    return &client->lib_config;
 }
 
-IotclConfig* iotconnect_sdk_get_lib_config() {
-    return iotcl_get_config();
+int iotconnect_client_send_packet(IotConnectClient* client, const char* data) {
+    return iotconnect_client_send_packet_len(client, data, strlen(data));
 }
 
-static void on_message_intercept(IotclEventData data, IotConnectEventType type) {
-    switch (type) {
-    case ON_FORCE_SYNC:
-        printf("Got a SYNC request request. Closing the mqtt connection.\n");
-        iotc_sync_free_response();
-        iotconnect_sdk_disconnect();
-        break;
-    case ON_CLOSE:
-        printf("Got a disconnect request. Closing the mqtt connection.\n");
-        iotconnect_sdk_disconnect();
-        break;
-    default:
-        break; // not handling nay other messages
+int iotconnect_client_send_packet_len(IotConnectClient* client, const char* data, size_t len) {
+    return iotconnect_client_send_packet_async(client, data, len, NULL);
+}
+
+static unsigned long ms_since_init(IotConnectClient* client) {
+    return (unsigned long) (iotc_platform_now_ms() - client->startup.init_ms);
+}
+
+static void record_first_publish(IotConnectClient* client) {
+    IotConnectStartupStats* stats = &client->startup.stats;
+    if (0 == stats->first_publish_ms) {
+        stats->first_publish_ms = ms_since_init(client);
+        printf("Startup: First message sent %lu ms after init (sync: %lu ms%s, connect: %lu ms)\n",
+            stats->first_publish_ms, stats->sync_ms,
+            stats->sync_from_cache ? " from cache" : "", stats->connect_ms);
     }
+}
 
-    if (NULL != config.msg_cb) {
-        config.msg_cb(data, type);
+static int send_packet_now(IotConnectClient* client, const char* data, size_t len, uint32_t* message_id) {
+    int ret;
+    if (message_id) {
+        *message_id = 0;
+    }
+    if (client->config.async.enabled) {
+        ret = iotc_async_enqueue(data, len, message_id);
+        if (ret) {
+            fprintf(stderr, "Async: Outbound queue is full. Message dropped.\n");
+        }
+    } else if (message_id) {
+        uint32_t id = ++client->last_message_id;
+        if (0 == id) {
+            id = ++client->last_message_id; // 0 is for messages without an ID
+        }
+        // QoS 0 messages complete before the publish returns
+        *message_id = id;
+        ret = iotc_device_client_publish(client->device, data, len, id);
+        if (ret) {
+            *message_id = 0;
+        }
+    } else {
+        ret = iotc_device_client_send_message_len(client->device, data, len);
+    }
+    if (0 == ret) {
+        record_first_publish(client);
     }
+    return ret;
 }
 
-int iotconnect_sdk_send_packet(const char* data) {
-    return iotc_device_client_send_message(data);
+static bool spool_is_enabled(IotConnectClient* client) {
+    return NULL != client->spool.log.storage;
 }
 
-void iotconnect_sdk_loop(unsigned int timeout_ms) {
-    iotc_device_client_loop(timeout_ms);
+static int spool_append(IotConnectClient* client, const char* data, size_t len) {
+    if (len > sizeof(client->spool.buffer) || iotc_spool_append(&client->spool.log, data, len)) {
+        fprintf(stderr, "Spool: Failed to store the message. Message dropped.\n");
+        return -1;
+    }
+    return 0;
 }
 
-///////////////////////////////////////////////////////////////////////////////////
-// this the Initialization os IoTConnect SDK
-int iotconnect_sdk_init() {
+// Sends a few of the stored messages, oldest first
+static void spool_replay(IotConnectClient* client) {
+    size_t len;
+    IotcSpool* log = &client->spool.log;
+    if (!spool_is_enabled(client) || iotc_spool_is_empty(log) || !iotc_device_client_is_connected(client->device)) {
+        return;
+    }
+    if ((iotc_platform_now_ms() - client->spool.last_replay_ms) < IOTCONNECT_SPOOL_REPLAY_INTERVAL_MS) {
+        return;
+    }
+    client->spool.last_replay_ms = iotc_platform_now_ms();
+    iotc_device_client_lock(client->device);
+    // Records are popped by spool_on_replay_complete(), so only one is sent at a time. With QoS 0 without async mode,
+    // it completes during the send, and the next one follows right away.
+    for (int i = 0; i < IOTCONNECT_SPOOL_REPLAY_BURST && 0 == client->spool.replay_id; i++) {
+        int ret = iotc_spool_peek(log, client->spool.buffer, sizeof(client->spool.buffer), &len);
+        if (ret < 0) {
+            // cannot be replayed. Skip it rather than getting stuck on it.
+            (void) iotc_spool_pop(log);
+            continue;
+        }
+        if (ret > 0) {
+            break; // nothing left
+        }
+        client->spool.replay_tail = log->tail;
+        client->spool.replay_dropped = log->stats.dropped;
+        if (send_packet_now(client, client->spool.buffer, len, &client->spool.replay_id)) {
+            break; // try again later
+        }
+    }
+    iotc_device_client_unlock(client->device);
+}
+
+int iotconnect_client_send_packet_async(IotConnectClient* client, const char* data, size_t len, uint32_t* message_id) {
+    if (!spool_is_enabled(client)) {
+        return send_packet_now(client, data, len, message_id);
+    }
+    // the spool is shared with command workers, which send their acks from other tasks
+    iotc_device_client_lock(client->device);
     int ret;
+    if (!iotc_device_client_is_connected(client->device)) {
+        if (message_id) {
+            *message_id = 0;
+        }
+        ret = spool_append(client, data, len);
+    } else {
+        ret = send_packet_now(client, data, len, message_id);
+        if (ret) {
+            ret = spool_append(client, data, len);
+        }
+    }
+    iotc_device_client_unlock(client->device);
+    return ret;
+}
 
-    iotc_sync_obtain_response();
+size_t iotconnect_client_get_spool_stats(IotConnectClient* client, IotcSpoolStats* stats) {
+    if (stats) {
+        *stats = client->spool.log.stats;
+    }
+    return client->spool.log.count;
+}
 
-    // We want to print only first 4 characters of cpid
-    lib_config.device.env = config.env;
-    lib_config.device.cpid = config.cpid;
-    lib_config.device.duid = config.duid;
+int iotconnect_client_send_ack(IotConnectClient* client, const IotcEventView* event, bool success, const char* message) {
+    size_t len;
+    const char* ack = iotc_event_view_write_ack(event, &client->lib_config, success, message,
+        client->ack_buffer, sizeof(client->ack_buffer), &len);
+    if (NULL == ack) {
+        fprintf(stderr, "Unable to create the ack. The event has no ack ID, or the ack is too large.\n");
+        return -1;
+    }
+    return iotconnect_client_send_packet_len(client, ack, len);
+}
 
-    if (!config.env || !config.cpid || !config.duid) {
-        printf("Error: Device configuration is invalid. Configuration values for env, cpid and duid are required.\n");
+char* iotconnect_client_get_tx_buffer(IotConnectClient* client, size_t* size) {
+    if (size) {
+        *size = sizeof(client->tx_buffer);
+    }
+    return client->tx_buffer;
+}
+
+static size_t batch_max_bytes(IotConnectClient* client) {
+    size_t max_bytes = client->config.batch.max_bytes;
+    if (0 == max_bytes || max_bytes > sizeof(client->batch.buffer)) {
+        return sizeof(client->batch.buffer);
+    }
+    return max_bytes;
+}
+
+static bool batch_write_point(IotcTelemetryStream* s, const char* iso_time, const IotConnectTelemetryField* fields, size_t count) {
+    bool ok = iotc_telemetry_stream_add_point(s, iso_time);
+    for (size_t i = 0; ok && i < count; i++) {
+        const IotConnectTelemetryField* f = &fields[i];
+        switch (f->type) {
+        case IOTC_FT_NUMBER:
+            ok = iotc_telemetry_stream_set_number(s, f->name, f->value.number);
+            break;
+        case IOTC_FT_STRING:
+            ok = iotc_telemetry_stream_set_string(s, f->name, f->value.string);
+            break;
+        case IOTC_FT_BOOL:
+            ok = iotc_telemetry_stream_set_bool(s, f->name, f->value.boolean);
+            break;
+        case IOTC_FT_NULL:
+            ok = iotc_telemetry_stream_set_null(s, f->name);
+            break;
+        default:
+            ok = false;
+            break;
+        }
+    }
+    // the closing brackets must still fit after this point
+    return ok && (s->w.size - s->w.len) >= iotc_telemetry_stream_finish_len(s);
+}
+
+static int batch_send(IotConnectClient* client, unsigned long* reason_counter) {
+    size_t len;
+    IotConnectBatchStats* stats = &client->batch.stats;
+    IotcTelemetryStream* s = &client->batch.stream;
+    if (!client->batch.started) {
+        return 0;
+    }
+    client->batch.started = false;
+
+    const char* str = iotc_telemetry_stream_finish(s, &len);
+    if (NULL == str) {
+        // should not happen as points are backed out if they do not fit
+        fprintf(stderr, "Batch: Failed to finalize the packet\n");
+        stats->failed_packets++;
         return -1;
     }
+    (*reason_counter)++;
+    stats->packets++;
+    stats->points += s->points;
+    stats->last_points_per_packet = s->points;
+    if ((unsigned long) s->points > stats->max_points_per_packet) {
+        stats->max_points_per_packet = s->points;
+    }
+    int ret = iotconnect_client_send_packet_len(client, str, len);
+    if (ret) {
+        stats->failed_packets++;
+    }
+    return ret;
+}
 
-    lib_config.event_functions.ota_cb = config.ota_cb;
-    lib_config.event_functions.cmd_cb = config.cmd_cb;
-    lib_config.event_functions.msg_cb = on_message_intercept;
+// While disconnected, the send would fail, and without the spool the points would be lost, so the batch keeps
+// growing until it is full, or until the client reconnects and the next loop flushes it
+static bool batch_is_expired(IotConnectClient* client) {
+    return client->batch.started && client->config.batch.max_age_ms > 0
+        && (iotc_platform_now_ms() - client->batch.first_point_ms) >= client->config.batch.max_age_ms
+        && iotconnect_client_is_connected(client);
+}
 
-    lib_config.telemetry.dtg = iotc_sync_get_dtg();
+int iotconnect_client_batch_add(IotConnectClient* client, const char* iso_time, const IotConnectTelemetryField* fields, size_t count) {
+    IotcTelemetryStreamMark mark;
+    IotcTelemetryStream* s = &client->batch.stream;
+    int ret = 0;
 
-    char cpid_buff[5];
-    strncpy(cpid_buff, config.cpid, 4);
-    cpid_buff[4] = 0;
-    printf("CPID: %s***\n", cpid_buff);
-    printf("ENV:  %s\n", config.env);
+    if (batch_is_expired(client)) {
+        ret = batch_send(client, &client->batch.stats.age_flushes);
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!client->batch.started) {
+            if (!iotc_telemetry_stream_begin_format(s, &client->lib_config, client->config.telemetry_format, &client->dict,
+                                                    client->batch.buffer, batch_max_bytes(client))) {
+                fprintf(stderr, "Batch: Unable to start a packet. Is the client connected?\n");
+                return -1;
+            }
+            client->batch.started = true;
+            client->batch.first_point_ms = iotc_platform_now_ms();
+        }
+        iotc_telemetry_stream_mark(s, &mark);
+        if (batch_write_point(s, iso_time, fields, count)) {
+            return ret;
+        }
+        iotc_telemetry_stream_rewind(s, &mark);
+        if (0 == s->points) {
+            break; // would not fit even into an empty packet
+        }
+        ret = batch_send(client, &client->batch.stats.size_flushes);
+    }
+
+    fprintf(stderr, "Batch: Data point does not fit into %lu bytes\n", (unsigned long) batch_max_bytes(client));
+    client->batch.started = false;
+    client->batch.stats.rejected_points++;
+    return -1;
+}
 
-    if (!iotcl_init(&lib_config)) {
+int iotconnect_client_batch_flush(IotConnectClient* client) {
+    return batch_send(client, &client->batch.stats.explicit_flushes);
+}
+
+void iotconnect_client_get_batch_stats(IotConnectClient* client, IotConnectBatchStats* stats) {
+    *stats = client->batch.stats;
+}
+
+bool iotconnect_client_telemetry_begin(IotConnectClient* client, IotcTelemetryStream* s, char* buf, size_t size) {
+    return iotc_telemetry_stream_begin_format(s, &client->lib_config, client->config.telemetry_format, &client->dict,
+                                              buf, size);
+}
+
+void iotconnect_client_get_startup_stats(IotConnectClient* client, IotConnectStartupStats* stats) {
+    *stats = client->startup.stats;
+}
+
+static void metrics_send(IotConnectClient* client) {
+    IotcMetricsSnapshot snapshot;
+    size_t len;
+    if (0 == client->config.metrics_interval_ms || !iotconnect_client_is_connected(client)
+        || (iotc_platform_now_ms() - client->last_metrics_ms) < client->config.metrics_interval_ms) {
+        return;
+    }
+    client->last_metrics_ms = iotc_platform_now_ms();
+    iotc_metrics_snapshot(&snapshot);
+    const char* str = iotc_metrics_write_telemetry(&snapshot, &client->lib_config, client->tx_buffer,
+        sizeof(client->tx_buffer), &len);
+    if (!str) {
+        fprintf(stderr, "Metrics: Snapshot does not fit into the TX buffer\n");
+        return;
+    }
+    (void) iotconnect_client_send_packet_len(client, str, len);
+}
+
+static void get_device_client_config(IotConnectClient* client, IotConnectDeviceClientConfig* pc) {
+    memset(pc, 0, sizeof(*pc));
+    pc->host = iotc_sync_ctx_get_iothub_host(client->sync);
+    pc->client_id = iotc_sync_ctx_get_client_id(client->sync);
+    pc->username = iotc_sync_ctx_get_username(client->sync);
+    pc->pub_topic = iotc_sync_ctx_get_pub_topic(client->sync);
+    pc->sub_topic = iotc_sync_ctx_get_sub_topic(client->sync);
+    pc->qos = client->config.qos;
+    pc->auth = &client->config.auth_info;
+    pc->persistent_session = client->config.reconnect.persistent_session;
+    pc->status_cb = on_device_status;
+    pc->c2d_msg_cb = on_mqtt_c2d_message;
+    // also removes replayed records from the spool
+    pc->publish_complete_cb = on_device_publish_complete;
+    pc->cb_ctx = client;
+}
+
+// Sets up the library configuration of the client. The dtg points into the sync response, so this
+// needs to run again whenever a new response is obtained.
+static int init_lib_config(IotConnectClient* client) {
+    IotConnectClientConfig* c = &client->config;
+    IotclConfig* lc = &client->lib_config;
+
+    memset(lc, 0, sizeof(*lc));
+    lc->device.env = c->env;
+    lc->device.cpid = c->cpid;
+    lc->device.duid = c->duid;
+    lc->telemetry.dtg = iotc_sync_ctx_get_dtg(client->sync);
+    if (!iotc_sync_ctx_get_attributes(client->sync, &client->dict)) {
+        memset(&client->dict, 0, sizeof(client->dict));
+    }
+
+    if (!client->uses_lib) {
+        return 0;
+    }
+#if !IOTC_STATIC_ALLOCATION
+    // view callbacks take precedence
+    lc->event_functions.ota_cb = c->ota_view_cb ? NULL : c->ota_cb;
+    lc->event_functions.cmd_cb = (c->cmd_view_cb || !c->cmd_cb) ? NULL : on_lib_command;
+    lc->event_functions.msg_cb = on_message_intercept;
+#endif
+
+    if (!iotcl_init(lc)) {
         fprintf(stderr, "Error: Failed to initialize the IoTConnect Lib\n");
         return -1;
     }
+    return 0;
+}
+
+static void reconnect_schedule(IotConnectClient* client) {
+    uint32_t max_ms = client->config.reconnect.max_ms ? client->config.reconnect.max_ms : IOTCONNECT_RECONNECT_MAX_MS;
+    // Full jitter spreads the attempts of devices that lost their connections at the same time
+    uint32_t delay_ms = iotc_platform_random() % (client->reconnect.backoff_ms + 1U);
+    client->reconnect.next_attempt_ms = iotc_platform_now_ms() + delay_ms;
+    client->reconnect.backoff_ms = (client->reconnect.backoff_ms > max_ms / 2U) ? max_ms : client->reconnect.backoff_ms * 2U;
+    printf("Reconnect: Next attempt in %lu ms\n", (unsigned long) delay_ms);
+}
+
+static int reconnect_attempt(IotConnectClient* client) {
+    IotConnectDeviceClientConfig pc;
+    bool resync = client->reconnect.needs_sync
+        || (client->reconnect.attempts > 0 && 0 == client->reconnect.attempts % IOTCONNECT_RECONNECT_RESYNC_ATTEMPTS);
+
+    // The I/O task is started again once connected. It may be on its way out after a sync request.
+    if (iotc_async_is_running_for(client->device)) {
+        iotc_async_stop();
+    }
+    if (resync) {
+        printf("Reconnect: Running discovery and sync\n");
+        // Neither the values in use nor the cached record are replaced unless the new response is obtained,
+        // so the next attempts can still connect with them if the sync fails during an outage
+        if (iotc_sync_ctx_obtain_response(client->sync) || init_lib_config(client)) {
+            return -1;
+        }
+        client->reconnect.needs_sync = false;
+    }
+    get_device_client_config(client, &pc);
+    if (iotc_device_client_init(client->device, &pc)) {
+        return -1;
+    }
+    if (client->config.async.enabled && iotc_async_start(client->device, on_device_publish_complete, client)) {
+        fprintf(stderr, "Reconnect: Failed to start the I/O task\n");
+        iotc_device_client_disconnect(client->device);
+        return -1;
+    }
+    return 0;
+}
+
+// Restores the connection if it went down without a disconnect by the application.
+// Returns false while disconnected, after waiting for up to timeout_ms.
+static bool reconnect_poll(IotConnectClient* client, unsigned int timeout_ms) {
+    if (!client->config.reconnect.enabled || !client->reconnect.keep_connected || iotconnect_client_is_connected(client)) {
+        return true;
+    }
+    if (!client->reconnect.active) {
+        printf("Reconnect: Connection is down\n");
+        client->reconnect.active = true;
+        client->reconnect.attempts = 0;
+        client->reconnect.backoff_ms = client->config.reconnect.base_ms ? client->config.reconnect.base_ms : IOTCONNECT_RECONNECT_BASE_MS;
+        reconnect_schedule(client);
+    }
+    int32_t wait_ms = (int32_t) (client->reconnect.next_attempt_ms - iotc_platform_now_ms());
+    if (wait_ms > 0) {
+        iotc_platform_sleep_ms(((uint32_t) wait_ms < timeout_ms) ? (uint32_t) wait_ms : timeout_ms);
+        return false;
+    }
+    if (reconnect_attempt(client)) {
+        client->reconnect.attempts++;
+        fprintf(stderr, "Reconnect: Attempt %u failed\n", client->reconnect.attempts);
+        reconnect_schedule(client);
+        return false;
+    }
+    printf("Reconnect: Connected after %u failed attempts\n", client->reconnect.attempts);
+    client->reconnect.active = false;
+    return true;
+}
+
+void iotconnect_client_loop(IotConnectClient* client, unsigned int timeout_ms) {
+    if (batch_is_expired(client)) {
+        batch_send(client, &client->batch.stats.age_flushes);
+    }
+    if (!reconnect_poll(client, timeout_ms)) {
+        return;
+    }
+    spool_replay(client);
+    metrics_send(client);
+    if (iotc_async_is_running_for(client->device)) {
+        iotc_platform_sleep_ms(timeout_ms);
+    } else {
+        iotc_device_client_loop(client->device, timeout_ms);
+    }
+}
 
+int iotconnect_client_connect(IotConnectClient* client) {
+    IotConnectClientConfig* c = &client->config;
     IotConnectDeviceClientConfig pc;
-    pc.status_cb = config.status_cb;
-    pc.status_cb = config.status_cb;
-    pc.c2d_msg_cb = on_mqtt_c2d_message;
+    int ret;
+
+    if (c->spool_storage && client->spool.log.storage != c->spool_storage) {
+        if (iotc_spool_init(&client->spool.log, c->spool_storage)) {
+            fprintf(stderr, "Warning: Failed to initialize the offline spool. Continuing without it.\n");
+            client->spool.log.storage = NULL;
+        }
+    }
 
-    ret = iotc_device_client_init(&pc);
+    memset(&client->startup, 0, sizeof(client->startup));
+    memset(&client->reconnect, 0, sizeof(client->reconnect));
+    client->startup.init_ms = iotc_platform_now_ms();
+
+    iotc_sync_ctx_set_cache_storage(client->sync, c->sync_cache_storage);
+    ret = iotc_sync_ctx_obtain_cached_response(client->sync, &client->startup.stats.sync_from_cache);
+    client->startup.stats.sync_ms = ms_since_init(client);
+    if (ret) {
+        fprintf(stderr, "Error: Failed to obtain the discovery and sync response\n");
+        return -1;
+    }
+
+    // We want to print only first 4 characters of cpid
+    char cpid_buff[5];
+    strncpy(cpid_buff, c->cpid, 4);
+    cpid_buff[4] = 0;
+    printf("CPID: %s***\n", cpid_buff);
+    printf("ENV:  %s\n", c->env);
+    printf("DUID: %s\n", c->duid);
+
+    if (init_lib_config(client)) {
+        return -1;
+    }
+
+    get_device_client_config(client, &pc);
+    ret = iotc_device_client_init(client->device, &pc);
+    if (IOTC_DEVICE_CLIENT_REFUSED == ret && client->startup.stats.sync_from_cache) {
+        // The broker rejected the cached values (device moved, credentials changed...). Other failures, like a
+        // network outage, keep the cache, as a fresh discovery and sync would not get through either.
+        // The cached record stays until a new response replaces it, so a failed sync leaves it for the next boot.
+        printf("The broker refused the cached sync response. Running discovery and sync.\n");
+        client->startup.stats.sync_from_cache = false;
+        if (iotc_sync_ctx_obtain_response(client->sync)) {
+            fprintf(stderr, "Error: Failed to obtain the discovery and sync response\n");
+            return -1;
+        }
+        client->startup.stats.sync_ms = ms_since_init(client);
+        if (init_lib_config(client)) {
+            return -1;
+        }
+        get_device_client_config(client, &pc);
+        ret = iotc_device_client_init(client->device, &pc);
+    }
     if (ret) {
         fprintf(stderr, "Failed to connect!\n");
         return ret;
     }
+    client->startup.stats.connect_ms = ms_since_init(client);
+
+    if (c->async.enabled) {
+        ret = iotc_async_start(client->device, on_device_publish_complete, client);
+        if (ret) {
+            fprintf(stderr, "Failed to start the I/O task! Only one client can use async mode.\n");
+            iotc_device_client_disconnect(client->device);
+            return ret;
+        }
+    }
+    client->reconnect.keep_connected = true;
 
     return ret;
 }
 
+///////////////////////////////////////////////////////////////////////////////////
+// The single client API below drives the SDK client
+
+void iotconnect_sdk_disconnect() {
+    if (sdk_client) {
+        iotconnect_client_disconnect(sdk_client);
+    }
+}
+
+bool iotconnect_sdk_is_connected() {
+    return sdk_client && iotconnect_client_is_connected(sdk_client);
+}
+
+IotConnectClientConfig* iotconnect_sdk_init_and_get_config() {
+    memset(&sdk_config, 0, sizeof(sdk_config));
+    sdk_config.qos = 1;
+    sdk_config.reconnect.enabled = true;
+    return &sdk_config;
+}
+
+IotclConfig* iotconnect_sdk_get_lib_config() {
+    return iotcl_get_config();
+}
+
+int iotconnect_sdk_send_packet(const char* data) {
+    return iotconnect_sdk_send_packet_len(data, strlen(data));
+}
+
+int iotconnect_sdk_send_packet_len(const char* data, size_t len) {
+    return iotconnect_sdk_send_packet_async(data, len, NULL);
+}
+
+int iotconnect_sdk_send_packet_async(const char* data, size_t len, uint32_t* message_id) {
+    if (!sdk_client) {
+        return -1;
+    }
+    return iotconnect_client_send_packet_async(sdk_client, data, len, message_id);
+}
+
+size_t iotconnect_sdk_get_spool_stats(IotcSpoolStats* stats) {
+    if (!sdk_client) {
+        if (stats) {
+            memset(stats, 0, sizeof(*stats));
+        }
+        return 0;
+    }
+    return iotconnect_client_get_spool_stats(sdk_client, stats);
+}
+
+void iotconnect_sdk_get_async_stats(IotConnectAsyncStats* stats) {
+    iotc_async_get_stats(stats);
+}
+
+int iotconnect_sdk_send_ack(const IotcEventView* event, bool success, const char* message) {
+    if (!sdk_client) {
+        return -1;
+    }
+    return iotconnect_client_send_ack(sdk_client, event, success, message);
+}
+
+char* iotconnect_sdk_get_tx_buffer(size_t* size) {
+    if (!sdk_client) {
+        if (size) {
+            *size = 0;
+        }
+        return NULL;
+    }
+    return iotconnect_client_get_tx_buffer(sdk_client, size);
+}
+
+int iotconnect_sdk_batch_add(const char* iso_time, const IotConnectTelemetryField* fields, size_t count) {
+    if (!sdk_client) {
+        fprintf(stderr, "Batch: Unable to start a packet. Is the SDK initialized?\n");
+        return -1;
+    }
+    return iotconnect_client_batch_add(sdk_client, iso_time, fields, count);
+}
+
+bool iotconnect_sdk_telemetry_begin(IotcTelemetryStream* s, char* buf, size_t size) {
+    if (!sdk_client) {
+        return false;
+    }
+    return iotconnect_client_telemetry_begin(sdk_client, s, buf, size);
+}
+
+int iotconnect_sdk_batch_flush(void) {
+    return sdk_client ? iotconnect_client_batch_flush(sdk_client) : 0;
+}
+
+void iotconnect_sdk_get_batch_stats(IotConnectBatchStats* stats) {
+    if (sdk_client) {
+        iotconnect_client_get_batch_stats(sdk_client, stats);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void iotconnect_sdk_get_startup_stats(IotConnectStartupStats* stats) {
+    if (sdk_client) {
+        iotconnect_client_get_startup_stats(sdk_client, stats);
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+void iotconnect_sdk_loop(unsigned int timeout_ms) {
+    if (sdk_client) {
+        iotconnect_client_loop(sdk_client, timeout_ms);
+    } else {
+        iotc_platform_sleep_ms(timeout_ms);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// this the Initialization os IoTConnect SDK
+int iotconnect_sdk_init() {
+    if (!sdk_client) {
+        sdk_client = alloc_client(&sdk_config, true);
+        if (!sdk_client) {
+            return -1;
+        }
+    } else if (apply_config(sdk_client, &sdk_config)) {
+        return -1;
+    }
+    return iotconnect_client_connect(sdk_client);
+}
+
 
 int RunIotconnectShadowDemo(bool awsIotMqttMode,
     const char* pIdentifier,
@@ -218,8 +1121,7 @@ int RunIotconnectShadowDemo(bool awsIotMqttMode,
     (void)pNetworkServerInfo;
     (void)pNetworkCredentialInfo;
     (void)pNetworkInterface;
-    
-    iotc_sync_obtain_response();
+
     if (iotconnect_sdk_init()) {
         return EXIT_FAILURE;
     }
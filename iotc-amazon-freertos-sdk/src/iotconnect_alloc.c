@@ -0,0 +1,207 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "iotc_platform.h"
+#include "iotconnect_alloc.h"
+
+static void *heap_malloc(size_t size) {
+#if IOTC_STATIC_ALLOCATION
+    (void) size;
+    return NULL;
+#else
+    return iotc_platform_malloc(size);
+#endif
+}
+
+static void heap_free(void *ptr) {
+#if IOTC_STATIC_ALLOCATION
+    (void) ptr;
+#else
+    if (ptr) {
+        iotc_platform_free(ptr);
+    }
+#endif
+}
+
+static const IotcAllocator heap_allocator = {heap_malloc, heap_free};
+
+#if IOTC_POOL_ALLOCATOR
+
+typedef struct {
+    size_t block_size;
+    size_t blocks;
+    uint8_t *start;
+    void *free_list; // blocks that were freed, linked through their first bytes
+    size_t unused; // blocks from this index on were never handed out
+    size_t in_use;
+    size_t peak;
+    unsigned long exhausted;
+} Pool;
+
+#define POOL_BYTES(block_size, block_count) + (block_size) * (block_count)
+#define POOL_ENTRY(block_size, block_count) {(block_size), (block_count), NULL, NULL, 0, 0, 0, 0},
+
+static uint64_t pool_storage[(0 IOTC_POOL_CLASSES(POOL_BYTES)) / sizeof(uint64_t)];
+static Pool pools[IOTC_POOL_CLASS_COUNT] = {IOTC_POOL_CLASSES(POOL_ENTRY)};
+static unsigned long heap_fallbacks = 0;
+
+// Blocks are only handed out from the index "unused" on, so the free lists need no setup
+static void pools_init(void) {
+    uint8_t *start = (uint8_t *) pool_storage;
+    for (size_t i = 0; i < IOTC_POOL_CLASS_COUNT; i++) {
+        pools[i].start = start;
+        start += pools[i].block_size * pools[i].blocks;
+    }
+}
+
+static void *pool_take(Pool *p) {
+    void *block = NULL;
+    if (p->free_list) {
+        block = p->free_list;
+        p->free_list = *(void **) block;
+    } else if (p->unused < p->blocks) {
+        block = p->start + p->unused * p->block_size;
+        p->unused++;
+    }
+    if (block) {
+        p->in_use++;
+        if (p->in_use > p->peak) {
+            p->peak = p->in_use;
+        }
+    }
+    return block;
+}
+
+// A request goes to the smallest class that fits it, or to the next larger one if that is exhausted
+static void *pool_malloc(size_t size) {
+    void *block = NULL;
+    bool first = true;
+
+    iotc_platform_enter_critical();
+    if (!pools[0].start) {
+        pools_init();
+    }
+    for (size_t i = 0; i < IOTC_POOL_CLASS_COUNT && !block; i++) {
+        if (size <= pools[i].block_size) {
+            block = pool_take(&pools[i]);
+            if (!block && first) {
+                pools[i].exhausted++;
+            }
+            first = false;
+        }
+    }
+    if (!block) {
+        heap_fallbacks++;
+    }
+    iotc_platform_exit_critical();
+
+    return block ? block : heap_malloc(size);
+}
+
+static void pool_free(void *ptr) {
+    uint8_t *p = (uint8_t *) ptr;
+    for (size_t i = 0; i < IOTC_POOL_CLASS_COUNT; i++) {
+        Pool *pool = &pools[i];
+        if (pool->start && p >= pool->start && p < pool->start + pool->block_size * pool->blocks) {
+            iotc_platform_enter_critical();
+            *(void **) ptr = pool->free_list;
+            pool->free_list = ptr;
+            pool->in_use--;
+            iotc_platform_exit_critical();
+            return;
+        }
+    }
+    heap_free(ptr);
+}
+
+static const IotcAllocator pool_allocator = {pool_malloc, pool_free};
+#define DEFAULT_ALLOCATOR pool_allocator
+
+#else
+#define DEFAULT_ALLOCATOR heap_allocator
+#endif // IOTC_POOL_ALLOCATOR
+
+// With the heap allocator, cJSON keeps its own malloc() and free(), so that applications can still release
+// the strings serialized by the library with free(). In the static allocation profile, the hooks keep cJSON
+// off the heap.
+#define DEFAULT_HOOKS (IOTC_POOL_ALLOCATOR || IOTC_STATIC_ALLOCATION)
+
+static const IotcAllocator *allocator = &DEFAULT_ALLOCATOR;
+static bool custom_allocator = false;
+static bool hooks_installed = false;
+static IotcAllocStats stats;
+
+void iotc_alloc_init(void) {
+    if (!hooks_installed && (DEFAULT_HOOKS || custom_allocator)) {
+        // Without a realloc hook, cJSON copies into a new block when a print buffer grows
+        cJSON_Hooks hooks = {iotc_malloc, iotc_free};
+        cJSON_InitHooks(&hooks);
+        hooks_installed = true;
+    }
+}
+
+void iotc_alloc_set_allocator(const IotcAllocator *a) {
+    allocator = a ? a : &DEFAULT_ALLOCATOR;
+    custom_allocator = (NULL != a);
+    if (hooks_installed && !DEFAULT_HOOKS && !custom_allocator) {
+        cJSON_InitHooks(NULL); // back to malloc() and free()
+        hooks_installed = false;
+    }
+    iotc_alloc_init();
+}
+
+const IotcAllocator *iotc_alloc_pool_allocator(void) {
+#if IOTC_POOL_ALLOCATOR
+    return &pool_allocator;
+#else
+    return NULL;
+#endif
+}
+
+void *iotc_malloc(size_t size) {
+    void *ptr = allocator->malloc_fn(size ? size : 1);
+    iotc_platform_enter_critical();
+    if (ptr) {
+        stats.allocs++;
+        stats.live++;
+        if (stats.live > stats.peak_live) {
+            stats.peak_live = stats.live;
+        }
+    } else {
+        stats.failures++;
+    }
+    iotc_platform_exit_critical();
+    return ptr;
+}
+
+void iotc_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    allocator->free_fn(ptr);
+    iotc_platform_enter_critical();
+    stats.frees++;
+    stats.live--;
+    iotc_platform_exit_critical();
+}
+
+void iotc_alloc_get_stats(IotcAllocStats *s) {
+    iotc_platform_enter_critical();
+    *s = stats;
+#if IOTC_POOL_ALLOCATOR
+    s->heap_fallbacks = heap_fallbacks;
+    for (size_t i = 0; i < IOTC_POOL_CLASS_COUNT; i++) {
+        s->classes[i].block_size = pools[i].block_size;
+        s->classes[i].blocks = pools[i].blocks;
+        s->classes[i].in_use = pools[i].in_use;
+        s->classes[i].peak = pools[i].peak;
+        s->classes[i].exhausted = pools[i].exhausted;
+    }
+#endif
+    iotc_platform_exit_critical();
+}
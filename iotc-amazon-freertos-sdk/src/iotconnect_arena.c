@@ -0,0 +1,159 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotc_platform.h"
+#include "iotconnect_arena.h"
+
+#define ARENA_ALIGN 8U
+
+typedef struct {
+    const void *owner;
+    IotcArenaUser user;
+    size_t offset;
+    size_t size;
+} Lease;
+
+static uint64_t storage[(IOTC_ARENA_SIZE + ARENA_ALIGN - 1) / ARENA_ALIGN];
+
+// Sorted by offset, so that the free gaps lie between consecutive leases
+static Lease leases[IOTC_ARENA_MAX_LEASES];
+static size_t lease_count = 0;
+static size_t in_use = 0;
+static size_t user_in_use[IOTC_ARENA_USER_COUNT];
+static IotcArenaStats stats;
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+}
+
+static IotcArenaPhase current_phase(void) {
+    return (user_in_use[IOTC_ARENA_MQTT] > 0) ? IOTC_ARENA_CONNECTED : IOTC_ARENA_PROVISIONING;
+}
+
+static void update_peaks(void) {
+    IotcArenaPhase phase = current_phase();
+    if (in_use > stats.peak[phase]) {
+        stats.peak[phase] = in_use;
+    }
+    for (size_t i = 0; i < IOTC_ARENA_USER_COUNT; i++) {
+        if (user_in_use[i] > stats.user_peak[phase][i]) {
+            stats.user_peak[phase][i] = user_in_use[i];
+        }
+    }
+}
+
+static Lease *find_lease(const void *owner) {
+    for (size_t i = 0; i < lease_count; i++) {
+        if (leases[i].owner == owner) {
+            return &leases[i];
+        }
+    }
+    return NULL;
+}
+
+// Start of the gap before lease i, or before the end of the arena for i == lease_count
+static size_t gap_start(size_t i) {
+    return (0 == i) ? 0 : align_up(leases[i - 1].offset + leases[i - 1].size);
+}
+
+static size_t gap_end(size_t i) {
+    return (i < lease_count) ? leases[i].offset : IOTC_ARENA_SIZE;
+}
+
+void *iotc_arena_acquire(IotcArenaUser user, const void *owner, size_t min_size, size_t max_size, size_t *size) {
+    void *block = NULL;
+
+    iotc_platform_enter_critical();
+    Lease *existing = find_lease(owner);
+    if (existing) {
+        *size = existing->size;
+        block = (uint8_t *) storage + existing->offset;
+        iotc_platform_exit_critical();
+        return block;
+    }
+
+    // Other users than HTTPS only grow beyond their minimum into what is left above the reserve
+    size_t limit = max_size;
+    if (IOTC_ARENA_HTTPS != user) {
+        size_t free_space = IOTC_ARENA_SIZE - in_use;
+        size_t above_reserve = (free_space > IOTC_ARENA_RESERVE) ? free_space - IOTC_ARENA_RESERVE : 0;
+        if (limit > above_reserve) {
+            limit = (above_reserve > min_size) ? above_reserve : min_size;
+        }
+    }
+
+    // The first gap that fits the limit, otherwise the largest gap that fits the minimum
+    size_t best = lease_count + 1;
+    size_t best_len = 0;
+    if (lease_count < IOTC_ARENA_MAX_LEASES) {
+        for (size_t i = 0; i <= lease_count; i++) {
+            size_t start = gap_start(i);
+            size_t len = (gap_end(i) > start) ? gap_end(i) - start : 0;
+            if (len >= limit) {
+                best = i;
+                best_len = limit;
+                break;
+            }
+            if (len >= min_size && len > best_len) {
+                best = i;
+                best_len = len;
+            }
+        }
+    }
+
+    if (best <= lease_count) {
+        memmove(&leases[best + 1], &leases[best], (lease_count - best) * sizeof(Lease));
+        leases[best].owner = owner;
+        leases[best].user = user;
+        leases[best].offset = gap_start(best);
+        leases[best].size = best_len;
+        lease_count++;
+        in_use += best_len;
+        user_in_use[user] += best_len;
+        update_peaks();
+        *size = best_len;
+        block = (uint8_t *) storage + leases[best].offset;
+    } else {
+        stats.failures++;
+        *size = 0;
+    }
+    iotc_platform_exit_critical();
+
+    if (!block) {
+        fprintf(stderr, "Arena: No room for %lu bytes. Increase IOTC_ARENA_SIZE.\n", (unsigned long) min_size);
+    }
+    return block;
+}
+
+void iotc_arena_release(const void *owner) {
+    iotc_platform_enter_critical();
+    Lease *l = find_lease(owner);
+    if (l) {
+        in_use -= l->size;
+        user_in_use[l->user] -= l->size;
+        lease_count--;
+        memmove(l, l + 1, (size_t) (&leases[lease_count] - l) * sizeof(Lease));
+    }
+    iotc_platform_exit_critical();
+}
+
+void iotc_arena_get_stats(IotcArenaStats *s) {
+    iotc_platform_enter_critical();
+    *s = stats;
+    s->size = IOTC_ARENA_SIZE;
+    s->in_use = in_use;
+    s->phase = current_phase();
+    iotc_platform_exit_critical();
+}
+
+void iotc_arena_reset_peaks(void) {
+    iotc_platform_enter_critical();
+    memset(stats.peak, 0, sizeof(stats.peak));
+    memset(stats.user_peak, 0, sizeof(stats.user_peak));
+    update_peaks();
+    iotc_platform_exit_critical();
+}
@@ -0,0 +1,202 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotc_platform.h"
+#include "iotc_device_client.h"
+#include "iotconnect_async.h"
+#include "iotconnect_metrics.h"
+
+typedef struct {
+    uint32_t id;
+    size_t len;
+    char data[IOTCONNECT_ASYNC_MAX_MESSAGE_SIZE];
+} AsyncSlot;
+
+// Slots are handed between the free and the pending queue by index, so only one byte is copied per queue operation
+static AsyncSlot slots[IOTCONNECT_ASYNC_QUEUE_DEPTH];
+
+static uint8_t free_queue_items[IOTCONNECT_ASYNC_QUEUE_DEPTH];
+static IotcQueue free_queue;
+
+static uint8_t pending_queue_items[IOTCONNECT_ASYNC_QUEUE_DEPTH];
+static IotcQueue pending_queue;
+
+// The I/O task posts a single entry when it exits
+static uint8_t stopped_queue_item;
+static IotcQueue stopped_queue;
+
+static bool queues_initialized = false;
+static IotcTask io_task;
+IOTC_TASK_STACKS(io_task_stack, 1, IOTCONNECT_ASYNC_TASK_STACK_SIZE);
+static volatile bool io_task_running = false;
+static IotcDeviceClient *io_client = NULL;
+static volatile bool stop_requested = false;
+static IotConnectPublishCompleteCallback complete_cb = NULL;
+static void *complete_cb_ctx = NULL;
+static uint32_t next_message_id = 0;
+static IotConnectAsyncStats stats = { 0 };
+
+static void init_queues(void) {
+    if (queues_initialized) {
+        return;
+    }
+    iotc_queue_init(&free_queue, free_queue_items, IOTCONNECT_ASYNC_QUEUE_DEPTH);
+    iotc_queue_init(&pending_queue, pending_queue_items, IOTCONNECT_ASYNC_QUEUE_DEPTH);
+    iotc_queue_init(&stopped_queue, &stopped_queue_item, 1);
+    for (uint8_t i = 0; i < IOTCONNECT_ASYNC_QUEUE_DEPTH; i++) {
+        (void) iotc_queue_send(&free_queue, i);
+    }
+    queues_initialized = true;
+}
+
+static void send_slot(uint8_t index) {
+    AsyncSlot *slot = &slots[index];
+    // On success, the device client reports completion through its publish_complete_cb
+    // once the message is acknowledged. QoS 1 messages are copied into the in-flight window, so the slot can be reused.
+    int ret = iotc_device_client_publish(io_client, slot->data, slot->len, slot->id);
+
+    iotc_platform_enter_critical();
+    if (ret) {
+        stats.failed++;
+    } else {
+        stats.sent++;
+    }
+    iotc_platform_exit_critical();
+
+    if (ret && complete_cb) {
+        complete_cb(complete_cb_ctx, slot->id, ret);
+    }
+    (void) iotc_queue_send(&free_queue, index);
+}
+
+static void io_task_fn(void *arg) {
+    uint8_t index;
+    (void) arg;
+
+    while (!stop_requested) {
+        if (!iotc_device_client_is_connected(io_client)) {
+            // Publishing would fail, so keep the messages queued until the connection is back
+            iotc_platform_sleep_ms(IOTCONNECT_ASYNC_POLL_MS);
+            continue;
+        }
+        // send everything that is queued up before processing inbound data
+        while (!stop_requested && iotc_device_client_is_connected(io_client)
+            && iotc_queue_receive(&pending_queue, &index, 0)) {
+            send_slot(index);
+        }
+        if (stop_requested) {
+            break;
+        }
+        if (iotc_device_client_is_connected(io_client)) {
+            // Blocks until inbound data, a keep-alive ping, or a wake-up from iotc_async_enqueue() or iotc_async_stop()
+            iotc_device_client_loop(io_client, IOTC_WAIT_FOREVER);
+        }
+    }
+
+    // Send what was queued before the stop request, unless the connection is already gone
+    while (iotc_device_client_is_connected(io_client) && iotc_queue_receive(&pending_queue, &index, 0)) {
+        send_slot(index);
+    }
+
+    iotc_metrics_unregister_task(&io_task);
+    io_task_running = false;
+    (void) iotc_queue_send(&stopped_queue, 0);
+}
+
+int iotc_async_start(IotcDeviceClient *client, IotConnectPublishCompleteCallback cb, void *cb_ctx) {
+    init_queues();
+    if (io_task_running) {
+        return (client == io_client) ? 0 : -1; // already running
+    }
+    io_client = client;
+    complete_cb = cb;
+    complete_cb_ctx = cb_ctx;
+    stop_requested = false;
+    uint8_t unused;
+    (void) iotc_queue_receive(&stopped_queue, &unused, 0); // clear a stop signal left from a previous run
+    io_task_running = true;
+    // Registered before the task starts, so that it cannot unregister itself first
+    (void) iotc_metrics_register_task("iotc_io", &io_task);
+    if (0 != iotc_task_create(&io_task, "iotc_io", io_task_fn, NULL, io_task_stack[0],
+        IOTCONNECT_ASYNC_TASK_STACK_SIZE, IOTCONNECT_ASYNC_TASK_PRIORITY)) {
+        fprintf(stderr, "Async: Failed to create the I/O task\n");
+        iotc_metrics_unregister_task(&io_task);
+        io_task_running = false;
+        return -1;
+    }
+    return 0;
+}
+
+bool iotc_async_is_running(void) {
+    return io_task_running;
+}
+
+bool iotc_async_is_running_for(const IotcDeviceClient *client) {
+    return io_task_running && client == io_client;
+}
+
+bool iotc_async_is_io_task(void) {
+    return io_task_running && iotc_task_is_current(&io_task);
+}
+
+void iotc_async_stop(void) {
+    if (!io_task_running) {
+        return;
+    }
+    stop_requested = true;
+    iotc_device_client_wake(io_client);
+    if (iotc_async_is_io_task()) {
+        return; // the task will exit once the current callback returns
+    }
+    uint8_t unused;
+    (void) iotc_queue_receive(&stopped_queue, &unused, IOTC_WAIT_FOREVER);
+}
+
+int iotc_async_enqueue(const char *data, size_t len, uint32_t *message_id) {
+    uint8_t index;
+    init_queues();
+
+    if (len > IOTCONNECT_ASYNC_MAX_MESSAGE_SIZE || !iotc_queue_receive(&free_queue, &index, 0)) {
+        iotc_platform_enter_critical();
+        stats.dropped++;
+        iotc_platform_exit_critical();
+        return -1;
+    }
+
+    AsyncSlot *slot = &slots[index];
+    memcpy(slot->data, data, len);
+    slot->len = len;
+
+    iotc_platform_enter_critical();
+    slot->id = ++next_message_id;
+    stats.enqueued++;
+    iotc_platform_exit_critical();
+
+    if (message_id) {
+        *message_id = slot->id;
+    }
+    (void) iotc_queue_send(&pending_queue, index); // cannot fail. There are only as many indexes as queue entries.
+    if (io_task_running) {
+        iotc_device_client_wake(io_client);
+    }
+
+    size_t depth = iotc_queue_count(&pending_queue);
+    iotc_platform_enter_critical();
+    if (depth > stats.high_water) {
+        stats.high_water = depth;
+    }
+    iotc_platform_exit_critical();
+    return 0;
+}
+
+void iotc_async_get_stats(IotConnectAsyncStats *out) {
+    iotc_platform_enter_critical();
+    *out = stats;
+    iotc_platform_exit_critical();
+    out->depth = queues_initialized ? iotc_queue_count(&pending_queue) : 0;
+    out->capacity = IOTCONNECT_ASYNC_QUEUE_DEPTH;
+}
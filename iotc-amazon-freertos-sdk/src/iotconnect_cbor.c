@@ -0,0 +1,241 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <math.h>
+#include <string.h>
+
+#include "iotconnect_cbor.h"
+
+#define MAJOR_UINT 0
+#define MAJOR_NEGATIVE 1
+#define MAJOR_BYTES 2
+#define MAJOR_TEXT 3
+#define MAJOR_ARRAY 4
+#define MAJOR_MAP 5
+#define MAJOR_SIMPLE 7
+
+#define SIMPLE_FALSE 20
+#define SIMPLE_TRUE 21
+#define SIMPLE_NULL 22
+#define FLOAT16 25
+#define FLOAT32 26
+#define FLOAT64 27
+#define INDEFINITE 31
+
+// Largest integer below which all integers are exact doubles
+#define MAX_EXACT_INTEGER 9007199254740992.0
+
+static void write_byte(IotcJsonWriter *w, uint8_t b) {
+    iotc_json_write_raw(w, (const char *) &b, 1);
+}
+
+static void write_be(IotcJsonWriter *w, uint64_t value, size_t size) {
+    char buf[8];
+    for (size_t i = 0; i < size; i++) {
+        buf[i] = (char) (value >> (8 * (size - 1 - i)));
+    }
+    iotc_json_write_raw(w, buf, size);
+}
+
+// The initial byte and the shortest encoding of the argument
+static void write_head(IotcJsonWriter *w, uint8_t major, uint64_t value) {
+    uint8_t mt = (uint8_t) (major << 5);
+    if (value < 24) {
+        write_byte(w, (uint8_t) (mt | value));
+    } else if (value <= 0xFF) {
+        write_byte(w, mt | 24);
+        write_be(w, value, 1);
+    } else if (value <= 0xFFFF) {
+        write_byte(w, mt | 25);
+        write_be(w, value, 2);
+    } else if (value <= 0xFFFFFFFFU) {
+        write_byte(w, mt | 26);
+        write_be(w, value, 4);
+    } else {
+        write_byte(w, mt | 27);
+        write_be(w, value, 8);
+    }
+}
+
+void iotc_cbor_write_uint(IotcJsonWriter *w, uint64_t value) {
+    write_head(w, MAJOR_UINT, value);
+}
+
+void iotc_cbor_write_int(IotcJsonWriter *w, int64_t value) {
+    if (value >= 0) {
+        write_head(w, MAJOR_UINT, (uint64_t) value);
+    } else {
+        write_head(w, MAJOR_NEGATIVE, (uint64_t) (-1 - value));
+    }
+}
+
+void iotc_cbor_write_number(IotcJsonWriter *w, double value) {
+    if (isnan(value) || isinf(value)) {
+        iotc_cbor_write_null(w);
+    } else if (value == floor(value) && fabs(value) <= MAX_EXACT_INTEGER) {
+        iotc_cbor_write_int(w, (int64_t) value);
+    } else if ((double) (float) value == value) {
+        float f = (float) value;
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        write_byte(w, (MAJOR_SIMPLE << 5) | FLOAT32);
+        write_be(w, bits, 4);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        write_byte(w, (MAJOR_SIMPLE << 5) | FLOAT64);
+        write_be(w, bits, 8);
+    }
+}
+
+void iotc_cbor_write_text(IotcJsonWriter *w, const char *s, size_t len) {
+    write_head(w, MAJOR_TEXT, len);
+    iotc_json_write_raw(w, s, len);
+}
+
+void iotc_cbor_write_bytes(IotcJsonWriter *w, const uint8_t *data, size_t len) {
+    write_head(w, MAJOR_BYTES, len);
+    iotc_json_write_raw(w, (const char *) data, len);
+}
+
+void iotc_cbor_write_bool(IotcJsonWriter *w, bool value) {
+    write_byte(w, (MAJOR_SIMPLE << 5) | (value ? SIMPLE_TRUE : SIMPLE_FALSE));
+}
+
+void iotc_cbor_write_null(IotcJsonWriter *w) {
+    write_byte(w, (MAJOR_SIMPLE << 5) | SIMPLE_NULL);
+}
+
+void iotc_cbor_begin_map(IotcJsonWriter *w) {
+    write_byte(w, (MAJOR_MAP << 5) | INDEFINITE);
+}
+
+void iotc_cbor_begin_array(IotcJsonWriter *w) {
+    write_byte(w, (MAJOR_ARRAY << 5) | INDEFINITE);
+}
+
+void iotc_cbor_write_break(IotcJsonWriter *w) {
+    write_byte(w, IOTC_CBOR_BREAK);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Reader
+
+void iotc_cbor_reader_init(IotcCborReader *r, const uint8_t *data, size_t len) {
+    r->data = data;
+    r->len = len;
+    r->pos = 0;
+}
+
+static bool read_be(IotcCborReader *r, size_t size, uint64_t *value) {
+    if (r->len - r->pos < size) {
+        return false;
+    }
+    *value = 0;
+    for (size_t i = 0; i < size; i++) {
+        *value = (*value << 8) | r->data[r->pos++];
+    }
+    return true;
+}
+
+static double half_to_double(uint16_t half) {
+    int exponent = (half >> 10) & 0x1F;
+    double mantissa = half & 0x3FF;
+    double value;
+    if (0 == exponent) {
+        value = ldexp(mantissa, -24);
+    } else if (31 == exponent) {
+        value = (0 == mantissa) ? INFINITY : NAN;
+    } else {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+static bool read_float(IotcCborReader *r, uint8_t info, IotcCborItem *item) {
+    uint64_t bits;
+    item->type = IOTC_CBOR_FLOAT;
+    if (FLOAT16 == info && read_be(r, 2, &bits)) {
+        item->number = half_to_double((uint16_t) bits);
+    } else if (FLOAT32 == info && read_be(r, 4, &bits)) {
+        uint32_t bits32 = (uint32_t) bits;
+        float f;
+        memcpy(&f, &bits32, sizeof(f));
+        item->number = f;
+    } else if (FLOAT64 == info && read_be(r, 8, &bits)) {
+        memcpy(&item->number, &bits, sizeof(item->number));
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool iotc_cbor_read(IotcCborReader *r, IotcCborItem *item) {
+    memset(item, 0, sizeof(*item));
+    if (r->pos >= r->len) {
+        return false;
+    }
+    uint8_t initial = r->data[r->pos++];
+    uint8_t major = initial >> 5;
+    uint8_t info = initial & 0x1F;
+
+    if (IOTC_CBOR_BREAK == initial) {
+        item->type = IOTC_CBOR_END;
+        return true;
+    }
+    if (MAJOR_SIMPLE == major) {
+        switch (info) {
+        case SIMPLE_FALSE: item->type = IOTC_CBOR_FALSE; return true;
+        case SIMPLE_TRUE: item->type = IOTC_CBOR_TRUE; return true;
+        case SIMPLE_NULL: item->type = IOTC_CBOR_NULL; return true;
+        default: return read_float(r, info, item);
+        }
+    }
+
+    if (INDEFINITE == info) {
+        if (MAJOR_ARRAY != major && MAJOR_MAP != major) {
+            return false; // indefinite strings are never written
+        }
+        item->indefinite = true;
+    } else if (info < 24) {
+        item->value = info;
+    } else if (info > 27 || !read_be(r, (size_t) 1 << (info - 24), &item->value)) {
+        return false;
+    }
+
+    switch (major) {
+    case MAJOR_UINT: item->type = IOTC_CBOR_UINT; break;
+    case MAJOR_NEGATIVE: item->type = IOTC_CBOR_NEGATIVE; break;
+    case MAJOR_ARRAY: item->type = IOTC_CBOR_ARRAY; break;
+    case MAJOR_MAP: item->type = IOTC_CBOR_MAP; break;
+    case MAJOR_BYTES:
+    case MAJOR_TEXT:
+        if (item->value > r->len - r->pos) {
+            return false;
+        }
+        item->type = (MAJOR_TEXT == major) ? IOTC_CBOR_TEXT : IOTC_CBOR_BYTES;
+        item->ptr = &r->data[r->pos];
+        r->pos += (size_t) item->value;
+        break;
+    default:
+        return false; // tags
+    }
+    return true;
+}
+
+bool iotc_cbor_to_double(const IotcCborItem *item, double *value) {
+    switch (item->type) {
+    case IOTC_CBOR_UINT:
+        *value = (double) item->value;
+        return true;
+    case IOTC_CBOR_NEGATIVE:
+        *value = -1.0 - (double) item->value;
+        return true;
+    case IOTC_CBOR_FLOAT:
+        *value = item->number;
+        return true;
+    default:
+        return false;
+    }
+}
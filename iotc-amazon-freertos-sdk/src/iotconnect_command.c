@@ -0,0 +1,277 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotc_platform.h"
+#include "iotconnect.h"
+#include "iotconnect_command.h"
+#include "iotconnect_metrics.h"
+
+#if (IOTCONNECT_COMMAND_TABLE_SIZE & (IOTCONNECT_COMMAND_TABLE_SIZE - 1)) != 0 \
+    || IOTCONNECT_COMMAND_TABLE_SIZE <= IOTCONNECT_COMMAND_MAX_COMMANDS
+#error "IOTCONNECT_COMMAND_TABLE_SIZE must be a power of 2 larger than IOTCONNECT_COMMAND_MAX_COMMANDS"
+#endif
+
+#define FNV_OFFSET_BASIS 2166136261U
+#define FNV_PRIME 16777619U
+
+typedef struct {
+    const char *name;
+    size_t name_len;
+    uint32_t hash;
+    IotConnectCommandHandler handler;
+    void *ctx;
+    IotConnectCommandStats stats;
+} CommandEntry;
+
+typedef struct {
+    CommandEntry *command;
+    IotConnectClient *client;
+    uint32_t received_ms;
+    char command_line[IOTCONNECT_COMMAND_MAX_LEN + 1]; // unescaped
+    char ack_id[IOTCONNECT_COMMAND_ACK_ID_MAX_LEN]; // raw, as received
+    size_t ack_id_len;
+    bool has_ack_id;
+} CommandJob;
+
+static CommandEntry commands[IOTCONNECT_COMMAND_MAX_COMMANDS];
+static size_t command_count = 0;
+// Open addressing with linear probing. Holds indexes into commands, plus one. 0 marks an empty bucket.
+static uint8_t table[IOTCONNECT_COMMAND_TABLE_SIZE];
+
+// Jobs are handed between the free and the pending queue by index, same as in iotconnect_async.c
+static CommandJob jobs[IOTCONNECT_COMMAND_QUEUE_DEPTH];
+
+static uint8_t free_queue_items[IOTCONNECT_COMMAND_QUEUE_DEPTH];
+static IotcQueue free_queue;
+
+static uint8_t pending_queue_items[IOTCONNECT_COMMAND_QUEUE_DEPTH];
+static IotcQueue pending_queue;
+
+static IotcTask workers[IOTCONNECT_COMMAND_WORKERS];
+IOTC_TASK_STACKS(worker_stacks, IOTCONNECT_COMMAND_WORKERS, IOTCONNECT_COMMAND_TASK_STACK_SIZE);
+static size_t workers_created = 0;
+static bool workers_started = false;
+
+static char ack_buffers[IOTCONNECT_COMMAND_WORKERS][IOTCONNECT_COMMAND_ACK_BUFFER_SIZE];
+
+static uint32_t hash_name(const char *name, size_t len) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) name[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static CommandEntry *find_command(const char *name, size_t len) {
+    uint32_t hash = hash_name(name, len);
+    for (size_t i = 0; i < IOTCONNECT_COMMAND_TABLE_SIZE; i++) {
+        uint8_t slot = table[(hash + i) & (IOTCONNECT_COMMAND_TABLE_SIZE - 1)];
+        if (0 == slot) {
+            return NULL;
+        }
+        CommandEntry *e = &commands[slot - 1];
+        if (e->hash == hash && e->name_len == len && 0 == memcmp(e->name, name, len)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static uint32_t ms_since(uint32_t start_ms) {
+    return iotc_platform_now_ms() - start_ms;
+}
+
+static void send_ack(IotConnectClient *client, char *buf, const char *ack_id, size_t ack_id_len, bool success,
+                     const char *message) {
+    size_t len;
+    const char *ack = iotc_write_ack(DEVICE_COMMAND, ack_id, ack_id_len, iotconnect_client_get_lib_config(client), success,
+        message, buf, IOTCONNECT_COMMAND_ACK_BUFFER_SIZE, &len);
+    if (NULL == ack) {
+        fprintf(stderr, "Command: Unable to create the ack\n");
+        return;
+    }
+    (void) iotconnect_client_send_packet_len(client, ack, len);
+}
+
+static void worker_task(void *arg) {
+    char *ack_buffer = ack_buffers[(size_t) arg];
+    uint8_t index;
+
+    for (;;) {
+        if (!iotc_queue_receive(&pending_queue, &index, IOTC_WAIT_FOREVER)) {
+            continue;
+        }
+        CommandJob *job = &jobs[index];
+        CommandEntry *e = job->command;
+        uint32_t queue_ms = ms_since(job->received_ms);
+        const char *message = NULL;
+
+        const char *args = job->command_line + e->name_len;
+        while (*args == ' ') {
+            args++;
+        }
+        bool success = e->handler(job->client, args, e->ctx, &message);
+        if (job->has_ack_id) {
+            send_ack(job->client, ack_buffer, job->ack_id, job->ack_id_len, success, message);
+        }
+        uint32_t total_ms = ms_since(job->received_ms);
+
+        iotc_platform_enter_critical();
+        e->stats.executed++;
+        if (!success) {
+            e->stats.failed++;
+        }
+        e->stats.last_ms = total_ms;
+        e->stats.total_ms += total_ms;
+        if (total_ms > e->stats.max_ms) {
+            e->stats.max_ms = total_ms;
+        }
+        if (queue_ms > e->stats.max_queue_ms) {
+            e->stats.max_queue_ms = queue_ms;
+        }
+        iotc_platform_exit_critical();
+
+        (void) iotc_queue_send(&free_queue, index);
+    }
+}
+
+// Tasks cannot be deleted, so if one fails to start, the ones already running are kept
+// and the next registration attempts to start the rest
+static int start_workers(void) {
+    char name[16];
+    if (0 == workers_created) {
+        iotc_queue_init(&free_queue, free_queue_items, IOTCONNECT_COMMAND_QUEUE_DEPTH);
+        iotc_queue_init(&pending_queue, pending_queue_items, IOTCONNECT_COMMAND_QUEUE_DEPTH);
+    }
+    for (size_t i = workers_created; i < IOTCONNECT_COMMAND_WORKERS; i++) {
+        snprintf(name, sizeof(name), "iotc_cmd%u", (unsigned) i);
+        if (0 != iotc_task_create(&workers[i], name, worker_task, (void *) i, worker_stacks[i],
+            IOTCONNECT_COMMAND_TASK_STACK_SIZE, IOTCONNECT_COMMAND_TASK_PRIORITY)) {
+            fprintf(stderr, "Command: Failed to create worker task %u\n", (unsigned) i);
+            return -1;
+        }
+        (void) iotc_metrics_register_task(name, &workers[i]);
+        workers_created++;
+    }
+    // jobs can only be dispatched once the free queue is filled
+    for (uint8_t i = 0; i < IOTCONNECT_COMMAND_QUEUE_DEPTH; i++) {
+        (void) iotc_queue_send(&free_queue, i);
+    }
+    workers_started = true;
+    return 0;
+}
+
+int iotconnect_command_register(const char *name, IotConnectCommandHandler handler, void *ctx) {
+    size_t len = strlen(name);
+    if (NULL == handler || 0 == len || NULL != strchr(name, ' ')) {
+        return -1;
+    }
+    if (command_count >= IOTCONNECT_COMMAND_MAX_COMMANDS || find_command(name, len)) {
+        fprintf(stderr, "Command: Unable to register %s\n", name);
+        return -1;
+    }
+    if (!workers_started && start_workers()) {
+        return -1;
+    }
+
+    CommandEntry *e = &commands[command_count];
+    e->name = name;
+    e->name_len = len;
+    e->hash = hash_name(name, len);
+    e->handler = handler;
+    e->ctx = ctx;
+    memset(&e->stats, 0, sizeof(e->stats));
+    e->stats.name = name;
+
+    for (size_t i = 0; i < IOTCONNECT_COMMAND_TABLE_SIZE; i++) {
+        uint8_t *slot = &table[(e->hash + i) & (IOTCONNECT_COMMAND_TABLE_SIZE - 1)];
+        if (0 == *slot) {
+            // publish the entry last, as the MQTT callback may be looking up commands concurrently
+            iotc_platform_enter_critical();
+            *slot = (uint8_t) (command_count + 1);
+            command_count++;
+            iotc_platform_exit_critical();
+            return 0;
+        }
+    }
+    return -1; // cannot happen, as the table is larger than the maximum number of commands
+}
+
+bool iotconnect_command_get_stats(const char *name, IotConnectCommandStats *stats) {
+    CommandEntry *e = find_command(name, strlen(name));
+    if (!e) {
+        return false;
+    }
+    iotc_platform_enter_critical();
+    *stats = e->stats;
+    iotc_platform_exit_critical();
+    return true;
+}
+
+// Sent from the MQTT callback of the client, so the client's ack buffer can be used
+static void reject(IotConnectClient *client, CommandEntry *e, const IotcEventView *ev, const char *reason) {
+    fprintf(stderr, "Command: Rejected %s: %s\n", e->name, reason);
+    iotc_platform_enter_critical();
+    e->stats.rejected++;
+    iotc_platform_exit_critical();
+    if (ev->ack_id.type == IOTC_JSON_STRING) {
+        (void) iotconnect_client_send_ack(client, ev, false, reason);
+    }
+}
+
+// The name is looked up in the raw string. Names with escaped characters will not match, which is fine for names.
+static CommandEntry *find_event_command(const IotcEventView *ev, IotcJsonToken *command) {
+    if (0 == command_count || ev->type != DEVICE_COMMAND || !iotc_event_view_get_command(ev, command)) {
+        return NULL;
+    }
+    size_t name_len = 0;
+    while (name_len < command->len && command->ptr[name_len] != ' ') {
+        name_len++;
+    }
+    return find_command(command->ptr, name_len);
+}
+
+bool iotc_command_is_registered(const IotcEventView *ev) {
+    IotcJsonToken command;
+    return NULL != find_event_command(ev, &command);
+}
+
+bool iotc_command_dispatch(IotConnectClient *client, const IotcEventView *ev) {
+    IotcJsonToken command;
+    uint8_t index;
+
+    CommandEntry *e = find_event_command(ev, &command);
+    if (!e) {
+        return false;
+    }
+
+    if (ev->ack_id.type == IOTC_JSON_STRING && ev->ack_id.len > IOTCONNECT_COMMAND_ACK_ID_MAX_LEN) {
+        reject(client, e, ev, "Ack ID too long");
+        return true;
+    }
+    if (!iotc_queue_receive(&free_queue, &index, 0)) {
+        reject(client, e, ev, "Busy");
+        return true;
+    }
+    CommandJob *job = &jobs[index];
+    if (iotc_json_view_copy_string(&command, job->command_line, sizeof(job->command_line)) < 0) {
+        (void) iotc_queue_send(&free_queue, index);
+        reject(client, e, ev, "Command too long");
+        return true;
+    }
+    job->command = e;
+    job->client = client;
+    job->received_ms = iotc_platform_now_ms();
+    job->has_ack_id = (ev->ack_id.type == IOTC_JSON_STRING);
+    job->ack_id_len = job->has_ack_id ? ev->ack_id.len : 0;
+    if (job->has_ack_id) {
+        memcpy(job->ack_id, ev->ack_id.ptr, ev->ack_id.len);
+    }
+    (void) iotc_queue_send(&pending_queue, index); // cannot fail. There are only as many indexes as queue entries.
+    return true;
+}
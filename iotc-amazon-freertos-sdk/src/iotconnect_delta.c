@@ -0,0 +1,195 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_delta.h"
+
+#define HDR_SOURCE_SIZE IOTC_DELTA_MAGIC_LEN
+#define HDR_SOURCE_SHA (HDR_SOURCE_SIZE + 4)
+#define HDR_TARGET_SIZE (HDR_SOURCE_SHA + IOTC_SHA256_SIZE)
+#define HDR_TARGET_SHA (HDR_TARGET_SIZE + 4)
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+// Length of the operation header that follows the op code
+static size_t op_args_len(uint8_t op) {
+    switch (op) {
+        case IOTC_DELTA_OP_COPY:
+            return 8;
+        case IOTC_DELTA_OP_INSERT:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+bool iotc_delta_is_patch(const void *data, size_t len) {
+    return len >= IOTC_DELTA_MAGIC_LEN && 0 == memcmp(data, IOTC_DELTA_MAGIC, IOTC_DELTA_MAGIC_LEN);
+}
+
+void iotc_delta_init(IotcDeltaPatcher *p, const IotcStorage *source, const IotcStorage *target) {
+    memset(p, 0, sizeof(*p));
+    p->source = source;
+    p->target = target;
+    iotc_sha256_init(&p->sha);
+}
+
+static IotcDeltaResult fail(IotcDeltaPatcher *p, IotcDeltaResult error) {
+    p->error = error;
+    return error;
+}
+
+static IotcDeltaResult check_source(IotcDeltaPatcher *p) {
+    uint8_t buf[IOTC_DELTA_COPY_BUFFER_SIZE];
+    uint8_t digest[IOTC_SHA256_SIZE];
+    IotcSha256 sha;
+
+    if (p->source_size > p->source->size) {
+        return IOTC_DELTA_ERR_SOURCE;
+    }
+    iotc_sha256_init(&sha);
+    for (uint32_t offset = 0; offset < p->source_size;) {
+        size_t n = min_size(sizeof(buf), p->source_size - offset);
+        if (p->source->read(p->source->ctx, offset, buf, n)) {
+            return IOTC_DELTA_ERR_STORAGE;
+        }
+        iotc_sha256_update(&sha, buf, n);
+        offset += (uint32_t) n;
+    }
+    iotc_sha256_finish(&sha, digest);
+    return (0 == memcmp(digest, &p->header[HDR_SOURCE_SHA], IOTC_SHA256_SIZE)) ? IOTC_DELTA_OK : IOTC_DELTA_ERR_SOURCE;
+}
+
+// Appends to the target in pieces that do not cross sector boundaries
+static IotcDeltaResult write_target(IotcDeltaPatcher *p, const uint8_t *data, size_t len) {
+    const IotcStorage *t = p->target;
+    if (len > p->target_size - p->written) {
+        return IOTC_DELTA_ERR_FORMAT; // more data than the header announced
+    }
+    while (len > 0) {
+        size_t piece = min_size(len, t->sector_size - p->written % t->sector_size);
+        if ((0 == p->written % t->sector_size && t->erase(t->ctx, p->written))
+            || t->write(t->ctx, p->written, data, piece)) {
+            return IOTC_DELTA_ERR_STORAGE;
+        }
+        iotc_sha256_update(&p->sha, data, piece);
+        p->written += (uint32_t) piece;
+        data += piece;
+        len -= piece;
+    }
+    return IOTC_DELTA_OK;
+}
+
+static IotcDeltaResult copy_from_source(IotcDeltaPatcher *p) {
+    uint8_t buf[IOTC_DELTA_COPY_BUFFER_SIZE];
+    while (p->op_remaining > 0) {
+        size_t n = min_size(sizeof(buf), p->op_remaining);
+        if (p->source->read(p->source->ctx, p->op_source, buf, n)) {
+            return IOTC_DELTA_ERR_STORAGE;
+        }
+        IotcDeltaResult ret = write_target(p, buf, n);
+        if (IOTC_DELTA_OK != ret) {
+            return ret;
+        }
+        p->op_source += (uint32_t) n;
+        p->op_remaining -= (uint32_t) n;
+    }
+    return IOTC_DELTA_OK;
+}
+
+// Starts the operation whose header is complete
+static IotcDeltaResult start_op(IotcDeltaPatcher *p) {
+    p->op = p->op_header[0];
+    p->op_header_len = 0;
+    switch (p->op) {
+        case IOTC_DELTA_OP_END:
+            p->done = true;
+            return IOTC_DELTA_OK;
+        case IOTC_DELTA_OP_COPY:
+            p->op_source = get_le32(&p->op_header[1]);
+            p->op_remaining = get_le32(&p->op_header[5]);
+            if (p->op_source > p->source_size || p->op_remaining > p->source_size - p->op_source) {
+                return IOTC_DELTA_ERR_FORMAT;
+            }
+            return copy_from_source(p);
+        case IOTC_DELTA_OP_INSERT:
+            p->op_remaining = get_le32(&p->op_header[1]);
+            return IOTC_DELTA_OK;
+        default:
+            return IOTC_DELTA_ERR_FORMAT;
+    }
+}
+
+IotcDeltaResult iotc_delta_feed(IotcDeltaPatcher *p, const void *data, size_t len) {
+    const uint8_t *in = (const uint8_t *) data;
+    IotcDeltaResult ret;
+
+    if (IOTC_DELTA_OK != p->error) {
+        return p->error;
+    }
+    while (len > 0) {
+        if (p->header_len < IOTC_DELTA_HEADER_SIZE) {
+            size_t n = min_size(len, IOTC_DELTA_HEADER_SIZE - p->header_len);
+            memcpy(&p->header[p->header_len], in, n);
+            p->header_len += n;
+            in += n;
+            len -= n;
+            if (p->header_len < IOTC_DELTA_HEADER_SIZE) {
+                break;
+            }
+            if (!iotc_delta_is_patch(p->header, p->header_len)) {
+                return fail(p, IOTC_DELTA_ERR_FORMAT);
+            }
+            p->source_size = get_le32(&p->header[HDR_SOURCE_SIZE]);
+            p->target_size = get_le32(&p->header[HDR_TARGET_SIZE]);
+            if (p->target_size > p->target->size) {
+                return fail(p, IOTC_DELTA_ERR_STORAGE);
+            }
+            if (IOTC_DELTA_OK != (ret = check_source(p))) {
+                printf("Delta: The patch is not for the running image\n");
+                return fail(p, ret);
+            }
+        } else if (p->done) {
+            return fail(p, IOTC_DELTA_ERR_FORMAT); // data after END
+        } else if (p->op_remaining > 0) {
+            // only an INSERT can be waiting for data. A COPY completes when it starts.
+            size_t n = min_size(len, p->op_remaining);
+            if (IOTC_DELTA_OK != (ret = write_target(p, in, n))) {
+                return fail(p, ret);
+            }
+            p->op_remaining -= (uint32_t) n;
+            in += n;
+            len -= n;
+        } else {
+            p->op_header[p->op_header_len++] = *in++;
+            len--;
+            if (p->op_header_len == 1 + op_args_len(p->op_header[0]) && IOTC_DELTA_OK != (ret = start_op(p))) {
+                return fail(p, ret);
+            }
+        }
+    }
+    return IOTC_DELTA_OK;
+}
+
+IotcDeltaResult iotc_delta_finish(IotcDeltaPatcher *p, uint8_t digest[IOTC_SHA256_SIZE]) {
+    if (IOTC_DELTA_OK != p->error) {
+        return p->error;
+    }
+    if (!p->done || p->written != p->target_size) {
+        return fail(p, IOTC_DELTA_ERR_FORMAT);
+    }
+    iotc_sha256_finish(&p->sha, digest);
+    if (0 != memcmp(digest, &p->header[HDR_TARGET_SHA], IOTC_SHA256_SIZE)) {
+        return fail(p, IOTC_DELTA_ERR_VERIFY);
+    }
+    return IOTC_DELTA_OK;
+}
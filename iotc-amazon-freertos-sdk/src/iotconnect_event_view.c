@@ -0,0 +1,145 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <string.h>
+
+#include "iotconnect_common.h"
+#include "iotconnect_telemetry_stream.h"
+#include "iotconnect_event_view.h"
+
+#define WRITE_LITERAL(w, s) iotc_json_write_raw((w), (s), sizeof(s) - 1)
+
+// Message types of the acknowledgements
+#define ACK_MT_COMMAND 5
+#define ACK_MT_OTA 11
+
+// Ack status values
+#define ACK_ST_SUCCESS 7
+#define ACK_ST_FAILED 4
+
+// Parses cmdType values like "0x01"
+static bool parse_cmd_type(const IotcJsonToken *t, IotConnectEventType *type) {
+    unsigned int value = 0;
+    size_t i = 0;
+
+    if (t->type != IOTC_JSON_STRING) {
+        return false;
+    }
+    if (t->len > 2 && t->ptr[0] == '0' && (t->ptr[1] == 'x' || t->ptr[1] == 'X')) {
+        i = 2;
+    }
+    if (i == t->len) {
+        return false;
+    }
+    for (; i < t->len; i++) {
+        char ch = t->ptr[i];
+        unsigned int digit;
+        if (ch >= '0' && ch <= '9') {
+            digit = (unsigned int) (ch - '0');
+        } else if (ch >= 'a' && ch <= 'f') {
+            digit = (unsigned int) (ch - 'a' + 10);
+        } else if (ch >= 'A' && ch <= 'F') {
+            digit = (unsigned int) (ch - 'A' + 10);
+        } else {
+            return false;
+        }
+        if (value > 0xFFFF) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    *type = (IotConnectEventType) value;
+    return true;
+}
+
+int iotc_event_view_parse(IotcEventView *ev, const char *payload, size_t len) {
+    IotcJsonToken root;
+    IotcJsonToken t;
+
+    memset(ev, 0, sizeof(*ev));
+    ev->type = UNKNOWN_EVENT;
+    if (!iotc_json_view_init(&root, payload, len) || root.type != IOTC_JSON_OBJECT) {
+        return -1;
+    }
+    if (!iotc_json_view_get(&root, "data", &ev->data) || ev->data.type != IOTC_JSON_OBJECT) {
+        return -1;
+    }
+    // cmdType is at the top level, and repeated in the data object
+    if (!iotc_json_view_get(&root, "cmdType", &t) && !iotc_json_view_get(&ev->data, "cmdType", &t)) {
+        return -1;
+    }
+    if (!parse_cmd_type(&t, &ev->type)) {
+        return -1;
+    }
+    (void) iotc_json_view_get(&ev->data, "ackId", &ev->ack_id);
+    if (iotc_json_view_get(&ev->data, "ack", &t)) {
+        ev->needs_ack = iotc_json_view_is_true(&t);
+    }
+    return 0;
+}
+
+bool iotc_event_view_get_command(const IotcEventView *ev, IotcJsonToken *command) {
+    return iotc_json_view_get(&ev->data, "command", command) && command->type == IOTC_JSON_STRING;
+}
+
+bool iotc_event_view_get_url(const IotcEventView *ev, size_t index, IotcJsonToken *url) {
+    IotcJsonToken urls;
+    IotcJsonToken entry;
+    if (!iotc_json_view_get(&ev->data, "urls", &urls) || !iotc_json_view_get_index(&urls, index, &entry)) {
+        url->type = IOTC_JSON_NONE;
+        return false;
+    }
+    // entries are either {"url":"..."} objects or plain strings
+    if (entry.type == IOTC_JSON_OBJECT) {
+        return iotc_json_view_get(&entry, "url", url) && url->type == IOTC_JSON_STRING;
+    }
+    *url = entry;
+    return url->type == IOTC_JSON_STRING;
+}
+
+bool iotc_event_view_get_sw_version(const IotcEventView *ev, IotcJsonToken *version) {
+    IotcJsonToken ver;
+    if (!iotc_json_view_get(&ev->data, "ver", &ver)) {
+        version->type = IOTC_JSON_NONE;
+        return false;
+    }
+    return iotc_json_view_get(&ver, "sw", version) && version->type == IOTC_JSON_STRING;
+}
+
+const char *iotc_write_ack(IotConnectEventType type, const char *ack_id, size_t ack_id_len, const IotclConfig *config,
+                           bool success, const char *message, char *buf, size_t size, size_t *out_len) {
+    IotcJsonWriter w;
+    if (!ack_id || !config || !config->device.env || !config->device.cpid || !config->device.duid) {
+        return NULL;
+    }
+
+    iotc_json_writer_init(&w, buf, size);
+    WRITE_LITERAL(&w, "{\"mt\":");
+    iotc_json_write_number(&w, (type == DEVICE_OTA) ? ACK_MT_OTA : ACK_MT_COMMAND);
+    WRITE_LITERAL(&w, ",\"t\":");
+    iotc_json_write_string(&w, iotcl_iso_timestamp_now());
+    WRITE_LITERAL(&w, ",\"uniqueId\":");
+    iotc_json_write_string(&w, config->device.duid);
+    WRITE_LITERAL(&w, ",\"cpId\":");
+    iotc_json_write_string(&w, config->device.cpid);
+    WRITE_LITERAL(&w, ",\"sdk\":");
+    iotc_json_write_sdk_info(&w, config->device.env);
+    // the ack ID is copied as is. It is still escaped, exactly as received.
+    WRITE_LITERAL(&w, ",\"d\":{\"ackId\":\"");
+    iotc_json_write_raw(&w, ack_id, ack_id_len);
+    WRITE_LITERAL(&w, "\",\"msg\":");
+    iotc_json_write_string(&w, message ? message : "");
+    WRITE_LITERAL(&w, ",\"st\":");
+    iotc_json_write_number(&w, success ? ACK_ST_SUCCESS : ACK_ST_FAILED);
+    WRITE_LITERAL(&w, "}}");
+    return iotc_json_writer_finish(&w, out_len);
+}
+
+const char *iotc_event_view_write_ack(const IotcEventView *ev, const IotclConfig *config, bool success,
+                                      const char *message, char *buf, size_t size, size_t *out_len) {
+    if (ev->ack_id.type != IOTC_JSON_STRING) {
+        return NULL;
+    }
+    return iotc_write_ack(ev->type, ev->ack_id.ptr, ev->ack_id.len, config, success, message, buf, size, out_len);
+}
@@ -0,0 +1,373 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "iotconnect_json_view.h"
+
+// Nesting limit for skipping values, so that hostile input cannot make a scan run for long
+#define MAX_DEPTH 32
+
+typedef struct {
+    const char *p;
+    const char *end;
+} Cursor;
+
+static void skip_ws(Cursor *c) {
+    while (c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r')) {
+        c->p++;
+    }
+}
+
+// c->p points to the opening quote. On success, c->p points past the closing quote.
+static bool scan_string(Cursor *c, IotcJsonToken *t) {
+    const char *start = ++c->p;
+    while (c->p < c->end) {
+        char ch = *c->p;
+        if (ch == '"') {
+            t->type = IOTC_JSON_STRING;
+            t->ptr = start;
+            t->len = (size_t) (c->p - start);
+            c->p++;
+            return true;
+        }
+        if (ch == '\\') {
+            c->p++; // the escaped character is validated when copying
+        } else if ((unsigned char) ch < 0x20) {
+            return false;
+        }
+        c->p++;
+    }
+    return false;
+}
+
+static bool scan_literal(Cursor *c, const char *literal, size_t len, IotcJsonType type, IotcJsonToken *t) {
+    if ((size_t) (c->end - c->p) < len || 0 != memcmp(c->p, literal, len)) {
+        return false;
+    }
+    t->type = type;
+    t->ptr = c->p;
+    t->len = len;
+    c->p += len;
+    return true;
+}
+
+static bool scan_number(Cursor *c, IotcJsonToken *t) {
+    const char *start = c->p;
+    while (c->p < c->end && *c->p && (strchr("+-.eE", *c->p) || (*c->p >= '0' && *c->p <= '9'))) {
+        c->p++;
+    }
+    if (c->p == start) {
+        return false;
+    }
+    t->type = IOTC_JSON_NUMBER;
+    t->ptr = start;
+    t->len = (size_t) (c->p - start);
+    return true;
+}
+
+// Skips over an object or an array. c->p points to the opening bracket.
+static bool scan_container(Cursor *c, IotcJsonToken *t) {
+    IotcJsonToken ignored;
+    int depth = 0;
+    const char *start = c->p;
+
+    while (c->p < c->end) {
+        switch (*c->p) {
+        case '"':
+            if (!scan_string(c, &ignored)) {
+                return false;
+            }
+            continue;
+        case '{':
+        case '[':
+            if (++depth > MAX_DEPTH) {
+                return false;
+            }
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0) {
+                c->p++;
+                t->type = (*start == '{') ? IOTC_JSON_OBJECT : IOTC_JSON_ARRAY;
+                t->ptr = start;
+                t->len = (size_t) (c->p - start);
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+        c->p++;
+    }
+    return false;
+}
+
+static bool scan_value(Cursor *c, IotcJsonToken *t) {
+    skip_ws(c);
+    if (c->p >= c->end) {
+        return false;
+    }
+    switch (*c->p) {
+    case '"':
+        return scan_string(c, t);
+    case '{':
+    case '[':
+        return scan_container(c, t);
+    case 't':
+        return scan_literal(c, "true", 4, IOTC_JSON_TRUE, t);
+    case 'f':
+        return scan_literal(c, "false", 5, IOTC_JSON_FALSE, t);
+    case 'n':
+        return scan_literal(c, "null", 4, IOTC_JSON_NULL, t);
+    default:
+        return scan_number(c, t);
+    }
+}
+
+// Moves past the separator after an object member or array element.
+// Returns 1 if another one follows, 0 at the closing bracket, or -1 if malformed.
+static int scan_separator(Cursor *c, char close) {
+    skip_ws(c);
+    if (c->p >= c->end) {
+        return -1;
+    }
+    if (*c->p == ',') {
+        c->p++;
+        return 1;
+    }
+    return (*c->p == close) ? 0 : -1;
+}
+
+static void set_none(IotcJsonToken *t) {
+    t->type = IOTC_JSON_NONE;
+    t->ptr = NULL;
+    t->len = 0;
+}
+
+bool iotc_json_view_init(IotcJsonToken *root, const char *json, size_t len) {
+    Cursor c = { json, json + len };
+    if (!json || !scan_value(&c, root)) {
+        set_none(root);
+        return false;
+    }
+    skip_ws(&c);
+    if (c.p != c.end) {
+        set_none(root);
+        return false;
+    }
+    return true;
+}
+
+bool iotc_json_view_get(const IotcJsonToken *object, const char *key, IotcJsonToken *out) {
+    IotcJsonToken name;
+    size_t key_len = strlen(key);
+
+    set_none(out);
+    if (object->type != IOTC_JSON_OBJECT) {
+        return false;
+    }
+    Cursor c = { object->ptr + 1, object->ptr + object->len };
+    skip_ws(&c);
+    if (c.p < c.end && *c.p == '}') {
+        return false; // empty object
+    }
+    for (;;) {
+        skip_ws(&c);
+        if (c.p >= c.end || *c.p != '"' || !scan_string(&c, &name)) {
+            return false;
+        }
+        skip_ws(&c);
+        if (c.p >= c.end || *c.p != ':') {
+            return false;
+        }
+        c.p++;
+        if (!scan_value(&c, out)) {
+            set_none(out);
+            return false;
+        }
+        if (name.len == key_len && 0 == memcmp(name.ptr, key, key_len)) {
+            return true;
+        }
+        if (scan_separator(&c, '}') <= 0) {
+            set_none(out);
+            return false;
+        }
+    }
+}
+
+bool iotc_json_view_get_index(const IotcJsonToken *array, size_t index, IotcJsonToken *out) {
+    set_none(out);
+    if (array->type != IOTC_JSON_ARRAY) {
+        return false;
+    }
+    Cursor c = { array->ptr + 1, array->ptr + array->len };
+    skip_ws(&c);
+    if (c.p < c.end && *c.p == ']') {
+        return false; // empty array
+    }
+    for (size_t i = 0;; i++) {
+        if (!scan_value(&c, out)) {
+            set_none(out);
+            return false;
+        }
+        if (i == index) {
+            return true;
+        }
+        if (scan_separator(&c, ']') <= 0) {
+            set_none(out);
+            return false;
+        }
+    }
+}
+
+bool iotc_json_view_equals(const IotcJsonToken *token, const char *str) {
+    return token->type == IOTC_JSON_STRING && token->len == strlen(str) && 0 == memcmp(token->ptr, str, token->len);
+}
+
+bool iotc_json_view_is_true(const IotcJsonToken *token) {
+    return token->type == IOTC_JSON_TRUE;
+}
+
+bool iotc_json_view_to_long(const IotcJsonToken *token, long *value) {
+    const char *p = token->ptr;
+    const char *end = token->ptr + token->len;
+    bool negative = false;
+    unsigned long v = 0;
+    // the magnitude of LONG_MIN is one more than LONG_MAX
+    unsigned long limit = (unsigned long) LONG_MAX;
+
+    if (token->type != IOTC_JSON_NUMBER) {
+        return false;
+    }
+    if (p < end && *p == '-') {
+        negative = true;
+        limit++;
+        p++;
+    }
+    if (p == end) {
+        return false;
+    }
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        unsigned long digit = (unsigned long) (*p - '0');
+        if (v > (limit - digit) / 10) {
+            return false;
+        }
+        v = v * 10 + digit;
+    }
+    *value = negative ? (long) (0 - v) : (long) v;
+    return true;
+}
+
+static int hex_value(char ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+static bool parse_hex4(const char *p, const char *end, uint32_t *value) {
+    *value = 0;
+    if (end - p < 4) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        int v = hex_value(p[i]);
+        if (v < 0) {
+            return false;
+        }
+        *value = (*value << 4) | (uint32_t) v;
+    }
+    return true;
+}
+
+// Appends the UTF-8 encoding of cp. Returns false if it does not fit.
+static bool put_utf8(char *buf, size_t size, size_t *len, uint32_t cp) {
+    char tmp[4];
+    size_t n;
+    if (cp < 0x80) {
+        tmp[0] = (char) cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        tmp[0] = (char) (0xC0 | (cp >> 6));
+        tmp[1] = (char) (0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        tmp[0] = (char) (0xE0 | (cp >> 12));
+        tmp[1] = (char) (0x80 | ((cp >> 6) & 0x3F));
+        tmp[2] = (char) (0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        tmp[0] = (char) (0xF0 | (cp >> 18));
+        tmp[1] = (char) (0x80 | ((cp >> 12) & 0x3F));
+        tmp[2] = (char) (0x80 | ((cp >> 6) & 0x3F));
+        tmp[3] = (char) (0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    if (*len + n >= size) {
+        return false;
+    }
+    memcpy(&buf[*len], tmp, n);
+    *len += n;
+    return true;
+}
+
+int iotc_json_view_copy_string(const IotcJsonToken *token, char *buf, size_t size) {
+    size_t len = 0;
+    if (token->type != IOTC_JSON_STRING || 0 == size) {
+        return -1;
+    }
+    const char *p = token->ptr;
+    const char *end = token->ptr + token->len;
+    while (p < end) {
+        uint32_t cp = (unsigned char) *p++;
+        if (cp == '\\') {
+            if (p >= end) {
+                return -1;
+            }
+            char esc = *p++;
+            switch (esc) {
+            case '"': cp = '"'; break;
+            case '\\': cp = '\\'; break;
+            case '/': cp = '/'; break;
+            case 'b': cp = '\b'; break;
+            case 'f': cp = '\f'; break;
+            case 'n': cp = '\n'; break;
+            case 'r': cp = '\r'; break;
+            case 't': cp = '\t'; break;
+            case 'u':
+                if (!parse_hex4(p, end, &cp)) {
+                    return -1;
+                }
+                p += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF) {
+                    uint32_t low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !parse_hex4(p + 2, end, &low)
+                        || low < 0xDC00 || low > 0xDFFF) {
+                        return -1;
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                if (!put_utf8(buf, size, &len, cp)) {
+                    return -1;
+                }
+                continue;
+            default:
+                return -1;
+            }
+        }
+        if (len + 1 >= size) {
+            return -1;
+        }
+        buf[len++] = (char) cp;
+    }
+    buf[len] = 0;
+    return (int) len;
+}
@@ -0,0 +1,200 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_metrics.h"
+#include "iotconnect_telemetry_stream.h"
+
+typedef struct {
+    char name[16];
+    const IotcTask *task; // NULL for a free entry
+} TaskEntry;
+
+static volatile uint32_t counters[IOTC_METRIC_COUNTER_COUNT];
+
+static volatile struct {
+    uint32_t count;
+    uint32_t sum_ms;
+    uint32_t max_ms;
+    uint32_t buckets[IOTC_METRICS_HISTOGRAM_BUCKETS];
+} histograms[IOTC_METRIC_HISTOGRAM_COUNT];
+
+static TaskEntry tasks[IOTC_METRICS_MAX_TASKS];
+
+// Short names keep the telemetry message within the TX buffer
+static const char *const counter_names[IOTC_METRIC_COUNTER_COUNT] = {
+    "pub_att", "pub_ok", "pub_fail", "bytes_out", "bytes_in", "msg_in", "conn_lost", "reconnects"
+};
+
+static const char *const histogram_names[IOTC_METRIC_HISTOGRAM_COUNT] = {
+    "pub_lat", "loop", "reconn", "disc", "sync"
+};
+
+// Where the target has no atomic 32-bit operations (Cortex-M0 for example), updates go through a critical section
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && (__GCC_ATOMIC_INT_LOCK_FREE == 2)
+static void atomic_add(volatile uint32_t *target, uint32_t value) {
+    (void) __atomic_fetch_add(target, value, __ATOMIC_RELAXED);
+}
+
+static void atomic_max(volatile uint32_t *target, uint32_t value) {
+    uint32_t current = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while (value > current
+        && !__atomic_compare_exchange_n(target, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+#else
+static void atomic_add(volatile uint32_t *target, uint32_t value) {
+    iotc_platform_enter_critical();
+    *target += value;
+    iotc_platform_exit_critical();
+}
+
+static void atomic_max(volatile uint32_t *target, uint32_t value) {
+    iotc_platform_enter_critical();
+    if (value > *target) {
+        *target = value;
+    }
+    iotc_platform_exit_critical();
+}
+#endif
+
+static size_t bucket_index(uint32_t duration_ms) {
+    size_t index = 0;
+    while (duration_ms > 0 && index < IOTC_METRICS_HISTOGRAM_BUCKETS - 1) {
+        duration_ms >>= 1;
+        index++;
+    }
+    return index;
+}
+
+void iotc_metrics_add(IotcMetricsCounter counter, uint32_t value) {
+    atomic_add(&counters[counter], value);
+}
+
+void iotc_metrics_record_ms(IotcMetricsHistogramId histogram, uint32_t duration_ms) {
+    atomic_add(&histograms[histogram].count, 1);
+    atomic_add(&histograms[histogram].sum_ms, duration_ms);
+    atomic_max(&histograms[histogram].max_ms, duration_ms);
+    atomic_add(&histograms[histogram].buckets[bucket_index(duration_ms)], 1);
+}
+
+void iotc_metrics_record_since(IotcMetricsHistogramId histogram, uint32_t start_ms) {
+    iotc_metrics_record_ms(histogram, iotc_platform_now_ms() - start_ms);
+}
+
+int iotc_metrics_register_task(const char *name, const IotcTask *task) {
+    int ret = -1;
+    iotc_platform_enter_critical();
+    for (size_t i = 0; i < IOTC_METRICS_MAX_TASKS; i++) {
+        if (NULL == tasks[i].task) {
+            strncpy(tasks[i].name, name, sizeof(tasks[i].name) - 1);
+            tasks[i].name[sizeof(tasks[i].name) - 1] = 0;
+            tasks[i].task = task;
+            ret = 0;
+            break;
+        }
+    }
+    iotc_platform_exit_critical();
+    return ret;
+}
+
+void iotc_metrics_unregister_task(const IotcTask *task) {
+    iotc_platform_enter_critical();
+    for (size_t i = 0; i < IOTC_METRICS_MAX_TASKS; i++) {
+        if (task == tasks[i].task) {
+            tasks[i].task = NULL;
+        }
+    }
+    iotc_platform_exit_critical();
+}
+
+void iotc_metrics_snapshot(IotcMetricsSnapshot *snapshot) {
+    TaskEntry registered[IOTC_METRICS_MAX_TASKS];
+
+    memset(snapshot, 0, sizeof(*snapshot));
+    for (size_t i = 0; i < IOTC_METRIC_COUNTER_COUNT; i++) {
+        snapshot->counters[i] = counters[i];
+    }
+    for (size_t i = 0; i < IOTC_METRIC_HISTOGRAM_COUNT; i++) {
+        IotcMetricsHistogram *h = &snapshot->histograms[i];
+        h->count = histograms[i].count;
+        h->sum_ms = histograms[i].sum_ms;
+        h->max_ms = histograms[i].max_ms;
+        for (size_t b = 0; b < IOTC_METRICS_HISTOGRAM_BUCKETS; b++) {
+            h->buckets[b] = histograms[i].buckets[b];
+        }
+    }
+    snapshot->heap_high_water = iotc_platform_heap_high_water();
+
+    // Reading the stack usage can take a while, so it is done outside of the critical section
+    iotc_platform_enter_critical();
+    memcpy(registered, tasks, sizeof(registered));
+    iotc_platform_exit_critical();
+    for (size_t i = 0; i < IOTC_METRICS_MAX_TASKS; i++) {
+        if (registered[i].task) {
+            IotcMetricsTaskStack *t = &snapshot->tasks[snapshot->task_count++];
+            memcpy(t->name, registered[i].name, sizeof(t->name));
+            t->stack_free = iotc_task_get_stack_free(registered[i].task);
+        }
+    }
+}
+
+void iotc_metrics_reset(void) {
+    iotc_platform_enter_critical();
+    memset((void *) counters, 0, sizeof(counters));
+    memset((void *) histograms, 0, sizeof(histograms));
+    iotc_platform_exit_critical();
+}
+
+uint32_t iotc_metrics_histogram_percentile(const IotcMetricsHistogram *histogram, double fraction) {
+    uint32_t target = (uint32_t) (fraction * (double) histogram->count + 0.5);
+    uint32_t seen = 0;
+    if (target < 1) {
+        target = 1;
+    }
+    for (size_t i = 0; i < IOTC_METRICS_HISTOGRAM_BUCKETS - 1; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= target) {
+            uint32_t limit = (1U << i) - 1U; // bucket i holds durations up to 2^i - 1 ms
+            return (limit < histogram->max_ms) ? limit : histogram->max_ms;
+        }
+    }
+    return histogram->max_ms;
+}
+
+const char *iotc_metrics_counter_name(IotcMetricsCounter counter) {
+    return (counter < IOTC_METRIC_COUNTER_COUNT) ? counter_names[counter] : NULL;
+}
+
+const char *iotc_metrics_histogram_name(IotcMetricsHistogramId histogram) {
+    return (histogram < IOTC_METRIC_HISTOGRAM_COUNT) ? histogram_names[histogram] : NULL;
+}
+
+const char *iotc_metrics_write_telemetry(const IotcMetricsSnapshot *snapshot, const IotclConfig *config,
+                                         char *buf, size_t size, size_t *out_len) {
+    IotcTelemetryStream s;
+    char name[32];
+
+    iotc_telemetry_stream_begin(&s, config, buf, size);
+    for (size_t i = 0; i < IOTC_METRIC_COUNTER_COUNT; i++) {
+        iotc_telemetry_stream_set_number(&s, counter_names[i], snapshot->counters[i]);
+    }
+    for (size_t i = 0; i < IOTC_METRIC_HISTOGRAM_COUNT; i++) {
+        const IotcMetricsHistogram *h = &snapshot->histograms[i];
+        snprintf(name, sizeof(name), "%s_n", histogram_names[i]);
+        iotc_telemetry_stream_set_number(&s, name, h->count);
+        snprintf(name, sizeof(name), "%s_p99", histogram_names[i]);
+        iotc_telemetry_stream_set_number(&s, name, iotc_metrics_histogram_percentile(h, 0.99));
+        snprintf(name, sizeof(name), "%s_max", histogram_names[i]);
+        iotc_telemetry_stream_set_number(&s, name, h->max_ms);
+    }
+    iotc_telemetry_stream_set_number(&s, "heap_hw", (double) snapshot->heap_high_water);
+    for (size_t i = 0; i < snapshot->task_count; i++) {
+        snprintf(name, sizeof(name), "stack_%s", snapshot->tasks[i].name);
+        iotc_telemetry_stream_set_number(&s, name, (double) snapshot->tasks[i].stack_free);
+    }
+    return iotc_telemetry_stream_finish(&s, out_len);
+}
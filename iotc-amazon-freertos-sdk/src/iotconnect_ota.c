@@ -0,0 +1,323 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_ota.h"
+
+// Checkpoint records are appended to the progress storage and the last valid one wins.
+// When the first sector is full, it is erased and the next record goes to offset 0.
+#define RECORD_SIZE 64
+#define RECORD_MAGIC_0 'O'
+#define RECORD_MAGIC_1 'T'
+#define RECORD_VERSION 1
+#define RECORD_STATE_OFFSET 2
+// The state byte is written last to commit a record, and cleared to drop it. Both need no erase.
+#define RECORD_STATE_VALID 0x7F
+#define RECORD_STATE_DROPPED 0x00
+#define RECORD_CRC_OFFSET 52 // CRC over bytes 4 to 51
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Splits "https://host/path" into host and resource
+static bool parse_url(IotcOta *ota, const char *url) {
+    static const char scheme[] = "https://";
+    if (0 != strncmp(url, scheme, sizeof(scheme) - 1)) {
+        return false;
+    }
+    const char *host = url + sizeof(scheme) - 1;
+    const char *resource = strchr(host, '/');
+    size_t host_len = resource ? (size_t) (resource - host) : strlen(host);
+    if (!resource) {
+        resource = "/";
+    }
+    if (0 == host_len || host_len > IOTC_OTA_MAX_HOST_LEN || strlen(resource) > IOTC_OTA_MAX_RESOURCE_LEN) {
+        return false;
+    }
+    memcpy(ota->host, host, host_len);
+    ota->host[host_len] = 0;
+    strcpy(ota->resource, resource);
+    return true;
+}
+
+// Records fill the first sector only, so that the progress storage can be a single sector
+static uint32_t records_per_sector(const IotcStorage *s) {
+    return s->sector_size / RECORD_SIZE;
+}
+
+// Finds the last valid checkpoint for the job and restores it. Also finds where the next record goes.
+static void progress_load(IotcOta *ota) {
+    const IotcStorage *s = ota->config.progress;
+    uint8_t rec[RECORD_SIZE];
+    bool found = false;
+
+    ota->record_offset = 0;
+    for (uint32_t i = 0; i < records_per_sector(s); i++) {
+        uint32_t offset = i * RECORD_SIZE;
+        if (s->read(s->ctx, offset, rec, sizeof(rec))) {
+            break;
+        }
+        if (0xFF == rec[0] && 0xFF == rec[1]) {
+            ota->record_offset = offset; // the first free slot
+            break;
+        }
+        ota->record_offset = offset + RECORD_SIZE;
+        if (rec[0] != RECORD_MAGIC_0 || rec[1] != RECORD_MAGIC_1 || rec[RECORD_STATE_OFFSET] != RECORD_STATE_VALID
+            || rec[3] != RECORD_VERSION || iotc_crc32(0, &rec[4], RECORD_CRC_OFFSET - 4) != get_le32(&rec[RECORD_CRC_OFFSET])) {
+            continue; // dropped, or torn by a reset
+        }
+        if (get_le32(&rec[4]) != ota->job_key) {
+            found = false; // a newer record of another job
+            continue;
+        }
+        ota->received = get_le32(&rec[8]);
+        ota->total = get_le32(&rec[12]);
+        for (int w = 0; w < 8; w++) {
+            ota->sha.state[w] = get_le32(&rec[16 + w * 4]);
+        }
+        ota->sha.length = ota->received;
+        found = true;
+    }
+    if (!found || 0 != ota->received % ota->config.image->sector_size || ota->received > ota->config.image->size) {
+        ota->received = 0;
+        ota->total = 0;
+        iotc_sha256_init(&ota->sha);
+    }
+    ota->checkpoint = ota->received;
+}
+
+static int progress_save(IotcOta *ota) {
+    const IotcStorage *s = ota->config.progress;
+    const uint8_t state = RECORD_STATE_VALID;
+    uint8_t rec[RECORD_SIZE];
+
+    if (!s) {
+        return 0;
+    }
+    if (ota->record_offset + RECORD_SIZE > records_per_sector(s) * RECORD_SIZE) {
+        // A reset right after this erase loses the progress, but never leaves a wrong checkpoint
+        if (s->erase(s->ctx, 0)) {
+            return -1;
+        }
+        ota->record_offset = 0;
+    }
+    memset(rec, 0xFF, sizeof(rec));
+    rec[0] = RECORD_MAGIC_0;
+    rec[1] = RECORD_MAGIC_1;
+    rec[3] = RECORD_VERSION;
+    put_le32(&rec[4], ota->job_key);
+    put_le32(&rec[8], (uint32_t) ota->received);
+    put_le32(&rec[12], (uint32_t) ota->total);
+    for (int w = 0; w < 8; w++) {
+        put_le32(&rec[16 + w * 4], ota->sha.state[w]);
+    }
+    put_le32(&rec[RECORD_CRC_OFFSET], iotc_crc32(0, &rec[4], RECORD_CRC_OFFSET - 4));
+
+    uint32_t offset = ota->record_offset;
+    ota->record_offset += RECORD_SIZE;
+    if (s->write(s->ctx, offset, rec, sizeof(rec)) || s->write(s->ctx, offset + RECORD_STATE_OFFSET, &state, 1)) {
+        return -1;
+    }
+    ota->checkpoint = ota->received;
+    return 0;
+}
+
+void iotc_ota_clear_progress(const IotcStorage *progress) {
+    const uint8_t state = RECORD_STATE_DROPPED;
+    uint8_t magic[2];
+    if (!progress) {
+        return;
+    }
+    for (uint32_t offset = 0; offset + RECORD_SIZE <= records_per_sector(progress) * RECORD_SIZE; offset += RECORD_SIZE) {
+        if (progress->read(progress->ctx, offset, magic, sizeof(magic)) || (0xFF == magic[0] && 0xFF == magic[1])) {
+            break;
+        }
+        (void) progress->write(progress->ctx, offset + RECORD_STATE_OFFSET, &state, 1);
+    }
+}
+
+static void report_progress(IotcOta *ota) {
+    if (ota->config.progress_cb) {
+        ota->config.progress_cb(ota->config.cb_ctx, ota->received, ota->total);
+    }
+}
+
+// Writes data at ota->received, which must not cross a sector boundary
+static bool write_piece(IotcOta *ota, const uint8_t *data, size_t len) {
+    const IotcStorage *image = ota->config.image;
+    if (0 == ota->received % image->sector_size && image->erase(image->ctx, (uint32_t) ota->received)) {
+        return false;
+    }
+    if (image->write(image->ctx, (uint32_t) ota->received, data, len)) {
+        return false;
+    }
+    iotc_sha256_update(&ota->sha, data, len);
+    ota->received += len;
+    return true;
+}
+
+static IotcOtaResult delta_result(IotcDeltaResult result) {
+    switch (result) {
+        case IOTC_DELTA_OK:
+            return IOTC_OTA_OK;
+        case IOTC_DELTA_ERR_SOURCE:
+            return IOTC_OTA_ERR_SOURCE;
+        case IOTC_DELTA_ERR_STORAGE:
+            return IOTC_OTA_ERR_STORAGE;
+        default:
+            return IOTC_OTA_ERR_VERIFY;
+    }
+}
+
+static bool on_chunk(void *ctx, size_t offset, const uint8_t *data, size_t len) {
+    IotcOta *ota = (IotcOta *) ctx;
+    const IotcStorage *image = ota->config.image;
+    size_t total = ota->stream.total_size;
+
+    if (offset != ota->received) {
+        ota->error = IOTC_OTA_ERR_DOWNLOAD;
+        return false;
+    }
+    if (0 == offset && iotc_delta_is_patch(data, len)) {
+        if (!ota->config.source) {
+            printf("OTA: The download is a patch, but no source image is configured\n");
+            ota->error = IOTC_OTA_ERR_SOURCE;
+            return false;
+        }
+        printf("OTA: Applying a patch\n");
+        ota->is_delta = true;
+        iotc_delta_init(&ota->patcher, ota->config.source, image);
+    }
+    if (ota->is_delta) {
+        ota->total = total;
+        IotcDeltaResult result = iotc_delta_feed(&ota->patcher, data, len);
+        if (IOTC_DELTA_OK != result) {
+            ota->error = delta_result(result);
+            return false;
+        }
+        ota->received += len;
+        return true;
+    }
+    if (total) {
+        if (ota->total && total != ota->total) {
+            printf("OTA: The image size changed from %lu to %lu. Starting over.\n", (unsigned long) ota->total,
+                   (unsigned long) total);
+            ota->restart = true;
+            return false;
+        }
+        ota->total = total;
+    }
+    if (offset + len > image->size || (total && total > image->size)) {
+        printf("OTA: The image does not fit into the %lu bytes of storage\n", (unsigned long) image->size);
+        ota->error = IOTC_OTA_ERR_STORAGE;
+        return false;
+    }
+
+    // Data is written in pieces that end at sector boundaries, where the hash state can be saved
+    while (len > 0) {
+        size_t room = image->sector_size - ota->received % image->sector_size;
+        size_t piece = (len < room) ? len : room;
+        if (!write_piece(ota, data, piece)) {
+            printf("OTA: Failed to write the image at %lu\n", (unsigned long) ota->received);
+            ota->error = IOTC_OTA_ERR_STORAGE;
+            return false;
+        }
+        data += piece;
+        len -= piece;
+        if (0 == ota->received % image->sector_size && ota->received - ota->checkpoint >= IOTC_OTA_CHECKPOINT_BYTES) {
+            if (progress_save(ota)) {
+                printf("OTA: Failed to save the progress\n");
+            }
+            report_progress(ota);
+        }
+    }
+    return true;
+}
+
+IotcOtaResult iotc_ota_download(IotcOta *ota, const IotcOtaConfig *config, const char *url) {
+    memset(ota, 0, sizeof(*ota));
+    ota->config = *config;
+    if (!config->image || 0 == config->image->sector_size || 0 != config->image->sector_size % IOTC_SHA256_BLOCK_SIZE
+        || (config->progress && config->progress->sector_size < RECORD_SIZE) || (!config->trust_anchor && !config->tls_cert)
+        || !url || !parse_url(ota, url)) {
+        printf("OTA: Invalid configuration or URL\n");
+        return IOTC_OTA_ERR_INVALID;
+    }
+    const char *job_id = config->job_id ? config->job_id : url;
+    // The path tells apart the files of one job, such as a patch and the full image
+    ota->job_key = iotc_crc32(iotc_crc32(0, job_id, strlen(job_id)), ota->resource, strcspn(ota->resource, "?"));
+
+    iotc_sha256_init(&ota->sha);
+    if (config->progress) {
+        progress_load(ota);
+    }
+    if (ota->received > 0) {
+        printf("OTA: Resuming at %lu of %lu bytes\n", (unsigned long) ota->received, (unsigned long) ota->total);
+        report_progress(ota);
+    }
+
+    IotConnectHttpRequest request = { 0 };
+    request.host_name = ota->host;
+    request.resource = ota->resource;
+    request.trust_anchor = config->trust_anchor;
+    request.tls_cert = (char *) config->tls_cert;
+    for (int attempt = 0; ; attempt++) {
+        memset(&ota->stream, 0, sizeof(ota->stream));
+        ota->stream.offset = ota->received;
+        ota->stream.chunk_cb = on_chunk;
+        ota->stream.cb_ctx = ota;
+        ota->error = IOTC_OTA_OK;
+        ota->restart = false;
+        ota->is_delta = false;
+
+        // An image that is complete already only needs its hash checked
+        bool complete = ota->total > 0 && ota->received == ota->total;
+        if (complete || 0 == iotconnect_https_stream(&request, &ota->stream)) {
+            break;
+        }
+        if (ota->restart && 0 == attempt) {
+            ota->received = 0;
+            ota->total = 0;
+            iotc_sha256_init(&ota->sha);
+            continue;
+        }
+        // What arrived after the last checkpoint is not saved, but the next call still resumes from the checkpoint
+        return (IOTC_OTA_OK != ota->error) ? ota->error : IOTC_OTA_ERR_DOWNLOAD;
+    }
+
+    if (ota->total && ota->received != ota->total) {
+        printf("OTA: Received %lu of %lu bytes\n", (unsigned long) ota->received, (unsigned long) ota->total);
+        return IOTC_OTA_ERR_DOWNLOAD;
+    }
+    ota->total = ota->received;
+    report_progress(ota);
+
+    // The image is either good or has to be downloaded again, so the progress is of no use anymore
+    iotc_ota_clear_progress(config->progress);
+    if (ota->is_delta) {
+        IotcDeltaResult result = iotc_delta_finish(&ota->patcher, ota->sha256);
+        if (IOTC_DELTA_OK != result) {
+            printf("OTA: The patch could not be applied\n");
+            return delta_result(result);
+        }
+    } else {
+        iotc_sha256_finish(&ota->sha, ota->sha256);
+    }
+    if (config->expected_sha256 && 0 != memcmp(config->expected_sha256, ota->sha256, IOTC_SHA256_SIZE)) {
+        printf("OTA: SHA-256 of the image does not match\n");
+        return IOTC_OTA_ERR_VERIFY;
+    }
+    printf("OTA: Downloaded %lu bytes\n", (unsigned long) ota->received);
+    return IOTC_OTA_OK;
+}
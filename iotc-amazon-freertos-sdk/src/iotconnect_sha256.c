@@ -0,0 +1,99 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <string.h>
+
+#include "iotconnect_sha256.h"
+
+static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static uint32_t ror(uint32_t x, unsigned int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void transform(uint32_t state[8], const uint8_t *block) {
+    uint32_t w[64];
+    uint32_t v[8];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16)
+            | ((uint32_t) block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    memcpy(v, state, sizeof(v));
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = v[7] + (ror(v[4], 6) ^ ror(v[4], 11) ^ ror(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + k[i] + w[i];
+        uint32_t t2 = (ror(v[0], 2) ^ ror(v[0], 13) ^ ror(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(&v[1], &v[0], 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++) {
+        state[i] += v[i];
+    }
+}
+
+void iotc_sha256_init(IotcSha256 *ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(ctx->state));
+    ctx->length = 0;
+}
+
+void iotc_sha256_update(IotcSha256 *ctx, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *) data;
+    size_t used = (size_t) (ctx->length % IOTC_SHA256_BLOCK_SIZE);
+
+    ctx->length += len;
+    if (used > 0) {
+        size_t n = IOTC_SHA256_BLOCK_SIZE - used;
+        if (len < n) {
+            memcpy(&ctx->block[used], p, len);
+            return;
+        }
+        memcpy(&ctx->block[used], p, n);
+        transform(ctx->state, ctx->block);
+        p += n;
+        len -= n;
+    }
+    // full blocks are hashed straight from the input
+    for (; len >= IOTC_SHA256_BLOCK_SIZE; p += IOTC_SHA256_BLOCK_SIZE, len -= IOTC_SHA256_BLOCK_SIZE) {
+        transform(ctx->state, p);
+    }
+    memcpy(ctx->block, p, len);
+}
+
+void iotc_sha256_finish(IotcSha256 *ctx, uint8_t digest[IOTC_SHA256_SIZE]) {
+    uint8_t pad[IOTC_SHA256_BLOCK_SIZE + 8] = { 0x80 };
+    uint8_t bits[8];
+    uint64_t bit_len = ctx->length * 8;
+    size_t used = (size_t) (ctx->length % IOTC_SHA256_BLOCK_SIZE);
+    size_t pad_len = (used < 56) ? 56 - used : 120 - used;
+
+    for (int i = 0; i < 8; i++) {
+        bits[i] = (uint8_t) (bit_len >> (56 - i * 8));
+    }
+    iotc_sha256_update(ctx, pad, pad_len);
+    iotc_sha256_update(ctx, bits, sizeof(bits));
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (uint8_t) (ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t) (ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t) (ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t) ctx->state[i];
+    }
+}
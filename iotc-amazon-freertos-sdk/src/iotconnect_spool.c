@@ -0,0 +1,321 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_spool.h"
+
+// Record header layout (little endian):
+// 0: magic (2 bytes), 2: state, 3: reserved (0xFF), 4: payload length (2 bytes), 6: reserved (0xFFFF),
+// 8: sequence number (4 bytes), 12: CRC32 over bytes 4..11 and the payload
+#define HDR_SIZE 16
+#define HDR_MAGIC_0 'S'
+#define HDR_MAGIC_1 'P'
+#define HDR_STATE_OFFSET 2
+
+// State transitions only clear bits, so they can be written in place on NOR flash
+#define STATE_WRITTEN   0xFF // header and payload may be incomplete
+#define STATE_PENDING   0x7F // committed, waiting to be replayed
+#define STATE_CONSUMED  0x3F // replayed
+
+#define RECORD_SIZE(len) ((HDR_SIZE + (uint32_t) (len) + 3U) & ~3U)
+
+typedef struct {
+    uint8_t state;
+    uint16_t len;
+    uint32_t seq;
+    uint32_t crc;
+} RecordHeader;
+
+typedef enum {
+    HDR_VALID,
+    HDR_ERASED,
+    HDR_INVALID
+} HeaderStatus;
+
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t) v);
+    put_le16(p + 2, (uint16_t) (v >> 16));
+}
+
+static uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return get_le16(p) | ((uint32_t) get_le16(p + 2) << 16);
+}
+
+static uint32_t sector_start(const IotcSpool *s, uint32_t offset) {
+    return offset - (offset % s->storage->sector_size);
+}
+
+static uint32_t next_sector(const IotcSpool *s, uint32_t offset) {
+    uint32_t next = sector_start(s, offset) + s->storage->sector_size;
+    return (next >= s->storage->size) ? 0 : next;
+}
+
+static HeaderStatus read_header(const IotcSpool *s, uint32_t offset, RecordHeader *h) {
+    uint8_t raw[HDR_SIZE];
+    uint32_t sector_end = sector_start(s, offset) + s->storage->sector_size;
+
+    if (offset + HDR_SIZE > sector_end) {
+        return HDR_ERASED; // no room for another record in this sector
+    }
+    if (s->storage->read(s->storage->ctx, offset, raw, sizeof(raw))) {
+        return HDR_INVALID;
+    }
+    if (raw[0] != HDR_MAGIC_0 || raw[1] != HDR_MAGIC_1) {
+        for (size_t i = 0; i < sizeof(raw); i++) {
+            if (raw[i] != 0xFF) {
+                return HDR_INVALID;
+            }
+        }
+        return HDR_ERASED;
+    }
+    h->state = raw[HDR_STATE_OFFSET];
+    h->len = get_le16(&raw[4]);
+    h->seq = get_le32(&raw[8]);
+    h->crc = get_le32(&raw[12]);
+    if (offset + RECORD_SIZE(h->len) > sector_end) {
+        return HDR_INVALID;
+    }
+    return HDR_VALID;
+}
+
+static bool record_crc_ok(const IotcSpool *s, uint32_t offset, const RecordHeader *h) {
+    uint8_t chunk[32];
+    uint8_t meta[8];
+    put_le16(&meta[0], h->len);
+    put_le16(&meta[2], 0xFFFF);
+    put_le32(&meta[4], h->seq);
+    uint32_t crc = iotc_crc32(0, meta, sizeof(meta));
+
+    for (uint32_t done = 0; done < h->len;) {
+        size_t n = (h->len - done) < sizeof(chunk) ? (h->len - done) : sizeof(chunk);
+        if (s->storage->read(s->storage->ctx, offset + HDR_SIZE + done, chunk, n)) {
+            return false;
+        }
+        crc = iotc_crc32(crc, chunk, n);
+        done += (uint32_t) n;
+    }
+    return crc == h->crc;
+}
+
+// Returns true if the record at offset is committed and intact
+static bool is_pending(IotcSpool *s, uint32_t offset, const RecordHeader *h) {
+    if (h->state != STATE_PENDING) {
+        return false;
+    }
+    if (!record_crc_ok(s, offset, h)) {
+        s->stats.corrupted++;
+        return false;
+    }
+    return true;
+}
+
+// Returns the offset following the record (or erased space) at offset, moving on to the next sector as needed
+static uint32_t next_record(const IotcSpool *s, uint32_t offset) {
+    RecordHeader h;
+    if (HDR_VALID == read_header(s, offset, &h)) {
+        uint32_t next = offset + RECORD_SIZE(h.len);
+        if (next < sector_start(s, offset) + s->storage->sector_size) {
+            return next;
+        }
+    }
+    return next_sector(s, offset);
+}
+
+// Finds the first pending record at or after offset, up to the head
+static uint32_t find_pending(IotcSpool *s, uint32_t offset) {
+    RecordHeader h;
+    // bounded, in case the storage content changes underneath us
+    uint32_t max_steps = s->storage->size / HDR_SIZE + 1;
+    while (offset != s->head && max_steps-- > 0) {
+        if (HDR_VALID == read_header(s, offset, &h) && is_pending(s, offset, &h)) {
+            return offset;
+        }
+        offset = next_record(s, offset);
+    }
+    return s->head;
+}
+
+// Erases the next sector and moves the head to it, dropping any pending records stored there
+static int advance_head(IotcSpool *s) {
+    RecordHeader h;
+    uint32_t next = next_sector(s, s->head);
+
+    if (s->count > 0 && sector_start(s, s->tail) == next) {
+        uint32_t end = next + s->storage->sector_size;
+        for (uint32_t off = next; off < end && HDR_VALID == read_header(s, off, &h); off += RECORD_SIZE(h.len)) {
+            if (h.state == STATE_PENDING && s->count > 0) {
+                s->count--;
+                s->stats.dropped++;
+            }
+        }
+    }
+    if (s->storage->erase(s->storage->ctx, next)) {
+        fprintf(stderr, "Spool: Failed to erase sector at %lu\n", (unsigned long) next);
+        return -1;
+    }
+    s->head = next;
+    if (0 == s->count) {
+        s->tail = s->head;
+    } else if (sector_start(s, s->tail) == next) {
+        s->tail = find_pending(s, next_sector(s, next));
+    }
+    return 0;
+}
+
+int iotc_spool_init(IotcSpool *s, const IotcStorage *storage) {
+    RecordHeader h;
+    bool found_any = false;
+    bool found_pending = false;
+    uint32_t max_seq = 0;
+    uint32_t min_pending_seq = 0;
+
+    memset(s, 0, sizeof(*s));
+    s->storage = storage;
+    if (!storage || !storage->read || !storage->write || !storage->erase || 0 == storage->sector_size
+        || storage->size < 2 * storage->sector_size || 0 != storage->size % storage->sector_size
+        || storage->sector_size < RECORD_SIZE(1)) {
+        fprintf(stderr, "Spool: Invalid storage configuration\n");
+        return -1;
+    }
+
+    for (uint32_t sector = 0; sector < storage->size; sector += storage->sector_size) {
+        uint32_t off = sector;
+        while (HDR_VALID == read_header(s, off, &h)) {
+            if (h.state == STATE_PENDING || h.state == STATE_CONSUMED) {
+                if (!found_any || h.seq > max_seq) {
+                    found_any = true;
+                    max_seq = h.seq;
+                    s->head = off + RECORD_SIZE(h.len);
+                }
+                if (is_pending(s, off, &h)) {
+                    s->count++;
+                    if (!found_pending || h.seq < min_pending_seq) {
+                        found_pending = true;
+                        min_pending_seq = h.seq;
+                        s->tail = off;
+                    }
+                }
+            } else {
+                s->stats.corrupted++; // torn write
+            }
+            off += RECORD_SIZE(h.len);
+        }
+    }
+    s->next_seq = found_any ? max_seq + 1 : 0;
+
+    if (found_any && 0 == s->head % storage->sector_size) {
+        s->head--; // the last record filled its sector. Keep the head in that sector, so that advancing moves past it.
+    }
+    // The head may follow a torn record, may be at the end of a full sector, or the storage may have never been used.
+    // Start over in a freshly erased sector then.
+    if (!found_any || HDR_ERASED != read_header(s, s->head, &h)
+        || (s->head + HDR_SIZE) > sector_start(s, s->head) + storage->sector_size) {
+        if (!found_any) {
+            s->head = storage->size - storage->sector_size; // so that advancing lands on sector 0
+        }
+        if (advance_head(s)) {
+            return -1;
+        }
+    }
+    if (!found_pending) {
+        s->tail = s->head;
+        s->count = 0;
+    }
+    printf("Spool: %lu pending records\n", (unsigned long) s->count);
+    return 0;
+}
+
+int iotc_spool_append(IotcSpool *s, const void *data, size_t len) {
+    uint8_t raw[HDR_SIZE];
+    const uint8_t state = STATE_PENDING;
+
+    if (!s->storage || len > 0xFFFF || RECORD_SIZE(len) > s->storage->sector_size) {
+        return -1;
+    }
+    if (sector_start(s, s->head) + s->storage->sector_size - s->head < RECORD_SIZE(len)) {
+        if (advance_head(s)) {
+            return -1;
+        }
+    }
+
+    memset(raw, 0xFF, sizeof(raw));
+    raw[0] = HDR_MAGIC_0;
+    raw[1] = HDR_MAGIC_1;
+    put_le16(&raw[4], (uint16_t) len);
+    put_le32(&raw[8], s->next_seq);
+    uint32_t crc = iotc_crc32(0, &raw[4], 8);
+    put_le32(&raw[12], iotc_crc32(crc, data, len));
+
+    uint32_t offset = s->head;
+    if (s->storage->write(s->storage->ctx, offset, raw, sizeof(raw))
+        || s->storage->write(s->storage->ctx, offset + HDR_SIZE, data, len)
+        || s->storage->write(s->storage->ctx, offset + HDR_STATE_OFFSET, &state, 1)) {
+        // the partial record will fail the CRC check. Skip past it.
+        s->head = offset + RECORD_SIZE(len);
+        if (0 == s->head % s->storage->sector_size) {
+            s->head = offset;
+            (void) advance_head(s);
+        }
+        return -1;
+    }
+
+    s->head = offset + RECORD_SIZE(len);
+    s->next_seq++;
+    if (0 == s->count) {
+        s->tail = offset;
+    }
+    s->count++;
+    s->stats.appended++;
+    if (0 == s->head % s->storage->sector_size) {
+        // the sector is full. Move on right away, so that the head always points into an erased area.
+        s->head = offset;
+        return advance_head(s);
+    }
+    return 0;
+}
+
+int iotc_spool_peek(IotcSpool *s, void *buf, size_t buf_size, size_t *len) {
+    RecordHeader h;
+    while (s->count > 0) {
+        if (HDR_VALID == read_header(s, s->tail, &h) && is_pending(s, s->tail, &h)) {
+            if (h.len > buf_size) {
+                return -1;
+            }
+            if (s->storage->read(s->storage->ctx, s->tail + HDR_SIZE, buf, h.len)) {
+                return -1;
+            }
+            *len = h.len;
+            return 0;
+        }
+        // the record went bad since we looked at it
+        s->count--;
+        s->tail = find_pending(s, next_record(s, s->tail));
+    }
+    return 1;
+}
+
+int iotc_spool_pop(IotcSpool *s) {
+    const uint8_t state = STATE_CONSUMED;
+    if (0 == s->count) {
+        return -1;
+    }
+    if (s->storage->write(s->storage->ctx, s->tail + HDR_STATE_OFFSET, &state, 1)) {
+        return -1;
+    }
+    s->count--;
+    s->stats.replayed++;
+    s->tail = (0 == s->count) ? s->head : find_pending(s, next_record(s, s->tail));
+    return 0;
+}
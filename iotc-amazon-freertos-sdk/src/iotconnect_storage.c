@@ -0,0 +1,104 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_storage.h"
+
+uint32_t iotc_crc32(uint32_t crc, const void *data, size_t len) {
+    // nibble-wise CRC-32 (IEEE 802.3). Small table, reasonable speed.
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t *p = (const uint8_t *) data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ p[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (p[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+static int file_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+    IotcFileStorage *fs = (IotcFileStorage *) ctx;
+    if (0 != fseek(fs->file, (long) offset, SEEK_SET)) {
+        return -1;
+    }
+    size_t got = fread(buf, 1, len, fs->file);
+    if (got < len) {
+        // reading past the end of a short file behaves like reading erased flash
+        memset((char *) buf + got, 0xFF, len - got);
+    }
+    return 0;
+}
+
+static int file_write(void *ctx, uint32_t offset, const void *buf, size_t len) {
+    IotcFileStorage *fs = (IotcFileStorage *) ctx;
+    if (0 != fseek(fs->file, (long) offset, SEEK_SET)) {
+        return -1;
+    }
+    if (fwrite(buf, 1, len, fs->file) != len) {
+        return -1;
+    }
+    return (0 == fflush(fs->file)) ? 0 : -1;
+}
+
+static int file_erase(void *ctx, uint32_t offset) {
+    IotcFileStorage *fs = (IotcFileStorage *) ctx;
+    unsigned char ff[64];
+    memset(ff, 0xFF, sizeof(ff));
+
+    if (0 != fseek(fs->file, (long) offset, SEEK_SET)) {
+        return -1;
+    }
+    for (uint32_t done = 0; done < fs->sector_size;) {
+        size_t chunk = fs->sector_size - done < sizeof(ff) ? fs->sector_size - done : sizeof(ff);
+        if (fwrite(ff, 1, chunk, fs->file) != chunk) {
+            return -1;
+        }
+        done += (uint32_t) chunk;
+    }
+    return (0 == fflush(fs->file)) ? 0 : -1;
+}
+
+int iotc_storage_file_open(IotcStorage *storage, IotcFileStorage *file_storage, const char *path,
+                           uint32_t size, uint32_t sector_size) {
+    if (0 == sector_size || 0 != size % sector_size) {
+        return -1;
+    }
+    memset(storage, 0, sizeof(*storage));
+    file_storage->sector_size = sector_size;
+    file_storage->file = fopen(path, "r+b");
+    if (NULL == file_storage->file) {
+        file_storage->file = fopen(path, "w+b");
+        if (NULL == file_storage->file) {
+            fprintf(stderr, "Storage: Unable to open %s\n", path);
+            return -1;
+        }
+        for (uint32_t offset = 0; offset < size; offset += sector_size) {
+            if (file_erase(file_storage, offset)) {
+                fclose(file_storage->file);
+                file_storage->file = NULL;
+                return -1;
+            }
+        }
+    }
+    storage->read = file_read;
+    storage->write = file_write;
+    storage->erase = file_erase;
+    storage->size = size;
+    storage->sector_size = sector_size;
+    storage->ctx = file_storage;
+    return 0;
+}
+
+void iotc_storage_file_close(IotcStorage *storage) {
+    IotcFileStorage *fs = (IotcFileStorage *) storage->ctx;
+    if (fs && fs->file) {
+        fclose(fs->file);
+        fs->file = NULL;
+    }
+}
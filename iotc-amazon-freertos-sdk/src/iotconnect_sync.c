@@ -7,21 +7,95 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
-
-/* Include config as the first non-system header. */
-#include "app_config.h"
+#include <stdint.h>
+#include <time.h>
 
 #include "iotconnect_discovery.h"
-#include "iotconnect_certs.h"
+#include "iotconnect_trust.h"
 #include "iotc_http_request.h"
+#include "iotconnect.h"
 #include "iotconnect_sync.h"
+#include "iotconnect_metrics.h"
+#include "iotconnect_json_view.h"
 
 #define RESOURCE_PATH_DSICOVERY "/api/sdk/cpid/%s/lang/M_C/ver/2.0/env/%s"
 #define RESOURCE_PATH_SYNC "%ssync"
 
-static IotclDiscoveryResponse* discovery_response = NULL;
-static IotclSyncResponse* sync_response = NULL;
-static IotclSyncResult last_sync_result = IOTCL_SR_UNKNOWN_DEVICE_STATUS;
+// IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_TEMPLATE, also requesting the attributes of the device template
+#define SYNC_POST_DATA_ATTRIBUTES_TEMPLATE "{\"cpId\":\"%s\",\"uniqueId\":\"%s\",\"option\":{\"attribute\":true," \
+    "\"setting\":false,\"protocol\":true,\"device\":false,\"sdkConfig\":false,\"rule\":false}}"
+
+// Longest base URL of the sync API that discovery can return
+#ifndef IOTCONNECT_SYNC_BASE_URL_MAX_LEN
+#define IOTCONNECT_SYNC_BASE_URL_MAX_LEN 128
+#endif
+
+// Cache record layout (little endian):
+// 0: magic (2 bytes), 2: state, 3: format version, 4: payload length (2 bytes), 6: reserved (0xFFFF),
+// 8: unix time when saved, or 0 if the clock was not set (4 bytes), 12: CRC32 over bytes 4..11 and the payload
+// The payload is cpid, env, duid, followed by the SyncField values, and the attribute names if requested,
+// each NUL terminated.
+#define CACHE_HDR_SIZE 16
+#define CACHE_MAGIC_0 'S'
+#define CACHE_MAGIC_1 'C'
+#define CACHE_STATE_OFFSET 2
+#define CACHE_STATE_VALID 0x7F
+#define CACHE_STATE_INVALID 0x00
+#define CACHE_VERSION 1
+
+// Times before this (2022-01-01) mean that the clock has not been set
+#define CACHE_MIN_VALID_TIME 1640995200
+
+typedef enum {
+    SF_HOST,
+    SF_CLIENT_ID,
+    SF_USER_NAME,
+    SF_PUB_TOPIC,
+    SF_SUB_TOPIC,
+    SF_DTG,
+    SF_COUNT
+} SyncField;
+
+// Names of the SyncField values in the "p" object of the sync response. The dtg is in the "d" object.
+static const char* const field_keys[SF_COUNT] = { "h", "id", "un", "pub", "sub", "dtg" };
+
+// Values returned by the getters. They point into the cache buffer of the context.
+typedef struct {
+    bool valid;
+    const char* values[SF_COUNT];
+    IotcAttributeDictionary dict;
+} SyncFields;
+
+struct IotcSyncContext {
+    bool in_use;
+    const char* cpid;
+    const char* env;
+    const char* duid;
+    IotclSyncResult last_sync_result;
+    bool attributes; // request the attributes of the device template with the sync
+
+    SyncFields fields;
+
+    // Holds the payload of the cache record, whether it was loaded or built from a sync response
+    struct {
+        const IotcStorage* storage;
+        char buffer[IOTCONNECT_SYNC_CACHE_MAX_SIZE];
+        size_t len;
+    } cache;
+};
+
+static IotcSyncContext contexts[IOTCONNECT_MAX_CLIENTS];
+
+// Used by the functions that take no context argument
+static IotcSyncContext* default_ctx = NULL;
+
+// The response that a new sync replaces, restored if the new one cannot be obtained.
+// Responses are only obtained while holding the HTTPS lock, so one copy is shared by all contexts.
+static struct {
+    SyncFields fields;
+    char buffer[IOTCONNECT_SYNC_CACHE_MAX_SIZE];
+    size_t len;
+} previous;
 
 
 static void dump_response(const char* message, IotConnectHttpRequest* response) {
@@ -34,12 +108,8 @@ static void dump_response(const char* message, IotConnectHttpRequest* response)
     }
 }
 
-static void report_sync_error(IotclSyncResponse* response, const char* sync_response_str) {
-    if (NULL == response) {
-        printf("Failed to obtain sync response?\r\n");
-        return;
-    }
-    switch (response->ds) {
+static void report_sync_error(IotclSyncResult ds, const char* sync_response_str) {
+    switch (ds) {
     case IOTCL_SR_DEVICE_NOT_REGISTERED:
         printf("IOTC_SyncResponse error: Not registered\r\n");
         break;
@@ -62,7 +132,7 @@ static void report_sync_error(IotclSyncResponse* response, const char* sync_resp
         printf("IOTC_SyncResponse error: Unknown device status error from server\r\n");
         break;
     case IOTCL_SR_ALLOCATION_ERROR:
-        printf("IOTC_SyncResponse internal error: Allocation Error\r\n");
+        printf("IOTC_SyncResponse internal error: The response does not fit. Increase IOTCONNECT_SYNC_CACHE_MAX_SIZE.\r\n");
         break;
     case IOTCL_SR_PARSING_ERROR:
         printf("IOTC_SyncResponse internal error: Parsing error. Please check parameters passed to the request.\r\n");
@@ -74,175 +144,563 @@ static void report_sync_error(IotclSyncResponse* response, const char* sync_resp
     printf("Raw server response was:\r\n--------------\r\n%s\r\n--------------\r\n", sync_response_str);
 }
 
-static IotclDiscoveryResponse* run_http_discovery(const char* cpid, const char* env) {
+// Splits "https://host/path/" into the host and the path. The path points into url and keeps its slashes.
+static bool split_base_url(const char* url, char* host, size_t host_size, const char** path) {
+    const char* start = strstr(url, "://");
+    if (!start) {
+        return false;
+    }
+    start += 3;
+    const char* slash = strchr(start, '/');
+    size_t host_len = slash ? (size_t) (slash - start) : strlen(start);
+    if (0 == host_len || host_len >= host_size) {
+        return false;
+    }
+    memcpy(host, start, host_len);
+    host[host_len] = 0;
+    *path = slash ? slash : "/";
+    return true;
+}
+
+// Obtains the base URL of the sync API into base_url
+static int run_http_discovery(const char* cpid, const char* env, char* base_url, size_t base_url_size) {
     IotConnectHttpRequest req = { 0 };
+    IotcJsonToken root;
+    IotcJsonToken url;
 
     char resource_str_buff[sizeof(RESOURCE_PATH_DSICOVERY) + CONFIG_IOTCONNECT_CPID_MAX_LEN + CONFIG_IOTCONNECT_ENV_MAX_LEN + 10 /* slack */];
-    sprintf(resource_str_buff, RESOURCE_PATH_DSICOVERY, cpid, env);
+    int resource_len = snprintf(resource_str_buff, sizeof(resource_str_buff), RESOURCE_PATH_DSICOVERY, cpid, env);
+    if (resource_len < 0 || (size_t) resource_len >= sizeof(resource_str_buff)) {
+        printf("Discovery: CPID or environment is too long\r\n");
+        return -1;
+    }
 
     req.host_name = IOTCONNECT_DISCOVERY_HOSTNAME;
     req.resource = resource_str_buff;
-    req.tls_cert = CERT_GODADDY_INT_SECURE_G2;
+    req.trust_anchor = iotc_trust_anchor(IOTC_TRUST_GODADDY_SECURE_G2);
 
+    uint32_t start_ms = iotc_platform_now_ms();
     int status = iotconnect_https_request(&req);
+    iotc_metrics_record_since(IOTC_METRIC_DISCOVERY_TIME, start_ms);
 
     if (status != EXIT_SUCCESS) {
         printf("Discovery: iotconnect_https_request() error code: %x data: %s\r\n", status, req.response);
-        return NULL;
+        return -1;
     }
     if (NULL == req.response || 0 == strlen(req.response)) {
         dump_response("Discovery: Unable to obtain HTTP response,", &req);
-        return NULL;
+        return -1;
     }
 
     char* json_start = strstr(req.response, "{");
     if (NULL == json_start) {
         dump_response("Discovery: No json response from server.", &req);
-        return NULL;
+        return -1;
     }
     if (json_start != req.response) {
         dump_response("WARN: Expected JSON to start immediately in the returned data.", &req);
     }
 
-    IotclDiscoveryResponse* ret = iotcl_discovery_parse_discovery_response(json_start);
-    if (!ret) {
+    if (!iotc_json_view_init(&root, json_start, strlen(json_start)) || !iotc_json_view_get(&root, "baseUrl", &url)
+        || iotc_json_view_copy_string(&url, base_url, base_url_size) <= 0) {
         dump_response("Discovery: Unable to parse HTTP response,", &req);
+        return -1;
+    }
+    return 0;
+}
+
+// Appends a NUL terminated string to the record in the cache buffer. Returns false if it does not fit.
+static bool record_put_string(IotcSyncContext* ctx, const char* str) {
+    size_t str_len = str ? strlen(str) : 0;
+    if (ctx->cache.len + str_len + 1 > sizeof(ctx->cache.buffer)) {
+        return false;
+    }
+    if (str_len) {
+        memcpy(&ctx->cache.buffer[ctx->cache.len], str, str_len);
     }
+    ctx->cache.buffer[ctx->cache.len + str_len] = 0;
+    ctx->cache.len += str_len + 1;
+    return true;
+}
 
-    return ret;
+// Maps the "ds" value of the response. The library enum uses the same numbers as the protocol.
+static IotclSyncResult to_sync_result(long ds) {
+    switch (ds) {
+    case IOTCL_SR_OK:
+    case IOTCL_SR_DEVICE_NOT_REGISTERED:
+    case IOTCL_SR_AUTO_REGISTER:
+    case IOTCL_SR_DEVICE_NOT_FOUND:
+    case IOTCL_SR_DEVICE_INACTIVE:
+    case IOTCL_SR_DEVICE_MOVED:
+    case IOTCL_SR_CPID_NOT_FOUND:
+        return (IotclSyncResult) ds;
+    default:
+        return IOTCL_SR_UNKNOWN_DEVICE_STATUS;
+    }
 }
 
+// Parses the sync response straight into the cache buffer, in the layout of the cache record, and points
+// the fields into it. Nothing is allocated, and the response buffer can be reused right after.
+static bool parse_sync_response(IotcSyncContext* ctx, const char* json) {
+    IotcJsonToken root;
+    IotcJsonToken d;
+    IotcJsonToken p;
+    IotcJsonToken token;
+    size_t offsets[SF_COUNT];
+    long ds;
+
+    if (!iotc_json_view_init(&root, json, strlen(json)) || !iotc_json_view_get(&root, "d", &d)
+        || !iotc_json_view_get(&d, "ds", &token) || !iotc_json_view_to_long(&token, &ds)) {
+        ctx->last_sync_result = IOTCL_SR_PARSING_ERROR;
+        return false;
+    }
+    ctx->last_sync_result = to_sync_result(ds);
+    if (IOTCL_SR_OK != ctx->last_sync_result) {
+        return false;
+    }
+    if (!iotc_json_view_get(&d, "p", &p)) {
+        ctx->last_sync_result = IOTCL_SR_PARSING_ERROR;
+        return false;
+    }
+
+    ctx->cache.len = 0;
+    if (!record_put_string(ctx, ctx->cpid) || !record_put_string(ctx, ctx->env) || !record_put_string(ctx, ctx->duid)) {
+        ctx->last_sync_result = IOTCL_SR_ALLOCATION_ERROR;
+        return false;
+    }
+    for (int i = 0; i < SF_COUNT; i++) {
+        if (!iotc_json_view_get((SF_DTG == i) ? &d : &p, field_keys[i], &token)) {
+            ctx->last_sync_result = IOTCL_SR_PARSING_ERROR;
+            return false;
+        }
+        offsets[i] = ctx->cache.len;
+        int len = iotc_json_view_copy_string(&token, &ctx->cache.buffer[ctx->cache.len],
+                                             sizeof(ctx->cache.buffer) - ctx->cache.len);
+        if (len < 0) {
+            // a string that does not fit, or not a string at all
+            ctx->last_sync_result = (IOTC_JSON_STRING == token.type) ? IOTCL_SR_ALLOCATION_ERROR : IOTCL_SR_PARSING_ERROR;
+            return false;
+        }
+        ctx->cache.len += (size_t) len + 1;
+    }
+    for (int i = 0; i < SF_COUNT; i++) {
+        ctx->fields.values[i] = &ctx->cache.buffer[offsets[i]];
+    }
 
-static IotclSyncResponse* run_http_sync(const char* cpid, const char* uniqueid) {
+    // The attribute names only make telemetry smaller, so the sync does not fail without them
+    int dict_len = iotc_attribute_dictionary_parse(&ctx->fields.dict, &d, &ctx->cache.buffer[ctx->cache.len],
+                                                   sizeof(ctx->cache.buffer) - ctx->cache.len);
+    if (dict_len < 0) {
+        printf("Sync: WARN: The attribute names do not fit. Increase IOTCONNECT_SYNC_CACHE_MAX_SIZE.\r\n");
+        ctx->fields.dict.count = 0;
+        ctx->fields.dict.hash = 0;
+    } else {
+        ctx->cache.len += (size_t) dict_len;
+    }
+    ctx->fields.valid = true;
+    return true;
+}
+
+static int run_http_sync(IotcSyncContext* ctx, const char* host, const char* path) {
     IotConnectHttpRequest req = { 0 };
     char post_data[IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_MAX_LEN + 1] = { 0 };
-    char* sync_path = malloc(strlen(discovery_response->path) + strlen("sync?") + 1);
-    
-    if (!sync_path) {
-        printf("Failed to allocate sync_path\r\n");
-        return NULL;
-    }
-    sprintf(sync_path, RESOURCE_PATH_SYNC, discovery_response->path);
+    char sync_path[IOTCONNECT_SYNC_BASE_URL_MAX_LEN + sizeof("sync")];
+
+    snprintf(sync_path, sizeof(sync_path), RESOURCE_PATH_SYNC, path);
     snprintf(post_data,
         IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_MAX_LEN, /*total length should not exceed MTU size*/
-        IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_TEMPLATE,
-        cpid,
-        uniqueid
+        ctx->attributes ? SYNC_POST_DATA_ATTRIBUTES_TEMPLATE : IOTCONNECT_DISCOVERY_PROTOCOL_POST_DATA_TEMPLATE,
+        ctx->cpid,
+        ctx->duid
     );
 
-    req.host_name = discovery_response->host;
+    req.host_name = (char*) host;
     req.resource = sync_path;
     req.payload = post_data;
-    req.tls_cert = CERT_GODADDY_INT_SECURE_G2;
+    req.trust_anchor = iotc_trust_anchor(IOTC_TRUST_GODADDY_SECURE_G2);
 
+    uint32_t start_ms = iotc_platform_now_ms();
     int status = iotconnect_https_request(&req);
-    free(sync_path);
+    iotc_metrics_record_since(IOTC_METRIC_SYNC_TIME, start_ms);
 
     if (status != EXIT_SUCCESS) {
         printf("Sync: iotconnect_https_request() error code: %x data: %s\r\n", status, req.response);
-        return NULL;
+        return -1;
     }
 
     if (NULL == req.response || 0 == strlen(req.response)) {
         dump_response("Sync: Unable to obtain HTTP response,", &req);
-        return NULL;
+        return -1;
     }
 
     char* json_start = strstr(req.response, "{");
     if (NULL == json_start) {
         dump_response("Sync: No json response from server.", &req);
-        return NULL;
+        return -1;
     }
     if (json_start != req.response) {
         dump_response("WARN: Expected JSON to start immediately in the returned data.", &req);
     }
 
-    IotclSyncResponse* ret = iotcl_discovery_parse_sync_response(json_start);
-    if (!ret) {
-        dump_response("Sync: Unable to parse HTTP response,", &req);
-    } else {
-        last_sync_result = ret->ds;
-        if (ret->ds != IOTCL_SR_OK) {
-            report_sync_error(ret, req.response);
-            iotcl_discovery_free_sync_response(ret);
-            ret = NULL;
+    if (!parse_sync_response(ctx, json_start)) {
+        if (IOTCL_SR_PARSING_ERROR == ctx->last_sync_result) {
+            dump_response("Sync: Unable to parse HTTP response,", &req);
+        } else {
+            report_sync_error(ctx->last_sync_result, req.response);
         }
+        return -1;
+    }
+    return 0;
+}
+
+// Getters never obtain a missing response themselves, so that they cannot block on HTTPS requests
+static const char* get_field(IotcSyncContext* ctx, SyncField field) {
+    if (!ctx || !ctx->fields.valid) return NULL;
+    return ctx->fields.values[field];
+}
+
+IotcSyncContext* iotc_sync_create(const char* cpid, const char* env, const char* duid) {
+    if (!cpid || !env || !duid) {
+        return NULL;
     }
+    for (int i = 0; i < IOTCONNECT_MAX_CLIENTS; i++) {
+        IotcSyncContext* ctx = &contexts[i];
+        if (!ctx->in_use) {
+            memset(ctx, 0, sizeof(*ctx));
+            ctx->in_use = true;
+            ctx->cpid = cpid;
+            ctx->env = env;
+            ctx->duid = duid;
+            ctx->last_sync_result = IOTCL_SR_UNKNOWN_DEVICE_STATUS;
+            return ctx;
+        }
+    }
+    printf("Sync: No free context. Increase IOTCONNECT_MAX_CLIENTS\r\n");
+    return NULL;
+}
+
+void iotc_sync_destroy(IotcSyncContext* ctx) {
+    if (!ctx) {
+        return;
+    }
+    iotc_sync_ctx_free_response(ctx);
+    if (default_ctx == ctx) {
+        default_ctx = NULL;
+    }
+    ctx->in_use = false;
+}
+
+void iotc_sync_set_default(IotcSyncContext* ctx) {
+    default_ctx = ctx;
+}
+
+IotcSyncContext* iotc_sync_get_default(void) {
+    return default_ctx;
+}
+
+const char* iotc_sync_ctx_get_iothub_host(IotcSyncContext* ctx) {
+    return get_field(ctx, SF_HOST);
+}
+
+const char* iotc_sync_ctx_get_username(IotcSyncContext* ctx) {
+    return get_field(ctx, SF_USER_NAME);
+}
+
+const char* iotc_sync_ctx_get_client_id(IotcSyncContext* ctx) {
+    return get_field(ctx, SF_CLIENT_ID);
+}
+
+const char* iotc_sync_ctx_get_pub_topic(IotcSyncContext* ctx) {
+    return get_field(ctx, SF_PUB_TOPIC);
+}
 
-    return ret;
+const char* iotc_sync_ctx_get_sub_topic(IotcSyncContext* ctx) {
+    return get_field(ctx, SF_SUB_TOPIC);
+}
+
+const char* iotc_sync_ctx_get_dtg(IotcSyncContext* ctx) {
+    return get_field(ctx, SF_DTG);
+}
+
+void iotc_sync_ctx_set_attributes(IotcSyncContext* ctx, bool attributes) {
+    ctx->attributes = attributes;
+}
 
+bool iotc_sync_ctx_get_attributes(IotcSyncContext* ctx, IotcAttributeDictionary* dict) {
+    if (!ctx || !ctx->fields.valid) {
+        return false;
+    }
+    *dict = ctx->fields.dict;
+    return true;
 }
 
 const char* iotc_sync_get_iothub_host() {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.host;
+    return get_field(default_ctx, SF_HOST);
 }
 
 const char* iotc_sync_get_username() {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.user_name;
+    return get_field(default_ctx, SF_USER_NAME);
 }
 
 const char* iotc_sync_get_client_id() {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.client_id;
+    return get_field(default_ctx, SF_CLIENT_ID);
 }
 
 const char* iotc_sync_get_pub_topic(void) {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.pub_topic;
+    return get_field(default_ctx, SF_PUB_TOPIC);
 }
 
 const char* iotc_sync_get_sub_topic(void) {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->broker.sub_topic;
+    return get_field(default_ctx, SF_SUB_TOPIC);
 }
 
 
 const char* iotc_sync_get_dtg(void) {
-    if (!sync_response)  iotc_sync_obtain_response();
-    if (!sync_response)  return NULL;
-    return sync_response->dtg;
+    return get_field(default_ctx, SF_DTG);
 }
 
+static void put_le16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+}
 
-int iotc_sync_obtain_response(void) {
-    iotcl_discovery_free_discovery_response(discovery_response);
-    iotcl_discovery_free_sync_response(sync_response);
-    discovery_response = NULL;
-    sync_response = NULL;
-
-    discovery_response = run_http_discovery(IOTCONNECT_CPID, IOTCONNECT_ENV);
-    if (NULL == discovery_response) {
-        // get_base_url will print the error
-        return -1;
+static void put_le32(uint8_t *p, uint32_t v) {
+    put_le16(p, (uint16_t) v);
+    put_le16(p + 2, (uint16_t) (v >> 16));
+}
+
+static uint16_t get_le16(const uint8_t *p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return get_le16(p) | ((uint32_t) get_le16(p + 2) << 16);
+}
+
+// Returns the current unix time, or 0 if the clock has not been set yet
+static uint32_t cache_now(void) {
+    time_t now = time(NULL);
+    return (now > CACHE_MIN_VALID_TIME) ? (uint32_t) now : 0;
+}
+
+static void cache_save(IotcSyncContext *ctx) {
+    uint8_t hdr[CACHE_HDR_SIZE];
+    const uint8_t state = CACHE_STATE_VALID;
+    const IotcStorage *s = ctx->cache.storage;
+    size_t len = ctx->cache.len;
+
+    if (!s) {
+        return;
+    }
+    if (CACHE_HDR_SIZE + len > s->sector_size) {
+        printf("Sync cache: Response is too large to be cached\r\n");
+        return;
+    }
+
+    memset(hdr, 0xFF, sizeof(hdr));
+    hdr[0] = CACHE_MAGIC_0;
+    hdr[1] = CACHE_MAGIC_1;
+    hdr[3] = CACHE_VERSION;
+    put_le16(&hdr[4], (uint16_t) len);
+    put_le32(&hdr[8], cache_now());
+    uint32_t crc = iotc_crc32(0, &hdr[4], 8);
+    put_le32(&hdr[12], iotc_crc32(crc, ctx->cache.buffer, len));
+
+    // The record is committed by writing the state byte last, so a reset while saving leaves no valid record
+    if (s->erase(s->ctx, 0)
+        || s->write(s->ctx, 0, hdr, sizeof(hdr))
+        || s->write(s->ctx, CACHE_HDR_SIZE, ctx->cache.buffer, len)
+        || s->write(s->ctx, CACHE_STATE_OFFSET, &state, 1)) {
+        printf("Sync cache: Failed to write the cache\r\n");
+        return;
+    }
+    printf("Sync cache: Saved %lu bytes\r\n", (unsigned long) len);
+}
+
+// Returns the next string in the record, or NULL if the record is malformed
+static const char* cache_get_string(IotcSyncContext *ctx, size_t *offset, size_t len) {
+    if (*offset >= len) {
+        return NULL;
+    }
+    const char *str = &ctx->cache.buffer[*offset];
+    const char *end = memchr(str, 0, len - *offset);
+    if (!end) {
+        return NULL;
+    }
+    *offset += (size_t) (end - str) + 1;
+    return str;
+}
+
+static bool cache_load(IotcSyncContext *ctx) {
+    uint8_t hdr[CACHE_HDR_SIZE];
+    const IotcStorage *s = ctx->cache.storage;
+    const char *key[3];
+    const char *values[SF_COUNT];
+    size_t offset = 0;
+
+    if (!s || s->read(s->ctx, 0, hdr, sizeof(hdr))) {
+        return false;
+    }
+    if (hdr[0] != CACHE_MAGIC_0 || hdr[1] != CACHE_MAGIC_1 || hdr[CACHE_STATE_OFFSET] != CACHE_STATE_VALID
+        || hdr[3] != CACHE_VERSION) {
+        return false; // nothing saved, invalidated, or written by a different SDK version
+    }
+    size_t len = get_le16(&hdr[4]);
+    uint32_t saved_time = get_le32(&hdr[8]);
+    if (len > sizeof(ctx->cache.buffer) || CACHE_HDR_SIZE + len > s->sector_size
+        || s->read(s->ctx, CACHE_HDR_SIZE, ctx->cache.buffer, len)) {
+        return false;
+    }
+    uint32_t crc = iotc_crc32(0, &hdr[4], 8);
+    if (iotc_crc32(crc, ctx->cache.buffer, len) != get_le32(&hdr[12])) {
+        printf("Sync cache: CRC error\r\n");
+        return false;
     }
-    printf("Discovery response parsing successful.\r\n");
 
-    sync_response = run_http_sync(IOTCONNECT_CPID, IOTCONNECT_DUID);
-    if (NULL == sync_response) {
-        // Sync_call will print the error
-        return -2;
+    for (int i = 0; i < 3; i++) {
+        if (NULL == (key[i] = cache_get_string(ctx, &offset, len))) {
+            return false;
+        }
+    }
+    for (int i = 0; i < SF_COUNT; i++) {
+        if (NULL == (values[i] = cache_get_string(ctx, &offset, len))) {
+            return false;
+        }
+    }
+    // the rest are the attribute names
+    ctx->fields.dict.names = &ctx->cache.buffer[offset];
+    ctx->fields.dict.count = 0;
+    while (cache_get_string(ctx, &offset, len)) {
+        ctx->fields.dict.count++;
+    }
+    if (offset != len) {
+        return false;
+    }
+    ctx->fields.dict.hash = iotc_attribute_dictionary_hash(&ctx->fields.dict);
+    if (0 != strcmp(key[0], ctx->cpid) || 0 != strcmp(key[1], ctx->env)
+        || 0 != strcmp(key[2], ctx->duid)) {
+        printf("Sync cache: Saved for a different device\r\n");
+        return false;
+    }
+    // The age can only be checked if the clock was set when saving and is set now.
+    // Otherwise, the cached values are used until the broker refuses them.
+    uint32_t now = cache_now();
+    if (IOTCONNECT_SYNC_CACHE_MAX_AGE_S > 0 && 0 != saved_time && 0 != now
+        && now - saved_time > (uint32_t) IOTCONNECT_SYNC_CACHE_MAX_AGE_S) {
+        printf("Sync cache: Expired\r\n");
+        return false;
+    }
+
+    memcpy(ctx->fields.values, values, sizeof(ctx->fields.values));
+    ctx->fields.valid = true;
+    ctx->cache.len = len;
+    return true;
+}
+
+void iotc_sync_ctx_set_cache_storage(IotcSyncContext *ctx, const IotcStorage *storage) {
+    ctx->cache.storage = storage;
+}
+
+void iotc_sync_ctx_invalidate_cache(IotcSyncContext *ctx) {
+    const uint8_t state = CACHE_STATE_INVALID;
+    if (ctx->cache.storage) {
+        // clearing bits of the state byte needs no erase
+        (void) ctx->cache.storage->write(ctx->cache.storage->ctx, CACHE_STATE_OFFSET, &state, 1);
+    }
+}
+
+int iotc_sync_ctx_obtain_response(IotcSyncContext *ctx) {
+    char base_url[IOTCONNECT_SYNC_BASE_URL_MAX_LEN + 1];
+    char host[IOTCONNECT_SYNC_BASE_URL_MAX_LEN + 1];
+    const char *path;
+    int ret;
+
+    // other clients may be connecting at the same time, and responses are parsed from the shared HTTP buffer
+    iotconnect_https_lock();
+    // The response is parsed in place, so a failed sync would otherwise leave the context without values,
+    // and reconnects during an outage would have no host or credentials left to try
+    previous.fields = ctx->fields;
+    if (ctx->fields.valid) {
+        memcpy(previous.buffer, ctx->cache.buffer, ctx->cache.len);
+        previous.len = ctx->cache.len;
+    }
+    iotc_sync_ctx_free_response(ctx);
+
+    ret = run_http_discovery(ctx->cpid, ctx->env, base_url, sizeof(base_url));
+    if (0 == ret) {
+        if (split_base_url(base_url, host, sizeof(host), &path)) {
+            printf("Discovery response parsing successful.\r\n");
+            ret = run_http_sync(ctx, host, path) ? -2 : 0;
+        } else {
+            printf("Discovery: Invalid base URL %s\r\n", base_url);
+            ret = -1;
+        }
+    }
+    if (ret && previous.fields.valid) {
+        // the fields point into the buffer, so they are valid again once its contents are back
+        memcpy(ctx->cache.buffer, previous.buffer, previous.len);
+        ctx->cache.len = previous.len;
+        ctx->fields = previous.fields;
+        printf("Sync: Keeping the previous response\r\n");
+    }
+    iotconnect_https_unlock();
+    if (ret) {
+        // the error was printed already
+        return ret;
     }
     printf("Sync response parsing successful.\r\n");
 
-    run_http_sync(IOTCONNECT_CPID, IOTCONNECT_DUID);
-    return (sync_response ? EXIT_SUCCESS : EXIT_FAILURE);
+    cache_save(ctx);
+    return EXIT_SUCCESS;
 }
- 
-void iotc_sync_free_response(void) {
-    if (sync_response) {
-        free(sync_response);
+
+int iotc_sync_ctx_obtain_cached_response(IotcSyncContext *ctx, bool *from_cache) {
+    if (from_cache) {
+        *from_cache = false;
+    }
+    if (ctx->fields.valid) {
+        return EXIT_SUCCESS;
     }
-    if (discovery_response) {
-        free(discovery_response);
+    if (cache_load(ctx)) {
+        printf("Sync cache: Using cached discovery and sync response\r\n");
+        if (from_cache) {
+            *from_cache = true;
+        }
+        return EXIT_SUCCESS;
+    }
+    return iotc_sync_ctx_obtain_response(ctx);
+}
+
+void iotc_sync_ctx_free_response(IotcSyncContext *ctx) {
+    memset(&ctx->fields, 0, sizeof(ctx->fields));
+    ctx->last_sync_result = IOTCL_SR_UNKNOWN_DEVICE_STATUS;
+}
+
+void iotc_sync_set_cache_storage(const IotcStorage *storage) {
+    if (default_ctx) {
+        iotc_sync_ctx_set_cache_storage(default_ctx, storage);
+    }
+}
+
+void iotc_sync_invalidate_cache(void) {
+    if (default_ctx) {
+        iotc_sync_ctx_invalidate_cache(default_ctx);
+    }
+}
+
+int iotc_sync_obtain_response(void) {
+    return default_ctx ? iotc_sync_ctx_obtain_response(default_ctx) : -1;
+}
+
+int iotc_sync_obtain_cached_response(bool *from_cache) {
+    if (from_cache) {
+        *from_cache = false;
+    }
+    return default_ctx ? iotc_sync_ctx_obtain_cached_response(default_ctx, from_cache) : -1;
+}
+
+void iotc_sync_free_response(void) {
+    if (default_ctx) {
+        iotc_sync_ctx_free_response(default_ctx);
     }
-    discovery_response = NULL;
-    sync_response = NULL;
-    last_sync_result = IOTCL_SR_UNKNOWN_DEVICE_STATUS;
 }
@@ -0,0 +1,532 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "iotconnect_cbor.h"
+#include "iotconnect_common.h"
+#include "iotconnect_storage.h"
+#include "iotconnect_telemetry_stream.h"
+
+#ifndef CONFIG_IOTCONNECT_SDK_NAME
+#define CONFIG_IOTCONNECT_SDK_NAME "M_C"
+#endif
+
+#ifndef CONFIG_IOTCONNECT_SDK_VERSION
+#define CONFIG_IOTCONNECT_SDK_VERSION "2.0"
+#endif
+
+#define WRITE_LITERAL(w, s) iotc_json_write_raw((w), (s), sizeof(s) - 1)
+
+void iotc_json_writer_init(IotcJsonWriter *w, char *buf, size_t size) {
+    w->buf = buf;
+    w->size = size;
+    w->len = 0;
+    w->overflow = (NULL == buf || 0 == size);
+}
+
+void iotc_json_write_raw(IotcJsonWriter *w, const char *s, size_t len) {
+    if (w->overflow) {
+        return;
+    }
+    // always leave room for the NUL terminator
+    if (len >= w->size - w->len) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(&w->buf[w->len], s, len);
+    w->len += len;
+}
+
+void iotc_json_write_string_len(IotcJsonWriter *w, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t run_start = 0;
+
+    WRITE_LITERAL(w, "\"");
+    for (size_t i = 0; i < len; i++) {
+        const unsigned char c = (unsigned char) s[i];
+        char esc[6];
+        size_t esc_len = 2;
+        esc[0] = '\\';
+        switch (c) {
+            case '\"': esc[1] = '\"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                if (c >= 32) {
+                    continue; // part of the current unescaped run
+                }
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[c >> 4];
+                esc[5] = hex[c & 0xF];
+                esc_len = 6;
+                break;
+        }
+        iotc_json_write_raw(w, &s[run_start], i - run_start);
+        iotc_json_write_raw(w, esc, esc_len);
+        run_start = i + 1;
+    }
+    iotc_json_write_raw(w, &s[run_start], len - run_start);
+    WRITE_LITERAL(w, "\"");
+}
+
+void iotc_json_write_string(IotcJsonWriter *w, const char *s) {
+    iotc_json_write_string_len(w, s, strlen(s));
+}
+
+static bool compare_double(double a, double b) {
+    double max_val = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+    return (fabs(a - b) <= max_val * DBL_EPSILON);
+}
+
+// Same rules as cJSON's print_number(), so that the output is byte-for-byte identical
+void iotc_json_write_number(IotcJsonWriter *w, double value) {
+    char number_buffer[26];
+    int length;
+    int valueint;
+
+    if (value >= INT_MAX) {
+        valueint = INT_MAX;
+    } else if (value <= (double) INT_MIN) {
+        valueint = INT_MIN;
+    } else {
+        valueint = (int) value;
+    }
+
+    if (isnan(value) || isinf(value)) {
+        length = snprintf(number_buffer, sizeof(number_buffer), "null");
+    } else if (value == (double) valueint) {
+        length = snprintf(number_buffer, sizeof(number_buffer), "%d", valueint);
+    } else {
+        double test = 0.0;
+        length = snprintf(number_buffer, sizeof(number_buffer), "%1.15g", value);
+        // check whether the 15 digits were enough to represent the double exactly (see cJSON's compare_double)
+        if ((sscanf(number_buffer, "%lg", &test) != 1) || !compare_double(test, value)) {
+            length = snprintf(number_buffer, sizeof(number_buffer), "%1.17g", value);
+        }
+    }
+    if (length < 0 || (size_t) length >= sizeof(number_buffer)) {
+        w->overflow = true;
+        return;
+    }
+    iotc_json_write_raw(w, number_buffer, (size_t) length);
+}
+
+void iotc_json_write_key(IotcJsonWriter *w, const char *name, bool first) {
+    if (!first) {
+        WRITE_LITERAL(w, ",");
+    }
+    iotc_json_write_string(w, name);
+    WRITE_LITERAL(w, ":");
+}
+
+const char *iotc_json_writer_finish(IotcJsonWriter *w, size_t *out_len) {
+    if (w->overflow) {
+        if (out_len) {
+            *out_len = 0;
+        }
+        return NULL;
+    }
+    w->buf[w->len] = 0; // iotc_json_write_raw() always leaves room for this
+    if (out_len) {
+        *out_len = w->len;
+    }
+    return w->buf;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Telemetry. Field order follows what iotcl_telemetry_create() and
+// iotcl_telemetry_add_with_iso_time() put into the cJSON tree:
+// {"sdk":{"l":..,"v":..,"e":..},"cpId":..,"dtg":..,"mt":0,"d":[{"id":..,"tg":"","dt":..,"d":{...}},...]}
+
+void iotc_json_write_sdk_info(IotcJsonWriter *w, const char *env) {
+    WRITE_LITERAL(w, "{\"l\":");
+    iotc_json_write_string(w, CONFIG_IOTCONNECT_SDK_NAME);
+    WRITE_LITERAL(w, ",\"v\":");
+    iotc_json_write_string(w, CONFIG_IOTCONNECT_SDK_VERSION);
+    WRITE_LITERAL(w, ",\"e\":");
+    iotc_json_write_string(w, env);
+    WRITE_LITERAL(w, "}");
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// Attribute dictionary
+
+static bool put_name(IotcAttributeDictionary *dict, const IotcJsonToken *name, char *buf, size_t size, size_t *len) {
+    if (IOTC_JSON_STRING != name->type || 0 == name->len) {
+        return true; // nothing to add
+    }
+    int n = iotc_json_view_copy_string(name, &buf[*len], size - *len);
+    if (n < 0) {
+        return false;
+    }
+    *len += (size_t) n + 1;
+    dict->count++;
+    return true;
+}
+
+// "att":[{"p":"","d":[{"ln":"temperature",...},...]},{"p":"gyro","d":[{"ln":"x",...},...]},...]
+int iotc_attribute_dictionary_parse(IotcAttributeDictionary *dict, const IotcJsonToken *d, char *buf, size_t size) {
+    IotcJsonToken att;
+    IotcJsonToken group;
+    IotcJsonToken token;
+    IotcJsonToken attribute;
+    size_t len = 0;
+
+    dict->names = buf;
+    dict->count = 0;
+    if (!iotc_json_view_get(d, "att", &att)) {
+        return 0; // attributes were not requested
+    }
+    for (size_t i = 0; iotc_json_view_get_index(&att, i, &group); i++) {
+        if (iotc_json_view_get(&group, "p", &token) && IOTC_JSON_STRING == token.type && token.len > 0) {
+            if (!put_name(dict, &token, buf, size, &len)) {
+                return -1;
+            }
+            continue;
+        }
+        if (!iotc_json_view_get(&group, "d", &token)) {
+            continue;
+        }
+        for (size_t j = 0; iotc_json_view_get_index(&token, j, &attribute); j++) {
+            IotcJsonToken name;
+            if (iotc_json_view_get(&attribute, "ln", &name) && !put_name(dict, &name, buf, size, &len)) {
+                return -1;
+            }
+        }
+    }
+    dict->hash = iotc_crc32(0, buf, len);
+    return (int) len;
+}
+
+int iotc_attribute_dictionary_find(const IotcAttributeDictionary *dict, const char *name) {
+    const char *p = dict->names;
+    for (size_t i = 0; i < dict->count; i++) {
+        if (0 == strcmp(p, name)) {
+            return (int) i;
+        }
+        p += strlen(p) + 1;
+    }
+    return -1;
+}
+
+const char *iotc_attribute_dictionary_get(const IotcAttributeDictionary *dict, size_t index) {
+    const char *p = dict->names;
+    if (index >= dict->count) {
+        return NULL;
+    }
+    for (size_t i = 0; i < index; i++) {
+        p += strlen(p) + 1;
+    }
+    return p;
+}
+
+uint32_t iotc_attribute_dictionary_hash(const IotcAttributeDictionary *dict) {
+    const char *end = dict->names;
+    for (size_t i = 0; i < dict->count; i++) {
+        end += strlen(end) + 1;
+    }
+    return iotc_crc32(0, dict->names, (size_t) (end - dict->names));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// CBOR. Values are only converted when the decoder can restore the exact same text.
+
+static bool parse_digits(const char *s, size_t count, int *value) {
+    *value = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+        *value = *value * 10 + (s[i] - '0');
+    }
+    return true;
+}
+
+static int64_t days_from_civil(int y, int m, int d) {
+    y -= (m <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = (int) (y - era * 400);
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// "2022-07-01T12:00:00.000Z"
+static bool parse_iso_time_ms(const char *s, uint64_t *ms) {
+    static const int month_days[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int year, month, day, hour, minute, second, milli;
+    if (24 != strlen(s) || s[4] != '-' || s[7] != '-' || s[10] != 'T' || s[13] != ':' || s[16] != ':'
+        || s[19] != '.' || s[23] != 'Z'
+        || !parse_digits(s, 4, &year) || !parse_digits(&s[5], 2, &month) || !parse_digits(&s[8], 2, &day)
+        || !parse_digits(&s[11], 2, &hour) || !parse_digits(&s[14], 2, &minute)
+        || !parse_digits(&s[17], 2, &second) || !parse_digits(&s[20], 3, &milli)) {
+        return false;
+    }
+    bool leap = (0 == year % 4 && 0 != year % 100) || 0 == year % 400;
+    if (year < 1970 || month < 1 || month > 12 || day < 1 || day > month_days[month - 1]
+        || (2 == month && 29 == day && !leap) || hour > 23 || minute > 59 || second > 59) {
+        return false;
+    }
+    int64_t seconds = days_from_civil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    *ms = (uint64_t) seconds * 1000U + (uint64_t) milli;
+    return true;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+// "0f8fad5b-d9cb-469f-a165-70867728950e"
+static bool parse_guid(const char *s, uint8_t guid[16]) {
+    size_t n = 0;
+    if (36 != strlen(s)) {
+        return false;
+    }
+    for (size_t i = 0; i < 36;) {
+        if (8 == i || 13 == i || 18 == i || 23 == i) {
+            if (s[i++] != '-') {
+                return false;
+            }
+            continue;
+        }
+        int hi = hex_value(s[i]);
+        int lo = hex_value(s[i + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        guid[n++] = (uint8_t) ((hi << 4) | lo);
+        i += 2;
+    }
+    return 16 == n;
+}
+
+static void cbor_write_string(IotcJsonWriter *w, const char *s) {
+    iotc_cbor_write_text(w, s, strlen(s));
+}
+
+static void cbor_begin(IotcTelemetryStream *s) {
+    IotcJsonWriter *w = &s->w;
+    uint8_t guid[16];
+
+    iotc_cbor_begin_map(w);
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_VERSION);
+    iotc_cbor_write_uint(w, IOTC_CBOR_FORMAT_VERSION);
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_ENV);
+    cbor_write_string(w, s->config->device.env);
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_CPID);
+    cbor_write_string(w, s->config->device.cpid);
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_DTG);
+    if (parse_guid(s->config->telemetry.dtg, guid)) {
+        iotc_cbor_write_bytes(w, guid, sizeof(guid));
+    } else {
+        cbor_write_string(w, s->config->telemetry.dtg);
+    }
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_ID);
+    cbor_write_string(w, s->config->device.duid);
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_DICTIONARY);
+    iotc_cbor_write_uint(w, s->dict ? s->dict->hash : 0);
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_POINTS);
+    iotc_cbor_begin_array(w);
+}
+
+static void cbor_add_point(IotcTelemetryStream *s, const char *iso_time) {
+    IotcJsonWriter *w = &s->w;
+    uint64_t ms;
+
+    if (s->points > 0) {
+        iotc_cbor_write_break(w); // data
+        iotc_cbor_write_break(w); // point
+    }
+    iotc_cbor_begin_map(w);
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_TIME);
+    if (parse_iso_time_ms(iso_time, &ms)) {
+        iotc_cbor_write_uint(w, ms);
+    } else {
+        cbor_write_string(w, iso_time);
+    }
+    iotc_cbor_write_uint(w, IOTC_CBOR_KEY_DATA);
+    iotc_cbor_begin_map(w);
+}
+
+static void cbor_write_key(IotcTelemetryStream *s, const char *name) {
+    int index = s->dict ? iotc_attribute_dictionary_find(s->dict, name) : -1;
+    if (index >= 0) {
+        iotc_cbor_write_uint(&s->w, (uint64_t) index);
+    } else {
+        cbor_write_string(&s->w, name);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+bool iotc_telemetry_stream_begin(IotcTelemetryStream *s, const IotclConfig *config, char *buf, size_t size) {
+    return iotc_telemetry_stream_begin_format(s, config, IOTC_TELEMETRY_JSON, NULL, buf, size);
+}
+
+bool iotc_telemetry_stream_begin_format(IotcTelemetryStream *s, const IotclConfig *config, IotcTelemetryFormat format,
+                                        const IotcAttributeDictionary *dict, char *buf, size_t size) {
+    iotc_json_writer_init(&s->w, buf, size);
+    s->config = config;
+    s->points = 0;
+    s->fields = 0;
+    s->format = format;
+    s->dict = dict;
+    if (!config || !config->device.env || !config->device.cpid || !config->device.duid || !config->telemetry.dtg) {
+        s->w.overflow = true;
+        return false;
+    }
+
+    IotcJsonWriter *w = &s->w;
+    if (IOTC_TELEMETRY_CBOR == format) {
+        cbor_begin(s);
+        return !w->overflow;
+    }
+    WRITE_LITERAL(w, "{\"sdk\":");
+    iotc_json_write_sdk_info(w, config->device.env);
+    WRITE_LITERAL(w, ",\"cpId\":");
+    iotc_json_write_string(w, config->device.cpid);
+    WRITE_LITERAL(w, ",\"dtg\":");
+    iotc_json_write_string(w, config->telemetry.dtg);
+    WRITE_LITERAL(w, ",\"mt\":0,\"d\":[");
+    return !w->overflow;
+}
+
+bool iotc_telemetry_stream_add_point(IotcTelemetryStream *s, const char *iso_time) {
+    IotcJsonWriter *w = &s->w;
+    if (!iso_time) {
+        iso_time = iotcl_iso_timestamp_now();
+    }
+    if (IOTC_TELEMETRY_CBOR == s->format) {
+        cbor_add_point(s, iso_time);
+        s->points++;
+        s->fields = 0;
+        return !w->overflow;
+    }
+    if (s->points > 0) {
+        WRITE_LITERAL(w, "}},");
+    }
+    WRITE_LITERAL(w, "{\"id\":");
+    iotc_json_write_string(w, s->config->device.duid);
+    WRITE_LITERAL(w, ",\"tg\":\"\",\"dt\":");
+    iotc_json_write_string(w, iso_time);
+    WRITE_LITERAL(w, ",\"d\":{");
+    s->points++;
+    s->fields = 0;
+    return !w->overflow;
+}
+
+static bool begin_field(IotcTelemetryStream *s, const char *name) {
+    if (!name || s->w.overflow) {
+        return false;
+    }
+    if (0 == s->points && !iotc_telemetry_stream_add_point(s, NULL)) {
+        return false;
+    }
+    if (IOTC_TELEMETRY_CBOR == s->format) {
+        cbor_write_key(s, name);
+    } else {
+        iotc_json_write_key(&s->w, name, 0 == s->fields);
+    }
+    s->fields++;
+    return true;
+}
+
+bool iotc_telemetry_stream_set_number(IotcTelemetryStream *s, const char *name, double value) {
+    if (!begin_field(s, name)) {
+        return false;
+    }
+    if (IOTC_TELEMETRY_CBOR == s->format) {
+        iotc_cbor_write_number(&s->w, value);
+    } else {
+        iotc_json_write_number(&s->w, value);
+    }
+    return !s->w.overflow;
+}
+
+bool iotc_telemetry_stream_set_string(IotcTelemetryStream *s, const char *name, const char *value) {
+    if (!value || !begin_field(s, name)) {
+        return false;
+    }
+    if (IOTC_TELEMETRY_CBOR == s->format) {
+        cbor_write_string(&s->w, value);
+    } else {
+        iotc_json_write_string(&s->w, value);
+    }
+    return !s->w.overflow;
+}
+
+bool iotc_telemetry_stream_set_bool(IotcTelemetryStream *s, const char *name, bool value) {
+    if (!begin_field(s, name)) {
+        return false;
+    }
+    if (IOTC_TELEMETRY_CBOR == s->format) {
+        iotc_cbor_write_bool(&s->w, value);
+    } else if (value) {
+        WRITE_LITERAL(&s->w, "true");
+    } else {
+        WRITE_LITERAL(&s->w, "false");
+    }
+    return !s->w.overflow;
+}
+
+bool iotc_telemetry_stream_set_null(IotcTelemetryStream *s, const char *name) {
+    if (!begin_field(s, name)) {
+        return false;
+    }
+    if (IOTC_TELEMETRY_CBOR == s->format) {
+        iotc_cbor_write_null(&s->w);
+    } else {
+        WRITE_LITERAL(&s->w, "null");
+    }
+    return !s->w.overflow;
+}
+
+void iotc_telemetry_stream_mark(const IotcTelemetryStream *s, IotcTelemetryStreamMark *mark) {
+    mark->len = s->w.len;
+    mark->points = s->points;
+    mark->fields = s->fields;
+}
+
+void iotc_telemetry_stream_rewind(IotcTelemetryStream *s, const IotcTelemetryStreamMark *mark) {
+    s->w.len = mark->len;
+    s->w.overflow = false;
+    s->points = mark->points;
+    s->fields = mark->fields;
+}
+
+// CBOR closes the same containers with one break byte each, so both formats need the same room
+size_t iotc_telemetry_stream_finish_len(const IotcTelemetryStream *s) {
+    return (s->points > 0 ? sizeof("}}]}") : sizeof("]}"));
+}
+
+const char *iotc_telemetry_stream_finish(IotcTelemetryStream *s, size_t *out_len) {
+    if (IOTC_TELEMETRY_CBOR == s->format) {
+        if (s->points > 0) {
+            iotc_cbor_write_break(&s->w);
+            iotc_cbor_write_break(&s->w);
+        }
+        iotc_cbor_write_break(&s->w);
+        iotc_cbor_write_break(&s->w);
+        return iotc_json_writer_finish(&s->w, out_len);
+    }
+    if (s->points > 0) {
+        WRITE_LITERAL(&s->w, "}}");
+    }
+    WRITE_LITERAL(&s->w, "]}");
+    return iotc_json_writer_finish(&s->w, out_len);
+}
@@ -0,0 +1,451 @@
+//
+// Copyright: Avnet 2022
+//
+
+// Benchmarks of the SDK hot paths: telemetry serialization, publishing, inbound event processing and acks.
+// The SDK runs unmodified over the in-memory loopback transport (see loopback.h), so nothing goes to the network
+// and the results only reflect the SDK, coreMQTT, cJSON and the IoTConnect library.
+// Heap usage is measured by wrapping malloc() and friends at link time (-Wl,--wrap).
+//
+// Usage: iotc-bench [-n iterations] [-o output.json]
+// Results are written as JSON, so that runs of different releases can be compared with a diff.
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iotconnect.h"
+#include "iotconnect_arena.h"
+#include "iotconnect_lib.h"
+#include "iotconnect_telemetry.h"
+#include "iotconnect_event_view.h"
+#include "iotconnect_telemetry_stream.h"
+#include "iotc_device_client.h"
+#include "loopback.h"
+
+#define BENCH_CPID "BENCH"
+#define BENCH_ENV "bench"
+#define BENCH_DUID "bench-device"
+#define BENCH_CLIENT_ID BENCH_CPID "-" BENCH_DUID
+#define BENCH_C2D_TOPIC "devices/" BENCH_CLIENT_ID "/messages/devicebound/bench"
+#define BENCH_PUB_TOPIC "devices/" BENCH_CLIENT_ID "/messages/events/"
+#define BENCH_ISO_TIME "2022-07-01T12:00:00.000Z"
+
+#define DEFAULT_ITERATIONS 100000
+#define MAX_RESULTS 16
+
+static const char command_event[] = "{\"cmdType\":\"0x01\",\"data\":{\"cpid\":\"" BENCH_CPID "\","
+    "\"guid\":\"9d2a4fd2-7d0b-4c02-9d2c-0a55b1d2f3e1\",\"uniqueId\":\"" BENCH_DUID "\",\"command\":\"led-red on\","
+    "\"ack\":true,\"ackId\":\"5a3c1e5e-1f6b-4d2a-8c1b-2f4e6d8a0b1c\",\"cmdType\":\"0x01\"}}";
+
+static const char ota_event[] = "{\"cmdType\":\"0x02\",\"data\":{\"cpid\":\"" BENCH_CPID "\","
+    "\"guid\":\"9d2a4fd2-7d0b-4c02-9d2c-0a55b1d2f3e1\",\"uniqueId\":\"" BENCH_DUID "\",\"command\":\"ota\","
+    "\"ack\":true,\"ackId\":\"7e1d2c3b-4a5f-4e6d-9c8b-7a6f5e4d3c2b\",\"cmdType\":\"0x02\","
+    "\"ver\":{\"sw\":\"1.1.0\",\"hw\":\"1.0\"},\"urls\":[{\"url\":\"https://firmware.example.com/app-1.1.0.bin\"}]}}";
+
+///////////////////////////////////////////////////////////////////////////////////
+// Heap accounting. Sizes are the usable sizes reported by the allocator.
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static struct {
+    unsigned long allocs;
+    unsigned long long bytes; // total allocated
+    long long current;
+    long long peak;
+} heap;
+
+static void heap_add(void *p) {
+    if (p) {
+        size_t size = malloc_usable_size(p);
+        heap.allocs++;
+        heap.bytes += size;
+        heap.current += (long long) size;
+        if (heap.current > heap.peak) {
+            heap.peak = heap.current;
+        }
+    }
+}
+
+static void heap_remove(void *p) {
+    if (p) {
+        heap.current -= (long long) malloc_usable_size(p);
+    }
+}
+
+void *__wrap_malloc(size_t size) {
+    void *p = __real_malloc(size);
+    heap_add(p);
+    return p;
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    void *p = __real_calloc(count, size);
+    heap_add(p);
+    return p;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    heap_remove(ptr);
+    void *p = __real_realloc(ptr, size);
+    heap_add(p ? p : ptr); // the original block is kept if realloc fails
+    return p;
+}
+
+void __wrap_free(void *ptr) {
+    heap_remove(ptr);
+    __real_free(ptr);
+}
+
+// strdup() allocates inside libc, where malloc() is not wrapped, but its result is freed with the wrapped free()
+char *__wrap_strdup(const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = __wrap_malloc(len);
+    if (p) {
+        memcpy(p, s, len);
+    }
+    return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Benchmark runner
+
+typedef struct {
+    const char *name;
+    unsigned long ops;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;
+    long long peak_heap_bytes; // above the heap in use when the benchmark started
+} BenchResult;
+
+static BenchResult results[MAX_RESULTS];
+static size_t result_count = 0;
+static unsigned long iterations = DEFAULT_ITERATIONS;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000U + (uint64_t) ts.tv_nsec;
+}
+
+static void run(const char *name, void (*op)(void)) {
+    unsigned long warmup = iterations / 10 + 1;
+    for (unsigned long i = 0; i < warmup; i++) {
+        op();
+    }
+
+    unsigned long allocs = heap.allocs;
+    unsigned long long bytes = heap.bytes;
+    long long base = heap.current;
+    heap.peak = heap.current;
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        op();
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    BenchResult *r = &results[result_count++];
+    r->name = name;
+    r->ops = iterations;
+    r->ns_per_op = (double) elapsed / (double) iterations;
+    r->allocs_per_op = (double) (heap.allocs - allocs) / (double) iterations;
+    r->bytes_per_op = (double) (heap.bytes - bytes) / (double) iterations;
+    r->peak_heap_bytes = heap.peak - base;
+}
+
+// For parts of an operation that cannot be run on their own, like creating an ack inside an event callback
+typedef struct {
+    const char *name;
+    uint64_t ns;
+    unsigned long ops;
+    unsigned long allocs;
+    unsigned long long bytes;
+    long long peak;
+} BenchSection;
+
+static BenchSection *current_section = NULL;
+static long long section_base;
+static long long section_outer_peak; // peak of the enclosing run()
+static uint64_t section_start;
+
+static void section_begin(void) {
+    if (current_section) {
+        section_base = heap.current;
+        section_outer_peak = heap.peak;
+        heap.peak = heap.current;
+        current_section->allocs -= heap.allocs;
+        current_section->bytes -= heap.bytes;
+        section_start = now_ns();
+    }
+}
+
+static void section_end(void) {
+    if (current_section) {
+        current_section->ns += now_ns() - section_start;
+        current_section->ops++;
+        current_section->allocs += heap.allocs;
+        current_section->bytes += heap.bytes;
+        if (heap.peak - section_base > current_section->peak) {
+            current_section->peak = heap.peak - section_base;
+        }
+        if (section_outer_peak > heap.peak) {
+            heap.peak = section_outer_peak;
+        }
+    }
+}
+
+static void add_section_result(const BenchSection *s) {
+    BenchResult *r = &results[result_count++];
+    r->name = s->name;
+    r->ops = s->ops;
+    r->ns_per_op = s->ops ? (double) s->ns / (double) s->ops : 0;
+    r->allocs_per_op = s->ops ? (double) s->allocs / (double) s->ops : 0;
+    r->bytes_per_op = s->ops ? (double) s->bytes / (double) s->ops : 0;
+    r->peak_heap_bytes = s->peak;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Operations
+
+static IotcDeviceClient *device_client = NULL;
+static char telemetry_buffer[512];
+static const char *telemetry_message = NULL;
+static size_t telemetry_message_len = 0;
+static size_t telemetry_cbor_len = 0;
+
+static void op_telemetry_stream(void) {
+    IotcTelemetryStream s;
+    size_t len;
+    iotc_telemetry_stream_begin(&s, iotconnect_sdk_get_lib_config(), telemetry_buffer, sizeof(telemetry_buffer));
+    iotc_telemetry_stream_add_point(&s, BENCH_ISO_TIME);
+    iotc_telemetry_stream_set_string(&s, "version", "1.0.0");
+    iotc_telemetry_stream_set_number(&s, "cpu", 3.123);
+    iotc_telemetry_stream_set_number(&s, "temperature", 21.5);
+    iotc_telemetry_stream_set_bool(&s, "door_open", false);
+    if (!iotc_telemetry_stream_finish(&s, &len)) {
+        fprintf(stderr, "Telemetry does not fit into the buffer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Same message in the binary format, with the attribute dictionary of the stub sync response
+static void op_telemetry_stream_cbor(void) {
+    IotcTelemetryStream s;
+    iotconnect_sdk_telemetry_begin(&s, telemetry_buffer, sizeof(telemetry_buffer));
+    iotc_telemetry_stream_add_point(&s, BENCH_ISO_TIME);
+    iotc_telemetry_stream_set_string(&s, "version", "1.0.0");
+    iotc_telemetry_stream_set_number(&s, "cpu", 3.123);
+    iotc_telemetry_stream_set_number(&s, "temperature", 21.5);
+    iotc_telemetry_stream_set_bool(&s, "door_open", false);
+    if (!iotc_telemetry_stream_finish(&s, &telemetry_cbor_len)) {
+        fprintf(stderr, "Telemetry does not fit into the buffer\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void op_telemetry_iotcl(void) {
+    IotclMessageHandle msg = iotcl_telemetry_create(iotconnect_sdk_get_lib_config());
+    iotcl_telemetry_add_with_iso_time(msg, BENCH_ISO_TIME);
+    iotcl_telemetry_set_string(msg, "version", "1.0.0");
+    iotcl_telemetry_set_number(msg, "cpu", 3.123);
+    iotcl_telemetry_set_number(msg, "temperature", 21.5);
+    iotcl_telemetry_set_bool(msg, "door_open", false);
+    const char *str = iotcl_create_serialized_string(msg, false);
+    iotcl_telemetry_destroy(msg);
+    iotcl_destroy_serialized(str);
+}
+
+static void op_device_client_send(void) {
+    if (iotc_device_client_send_message(device_client, telemetry_message)) {
+        fprintf(stderr, "Failed to send a message\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void op_device_client_send_len(void) {
+    if (iotc_device_client_send_message_len(device_client, telemetry_message, telemetry_message_len)) {
+        fprintf(stderr, "Failed to send a message\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void inject_and_process(const char *event, size_t len) {
+    if (loopback_inject_publish(BENCH_CLIENT_ID, BENCH_C2D_TOPIC, event, len)) {
+        fprintf(stderr, "Failed to inject an event\n");
+        exit(EXIT_FAILURE);
+    }
+    iotconnect_sdk_loop(0);
+}
+
+static void op_c2d_command(void) {
+    inject_and_process(command_event, sizeof(command_event) - 1);
+}
+
+static void op_c2d_ota(void) {
+    inject_and_process(ota_event, sizeof(ota_event) - 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// SDK callbacks. The acks are created but not sent, so that only the inbound path is measured.
+
+static BenchSection ack_iotcl = { .name = "ack_iotcl" };
+static BenchSection ack_view = { .name = "ack_event_view" };
+
+static void on_lib_event(IotclEventData data) {
+    section_begin();
+    const char *ack = iotcl_create_ack_string_and_destroy_event(data, true, "OK");
+    iotcl_destroy_serialized(ack); // printed by cJSON, so it is released through the cJSON hooks
+    section_end();
+}
+
+static void on_view_event(IotConnectClient *client, const IotcEventView *event) {
+    char buf[384];
+    section_begin();
+    const char *ack = iotc_event_view_write_ack(event, iotconnect_client_get_lib_config(client), true, "OK", buf,
+        sizeof(buf), NULL);
+    section_end();
+    if (!ack) {
+        fprintf(stderr, "Failed to create an ack\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+
+static int connect_sdk(bool use_views) {
+    IotConnectClientConfig *config = iotconnect_sdk_init_and_get_config();
+    config->cpid = BENCH_CPID;
+    config->env = BENCH_ENV;
+    config->duid = BENCH_DUID;
+    config->qos = 1;
+    config->auth_info.type = IOTC_AT_X509;
+    config->cmd_cb = use_views ? NULL : on_lib_event;
+    config->ota_cb = use_views ? NULL : on_lib_event;
+    config->cmd_view_cb = use_views ? on_view_event : NULL;
+    config->ota_view_cb = use_views ? on_view_event : NULL;
+    config->telemetry_format = IOTC_TELEMETRY_CBOR; // only for op_telemetry_stream_cbor
+    return iotconnect_sdk_init();
+}
+
+static int connect_device_client(int qos) {
+    IotConnectDeviceClientConfig dc = { 0 };
+    dc.host = "loopback.local";
+    dc.client_id = "bench-publisher";
+    dc.username = "bench-publisher";
+    dc.pub_topic = BENCH_PUB_TOPIC;
+    dc.sub_topic = "devices/bench-publisher/messages/devicebound/#";
+    dc.qos = qos;
+    if (!device_client) {
+        device_client = iotc_device_client_create();
+    }
+    return device_client ? iotc_device_client_init(device_client, &dc) : -1;
+}
+
+static void write_results(FILE *f) {
+    LoopbackStats stats;
+    IotcArenaStats arena;
+    loopback_get_stats(&stats);
+    iotc_arena_get_stats(&arena);
+    fprintf(f, "{\n  \"tool\": \"iotc-bench\",\n  \"iterations\": %lu,\n", iterations);
+    fprintf(f, "  \"telemetry_bytes\": %lu,\n", (unsigned long) telemetry_message_len);
+    fprintf(f, "  \"telemetry_cbor_bytes\": %lu,\n", (unsigned long) telemetry_cbor_len);
+    fprintf(f, "  \"loopback_publishes\": %lu,\n", stats.publishes);
+    // The loopback HTTPS client needs no buffer, so only the MQTT buffers show up
+    fprintf(f, "  \"arena\": {\"size\": %lu, \"provisioning_peak\": %lu, \"connected_peak\": %lu, "
+        "\"connected_mqtt_peak\": %lu, \"failures\": %lu},\n", (unsigned long) arena.size,
+        (unsigned long) arena.peak[IOTC_ARENA_PROVISIONING], (unsigned long) arena.peak[IOTC_ARENA_CONNECTED],
+        (unsigned long) arena.user_peak[IOTC_ARENA_CONNECTED][IOTC_ARENA_MQTT], (unsigned long) arena.failures);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < result_count; i++) {
+        const BenchResult *r = &results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"ops\": %lu, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, "
+            "\"bytes_per_op\": %.1f, \"peak_heap_bytes\": %lld}%s\n", r->name, r->ops, r->ns_per_op,
+            r->allocs_per_op, r->bytes_per_op, r->peak_heap_bytes, (i + 1 < result_count) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-o output.json]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (0 == iterations) {
+        iterations = DEFAULT_ITERATIONS;
+    }
+
+    // The SDK logs every event to stdout, which would swamp the timings if it went to a terminal.
+    // It still formats the messages, as it would on a device.
+    FILE *out = output_path ? fopen(output_path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "Unable to open the output\n");
+        return EXIT_FAILURE;
+    }
+
+    if (connect_sdk(false)) {
+        fprintf(stderr, "Unable to connect the SDK over the loopback transport\n");
+        return EXIT_FAILURE;
+    }
+
+    run("telemetry_stream", op_telemetry_stream);
+    run("telemetry_stream_cbor", op_telemetry_stream_cbor);
+    run("telemetry_iotcl", op_telemetry_iotcl);
+
+    op_telemetry_stream();
+    telemetry_message = telemetry_buffer;
+    telemetry_message_len = strlen(telemetry_buffer);
+
+    if (connect_device_client(0)) {
+        fprintf(stderr, "Unable to connect the device client\n");
+        return EXIT_FAILURE;
+    }
+    run("device_client_send_qos0", op_device_client_send);
+    run("device_client_send_len_qos0", op_device_client_send_len);
+    if (connect_device_client(1)) {
+        fprintf(stderr, "Unable to connect the device client\n");
+        return EXIT_FAILURE;
+    }
+    run("device_client_send_qos1", op_device_client_send);
+    iotc_device_client_destroy(device_client);
+
+    current_section = &ack_iotcl;
+    run("c2d_command_iotcl", op_c2d_command);
+    run("c2d_ota_iotcl", op_c2d_ota);
+    add_section_result(&ack_iotcl);
+
+    if (connect_sdk(true)) {
+        fprintf(stderr, "Unable to reconnect the SDK over the loopback transport\n");
+        return EXIT_FAILURE;
+    }
+    current_section = &ack_view;
+    run("c2d_command_view", op_c2d_command);
+    run("c2d_ota_view", op_c2d_ota);
+    add_section_result(&ack_view);
+    current_section = NULL;
+
+    iotconnect_sdk_disconnect();
+
+    write_results(out);
+    fclose(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,28 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+#include <stddef.h>
+
+// In-memory stand-ins for the TLS transport (iotc_posix_tls.h) and the HTTPS client (iotc_http_request.h)
+// of the POSIX layer. Linked in place of them, they let the SDK run unmodified without a network.
+// The transport acts as the MQTT broker: it answers CONNECT, SUBSCRIBE, PUBLISH with QoS 1 and PINGREQ right away,
+// and discards everything that the client publishes.
+// The HTTPS client answers discovery and sync for any device with a response pointing to the loopback broker.
+
+typedef struct {
+    unsigned long connects;
+    unsigned long publishes; // received from clients
+    unsigned long publish_bytes; // payload bytes of the above
+} LoopbackStats;
+
+// Queues a QoS 0 PUBLISH for the connection of the client with the MQTT client ID.
+// Returns 0 on success, or -1 if there is no such connection or its receive buffer is full.
+int loopback_inject_publish(const char *client_id, const char *topic, const char *payload, size_t len);
+
+void loopback_get_stats(LoopbackStats *stats);
+
+#endif // LOOPBACK_H
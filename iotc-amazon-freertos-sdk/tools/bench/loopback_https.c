@@ -0,0 +1,34 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdlib.h>
+
+#include "iotc_http_request.h"
+#include "loopback.h"
+#include "stub_responses.h"
+
+#define LOOPBACK_HOST "loopback.local"
+
+static char response[2048];
+
+int iotconnect_https_request(IotConnectHttpRequest *request) {
+    int len;
+    request->response = NULL;
+    if (request->payload) {
+        len = stub_write_sync_response(response, sizeof(response), request->payload, LOOPBACK_HOST);
+    } else {
+        len = stub_write_discovery_response(response, sizeof(response), LOOPBACK_HOST);
+    }
+    if (len < 0) {
+        return EXIT_FAILURE;
+    }
+    request->response = response;
+    return EXIT_SUCCESS;
+}
+
+void iotconnect_https_lock(void) {
+}
+
+void iotconnect_https_unlock(void) {
+}
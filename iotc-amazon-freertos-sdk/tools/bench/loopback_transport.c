@@ -0,0 +1,267 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "iotc_posix_tls.h"
+#include "loopback.h"
+
+#define MAX_CONNECTIONS 8
+#define TX_BUFFER_SIZE 4096
+#define RX_BUFFER_SIZE 16384
+#define MAX_CLIENT_ID_LEN 127
+
+// One side of a connection. The eventfd stands in for the socket,
+// so that the device client can wait for it with epoll. It is readable while rx holds data.
+typedef struct {
+    bool in_use;
+    int fd;
+    char client_id[MAX_CLIENT_ID_LEN + 1];
+    uint8_t tx[TX_BUFFER_SIZE]; // a partially sent packet
+    size_t tx_len;
+    uint8_t rx[RX_BUFFER_SIZE]; // packets for the client
+    size_t rx_len;
+    size_t rx_pos;
+} Connection;
+
+static Connection connections[MAX_CONNECTIONS];
+static LoopbackStats stats;
+
+static Connection *find_connection(int fd) {
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].in_use && connections[i].fd == fd) {
+            return &connections[i];
+        }
+    }
+    return NULL;
+}
+
+static int queue_rx(Connection *conn, const uint8_t *data, size_t len) {
+    if (conn->rx_pos > 0) {
+        memmove(conn->rx, conn->rx + conn->rx_pos, conn->rx_len - conn->rx_pos);
+        conn->rx_len -= conn->rx_pos;
+        conn->rx_pos = 0;
+    }
+    if (len > sizeof(conn->rx) - conn->rx_len) {
+        return -1;
+    }
+    memcpy(conn->rx + conn->rx_len, data, len);
+    conn->rx_len += len;
+    uint64_t one = 1;
+    (void) write(conn->fd, &one, sizeof(one));
+    return 0;
+}
+
+static uint16_t read_u16(const uint8_t *p) {
+    return (uint16_t) ((p[0] << 8) | p[1]);
+}
+
+// body points past the fixed header
+static void handle_packet(Connection *conn, uint8_t type, const uint8_t *body, size_t len) {
+    switch (type & 0xF0U) {
+        case 0x10: { // CONNECT. Protocol name (6), level (1), flags (1) and keep-alive (2), then the client ID.
+            static const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+            if (len >= 12) {
+                size_t id_len = read_u16(body + 10);
+                if (id_len > MAX_CLIENT_ID_LEN || 12 + id_len > len) {
+                    id_len = 0;
+                }
+                memcpy(conn->client_id, body + 12, id_len);
+                conn->client_id[id_len] = 0;
+            }
+            stats.connects++;
+            (void) queue_rx(conn, connack, sizeof(connack));
+            break;
+        }
+        case 0x80: { // SUBSCRIBE. Grant QoS 1.
+            uint8_t suback[] = { 0x90, 0x03, body[0], body[1], 0x01 };
+            (void) queue_rx(conn, suback, sizeof(suback));
+            break;
+        }
+        case 0x30: { // PUBLISH
+            unsigned int qos = (type >> 1) & 0x03U;
+            size_t header_len = 2 + read_u16(body) + (qos > 0 ? 2 : 0);
+            stats.publishes++;
+            stats.publish_bytes += (len > header_len) ? (unsigned long) (len - header_len) : 0;
+            if (qos > 0) {
+                const uint8_t *id = body + header_len - 2;
+                uint8_t puback[] = { 0x40, 0x02, id[0], id[1] };
+                (void) queue_rx(conn, puback, sizeof(puback));
+            }
+            break;
+        }
+        case 0xC0: { // PINGREQ
+            static const uint8_t pingresp[] = { 0xD0, 0x00 };
+            (void) queue_rx(conn, pingresp, sizeof(pingresp));
+            break;
+        }
+        default:
+            break; // DISCONNECT, and PUBACK for injected messages
+    }
+}
+
+// Handles the complete packets in tx. Returns -1 if a packet is too large for the buffer.
+static int process_tx(Connection *conn) {
+    for (;;) {
+        size_t remaining = 0;
+        size_t pos = 1;
+        unsigned int shift = 0;
+        // remaining length, 7 bits per byte
+        for (;;) {
+            if (pos >= conn->tx_len) {
+                return 0;
+            }
+            uint8_t b = conn->tx[pos++];
+            remaining |= (size_t) (b & 0x7FU) << shift;
+            shift += 7;
+            if (0 == (b & 0x80U)) {
+                break;
+            }
+            if (shift > 21) {
+                return -1;
+            }
+        }
+        size_t total = pos + remaining;
+        if (total > sizeof(conn->tx)) {
+            fprintf(stderr, "Loopback: Packet of %lu bytes is too large\n", (unsigned long) total);
+            return -1;
+        }
+        if (conn->tx_len < total) {
+            return 0;
+        }
+        handle_packet(conn, conn->tx[0], conn->tx + pos, remaining);
+        memmove(conn->tx, conn->tx + total, conn->tx_len - total);
+        conn->tx_len -= total;
+    }
+}
+
+int loopback_inject_publish(const char *client_id, const char *topic, const char *payload, size_t len) {
+    uint8_t header[8];
+    size_t topic_len = strlen(topic);
+    size_t remaining = 2 + topic_len + len;
+    size_t pos = 1;
+
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection *conn = &connections[i];
+        if (!conn->in_use || 0 != strcmp(conn->client_id, client_id)) {
+            continue;
+        }
+        if (1 + 4 + remaining > sizeof(conn->rx) - (conn->rx_len - conn->rx_pos)) {
+            return -1;
+        }
+        header[0] = 0x30;
+        do {
+            uint8_t b = (uint8_t) (remaining & 0x7FU);
+            remaining >>= 7;
+            header[pos++] = (uint8_t) (b | (remaining ? 0x80U : 0));
+        } while (remaining);
+        header[pos++] = (uint8_t) (topic_len >> 8);
+        header[pos++] = (uint8_t) topic_len;
+        (void) queue_rx(conn, header, pos);
+        (void) queue_rx(conn, (const uint8_t *) topic, topic_len);
+        (void) queue_rx(conn, (const uint8_t *) payload, len);
+        return 0;
+    }
+    return -1;
+}
+
+void loopback_get_stats(LoopbackStats *out) {
+    *out = stats;
+}
+
+int iotc_tls_client_init(IotcTlsClient *client, const IotcTlsCredentials *credentials) {
+    (void) credentials;
+    memset(client, 0, sizeof(*client));
+    client->ctx = (SSL_CTX *) client; // never dereferenced. The device client only checks that it is set.
+    return 0;
+}
+
+void iotc_tls_client_free(IotcTlsClient *client) {
+    client->ctx = NULL;
+}
+
+void iotc_tls_client_forget_session(IotcTlsClient *client) {
+    (void) client;
+}
+
+int iotc_tls_connect(IotcTlsClient *client, NetworkContext_t *net, const char *host, uint16_t port,
+                     uint32_t timeout_ms, bool *resumed) {
+    (void) client;
+    (void) host;
+    (void) port;
+    (void) timeout_ms;
+    *resumed = false;
+    net->ssl = NULL;
+    net->fd = -1;
+    for (size_t i = 0; i < MAX_CONNECTIONS; i++) {
+        Connection *conn = &connections[i];
+        if (!conn->in_use) {
+            memset(conn, 0, sizeof(*conn));
+            conn->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (conn->fd < 0) {
+                return -1;
+            }
+            conn->in_use = true;
+            net->fd = conn->fd;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Loopback: Too many connections\n");
+    return -1;
+}
+
+void iotc_tls_disconnect(NetworkContext_t *net) {
+    Connection *conn = find_connection(net->fd);
+    if (conn) {
+        close(conn->fd);
+        conn->in_use = false;
+    }
+    net->fd = -1;
+}
+
+int32_t iotc_tls_send(NetworkContext_t *net, const void *buffer, size_t bytes) {
+    Connection *conn = find_connection(net->fd);
+    if (!conn) {
+        return -1;
+    }
+    size_t len = sizeof(conn->tx) - conn->tx_len;
+    if (len > bytes) {
+        len = bytes;
+    }
+    memcpy(conn->tx + conn->tx_len, buffer, len);
+    conn->tx_len += len;
+    if (process_tx(conn)) {
+        return -1;
+    }
+    return (int32_t) len;
+}
+
+int32_t iotc_tls_recv(NetworkContext_t *net, void *buffer, size_t bytes) {
+    Connection *conn = find_connection(net->fd);
+    if (!conn) {
+        return -1;
+    }
+    size_t len = conn->rx_len - conn->rx_pos;
+    if (len > bytes) {
+        len = bytes;
+    }
+    memcpy(buffer, conn->rx + conn->rx_pos, len);
+    conn->rx_pos += len;
+    if (conn->rx_pos == conn->rx_len) {
+        uint64_t value;
+        conn->rx_pos = 0;
+        conn->rx_len = 0;
+        (void) read(conn->fd, &value, sizeof(value)); // no longer readable
+    }
+    return (int32_t) len;
+}
+
+bool iotc_tls_has_pending(NetworkContext_t *net) {
+    (void) net;
+    return false;
+}
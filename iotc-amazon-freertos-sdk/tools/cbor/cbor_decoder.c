@@ -0,0 +1,278 @@
+//
+// Copyright: Avnet 2022
+//
+
+#define _GNU_SOURCE // gmtime_r
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "iotconnect_cbor.h"
+#include "cbor_decoder.h"
+
+// Longest env, cpId, dtg, id or timestamp accepted
+#define MAX_STRING_LEN 127
+
+#define WRITE_LITERAL(w, s) iotc_json_write_raw((w), (s), sizeof(s) - 1)
+
+typedef struct {
+    IotcCborReader r;
+    const IotcAttributeDictionary *dict;
+    uint32_t dict_hash; // of the message
+    IotcJsonWriter *w;
+    const char *error; // set on the first error
+} Decoder;
+
+typedef struct {
+    const IotcCborItem *container;
+    uint64_t index;
+} Entries;
+
+static bool fail(Decoder *d, const char *error) {
+    if (!d->error) {
+        d->error = error;
+    }
+    return false;
+}
+
+static bool read_item(Decoder *d, IotcCborItem *item) {
+    if (d->error) {
+        return false;
+    }
+    if (!iotc_cbor_read(&d->r, item)) {
+        return fail(d, "Truncated or malformed CBOR");
+    }
+    return true;
+}
+
+// Reads the next key of a map, or the next element of an array. Returns false at its end, or on errors.
+static bool next_entry(Decoder *d, Entries *e, IotcCborItem *item) {
+    if (!e->container->indefinite && e->index >= e->container->value) {
+        return false;
+    }
+    if (!read_item(d, item)) {
+        return false;
+    }
+    if (IOTC_CBOR_END == item->type) {
+        return e->container->indefinite ? false : fail(d, "Unexpected break");
+    }
+    e->index++;
+    return true;
+}
+
+static bool is_uint(const IotcCborItem *item, uint64_t value) {
+    return IOTC_CBOR_UINT == item->type && value == item->value;
+}
+
+static bool expect_key(Decoder *d, Entries *e, uint64_t key) {
+    IotcCborItem item;
+    if (!next_entry(d, e, &item)) {
+        return fail(d, "Missing key");
+    }
+    return is_uint(&item, key) || fail(d, "Unexpected key");
+}
+
+static bool read_container(Decoder *d, IotcCborType type, IotcCborItem *item) {
+    if (!read_item(d, item)) {
+        return false;
+    }
+    return item->type == type || fail(d, (IOTC_CBOR_MAP == type) ? "Map expected" : "Array expected");
+}
+
+static bool copy_text(Decoder *d, const IotcCborItem *item, char *str) {
+    if (IOTC_CBOR_TEXT != item->type) {
+        return fail(d, "Text expected");
+    }
+    if (item->value > MAX_STRING_LEN) {
+        return fail(d, "Text is too long");
+    }
+    memcpy(str, item->ptr, (size_t) item->value);
+    str[item->value] = 0;
+    return true;
+}
+
+static bool read_text(Decoder *d, char *str) {
+    IotcCborItem item;
+    return read_item(d, &item) && copy_text(d, &item, str);
+}
+
+static bool read_dtg(Decoder *d, char *str) {
+    IotcCborItem item;
+    if (!read_item(d, &item)) {
+        return false;
+    }
+    if (IOTC_CBOR_BYTES != item.type) {
+        return copy_text(d, &item, str);
+    }
+    if (16 != item.value) {
+        return fail(d, "The dtg must have 16 bytes");
+    }
+    const uint8_t *g = item.ptr;
+    sprintf(str, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+        g[0], g[1], g[2], g[3], g[4], g[5], g[6], g[7], g[8], g[9], g[10], g[11], g[12], g[13], g[14], g[15]);
+    return true;
+}
+
+static bool read_time(Decoder *d, char *str) {
+    IotcCborItem item;
+    struct tm tm;
+    if (!read_item(d, &item)) {
+        return false;
+    }
+    if (IOTC_CBOR_UINT != item.type) {
+        return copy_text(d, &item, str);
+    }
+    time_t seconds = (time_t) (item.value / 1000U);
+    if (!gmtime_r(&seconds, &tm) || tm.tm_year + 1900 > 9999) {
+        return fail(d, "Time out of range");
+    }
+    sprintf(str, "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+        tm.tm_hour, tm.tm_min, tm.tm_sec, (unsigned) (item.value % 1000U));
+    return true;
+}
+
+// Writes "name":value for the attribute key, and the value that follows it
+static bool write_field(Decoder *d, const IotcCborItem *key, bool first) {
+    IotcCborItem item;
+    double number;
+
+    if (!first) {
+        WRITE_LITERAL(d->w, ",");
+    }
+    if (IOTC_CBOR_UINT == key->type) {
+        const char *name = d->dict ? iotc_attribute_dictionary_get(d->dict, (size_t) key->value) : NULL;
+        if (!name) {
+            return fail(d, "Attribute index is not in the dictionary. Is the sync response (-s) right?");
+        }
+        if (d->dict_hash != d->dict->hash) {
+            return fail(d, "The message uses another attribute dictionary. Is the sync response (-s) current?");
+        }
+        iotc_json_write_string(d->w, name);
+    } else if (IOTC_CBOR_TEXT == key->type) {
+        iotc_json_write_string_len(d->w, (const char *) key->ptr, (size_t) key->value);
+    } else {
+        return fail(d, "Attribute index or name expected");
+    }
+    WRITE_LITERAL(d->w, ":");
+
+    if (!read_item(d, &item)) {
+        return false;
+    }
+    switch (item.type) {
+    case IOTC_CBOR_TEXT: iotc_json_write_string_len(d->w, (const char *) item.ptr, (size_t) item.value); break;
+    case IOTC_CBOR_TRUE: WRITE_LITERAL(d->w, "true"); break;
+    case IOTC_CBOR_FALSE: WRITE_LITERAL(d->w, "false"); break;
+    case IOTC_CBOR_NULL: WRITE_LITERAL(d->w, "null"); break;
+    default:
+        if (!iotc_cbor_to_double(&item, &number)) {
+            return fail(d, "Unsupported attribute value");
+        }
+        iotc_json_write_number(d->w, number);
+        break;
+    }
+    return true;
+}
+
+// {0: dt, 1: {attribute: value, ...}}
+static bool write_point(Decoder *d, const IotcCborItem *map, const char *duid, bool first) {
+    IotcCborItem data;
+    IotcCborItem key;
+    Entries point = { map, 0 };
+    Entries fields = { &data, 0 };
+    char dt[MAX_STRING_LEN + 1];
+
+    if (IOTC_CBOR_MAP != map->type) {
+        return fail(d, "Data point expected");
+    }
+    if (!expect_key(d, &point, IOTC_CBOR_KEY_TIME) || !read_time(d, dt)
+        || !expect_key(d, &point, IOTC_CBOR_KEY_DATA) || !read_container(d, IOTC_CBOR_MAP, &data)) {
+        return false;
+    }
+    if (!first) {
+        WRITE_LITERAL(d->w, ",");
+    }
+    WRITE_LITERAL(d->w, "{\"id\":");
+    iotc_json_write_string(d->w, duid);
+    WRITE_LITERAL(d->w, ",\"tg\":\"\",\"dt\":");
+    iotc_json_write_string(d->w, dt);
+    WRITE_LITERAL(d->w, ",\"d\":{");
+    while (next_entry(d, &fields, &key)) {
+        if (!write_field(d, &key, 1 == fields.index)) {
+            return false;
+        }
+    }
+    WRITE_LITERAL(d->w, "}}");
+    if (next_entry(d, &point, &key)) {
+        return fail(d, "Unexpected key in a data point");
+    }
+    return !d->error;
+}
+
+// {0: version, 1: env, 2: cpId, 3: dtg, 4: id, 5: dictionary hash, 6: [point, ...]}
+static bool write_message(Decoder *d) {
+    IotcCborItem map;
+    IotcCborItem points;
+    IotcCborItem item;
+    Entries message = { &map, 0 };
+    Entries list = { &points, 0 };
+    char env[MAX_STRING_LEN + 1];
+    char cpid[MAX_STRING_LEN + 1];
+    char dtg[MAX_STRING_LEN + 1];
+    char duid[MAX_STRING_LEN + 1];
+
+    if (!read_container(d, IOTC_CBOR_MAP, &map) || !expect_key(d, &message, IOTC_CBOR_KEY_VERSION)
+        || !read_item(d, &item)) {
+        return false;
+    }
+    if (!is_uint(&item, IOTC_CBOR_FORMAT_VERSION)) {
+        return fail(d, "Unsupported format version");
+    }
+    if (!expect_key(d, &message, IOTC_CBOR_KEY_ENV) || !read_text(d, env)
+        || !expect_key(d, &message, IOTC_CBOR_KEY_CPID) || !read_text(d, cpid)
+        || !expect_key(d, &message, IOTC_CBOR_KEY_DTG) || !read_dtg(d, dtg)
+        || !expect_key(d, &message, IOTC_CBOR_KEY_ID) || !read_text(d, duid)
+        || !expect_key(d, &message, IOTC_CBOR_KEY_DICTIONARY) || !read_item(d, &item)) {
+        return false;
+    }
+    if (IOTC_CBOR_UINT != item.type || item.value > UINT32_MAX) {
+        return fail(d, "Dictionary hash expected");
+    }
+    d->dict_hash = (uint32_t) item.value;
+    if (!expect_key(d, &message, IOTC_CBOR_KEY_POINTS) || !read_container(d, IOTC_CBOR_ARRAY, &points)) {
+        return false;
+    }
+
+    WRITE_LITERAL(d->w, "{\"sdk\":");
+    iotc_json_write_sdk_info(d->w, env);
+    WRITE_LITERAL(d->w, ",\"cpId\":");
+    iotc_json_write_string(d->w, cpid);
+    WRITE_LITERAL(d->w, ",\"dtg\":");
+    iotc_json_write_string(d->w, dtg);
+    WRITE_LITERAL(d->w, ",\"mt\":0,\"d\":[");
+    while (next_entry(d, &list, &item)) {
+        if (!write_point(d, &item, duid, 1 == list.index)) {
+            return false;
+        }
+    }
+    WRITE_LITERAL(d->w, "]}");
+    if (next_entry(d, &message, &item)) {
+        return fail(d, "Unexpected key in the message");
+    }
+    return !d->error;
+}
+
+const char *cbor_decode_message(const uint8_t *data, size_t len, size_t *pos, const IotcAttributeDictionary *dict,
+                                IotcJsonWriter *w) {
+    Decoder d = { .dict = dict, .w = w };
+    iotc_cbor_reader_init(&d.r, data, len);
+    d.r.pos = *pos;
+    if (!write_message(&d)) {
+        *pos = d.r.pos;
+        return d.error ? d.error : "Unknown";
+    }
+    *pos = d.r.pos;
+    return NULL;
+}
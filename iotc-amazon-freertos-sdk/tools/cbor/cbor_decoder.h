@@ -0,0 +1,22 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef CBOR_DECODER_H
+#define CBOR_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "iotconnect_telemetry_stream.h"
+
+// Decodes the CBOR telemetry message at *pos of data into the JSON message that the same calls produce with
+// IOTC_TELEMETRY_JSON, byte for byte, and moves *pos past it.
+// Attribute indexes are resolved with dict, which can be NULL. They are rejected if the dictionary hash
+// of the message is not that of dict, rather than being turned into the wrong names.
+// Returns NULL on success, or the error, in which case *pos is where it was found.
+// If the output does not fit, w->overflow is set, and the message can be decoded again into a larger buffer.
+const char *cbor_decode_message(const uint8_t *data, size_t len, size_t *pos, const IotcAttributeDictionary *dict,
+                                IotcJsonWriter *w);
+
+#endif // CBOR_DECODER_H
@@ -0,0 +1,161 @@
+//
+// Copyright: Avnet 2022
+//
+
+// Turns telemetry messages in the CBOR format of iotconnect_telemetry_stream.h back into the JSON message that
+// the same calls produce with IOTC_TELEMETRY_JSON, byte for byte, for the ingest side and for testing.
+// Messages that start with '{' are JSON already, and are passed through.
+//
+// Attribute indices are resolved with the dictionary of the sync response that the device used, given with -s.
+// Messages made with another dictionary, for example before a change of the device template, are rejected.
+// The input may hold several CBOR messages back to back. Each is written as one line.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotconnect_json_view.h"
+#include "iotconnect_telemetry_stream.h"
+#include "cbor_decoder.h"
+
+#define MAX_OUTPUT_SIZE (64 * 1024 * 1024)
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} Buffer;
+
+static int read_stream(FILE *f, Buffer *b) {
+    size_t size = 4096;
+    b->len = 0;
+    b->data = malloc(size);
+    while (b->data) {
+        b->len += fread(&b->data[b->len], 1, size - b->len, f);
+        if (b->len < size) {
+            return ferror(f) ? -1 : 0;
+        }
+        size *= 2;
+        uint8_t *data = realloc(b->data, size);
+        if (!data) {
+            free(b->data);
+        }
+        b->data = data;
+    }
+    return -1;
+}
+
+static int read_file(const char *path, Buffer *b) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return -1;
+    }
+    int ret = read_stream(f, b);
+    fclose(f);
+    if (ret) {
+        fprintf(stderr, "Unable to read %s\n", path);
+    }
+    return ret;
+}
+
+static int load_dictionary(const char *path, Buffer *json, char **names, IotcAttributeDictionary *dict) {
+    IotcJsonToken root;
+    IotcJsonToken d;
+
+    if (read_file(path, json)) {
+        return -1;
+    }
+    // the names take no more room than they do in the JSON, with their quotes
+    *names = malloc(json->len + 1);
+    if (!*names || !iotc_json_view_init(&root, (const char *) json->data, json->len)
+        || !iotc_json_view_get(&root, "d", &d) || iotc_attribute_dictionary_parse(dict, &d, *names, json->len + 1) < 0) {
+        fprintf(stderr, "Unable to parse the sync response in %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int decode(const Buffer *in, const IotcAttributeDictionary *dict) {
+    IotcJsonWriter w;
+    size_t pos = 0;
+    size_t size = 4096;
+    char *out = NULL;
+
+    while (pos < in->len) {
+        size_t start = pos;
+        size_t len;
+        const char *str = NULL;
+        while (!str && size <= MAX_OUTPUT_SIZE) {
+            char *buf = realloc(out, size);
+            if (!buf) {
+                break;
+            }
+            out = buf;
+            pos = start;
+            iotc_json_writer_init(&w, out, size);
+            const char *error = cbor_decode_message(in->data, in->len, &pos, dict, &w);
+            if (error) {
+                fprintf(stderr, "Error at byte %lu: %s\n", (unsigned long) pos, error);
+                free(out);
+                return EXIT_FAILURE;
+            }
+            str = iotc_json_writer_finish(&w, &len);
+            if (!str) {
+                size *= 2;
+            }
+        }
+        if (!str) {
+            fprintf(stderr, "Unable to allocate the output\n");
+            free(out);
+            return EXIT_FAILURE;
+        }
+        fwrite(str, 1, len, stdout);
+        fputc('\n', stdout);
+    }
+    free(out);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    Buffer in = { 0 };
+    Buffer sync_response = { 0 };
+    char *names = NULL;
+    IotcAttributeDictionary dict = { 0 };
+    const char *sync_path = NULL;
+    const char *in_path = NULL;
+    int ret;
+
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "-s") && i + 1 < argc) {
+            sync_path = argv[++i];
+        } else if (!in_path && argv[i][0] != '-') {
+            in_path = argv[i];
+        } else {
+            fprintf(stderr, "Usage: %s [-s sync_response.json] [message.cbor]\n"
+                "Writes the JSON telemetry messages of the CBOR input, or of the standard input.\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (sync_path && load_dictionary(sync_path, &sync_response, &names, &dict)) {
+        return EXIT_FAILURE;
+    }
+    if (in_path ? read_file(in_path, &in) : read_stream(stdin, &in)) {
+        if (!in_path) {
+            fprintf(stderr, "Unable to read the standard input\n");
+        }
+        return EXIT_FAILURE;
+    }
+
+    if (in.len > 0 && '{' == in.data[0]) {
+        fwrite(in.data, 1, in.len, stdout); // JSON already
+        ret = EXIT_SUCCESS;
+    } else {
+        ret = decode(&in, &dict);
+    }
+    free(in.data);
+    free(sync_response.data);
+    free(names);
+    return ret;
+}
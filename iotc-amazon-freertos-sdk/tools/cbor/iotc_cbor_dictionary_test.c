@@ -0,0 +1,109 @@
+//
+// Copyright: Avnet 2022
+//
+
+// Encodes telemetry as CBOR with the attribute dictionary of one sync response, and checks that the decoder
+// restores the JSON message with the same dictionary, and rejects the message with the dictionary of a changed
+// device template, instead of mapping the indexes to the wrong names.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotconnect_json_view.h"
+#include "iotconnect_telemetry_stream.h"
+#include "cbor_decoder.h"
+
+#define ISO_TIME "2022-07-01T12:00:00.000Z"
+
+// The device template before and after a change that added an attribute in front of the others
+#define SYNC_RESPONSE_OLD "{\"d\":{\"att\":[{\"p\":\"\",\"d\":[{\"ln\":\"temperature\"},{\"ln\":\"humidity\"}]}]}}"
+#define SYNC_RESPONSE_NEW "{\"d\":{\"att\":[{\"p\":\"\",\"d\":[{\"ln\":\"pressure\"},{\"ln\":\"temperature\"}," \
+    "{\"ln\":\"humidity\"}]}]}}"
+
+static bool parse_dictionary(const char *json, char *names, size_t size, IotcAttributeDictionary *dict) {
+    IotcJsonToken root;
+    IotcJsonToken d;
+    return iotc_json_view_init(&root, json, strlen(json)) && iotc_json_view_get(&root, "d", &d)
+        && iotc_attribute_dictionary_parse(dict, &d, names, size) > 0;
+}
+
+static const char *write_message(const IotclConfig *config, IotcTelemetryFormat format,
+                                 const IotcAttributeDictionary *dict, char *buf, size_t size, size_t *len) {
+    IotcTelemetryStream s;
+    iotc_telemetry_stream_begin_format(&s, config, format, dict, buf, size);
+    iotc_telemetry_stream_add_point(&s, ISO_TIME);
+    iotc_telemetry_stream_set_number(&s, "temperature", 21.5);
+    iotc_telemetry_stream_set_number(&s, "humidity", 40);
+    return iotc_telemetry_stream_finish(&s, len);
+}
+
+// Returns the error of the decoder, or NULL if it decoded the message, and restored expected if not NULL
+static const char *decode(const char *cbor, size_t cbor_len, const IotcAttributeDictionary *dict,
+                          const char *expected) {
+    IotcJsonWriter w;
+    char json[512];
+    size_t pos = 0;
+    size_t len;
+
+    iotc_json_writer_init(&w, json, sizeof(json));
+    const char *error = cbor_decode_message((const uint8_t *) cbor, cbor_len, &pos, dict, &w);
+    if (error) {
+        return error;
+    }
+    const char *str = iotc_json_writer_finish(&w, &len);
+    if (expected && (!str || 0 != strcmp(str, expected))) {
+        fprintf(stderr, "Decoded %s\n", str ? str : "(does not fit)");
+        return "The decoded message differs";
+    }
+    return NULL;
+}
+
+static bool expect(const char *test, const char *error, bool should_fail) {
+    if (should_fail != (NULL != error)) {
+        fprintf(stderr, "FAILED: %s: %s\n", test, error ? error : "Decoded the message");
+        return false;
+    }
+    printf("%s: %s\n", test, error ? error : "OK");
+    return true;
+}
+
+int main(void) {
+    IotclConfig config;
+    IotcAttributeDictionary old_dict;
+    IotcAttributeDictionary new_dict;
+    char old_names[64];
+    char new_names[64];
+    char json[512];
+    char cbor[512];
+    char cbor_by_name[512];
+    size_t json_len;
+    size_t cbor_len;
+    size_t cbor_by_name_len;
+    bool ok = true;
+
+    memset(&config, 0, sizeof(config));
+    config.device.env = "env";
+    config.device.cpid = "cpid";
+    config.device.duid = "device";
+    config.telemetry.dtg = "5a6e6a5e-6d4f-4c4a-9a3e-1b2c3d4e5f60";
+
+    if (!parse_dictionary(SYNC_RESPONSE_OLD, old_names, sizeof(old_names), &old_dict)
+        || !parse_dictionary(SYNC_RESPONSE_NEW, new_names, sizeof(new_names), &new_dict)
+        || old_dict.hash == new_dict.hash || old_dict.hash != iotc_attribute_dictionary_hash(&old_dict)
+        || !write_message(&config, IOTC_TELEMETRY_JSON, NULL, json, sizeof(json), &json_len)
+        || !write_message(&config, IOTC_TELEMETRY_CBOR, &old_dict, cbor, sizeof(cbor), &cbor_len)
+        || !write_message(&config, IOTC_TELEMETRY_CBOR, NULL, cbor_by_name, sizeof(cbor_by_name), &cbor_by_name_len)) {
+        fprintf(stderr, "FAILED: Unable to set up the test\n");
+        return EXIT_FAILURE;
+    }
+
+    ok = expect("Same dictionary", decode(cbor, cbor_len, &old_dict, json), false) && ok;
+    // would decode, with the wrong names, without the dictionary hash
+    ok = expect("Changed dictionary", decode(cbor, cbor_len, &new_dict, NULL), true) && ok;
+    ok = expect("No dictionary", decode(cbor, cbor_len, NULL, NULL), true) && ok;
+    ok = expect("Names with a changed dictionary", decode(cbor_by_name, cbor_by_name_len, &new_dict, json), false) && ok;
+    printf(ok ? "PASSED\n" : "FAILED\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,41 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include <stdio.h>
+
+#include "cJSON.h"
+#include "stub_responses.h"
+
+#define DISCOVERY_RESPONSE "{\"baseUrl\":\"https://%s/api/2.0/agent/\"}"
+#define SYNC_RESPONSE "{\"d\":{\"ec\":0,\"ct\":200,\"ds\":0,\"cpId\":\"%s\",\"dtg\":\"00000000-0000-0000-0000-000000000000\"," \
+    "\"ee\":null,\"rc\":0,\"at\":2,\"p\":{\"n\":\"mqtt\",\"h\":\"%s\",\"p\":8883,\"id\":\"%s-%s\"," \
+    "\"un\":\"%s/%s-%s/?api-version=2018-06-30\",\"pwd\":\"\"," \
+    "\"pub\":\"devices/%s-%s/messages/events/\",\"sub\":\"devices/%s-%s/messages/devicebound/#\"}," \
+    "\"att\":[{\"p\":\"\",\"dt\":0,\"agt\":0,\"d\":[{\"ln\":\"version\",\"dt\":5,\"dv\":\"\",\"sq\":1}," \
+    "{\"ln\":\"cpu\",\"dt\":1,\"dv\":\"\",\"sq\":2},{\"ln\":\"temperature\",\"dt\":1,\"dv\":\"\",\"sq\":3}," \
+    "{\"ln\":\"door_open\",\"dt\":7,\"dv\":\"\",\"sq\":4}]}]}}"
+
+static int checked_length(int len, size_t size) {
+    return (len > 0 && (size_t) len < size) ? len : -1;
+}
+
+int stub_write_discovery_response(char *buf, size_t size, const char *sync_host) {
+    return checked_length(snprintf(buf, size, DISCOVERY_RESPONSE, sync_host), size);
+}
+
+// The sync request carries the CPID and the unique ID in its payload
+int stub_write_sync_response(char *buf, size_t size, const char *request_payload, const char *broker_host) {
+    cJSON *root = cJSON_Parse(request_payload);
+    const cJSON *cpid = cJSON_GetObjectItemCaseSensitive(root, "cpId");
+    const cJSON *duid = cJSON_GetObjectItemCaseSensitive(root, "uniqueId");
+    int ret = -1;
+    if (cJSON_IsString(cpid) && cJSON_IsString(duid)) {
+        const char *c = cpid->valuestring;
+        const char *d = duid->valuestring;
+        const char *h = broker_host;
+        ret = checked_length(snprintf(buf, size, SYNC_RESPONSE, c, h, c, d, h, c, d, c, d, c, d), size);
+    }
+    cJSON_Delete(root);
+    return ret;
+}
@@ -0,0 +1,20 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef STUB_RESPONSES_H
+#define STUB_RESPONSES_H
+
+#include <stddef.h>
+
+// Responses in the format of the IoTConnect discovery and sync services, with only the fields that the SDK uses.
+// Used by the tools that run the SDK without the IoTConnect cloud.
+
+// Writes a discovery response that sends sync requests to sync_host. Returns the length, or -1 if it does not fit.
+int stub_write_discovery_response(char *buf, size_t size, const char *sync_host);
+
+// Writes a sync response for the CPID and unique ID in the sync request payload, with broker_host as the MQTT host.
+// Returns the length, or -1 if the request is invalid or the response does not fit.
+int stub_write_sync_response(char *buf, size_t size, const char *request_payload, const char *broker_host);
+
+#endif // STUB_RESPONSES_H
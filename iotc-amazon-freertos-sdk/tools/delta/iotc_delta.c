@@ -0,0 +1,266 @@
+//
+// Copyright: Avnet 2022
+//
+
+// Makes patches in the format of iotconnect_delta.h, and applies them with the SDK code for testing.
+//
+// The patch is built greedily: at each position of the new image, the longest match in the old image is looked up
+// through a hash index of all 8 byte windows of the old image. Matches of at least MIN_MATCH bytes become COPY
+// operations. Everything else is sent as INSERT data. Firmware that changes a little between versions keeps most
+// of its code in place or shifted, which this finds. Patches are not compressed.
+
+#define _GNU_SOURCE // mkstemp, truncate
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "iotconnect_delta.h"
+#include "iotconnect_sha256.h"
+#include "iotconnect_storage.h"
+
+#define WINDOW 8
+// A COPY takes 9 bytes and breaks an INSERT, which takes 5 more, so shorter matches are not worth it
+#define MIN_MATCH 24
+#define HASH_BITS 20
+#define MAX_CHAIN 64 // candidates compared at each position
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} Buffer;
+
+typedef struct {
+    FILE *f;
+    const uint8_t *insert; // start of the pending INSERT data
+    size_t insert_len;
+    size_t copies;
+    size_t copied;
+    size_t inserted;
+} PatchWriter;
+
+static int read_file(const char *path, Buffer *b) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    b->len = (len > 0) ? (size_t) len : 0;
+    b->data = malloc(b->len + 1);
+    if (!b->data || fread(b->data, 1, b->len, f) != b->len) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+static void write_le32(FILE *f, uint32_t v) {
+    uint8_t b[4] = { (uint8_t) v, (uint8_t) (v >> 8), (uint8_t) (v >> 16), (uint8_t) (v >> 24) };
+    fwrite(b, 1, sizeof(b), f);
+}
+
+static void write_sha256(FILE *f, const Buffer *b) {
+    IotcSha256 sha;
+    uint8_t digest[IOTC_SHA256_SIZE];
+    iotc_sha256_init(&sha);
+    iotc_sha256_update(&sha, b->data, b->len);
+    iotc_sha256_finish(&sha, digest);
+    fwrite(digest, 1, sizeof(digest), f);
+}
+
+static uint32_t hash_window(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t) ((v * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS));
+}
+
+static void flush_insert(PatchWriter *w) {
+    if (w->insert_len) {
+        fputc(IOTC_DELTA_OP_INSERT, w->f);
+        write_le32(w->f, (uint32_t) w->insert_len);
+        fwrite(w->insert, 1, w->insert_len, w->f);
+        w->inserted += w->insert_len;
+        w->insert_len = 0;
+    }
+}
+
+static int diff(const char *old_path, const char *new_path, const char *patch_path) {
+    Buffer old_image;
+    Buffer new_image;
+    PatchWriter w = { 0 };
+
+    if (read_file(old_path, &old_image) || read_file(new_path, &new_image)) {
+        return EXIT_FAILURE;
+    }
+    if (old_image.len > UINT32_MAX || new_image.len > UINT32_MAX) {
+        fprintf(stderr, "Images must be smaller than 4 GB\n");
+        return EXIT_FAILURE;
+    }
+
+    // head[hash] is the last position with that hash, and chain[pos] the one before it
+    int32_t *head = malloc(sizeof(int32_t) << HASH_BITS);
+    int32_t *chain = malloc(sizeof(int32_t) * (old_image.len + 1));
+    if (!head || !chain) {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+    memset(head, 0xFF, sizeof(int32_t) << HASH_BITS);
+    for (size_t i = 0; i + WINDOW <= old_image.len; i++) {
+        uint32_t h = hash_window(&old_image.data[i]);
+        chain[i] = head[h];
+        head[h] = (int32_t) i;
+    }
+
+    w.f = fopen(patch_path, "wb");
+    if (!w.f) {
+        fprintf(stderr, "Unable to create %s\n", patch_path);
+        return EXIT_FAILURE;
+    }
+    fwrite(IOTC_DELTA_MAGIC, 1, IOTC_DELTA_MAGIC_LEN, w.f);
+    write_le32(w.f, (uint32_t) old_image.len);
+    write_sha256(w.f, &old_image);
+    write_le32(w.f, (uint32_t) new_image.len);
+    write_sha256(w.f, &new_image);
+
+    for (size_t pos = 0; pos < new_image.len;) {
+        size_t best_len = 0;
+        size_t best_src = 0;
+        if (pos + WINDOW <= new_image.len) {
+            int32_t candidate = head[hash_window(&new_image.data[pos])];
+            for (int n = 0; candidate >= 0 && n < MAX_CHAIN; n++, candidate = chain[candidate]) {
+                size_t len = 0;
+                size_t max = old_image.len - (size_t) candidate;
+                if (max > new_image.len - pos) {
+                    max = new_image.len - pos;
+                }
+                while (len < max && old_image.data[candidate + len] == new_image.data[pos + len]) {
+                    len++;
+                }
+                if (len > best_len) {
+                    best_len = len;
+                    best_src = (size_t) candidate;
+                }
+            }
+        }
+        if (best_len >= MIN_MATCH) {
+            flush_insert(&w);
+            fputc(IOTC_DELTA_OP_COPY, w.f);
+            write_le32(w.f, (uint32_t) best_src);
+            write_le32(w.f, (uint32_t) best_len);
+            w.copies++;
+            w.copied += best_len;
+            pos += best_len;
+        } else {
+            if (0 == w.insert_len) {
+                w.insert = &new_image.data[pos];
+            }
+            w.insert_len++;
+            pos++;
+        }
+    }
+    flush_insert(&w);
+    fputc(IOTC_DELTA_OP_END, w.f);
+    long patch_len = ftell(w.f);
+    if (0 != fclose(w.f)) {
+        fprintf(stderr, "Unable to write %s\n", patch_path);
+        return EXIT_FAILURE;
+    }
+    printf("Patch: %ld bytes for an image of %lu bytes (%.1f%%). %lu copies of %lu bytes, %lu new bytes.\n",
+           patch_len, (unsigned long) new_image.len, new_image.len ? 100.0 * (double) patch_len / (double) new_image.len : 0.0,
+           (unsigned long) w.copies, (unsigned long) w.copied, (unsigned long) w.inserted);
+    free(head);
+    free(chain);
+    free(old_image.data);
+    free(new_image.data);
+    return EXIT_SUCCESS;
+}
+
+// Applies the patch the way the OTA engine does: from file backed storage, in small pieces
+static int apply(const char *old_path, const char *patch_path, const char *new_path) {
+    IotcStorage source;
+    IotcStorage target;
+    IotcFileStorage source_file;
+    IotcFileStorage target_file;
+    IotcDeltaPatcher patcher;
+    Buffer old_image;
+    Buffer patch;
+    uint8_t digest[IOTC_SHA256_SIZE];
+    const uint32_t sector_size = 4096;
+
+    if (read_file(old_path, &old_image) || read_file(patch_path, &patch)) {
+        return EXIT_FAILURE;
+    }
+    uint32_t source_size = ((uint32_t) old_image.len + sector_size - 1) / sector_size * sector_size;
+    if (!iotc_delta_is_patch(patch.data, patch.len) || patch.len < IOTC_DELTA_HEADER_SIZE) {
+        fprintf(stderr, "%s is not a patch\n", patch_path);
+        return EXIT_FAILURE;
+    }
+    uint32_t target_len = patch.data[IOTC_DELTA_HEADER_SIZE - IOTC_SHA256_SIZE - 4]
+        | ((uint32_t) patch.data[IOTC_DELTA_HEADER_SIZE - IOTC_SHA256_SIZE - 3] << 8)
+        | ((uint32_t) patch.data[IOTC_DELTA_HEADER_SIZE - IOTC_SHA256_SIZE - 2] << 16)
+        | ((uint32_t) patch.data[IOTC_DELTA_HEADER_SIZE - IOTC_SHA256_SIZE - 1] << 24);
+    uint32_t target_size = (target_len + sector_size - 1) / sector_size * sector_size;
+
+    remove(new_path);
+    // The source storage is a copy of the old image, so that the old file is never written
+    char source_path[] = "/tmp/iotc-delta-XXXXXX";
+    int fd = mkstemp(source_path);
+    FILE *f;
+    if (fd < 0 || (f = fdopen(fd, "wb")) == NULL || fwrite(old_image.data, 1, old_image.len, f) != old_image.len
+        || 0 != fclose(f)) {
+        fprintf(stderr, "Unable to create a temporary file\n");
+        return EXIT_FAILURE;
+    }
+    if (iotc_storage_file_open(&source, &source_file, source_path, source_size ? source_size : sector_size, sector_size)
+        || iotc_storage_file_open(&target, &target_file, new_path, target_size ? target_size : sector_size, sector_size)) {
+        remove(source_path);
+        return EXIT_FAILURE;
+    }
+
+    iotc_delta_init(&patcher, &source, &target);
+    IotcDeltaResult result = IOTC_DELTA_OK;
+    // Pieces as small and as odd as a download might deliver them
+    for (size_t offset = 0; IOTC_DELTA_OK == result && offset < patch.len; offset += 1000) {
+        size_t len = (patch.len - offset < 1000) ? patch.len - offset : 1000;
+        result = iotc_delta_feed(&patcher, &patch.data[offset], len);
+    }
+    if (IOTC_DELTA_OK == result) {
+        result = iotc_delta_finish(&patcher, digest);
+    }
+    iotc_storage_file_close(&source);
+    iotc_storage_file_close(&target);
+    remove(source_path);
+    if (IOTC_DELTA_OK != result) {
+        fprintf(stderr, "Failed to apply the patch: error %d\n", (int) result);
+        return EXIT_FAILURE;
+    }
+    // The storage is padded to whole sectors
+    if (0 != truncate(new_path, (off_t) target_len)) {
+        fprintf(stderr, "Unable to truncate %s\n", new_path);
+        return EXIT_FAILURE;
+    }
+    printf("Applied: %lu bytes written to %s\n", (unsigned long) target_len, new_path);
+    free(old_image.data);
+    free(patch.data);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (5 == argc && 0 == strcmp(argv[1], "diff")) {
+        return diff(argv[2], argv[3], argv[4]);
+    }
+    if (5 == argc && 0 == strcmp(argv[1], "apply")) {
+        return apply(argv[2], argv[3], argv[4]);
+    }
+    fprintf(stderr, "Usage: %s diff old.bin new.bin patch.bin\n"
+        "       %s apply old.bin patch.bin new.bin\n", argv[0], argv[0]);
+    return EXIT_FAILURE;
+}
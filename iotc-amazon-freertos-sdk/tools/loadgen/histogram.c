@@ -0,0 +1,72 @@
+//
+// Copyright: Avnet 2022
+//
+
+#include "histogram.h"
+
+static int bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int) value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int index = (msb - 3) * HISTOGRAM_SUB_BUCKETS + (int) ((value >> (msb - 4)) & (HISTOGRAM_SUB_BUCKETS - 1));
+    return (index < HISTOGRAM_BUCKETS) ? index : HISTOGRAM_BUCKETS - 1;
+}
+
+// The largest value that falls into the bucket
+static uint64_t bucket_limit(int index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return (uint64_t) index;
+    }
+    int msb = index / HISTOGRAM_SUB_BUCKETS + 3;
+    uint64_t sub = (uint64_t) (index % HISTOGRAM_SUB_BUCKETS) | HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << (msb - 4)) - 1;
+}
+
+void histogram_record(Histogram *h, uint64_t value_us) {
+    h->counts[bucket_index(value_us)]++;
+    h->count++;
+    h->sum_us += value_us;
+    if (value_us > h->max_us) {
+        h->max_us = value_us;
+    }
+}
+
+void histogram_merge(Histogram *into, const Histogram *from) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->count += from->count;
+    into->sum_us += from->sum_us;
+    if (from->max_us > into->max_us) {
+        into->max_us = from->max_us;
+    }
+}
+
+uint64_t histogram_percentile(const Histogram *h, double fraction) {
+    uint64_t target = (uint64_t) (fraction * (double) h->count + 0.5);
+    uint64_t seen = 0;
+    if (0 == h->count) {
+        return 0;
+    }
+    if (target < 1) {
+        target = 1;
+    }
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= target) {
+            uint64_t limit = bucket_limit(i);
+            return (limit < h->max_us) ? limit : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+void histogram_write_json(const Histogram *h, FILE *f) {
+    double mean = h->count ? (double) h->sum_us / (double) h->count : 0;
+    fprintf(f, "{\"count\": %llu, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, "
+        "\"p999_ms\": %.3f, \"max_ms\": %.3f}", (unsigned long long) h->count, mean / 1000.0,
+        (double) histogram_percentile(h, 0.5) / 1000.0, (double) histogram_percentile(h, 0.9) / 1000.0,
+        (double) histogram_percentile(h, 0.99) / 1000.0, (double) histogram_percentile(h, 0.999) / 1000.0,
+        (double) h->max_us / 1000.0);
+}
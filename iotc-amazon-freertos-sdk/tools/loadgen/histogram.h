@@ -0,0 +1,34 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// A log-linear histogram of durations in microseconds. Values are kept in 16 buckets per power of two,
+// so percentiles are within about 6% of the exact value, in constant memory.
+
+#define HISTOGRAM_SUB_BUCKETS 16
+#define HISTOGRAM_BUCKETS (HISTOGRAM_SUB_BUCKETS * 40)
+
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+} Histogram;
+
+void histogram_record(Histogram *h, uint64_t value_us);
+
+void histogram_merge(Histogram *into, const Histogram *from);
+
+// Returns the value below which the given fraction (0..1) of the recorded values fall
+uint64_t histogram_percentile(const Histogram *h, double fraction);
+
+// Writes the count, mean, p50, p90, p99, p99.9 and max in milliseconds, as a JSON object
+void histogram_write_json(const Histogram *h, FILE *f);
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,605 @@
+//
+// Copyright: Avnet 2022
+//
+
+// Simulates a fleet of devices, each running the connect, send and disconnect cycle of iotconnect_app_main()
+// with its own IotConnectClient, against a local MQTT broker. Discovery and sync are answered by an in-process
+// HTTPS stub, which sends every device to the broker. Reports publish latency, connect and reconnect times,
+// and heap and RSS growth per session, as JSON.
+//
+// Devices are spread over worker threads. Each worker services its devices in turn, so latencies include the time
+// until the worker gets back to a device. Use more workers if the reported latencies approach the publish interval.
+
+#define _GNU_SOURCE // mallinfo2
+
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iotconnect.h"
+#include "iotconnect_discovery.h"
+#include "iotconnect_telemetry_stream.h"
+#include "iotc_device_client.h"
+#include "iotc_posix_tls.h"
+#include "iotc_tls_stats.h"
+#include "histogram.h"
+#include "sync_stub_server.h"
+
+#define LOADGEN_CPID "LOADGEN"
+#define LOADGEN_ENV "loadgen"
+#define LOADGEN_DISCOVERY_PORT 443
+
+// Send times are kept for this many of the most recent messages of each device. Must exceed the QoS 1 window.
+#define SENT_SLOTS 16
+
+#define MESSAGE_BUFFER_SIZE 4096
+#define CONNECT_RETRY_US 1000000U
+
+typedef enum {
+    CHURN_NONE, // connect once
+    CHURN_STEADY, // disconnect after a random time online (exponentially distributed), reconnect after offline_s
+    CHURN_STORM // all devices disconnect together every online_s seconds, and reconnect right away
+} ChurnPattern;
+
+typedef struct {
+    unsigned long devices;
+    unsigned long workers;
+    double duration_s;
+    double rate; // messages per second per device
+    int qos;
+    unsigned long fields; // numeric fields per message
+    unsigned long string_bytes; // size of an extra string field. 0 for none.
+    ChurnPattern churn;
+    double online_s;
+    double offline_s;
+    double ramp_s;
+    const char *broker_host;
+    uint16_t broker_port;
+    uint16_t stub_port;
+    const char *ca_file;
+    const char *stub_cert;
+    const char *stub_key;
+    const char *device_cert;
+    const char *device_key;
+    const char *output_path;
+} LoadgenConfig;
+
+typedef struct {
+    pthread_t thread;
+    size_t index;
+    unsigned int seed;
+    char message[MESSAGE_BUFFER_SIZE];
+    Histogram latency;
+    Histogram connect;
+    Histogram reconnect;
+    unsigned long published;
+    unsigned long completed;
+    unsigned long failed; // sends that failed, or completed with an error
+    unsigned long connects;
+    unsigned long connect_failures;
+    unsigned long disconnects; // by the churn pattern
+    unsigned long drops; // connections lost without a disconnect
+} Worker;
+
+typedef struct {
+    IotConnectClient *client;
+    Worker *worker;
+    char duid[32];
+    bool online;
+    bool connected_before;
+    bool in_send;
+    uint64_t send_start_us;
+    uint64_t next_connect_us;
+    uint64_t next_publish_us;
+    uint64_t disconnect_at_us; // 0 for never
+    uint32_t sent_ids[SENT_SLOTS];
+    uint64_t sent_us[SENT_SLOTS];
+} Session;
+
+static LoadgenConfig config = {
+    .devices = 100,
+    .workers = 4,
+    .duration_s = 60,
+    .rate = 0.2,
+    .qos = 1,
+    .fields = 4,
+    .churn = CHURN_NONE,
+    .online_s = 30,
+    .offline_s = 5,
+    .ramp_s = 10,
+    .broker_host = "localhost",
+    .broker_port = IOTC_DEVICE_CLIENT_MQTT_PORT,
+    .stub_port = 8443,
+};
+
+static IotConnectClientConfig client_configs[IOTCONNECT_MAX_CLIENTS];
+static Session sessions[IOTCONNECT_MAX_CLIENTS];
+static Worker *workers = NULL;
+static uint64_t start_us;
+static atomic_bool stop_requested = false;
+static atomic_ulong online_count = 0;
+static char *string_field = NULL;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000U + (uint64_t) ts.tv_nsec / 1000U;
+}
+
+static uint64_t seconds_to_us(double s) {
+    return (s > 0) ? (uint64_t) (s * 1e6) : 0;
+}
+
+static double random_unit(Worker *w) {
+    return (double) rand_r(&w->seed) / ((double) RAND_MAX + 1.0);
+}
+
+static uint64_t publish_interval_us(void) {
+    return (config.rate > 0) ? seconds_to_us(1.0 / config.rate) : 0;
+}
+
+// Storms happen at fixed times, so that all devices disconnect together
+static uint64_t next_storm_us(uint64_t now) {
+    uint64_t interval = seconds_to_us(config.online_s);
+    uint64_t ramp_end = start_us + seconds_to_us(config.ramp_s);
+    if (now < ramp_end) {
+        return ramp_end + interval;
+    }
+    return ramp_end + ((now - ramp_end) / interval + 1) * interval;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Memory
+
+typedef struct {
+    size_t heap_bytes;
+    size_t rss_bytes;
+} MemoryUsage;
+
+static void get_memory_usage(MemoryUsage *m) {
+    long pages_total = 0;
+    long pages_resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (2 != fscanf(f, "%ld %ld", &pages_total, &pages_resident)) {
+            pages_resident = 0;
+        }
+        fclose(f);
+    }
+    m->rss_bytes = (size_t) pages_resident * (size_t) sysconf(_SC_PAGESIZE);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+    m->heap_bytes = mi.uordblks + mi.hblkhd;
+#else
+    struct mallinfo mi = mallinfo();
+    m->heap_bytes = (size_t) mi.uordblks + (size_t) mi.hblkhd;
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Sessions
+
+static void on_publish_complete(IotConnectClient *client, uint32_t message_id, int status) {
+    Session *s = (Session *) iotconnect_client_get_user_data(client);
+    Worker *w = s->worker;
+    uint64_t sent_us;
+    size_t slot = message_id % SENT_SLOTS;
+
+    if (s->sent_ids[slot] == message_id) {
+        sent_us = s->sent_us[slot];
+        s->sent_ids[slot] = 0;
+    } else if (s->in_send) {
+        sent_us = s->send_start_us; // QoS 0 messages complete before the send returns their ID
+    } else {
+        return; // too old
+    }
+    if (status) {
+        w->failed++;
+    } else {
+        w->completed++;
+        histogram_record(&w->latency, now_us() - sent_us);
+    }
+}
+
+static void go_offline(Session *s, uint64_t reconnect_at_us) {
+    s->online = false;
+    s->next_connect_us = reconnect_at_us;
+    memset(s->sent_ids, 0, sizeof(s->sent_ids));
+    atomic_fetch_sub(&online_count, 1);
+}
+
+static void connect_session(Worker *w, Session *s) {
+    uint64_t start = now_us();
+    int ret = iotconnect_client_connect(s->client);
+    uint64_t now = now_us();
+    if (ret) {
+        w->connect_failures++;
+        s->next_connect_us = now + CONNECT_RETRY_US / 2 + (uint64_t) (random_unit(w) * CONNECT_RETRY_US);
+        return;
+    }
+    w->connects++;
+    histogram_record(s->connected_before ? &w->reconnect : &w->connect, now - start);
+    s->connected_before = true;
+    s->online = true;
+    atomic_fetch_add(&online_count, 1);
+    s->next_publish_us = now + (uint64_t) (random_unit(w) * (double) publish_interval_us());
+    switch (config.churn) {
+        case CHURN_STEADY:
+            s->disconnect_at_us = now + seconds_to_us(-log(1.0 - random_unit(w)) * config.online_s);
+            break;
+        case CHURN_STORM:
+            s->disconnect_at_us = next_storm_us(now);
+            break;
+        default:
+            s->disconnect_at_us = 0;
+            break;
+    }
+}
+
+static const char *create_message(Worker *w, Session *s, size_t *len) {
+    IotcTelemetryStream stream;
+    char name[16];
+    iotc_telemetry_stream_begin(&stream, iotconnect_client_get_lib_config(s->client), w->message, sizeof(w->message));
+    iotc_telemetry_stream_add_point(&stream, NULL);
+    for (unsigned long i = 0; i < config.fields; i++) {
+        snprintf(name, sizeof(name), "f%lu", i);
+        iotc_telemetry_stream_set_number(&stream, name, random_unit(w) * 100.0);
+    }
+    if (string_field) {
+        iotc_telemetry_stream_set_string(&stream, "s", string_field);
+    }
+    return iotc_telemetry_stream_finish(&stream, len);
+}
+
+static void publish(Worker *w, Session *s, uint64_t now) {
+    size_t len;
+    uint32_t message_id = 0;
+    const char *message = create_message(w, s, &len);
+
+    s->next_publish_us = now + publish_interval_us();
+    if (!message) {
+        w->failed++;
+        return;
+    }
+    s->in_send = true;
+    s->send_start_us = now_us();
+    int ret = iotconnect_client_send_packet_async(s->client, message, len, &message_id);
+    s->in_send = false;
+    w->published++;
+    if (ret) {
+        w->failed++;
+    } else if (config.qos > 0) {
+        size_t slot = message_id % SENT_SLOTS;
+        s->sent_ids[slot] = message_id;
+        s->sent_us[slot] = s->send_start_us;
+    }
+}
+
+// Returns true if the session did anything besides servicing the connection
+static bool service_session(Worker *w, Session *s) {
+    uint64_t now = now_us();
+    if (!s->online) {
+        if (now < s->next_connect_us) {
+            return false;
+        }
+        connect_session(w, s);
+        return true;
+    }
+    if (!iotconnect_client_is_connected(s->client)) {
+        w->drops++;
+        go_offline(s, now);
+        return true;
+    }
+    if (s->disconnect_at_us && now >= s->disconnect_at_us) {
+        iotconnect_client_disconnect(s->client);
+        w->disconnects++;
+        go_offline(s, now + seconds_to_us((CHURN_STORM == config.churn) ? 0 : config.offline_s));
+        return true;
+    }
+    bool busy = false;
+    if (config.rate > 0 && now >= s->next_publish_us) {
+        publish(w, s, now);
+        busy = true;
+    }
+    iotconnect_client_loop(s->client, 0);
+    return busy;
+}
+
+static void *worker_thread(void *arg) {
+    Worker *w = (Worker *) arg;
+    while (!atomic_load(&stop_requested)) {
+        bool busy = false;
+        for (size_t i = w->index; i < config.devices && !atomic_load(&stop_requested); i += config.workers) {
+            busy |= service_session(w, &sessions[i]);
+        }
+        if (!busy) {
+            usleep(1000);
+        }
+    }
+    for (size_t i = w->index; i < config.devices; i += config.workers) {
+        if (sessions[i].online) {
+            iotconnect_client_disconnect(sessions[i].client);
+        }
+    }
+    return NULL;
+}
+
+static int create_sessions(void) {
+    for (size_t i = 0; i < config.devices; i++) {
+        Session *s = &sessions[i];
+        IotConnectClientConfig *c = &client_configs[i];
+        snprintf(s->duid, sizeof(s->duid), "loadgen-%05lu", (unsigned long) i);
+        c->cpid = LOADGEN_CPID;
+        c->env = LOADGEN_ENV;
+        c->duid = s->duid;
+        c->qos = config.qos;
+        c->auth_info.type = IOTC_AT_X509;
+        c->auth_info.trust_store = (char *) config.ca_file;
+        c->auth_info.data.cert_info.device_cert = (char *) config.device_cert;
+        c->auth_info.data.cert_info.device_key = (char *) config.device_key;
+        c->client_publish_cb = on_publish_complete;
+        c->user_data = s;
+        s->client = iotconnect_client_create(c);
+        if (!s->client) {
+            return -1;
+        }
+        s->worker = &workers[i % config.workers];
+        // spread the initial connects over the ramp-up time
+        s->next_connect_us = start_us + seconds_to_us(config.ramp_s * (double) i / (double) config.devices);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////
+// Setup and reporting
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s -a ca.pem -t stub-cert.pem -k stub-key.pem [options]\n"
+        "  -n devices     number of simulated devices (default %lu, at most %d)\n"
+        "  -w workers     worker threads (default %lu)\n"
+        "  -d seconds     duration, including the ramp-up (default %.0f)\n"
+        "  -R seconds     spread the initial connects over this time (default %.0f)\n"
+        "  -r rate        messages per second per device (default %.1f)\n"
+        "  -q qos         0 or 1 (default %d)\n"
+        "  -f fields      numeric fields per message (default %lu)\n"
+        "  -s bytes       add a string field of this size to each message (default none)\n"
+        "  -c churn       none, steady or storm (default none)\n"
+        "  -u seconds     steady: mean time online; storm: time between storms (default %.0f)\n"
+        "  -O seconds     steady: time offline before reconnecting (default %.0f)\n"
+        "  -b host:port   MQTT broker (default %s:%u)\n"
+        "  -p port        port of the discovery and sync stub (default %u)\n"
+        "  -a file        CA certificate of the broker and the stub server\n"
+        "  -t file        certificate of the stub server, valid for %s\n"
+        "  -k file        private key of the stub server\n"
+        "  -C file        device certificate, if the broker requires one\n"
+        "  -K file        device private key\n"
+        "  -o file        write the JSON report here instead of to stdout\n",
+        name, config.devices, IOTCONNECT_MAX_CLIENTS, config.workers, config.duration_s, config.ramp_s, config.rate,
+        config.qos, config.fields, config.online_s, config.offline_s, config.broker_host,
+        (unsigned) config.broker_port, (unsigned) config.stub_port, IOTCONNECT_DISCOVERY_HOSTNAME);
+}
+
+static int parse_churn(const char *s) {
+    if (0 == strcmp(s, "none")) {
+        config.churn = CHURN_NONE;
+    } else if (0 == strcmp(s, "steady")) {
+        config.churn = CHURN_STEADY;
+    } else if (0 == strcmp(s, "storm")) {
+        config.churn = CHURN_STORM;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int parse_broker(char *s) {
+    char *colon = strrchr(s, ':');
+    if (colon) {
+        *colon = 0;
+        config.broker_port = (uint16_t) strtoul(colon + 1, NULL, 10);
+    }
+    config.broker_host = s;
+    return (config.broker_port && *s) ? 0 : -1;
+}
+
+static int parse_args(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:d:R:r:q:f:s:c:u:O:b:p:a:t:k:C:K:o:")) != -1) {
+        switch (opt) {
+            case 'n': config.devices = strtoul(optarg, NULL, 10); break;
+            case 'w': config.workers = strtoul(optarg, NULL, 10); break;
+            case 'd': config.duration_s = atof(optarg); break;
+            case 'R': config.ramp_s = atof(optarg); break;
+            case 'r': config.rate = atof(optarg); break;
+            case 'q': config.qos = atoi(optarg); break;
+            case 'f': config.fields = strtoul(optarg, NULL, 10); break;
+            case 's': config.string_bytes = strtoul(optarg, NULL, 10); break;
+            case 'c': if (parse_churn(optarg)) return -1; break;
+            case 'u': config.online_s = atof(optarg); break;
+            case 'O': config.offline_s = atof(optarg); break;
+            case 'b': if (parse_broker(optarg)) return -1; break;
+            case 'p': config.stub_port = (uint16_t) strtoul(optarg, NULL, 10); break;
+            case 'a': config.ca_file = optarg; break;
+            case 't': config.stub_cert = optarg; break;
+            case 'k': config.stub_key = optarg; break;
+            case 'C': config.device_cert = optarg; break;
+            case 'K': config.device_key = optarg; break;
+            case 'o': config.output_path = optarg; break;
+            default: return -1;
+        }
+    }
+    if (!config.ca_file || !config.stub_cert || !config.stub_key) {
+        return -1;
+    }
+    if (0 == config.devices || config.devices > IOTCONNECT_MAX_CLIENTS) {
+        fprintf(stderr, "The number of devices must be between 1 and %d. Rebuild with a larger IOTC_LOADGEN_MAX_DEVICES for more.\n",
+            IOTCONNECT_MAX_CLIENTS);
+        return -1;
+    }
+    if (0 == config.workers || config.workers > config.devices) {
+        config.workers = (config.workers > config.devices) ? config.devices : 1;
+    }
+    if ((config.qos != 0 && config.qos != 1) || config.duration_s <= 0 || config.ramp_s < 0
+        || (CHURN_NONE != config.churn && config.online_s <= 0)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Each device has a socket, an epoll instance and an eventfd
+static void raise_file_limit(void) {
+    struct rlimit rl;
+    if (0 == getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        (void) setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (0 == getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_cur < 3 * config.devices + 64) {
+        fprintf(stderr, "Warning: The open file limit (%lu) is too low for %lu devices.\n",
+            (unsigned long) rl.rlim_cur, config.devices);
+    }
+}
+
+static const char *churn_name(ChurnPattern churn) {
+    switch (churn) {
+        case CHURN_STEADY: return "steady";
+        case CHURN_STORM: return "storm";
+        default: return "none";
+    }
+}
+
+static void write_report(FILE *f, const MemoryUsage *before, const MemoryUsage *after, unsigned long online) {
+    Worker total = { 0 };
+    SyncStubStats stub;
+    IotcTlsStats tls;
+
+    for (size_t i = 0; i < config.workers; i++) {
+        Worker *w = &workers[i];
+        histogram_merge(&total.latency, &w->latency);
+        histogram_merge(&total.connect, &w->connect);
+        histogram_merge(&total.reconnect, &w->reconnect);
+        total.published += w->published;
+        total.completed += w->completed;
+        total.failed += w->failed;
+        total.connects += w->connects;
+        total.connect_failures += w->connect_failures;
+        total.disconnects += w->disconnects;
+        total.drops += w->drops;
+    }
+    sync_stub_server_get_stats(&stub);
+    iotc_tls_stats_get(IOTC_TLS_MQTT, &tls);
+
+    fprintf(f, "{\n  \"tool\": \"iotc-loadgen\",\n");
+    fprintf(f, "  \"config\": {\"devices\": %lu, \"workers\": %lu, \"duration_s\": %.1f, \"ramp_s\": %.1f, "
+        "\"rate\": %.3f, \"qos\": %d, \"fields\": %lu, \"string_bytes\": %lu, \"churn\": \"%s\", "
+        "\"online_s\": %.1f, \"offline_s\": %.1f},\n", config.devices, config.workers, config.duration_s,
+        config.ramp_s, config.rate, config.qos, config.fields, config.string_bytes, churn_name(config.churn),
+        config.online_s, config.offline_s);
+    fprintf(f, "  \"publish\": {\"sent\": %lu, \"completed\": %lu, \"failed\": %lu, \"latency\": ",
+        total.published, total.completed, total.failed);
+    histogram_write_json(&total.latency, f);
+    fprintf(f, "},\n  \"connections\": {\"connects\": %lu, \"failures\": %lu, \"disconnects\": %lu, \"drops\": %lu, "
+        "\"tls_resumed\": %lu, \"tls_cpu_us_avg\": %.0f,\n    \"connect\": ", total.connects, total.connect_failures,
+        total.disconnects, total.drops, tls.resumed, tls.handshakes ? (double) tls.total_cpu_us / (double) tls.handshakes : 0.0);
+    histogram_write_json(&total.connect, f);
+    fprintf(f, ",\n    \"reconnect\": ");
+    histogram_write_json(&total.reconnect, f);
+    fprintf(f, "},\n  \"memory\": {\"sessions\": %lu, \"online\": %lu, \"heap_bytes_per_session\": %.0f, "
+        "\"rss_bytes_per_session\": %.0f},\n", config.devices, online,
+        ((double) after->heap_bytes - (double) before->heap_bytes) / (double) config.devices,
+        ((double) after->rss_bytes - (double) before->rss_bytes) / (double) config.devices);
+    fprintf(f, "  \"sync_stub\": {\"connections\": %lu, \"discovery_requests\": %lu, \"sync_requests\": %lu, "
+        "\"errors\": %lu}\n}\n", stub.connections, stub.discovery_requests, stub.sync_requests, stub.errors);
+}
+
+int main(int argc, char *argv[]) {
+    MemoryUsage before;
+    MemoryUsage after;
+
+    if (parse_args(argc, argv)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    raise_file_limit();
+
+    if (config.string_bytes) {
+        string_field = malloc(config.string_bytes + 1);
+        if (!string_field) {
+            return EXIT_FAILURE;
+        }
+        memset(string_field, 'x', config.string_bytes);
+        string_field[config.string_bytes] = 0;
+    }
+
+    // The discovery host is served by the stub. The broker host comes from the sync response,
+    // and the device client always connects to IOTC_DEVICE_CLIENT_MQTT_PORT.
+    if (sync_stub_server_start(config.stub_port, config.stub_cert, config.stub_key, config.broker_host)
+        || iotc_tls_add_connect_to(IOTCONNECT_DISCOVERY_HOSTNAME, LOADGEN_DISCOVERY_PORT, "127.0.0.1",
+            config.stub_port, config.ca_file)) {
+        return EXIT_FAILURE;
+    }
+    if (config.broker_port != IOTC_DEVICE_CLIENT_MQTT_PORT
+        && iotc_tls_add_connect_to(config.broker_host, IOTC_DEVICE_CLIENT_MQTT_PORT, config.broker_host,
+            config.broker_port, NULL)) {
+        return EXIT_FAILURE;
+    }
+
+    // The SDK logs every connection and message to stdout
+    FILE *out = config.output_path ? fopen(config.output_path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (!out || !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "Unable to open the output\n");
+        return EXIT_FAILURE;
+    }
+
+    workers = calloc(config.workers, sizeof(Worker));
+    if (!workers) {
+        return EXIT_FAILURE;
+    }
+    get_memory_usage(&before);
+    start_us = now_us();
+    if (create_sessions()) {
+        fprintf(stderr, "Unable to create the device sessions\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < config.workers; i++) {
+        workers[i].index = i;
+        workers[i].seed = (unsigned int) (start_us + i);
+        if (0 != pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i])) {
+            fprintf(stderr, "Unable to start the worker threads\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Memory is measured once the initial connects are done, or at the end if they take longer
+    uint64_t end_us = start_us + seconds_to_us(config.duration_s);
+    bool measured = false;
+    unsigned long online = 0;
+    while (now_us() < end_us) {
+        usleep(100000);
+        if (!measured && atomic_load(&online_count) == config.devices) {
+            get_memory_usage(&after);
+            online = atomic_load(&online_count);
+            measured = true;
+        }
+    }
+    if (!measured) {
+        get_memory_usage(&after);
+        online = atomic_load(&online_count);
+    }
+
+    atomic_store(&stop_requested, true);
+    for (size_t i = 0; i < config.workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    write_report(out, &before, &after, online);
+    fclose(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+//
+// Copyright: Avnet 2022
+//
+
+#define _GNU_SOURCE // strcasestr
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+
+#include "stub_responses.h"
+#include "sync_stub_server.h"
+
+#define REQUEST_BUFFER_SIZE 4096
+#define RESPONSE_BUFFER_SIZE 2048
+#define IDLE_TIMEOUT_S 30
+
+typedef struct {
+    SSL *ssl;
+    int fd;
+    char buf[REQUEST_BUFFER_SIZE + 1];
+    size_t len;
+} Connection;
+
+static SSL_CTX *ctx = NULL;
+static int listen_fd = -1;
+static const char *broker_host = NULL;
+static SyncStubStats stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void count(unsigned long *counter) {
+    pthread_mutex_lock(&stats_lock);
+    (*counter)++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Reads until the buffer holds at least min_len bytes. Returns false if the connection is closed or fails.
+static bool read_at_least(Connection *c, size_t min_len) {
+    while (c->len < min_len) {
+        int ret = SSL_read(c->ssl, c->buf + c->len, (int) (REQUEST_BUFFER_SIZE - c->len));
+        if (ret <= 0) {
+            return false;
+        }
+        c->len += (size_t) ret;
+    }
+    return true;
+}
+
+// Copies the value of a header into value. Returns false if the header is missing.
+static bool get_header(const char *headers, const char *name, char *value, size_t size) {
+    const char *p = strcasestr(headers, name);
+    if (!p) {
+        return false;
+    }
+    p += strlen(name);
+    p += strspn(p, " \t");
+    size_t len = strcspn(p, "\r\n");
+    if (len >= size) {
+        return false;
+    }
+    memcpy(value, p, len);
+    value[len] = 0;
+    return true;
+}
+
+static bool send_response(Connection *c, int code, const char *body, size_t body_len) {
+    char header[128];
+    int len = snprintf(header, sizeof(header),
+        "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %lu\r\n\r\n",
+        code, (200 == code) ? "OK" : "Bad Request", (unsigned long) body_len);
+    return SSL_write(c->ssl, header, len) == len
+        && (0 == body_len || SSL_write(c->ssl, body, (int) body_len) == (int) body_len);
+}
+
+// Serves one request. Returns false when the connection should be closed.
+static bool serve_request(Connection *c) {
+    char response[RESPONSE_BUFFER_SIZE];
+    char host[128];
+    char content_length[16];
+    char *headers_end;
+
+    c->buf[c->len] = 0;
+    while (NULL == (headers_end = strstr(c->buf, "\r\n\r\n"))) {
+        if (c->len >= REQUEST_BUFFER_SIZE || !read_at_least(c, c->len + 1)) {
+            return false;
+        }
+        c->buf[c->len] = 0;
+    }
+    *headers_end = 0;
+    char *body = headers_end + 4;
+    size_t body_len = 0;
+    if (get_header(c->buf, "\ncontent-length:", content_length, sizeof(content_length))) {
+        body_len = strtoul(content_length, NULL, 10);
+    }
+    size_t request_len = (size_t) (body - c->buf) + body_len;
+    if (request_len > REQUEST_BUFFER_SIZE || !read_at_least(c, request_len)) {
+        count(&stats.errors);
+        return false;
+    }
+    char saved = c->buf[request_len];
+    c->buf[request_len] = 0;
+
+    int len = -1;
+    if (!get_header(c->buf, "\nhost:", host, sizeof(host))) {
+        len = -1;
+    } else if (0 == strncmp(c->buf, "GET ", 4)) {
+        count(&stats.discovery_requests);
+        len = stub_write_discovery_response(response, sizeof(response), host);
+    } else if (0 == strncmp(c->buf, "POST ", 5)) {
+        count(&stats.sync_requests);
+        len = stub_write_sync_response(response, sizeof(response), body, broker_host);
+    }
+
+    // keep anything that the client sent after this request
+    c->buf[request_len] = saved;
+    c->len -= request_len;
+    memmove(c->buf, c->buf + request_len, c->len);
+
+    if (len < 0) {
+        count(&stats.errors);
+        return send_response(c, 400, NULL, 0);
+    }
+    return send_response(c, 200, response, (size_t) len);
+}
+
+static void *connection_thread(void *arg) {
+    Connection *c = (Connection *) arg;
+    if (1 == SSL_accept(c->ssl)) {
+        while (serve_request(c)) {
+        }
+    }
+    ERR_clear_error();
+    SSL_free(c->ssl);
+    close(c->fd);
+    free(c);
+    return NULL;
+}
+
+static void *accept_thread(void *arg) {
+    (void) arg;
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval tv = { .tv_sec = IDLE_TIMEOUT_S };
+        (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        Connection *c = calloc(1, sizeof(Connection));
+        pthread_t thread;
+        if (!c || NULL == (c->ssl = SSL_new(ctx)) || 1 != SSL_set_fd(c->ssl, fd)) {
+            if (c && c->ssl) {
+                SSL_free(c->ssl);
+            }
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        count(&stats.connections);
+        if (0 != pthread_create(&thread, NULL, connection_thread, c)) {
+            SSL_free(c->ssl);
+            free(c);
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+int sync_stub_server_start(uint16_t port, const char *cert_file, const char *key_file, const char *broker) {
+    struct sockaddr_in addr = { 0 };
+    pthread_t thread;
+    int one = 1;
+
+    broker_host = broker;
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx || 1 != SSL_CTX_use_certificate_chain_file(ctx, cert_file)
+        || 1 != SSL_CTX_use_PrivateKey_file(ctx, key_file, SSL_FILETYPE_PEM)) {
+        fprintf(stderr, "Sync stub: Failed to load %s and %s\n", cert_file, key_file);
+        return -1;
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || 0 != setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))
+        || 0 != bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) || 0 != listen(listen_fd, 128)) {
+        fprintf(stderr, "Sync stub: Unable to listen on port %u\n", (unsigned) port);
+        return -1;
+    }
+    if (0 != pthread_create(&thread, NULL, accept_thread, NULL)) {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+void sync_stub_server_get_stats(SyncStubStats *s) {
+    pthread_mutex_lock(&stats_lock);
+    *s = stats;
+    pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,26 @@
+//
+// Copyright: Avnet 2022
+//
+
+#ifndef SYNC_STUB_SERVER_H
+#define SYNC_STUB_SERVER_H
+
+#include <stdint.h>
+
+// A local HTTPS server that answers discovery and sync requests for any CPID and device.
+// Every device is sent to broker_host for MQTT. Each connection is served by its own thread, with keep-alive.
+
+typedef struct {
+    unsigned long connections;
+    unsigned long discovery_requests;
+    unsigned long sync_requests;
+    unsigned long errors; // requests that could not be parsed or answered
+} SyncStubStats;
+
+// Starts the server on 127.0.0.1:port. The certificate must be valid for the discovery host name
+// and the CA that issued it must be passed to iotc_tls_add_connect_to(). Returns 0 on success.
+int sync_stub_server_start(uint16_t port, const char *cert_file, const char *key_file, const char *broker_host);
+
+void sync_stub_server_get_stats(SyncStubStats *stats);
+
+#endif // SYNC_STUB_SERVER_H
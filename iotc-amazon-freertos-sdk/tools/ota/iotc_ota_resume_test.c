@@ -0,0 +1,152 @@
+//
+// Copyright: Avnet 2022
+//
+
+// Interrupts OTA downloads and checks that iotc_ota_download() resumes them from the last checkpoint, with progress
+// and image storages of the same and of different sector sizes. The HTTPS client is replaced by a stub that serves
+// the image from memory and fails once the download reaches a given offset.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotconnect_ota.h"
+
+#define IMAGE_SIZE 100003
+#define FAIL_AT 60000
+#define CHUNK_SIZE 3072
+
+typedef struct {
+    uint8_t *data;
+    uint32_t sector_size;
+} RamStorage;
+
+static uint8_t server_image[IMAGE_SIZE];
+static size_t fail_at;
+static size_t first_requested_offset; // of the last download
+
+static int ram_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+    memcpy(buf, &((RamStorage *) ctx)->data[offset], len);
+    return 0;
+}
+
+// Like flash, writes can only clear bits
+static int ram_write(void *ctx, uint32_t offset, const void *buf, size_t len) {
+    uint8_t *p = &((RamStorage *) ctx)->data[offset];
+    for (size_t i = 0; i < len; i++) {
+        p[i] &= ((const uint8_t *) buf)[i];
+    }
+    return 0;
+}
+
+static int ram_erase(void *ctx, uint32_t offset) {
+    RamStorage *r = (RamStorage *) ctx;
+    memset(&r->data[offset], 0xFF, r->sector_size);
+    return 0;
+}
+
+static void ram_open(IotcStorage *s, RamStorage *r, uint32_t size, uint32_t sector_size) {
+    r->data = malloc(size);
+    r->sector_size = sector_size;
+    memset(r->data, 0xFF, size);
+    s->read = ram_read;
+    s->write = ram_write;
+    s->erase = ram_erase;
+    s->size = size;
+    s->sector_size = sector_size;
+    s->ctx = r;
+}
+
+int iotconnect_https_stream(IotConnectHttpRequest *request, IotConnectHttpStream *stream) {
+    size_t offset = stream->offset;
+    first_requested_offset = offset;
+    stream->total_size = IMAGE_SIZE;
+    while (offset < IMAGE_SIZE) {
+        size_t len = (IMAGE_SIZE - offset < CHUNK_SIZE) ? IMAGE_SIZE - offset : CHUNK_SIZE;
+        if (offset + len > fail_at) {
+            return EXIT_FAILURE; // the connection dropped
+        }
+        if (!stream->chunk_cb(stream->cb_ctx, offset, &server_image[offset], len)) {
+            return EXIT_FAILURE;
+        }
+        offset += len;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Returns the offset of the last checkpoint before FAIL_AT: the last image sector boundary that is at least
+// IOTC_OTA_CHECKPOINT_BYTES after the previous checkpoint
+static size_t expected_resume_offset(uint32_t image_sector_size) {
+    size_t checkpoint = 0;
+    for (size_t offset = image_sector_size; offset <= FAIL_AT; offset += image_sector_size) {
+        if (offset - checkpoint >= IOTC_OTA_CHECKPOINT_BYTES) {
+            checkpoint = offset;
+        }
+    }
+    return checkpoint;
+}
+
+static bool run(uint32_t progress_sector_size, uint32_t image_sector_size) {
+    static IotcOta ota;
+    IotcStorage image;
+    IotcStorage progress;
+    RamStorage image_ram;
+    RamStorage progress_ram;
+    uint8_t digest[IOTC_SHA256_SIZE];
+    IotcSha256 sha;
+    bool ok = true;
+
+    iotc_sha256_init(&sha);
+    iotc_sha256_update(&sha, server_image, sizeof(server_image));
+    iotc_sha256_finish(&sha, digest);
+    ram_open(&image, &image_ram, 128 * 1024, image_sector_size);
+    ram_open(&progress, &progress_ram, progress_sector_size, progress_sector_size);
+
+    IotcOtaConfig config = { 0 };
+    config.image = &image;
+    config.progress = &progress;
+    config.tls_cert = "unused";
+    config.expected_sha256 = digest;
+    config.job_id = "1.0.1";
+
+    printf("Progress sectors of %lu bytes, image sectors of %lu bytes\n", (unsigned long) progress_sector_size,
+           (unsigned long) image_sector_size);
+    fail_at = FAIL_AT;
+    IotcOtaResult result = iotc_ota_download(&ota, &config, "https://firmware.example.com/image.bin?token=1");
+    if (IOTC_OTA_ERR_DOWNLOAD != result) {
+        fprintf(stderr, "FAILED: The interrupted download returned %d\n", (int) result);
+        ok = false;
+    }
+
+    fail_at = IMAGE_SIZE;
+    result = iotc_ota_download(&ota, &config, "https://firmware.example.com/image.bin?token=2");
+    size_t expected = expected_resume_offset(image_sector_size);
+    if (IOTC_OTA_OK != result) {
+        fprintf(stderr, "FAILED: The resumed download returned %d\n", (int) result);
+        ok = false;
+    } else if (first_requested_offset != expected) {
+        fprintf(stderr, "FAILED: Resumed at %lu instead of %lu\n", (unsigned long) first_requested_offset,
+                (unsigned long) expected);
+        ok = false;
+    } else if (0 != memcmp(image_ram.data, server_image, sizeof(server_image))) {
+        fprintf(stderr, "FAILED: The image differs\n");
+        ok = false;
+    }
+    free(image_ram.data);
+    free(progress_ram.data);
+    return ok;
+}
+
+int main(void) {
+    srand(1);
+    for (size_t i = 0; i < sizeof(server_image); i++) {
+        server_image[i] = (uint8_t) rand();
+    }
+    bool ok = run(4096, 4096);
+    ok = run(64 * 1024, 4096) && ok;
+    ok = run(4096, 32 * 1024) && ok;
+    printf(ok ? "PASSED\n" : "FAILED\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+//
+// Copyright: Avnet 2022
+//
+
+// Runs a sync, then a resync that fails the way it would during an outage, and checks that the host and client ID
+// used to connect are still those of the first sync, in RAM and in the cache. The HTTPS client is replaced by
+// a stub that serves the discovery and sync responses from memory.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iotc_http_request.h"
+#include "iotconnect_metrics.h"
+#include "iotconnect_sync.h"
+
+#define DISCOVERY_RESPONSE "{\"baseUrl\":\"https://sync.example.com/api/2.1/agent/\"}"
+#define SYNC_RESPONSE_FORMAT "{\"d\":{\"ds\":%d,\"dtg\":\"dtg-1\",\"p\":{\"h\":\"%s\",\"id\":\"%s\",\"un\":\"user\"," \
+    "\"pub\":\"devices/%s/messages/events/\",\"sub\":\"devices/%s/messages/devicebound/#\"}}}"
+#define SECTOR_SIZE 1024
+
+typedef enum {
+    SERVER_OK,
+    SERVER_DOWN, // requests fail, as during a network outage
+    SERVER_DEVICE_MOVED // the sync response has a "ds" other than 0
+} ServerState;
+
+static ServerState server_state;
+static const char *server_host;
+static char response[1024];
+static uint8_t cache_data[SECTOR_SIZE];
+
+static int ram_read(void *ctx, uint32_t offset, void *buf, size_t len) {
+    memcpy(buf, &cache_data[offset], len);
+    return 0;
+}
+
+// Like flash, writes can only clear bits
+static int ram_write(void *ctx, uint32_t offset, const void *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        cache_data[offset + i] &= ((const uint8_t *) buf)[i];
+    }
+    return 0;
+}
+
+static int ram_erase(void *ctx, uint32_t offset) {
+    memset(&cache_data[offset], 0xFF, SECTOR_SIZE);
+    return 0;
+}
+
+int iotconnect_https_request(IotConnectHttpRequest *request) {
+    if (SERVER_DOWN == server_state) {
+        request->response = NULL;
+        return EXIT_FAILURE;
+    }
+    if (NULL == request->payload) {
+        strcpy(response, DISCOVERY_RESPONSE);
+    } else {
+        snprintf(response, sizeof(response), SYNC_RESPONSE_FORMAT, (SERVER_DEVICE_MOVED == server_state) ? 5 : 0,
+                 server_host, "cpid-device", "cpid-device", "cpid-device");
+    }
+    request->response = response;
+    return EXIT_SUCCESS;
+}
+
+void iotconnect_https_lock(void) {
+}
+
+void iotconnect_https_unlock(void) {
+}
+
+void iotc_metrics_record_since(IotcMetricsHistogramId histogram, uint32_t start_ms) {
+    (void) histogram;
+    (void) start_ms;
+}
+
+uint32_t iotc_platform_now_ms(void) {
+    return 0;
+}
+
+static bool expect_host(IotcSyncContext *ctx, const char *step, const char *host) {
+    const char *actual = iotc_sync_ctx_get_iothub_host(ctx);
+    const char *client_id = iotc_sync_ctx_get_client_id(ctx);
+    if (NULL == actual || NULL == client_id || 0 != strcmp(actual, host) || 0 != strcmp(client_id, "cpid-device")) {
+        fprintf(stderr, "FAILED: %s: Host %s and client ID %s instead of %s and cpid-device\n", step,
+                actual ? actual : "NULL", client_id ? client_id : "NULL", host);
+        return false;
+    }
+    return true;
+}
+
+static bool run(ServerState failure) {
+    IotcStorage storage = { ram_read, ram_write, ram_erase, SECTOR_SIZE, SECTOR_SIZE, NULL };
+    bool ok = true;
+
+    printf("Resync failure %d\n", (int) failure);
+    memset(cache_data, 0xFF, sizeof(cache_data));
+    IotcSyncContext *ctx = iotc_sync_create("cpid", "env", "device");
+    iotc_sync_ctx_set_cache_storage(ctx, &storage);
+
+    server_state = SERVER_OK;
+    server_host = "old.example.com";
+    if (iotc_sync_ctx_obtain_response(ctx)) {
+        fprintf(stderr, "FAILED: The first sync failed\n");
+        iotc_sync_destroy(ctx);
+        return false;
+    }
+
+    // a periodic resync during the outage
+    server_state = failure;
+    server_host = "new.example.com";
+    if (0 == iotc_sync_ctx_obtain_response(ctx)) {
+        fprintf(stderr, "FAILED: The resync succeeded\n");
+        ok = false;
+    }
+    // the next reconnect attempt
+    ok = expect_host(ctx, "After the failed resync", "old.example.com") && ok;
+
+    // the next boot
+    iotc_sync_ctx_free_response(ctx);
+    bool from_cache = false;
+    if (iotc_sync_ctx_obtain_cached_response(ctx, &from_cache) || !from_cache) {
+        fprintf(stderr, "FAILED: The cache was lost\n");
+        ok = false;
+    } else {
+        ok = expect_host(ctx, "From the cache", "old.example.com") && ok;
+    }
+
+    server_state = SERVER_OK;
+    if (iotc_sync_ctx_obtain_response(ctx)) {
+        fprintf(stderr, "FAILED: The resync failed once the server was back\n");
+        ok = false;
+    } else {
+        ok = expect_host(ctx, "After the resync", "new.example.com") && ok;
+    }
+    iotc_sync_destroy(ctx);
+    return ok;
+}
+
+int main(void) {
+    bool ok = run(SERVER_DOWN);
+    ok = run(SERVER_DEVICE_MOVED) && ok;
+    printf(ok ? "PASSED\n" : "FAILED\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
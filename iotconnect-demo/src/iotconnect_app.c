@@ -6,6 +6,10 @@
 
 #include "iotconnect.h"
 #include "iotconnect_common.h"
+#include "iotconnect_telemetry_stream.h"
+#include "iotconnect_command.h"
+#include "iotconnect_trust.h"
+#include "iotconnect_ota.h"
 #include "app_config.h"
 
 #define APP_VERSION "00.01.00"
@@ -25,24 +29,58 @@ static void on_connection_status(IotConnectConnectionStatus status) {
     }
 }
 
-static void command_status(IotclEventData data, bool status, const char *command_name, const char *message) {
-    const char *ack = iotcl_create_ack_string_and_destroy_event(data, status, message);
+// Large enough for the command and version strings this app expects. Longer ones are rejected.
+#define EVENT_STRING_MAX_LEN 64
+
+static void command_status(IotConnectClient *client, const IotcEventView *event, bool status, const char *command_name,
+                           const char *message) {
     printf("command: %s status=%s: %s\n", command_name, status ? "OK" : "Failed", message);
-    printf("Sent CMD ack: %s\n", ack);
-    iotconnect_sdk_send_packet(ack);
-    free((void *) ack);
+    // The ack is written straight from the event view. Nothing is allocated.
+    if (0 == iotconnect_client_send_ack(client, event, status, message)) {
+        printf("Sent CMD ack\n");
+    }
 }
 
-static void on_command(IotclEventData data) {
-    char *command = iotcl_clone_command(data);
-    if (NULL != command) {
-        command_status(data, false, command, "Not implemented");
-        free((void *) command);
+static void on_command(IotConnectClient *client, const IotcEventView *event) {
+    char command[EVENT_STRING_MAX_LEN];
+    IotcJsonToken t;
+    if (iotc_event_view_get_command(event, &t) && iotc_json_view_copy_string(&t, command, sizeof(command)) >= 0) {
+        command_status(client, event, false, command, "Not implemented");
     } else {
-        command_status(data, false, "?", "Internal error");
+        command_status(client, event, false, "?", "Internal error");
     }
 }
 
+// Runs on a command worker task. Commands that are not registered go to on_command().
+static bool on_ping_command(IotConnectClient *client, const char *args, void *ctx, const char **message) {
+    (void) client;
+    (void) ctx;
+    printf("ping command received. Arguments: \"%s\"\n", args);
+    *message = "pong";
+    return true;
+}
+
+// Set these to the firmware update partition of the board, and a sector for the download progress, to enable OTA.
+// Set the source to the partition of the running image to accept delta patches. See iotconnect_ota.h.
+static const IotcStorage *ota_image_storage = NULL;
+static const IotcStorage *ota_progress_storage = NULL;
+static const IotcStorage *ota_source_storage = NULL;
+
+// An OTA can have a patch as the first file and the full image as the second,
+// so that the full image is downloaded if the patch is not for the running version
+#define OTA_MAX_URLS 2
+
+// The OTA event is only valid in the callback, and the download must not run on the MQTT loop,
+// so what is needed is copied out and the download runs in the main loop
+static struct {
+    bool pending;
+    char urls[OTA_MAX_URLS][IOTC_OTA_MAX_HOST_LEN + IOTC_OTA_MAX_RESOURCE_LEN + 16];
+    size_t url_count;
+    char version[EVENT_STRING_MAX_LEN];
+    char ack_id[EVENT_STRING_MAX_LEN]; // still escaped, as iotc_write_ack() expects
+    size_t ack_id_len;
+} ota_job;
+
 static bool is_app_version_same_as_ota(const char *version) {
     return strcmp(APP_VERSION, version) == 0;
 }
@@ -51,21 +89,46 @@ static bool app_needs_ota_update(const char *version) {
     return strcmp(APP_VERSION, version) < 0;
 }
 
-static void on_ota(IotclEventData data) {
+static void on_ota(IotConnectClient *client, const IotcEventView *event) {
     const char *message = NULL;
-    char *url = iotcl_clone_download_url(data, 0);
+    char version[EVENT_STRING_MAX_LEN];
+    IotcJsonToken url;
+    IotcJsonToken t;
     bool success = false;
-    if (NULL != url) {
-        printf("Download URL is: %s\n", url);
-        const char *version = iotcl_clone_sw_version(data);
-        if (is_app_version_same_as_ota(version)) {
+    if (iotc_event_view_get_url(event, 0, &url)) {
+        printf("Download URL is: %.*s\n", (int) url.len, url.ptr);
+        if (!iotc_event_view_get_sw_version(event, &t) || iotc_json_view_copy_string(&t, version, sizeof(version)) < 0) {
+            printf("OTA request has no valid version. Sending failure\n");
+            success = false;
+            message = "Invalid version";
+        } else if (is_app_version_same_as_ota(version)) {
             printf("OTA request for same version %s. Sending success\n", version);
             success = true;
             message = "Version is matching";
         } else if (app_needs_ota_update(version)) {
             printf("OTA update is required for version %s.\n", version);
-            success = false;
-            message = "Not implemented";
+            if (!ota_image_storage) {
+                success = false;
+                message = "Not implemented";
+            } else if (iotc_json_view_copy_string(&url, ota_job.urls[0], sizeof(ota_job.urls[0])) < 0
+                       || event->ack_id.len > sizeof(ota_job.ack_id)) {
+                success = false;
+                message = "Download URL is too long";
+            } else {
+                ota_job.url_count = 1;
+                while (ota_job.url_count < OTA_MAX_URLS && iotc_event_view_get_url(event, ota_job.url_count, &t)
+                       && iotc_json_view_copy_string(&t, ota_job.urls[ota_job.url_count],
+                                                     sizeof(ota_job.urls[0])) >= 0) {
+                    ota_job.url_count++;
+                }
+                strcpy(ota_job.version, version);
+                ota_job.ack_id_len = (event->ack_id.type == IOTC_JSON_STRING) ? event->ack_id.len : 0;
+                if (ota_job.ack_id_len > 0) {
+                    memcpy(ota_job.ack_id, event->ack_id.ptr, ota_job.ack_id_len);
+                }
+                ota_job.pending = true;
+                return; // acknowledged once the download is done
+            }
         } else {
             printf("Device firmware version %s is newer than OTA version %s. Sending failure\n", APP_VERSION,
                    version);
@@ -75,43 +138,78 @@ static void on_ota(IotclEventData data) {
             success = false;
             message = "Device firmware version is newer";
         }
-
-        free((void *) url);
-        free((void *) version);
     } else {
         // compatibility with older events
         // This app does not support FOTA with older back ends, but the user can add the functionality
-        const char *command = iotcl_clone_command(data);
-        if (NULL != command) {
+        if (iotc_event_view_get_command(event, &t)) {
             // URL will be inside the command
-            printf("Command is: %s\n", command);
+            printf("Command is: %.*s\n", (int) t.len, t.ptr);
             message = "Old back end URLS are not supported by the app";
-            free((void *) command);
         }
     }
-    const char *ack = iotcl_create_ack_string_and_destroy_event(data, success, message);
-    if (NULL != ack) {
-        printf("Sent OTA ack: %s\n", ack);
-        iotconnect_sdk_send_packet(ack);
-        free((void *) ack);
+    if (0 == iotconnect_client_send_ack(client, event, success, message)) {
+        printf("Sent OTA ack\n");
     }
 }
 
+static void on_ota_progress(void *ctx, size_t received, size_t total) {
+    (void) ctx;
+    printf("OTA: %lu of %lu bytes\n", (unsigned long) received, (unsigned long) total);
+}
+
+static void run_pending_ota(void) {
+    static IotcOta ota; // large, because of the URL
+    IotcOtaConfig config = { 0 };
+    size_t buffer_size;
+    size_t len;
+    IotcOtaResult result = IOTC_OTA_ERR_INVALID;
+
+    ota_job.pending = false;
+    config.image = ota_image_storage;
+    config.progress = ota_progress_storage;
+    config.source = ota_source_storage;
+    config.trust_anchor = iotc_trust_anchor(IOTC_TRUST_BALTIMORE_ROOT);
+    config.job_id = ota_job.version;
+    config.progress_cb = on_ota_progress;
+    for (size_t i = 0; IOTC_OTA_OK != result && i < ota_job.url_count; i++) {
+        result = iotc_ota_download(&ota, &config, ota_job.urls[i]);
+    }
+    // Mark the new image for boot with the vendor boot loader API here, then restart once the ack is sent
+
+    if (0 == ota_job.ack_id_len) {
+        return; // no ack requested
+    }
+    char *buffer = iotconnect_sdk_get_tx_buffer(&buffer_size);
+    const char *ack = iotc_write_ack(DEVICE_OTA, ota_job.ack_id, ota_job.ack_id_len, iotconnect_sdk_get_lib_config(),
+                                     IOTC_OTA_OK == result, (IOTC_OTA_OK == result) ? "Downloaded" : "Download failed",
+                                     buffer, buffer_size, &len);
+    if (ack && 0 == iotconnect_sdk_send_packet_len(ack, len)) {
+        printf("Sent OTA ack\n");
+    }
+}
 
 static void publish_telemetry() {
-    IotclMessageHandle msg = iotcl_telemetry_create(iotconnect_sdk_get_lib_config());
+    IotcTelemetryStream s;
+    size_t buffer_size;
+    size_t len;
+    char *buffer = iotconnect_sdk_get_tx_buffer(&buffer_size);
+
+    // The data is serialized straight into the SDK's TX buffer. No heap allocations are involved.
+    iotc_telemetry_stream_begin(&s, iotconnect_sdk_get_lib_config(), buffer, buffer_size);
 
     // Optional. The first time you create a data point, the current timestamp will be automatically added
-    // TelemetryAddWith* calls are only required if sending multiple data points in one packet.
-    iotcl_telemetry_add_with_iso_time(msg, iotcl_iso_timestamp_now());
-    iotcl_telemetry_set_string(msg, "version", APP_VERSION);
-    iotcl_telemetry_set_number(msg, "cpu", 3.123); // test floating point numbers
+    // add_point calls are only required if sending multiple data points in one packet.
+    iotc_telemetry_stream_add_point(&s, iotcl_iso_timestamp_now());
+    iotc_telemetry_stream_set_string(&s, "version", APP_VERSION);
+    iotc_telemetry_stream_set_number(&s, "cpu", 3.123); // test floating point numbers
 
-    const char *str = iotcl_create_serialized_string(msg, false);
-    iotcl_telemetry_destroy(msg);
+    const char *str = iotc_telemetry_stream_finish(&s, &len);
+    if (NULL == str) {
+        printf("Telemetry did not fit into the TX buffer of %lu bytes\n", (unsigned long) buffer_size);
+        return;
+    }
     printf("Sending: %s\n", str);
-    iotconnect_sdk_send_packet(str); // underlying code will report an error
-    iotcl_destroy_serialized(str);
+    iotconnect_sdk_send_packet_len(str, len); // underlying code will report an error
 }
 
 int iotconnect_app_main(void) {
@@ -122,8 +220,9 @@ int iotconnect_app_main(void) {
     config->duid = IOTCONNECT_DUID;
 
     config->status_cb = on_connection_status;
-    config->ota_cb = on_ota;
-    config->cmd_cb = on_command;
+    config->ota_view_cb = on_ota;
+    config->cmd_view_cb = on_command;
+    iotconnect_command_register("ping", on_ping_command, NULL);
 
 
     // run a dozen connect/send/disconnect cycles with each cycle being about a minute
@@ -137,9 +236,10 @@ int iotconnect_app_main(void) {
         // send 10 messages
         for (int i = 0; iotconnect_sdk_is_connected() && i < 10; i++) {
             publish_telemetry();
-            // repeat approximately evey ~5 seconds
-            for (int k = 0; k < 5; k++) {
-                iotconnect_sdk_loop(1000);
+            // repeat approximately evey ~5 seconds. The loop wakes up early only for inbound data and keep-alive pings.
+            iotconnect_sdk_loop(5000);
+            if (ota_job.pending) {
+                run_pending_ota();
             }
         }
         iotconnect_sdk_disconnect();